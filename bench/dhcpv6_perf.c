@@ -0,0 +1,624 @@
+// Client-population load generator. Simulated clients run full
+// SOLICIT -> ADVERTISE -> REQUEST -> REPLY -> RENEW -> RELEASE lifecycles,
+// a window of them in flight at once, with RFC 8415 retransmission (RT
+// from IRT, doubling with +-10% jitter up to 16 * IRT, at most MRC
+// attempts) and an optional cap on the message rate.
+//   inproc - dh6_handle_packet() on a mem_store, pools from the config file
+//   udp    - a running daemon over loopback; replies to clients come back
+//            on port 546, so the tool binds it (root, no other client)
+// Reports throughput, per-exchange p50/p99/p999 latency (first send to
+// the answer, retransmissions included) and failures by status code.
+//
+//   make bench/dhcpv6-perf
+//   bench/dhcpv6-perf [-m inproc|udp] [-f conf] [-n clients] [-w window]
+//                     [-L lifecycles] [-r renews] [-b rebind%] [-q rapid%]
+//                     [-x release%] [-I na|pd|both] [-R msgs/s]
+//                     [-T irt_ms] [-M mrc] [-a addr] [-p port] [-s run]
+#define _GNU_SOURCE
+#include "dhcp/handlers.h"
+#include "dhcp/opt.h"
+#include "config/config.h"
+#include "store/mem_store.h"
+#include "util/hash.h"
+#include "util/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define PKT_MAX 2048
+
+// exchanges: one request kind and the answer to it
+enum { K_SOLICIT, K_REQUEST, K_RENEW, K_REBIND, K_RELEASE, K_N };
+static const char* const kind_name[K_N] = { "solicit", "request", "renew", "rebind", "release" };
+static const uint8_t kind_msg[K_N] = {
+  DHCP6_SOLICIT, DHCP6_REQUEST, DHCP6_RENEW, DHCP6_REBIND, DHCP6_RELEASE
+};
+
+// failures: IA status codes 0..6 (0 counts IAs answered without a lease
+// and without a status), then our own
+enum { F_TIMEOUT = 7, F_DROPPED, F_BADREPLY, F_N };
+static const char* const fail_name[F_N] = {
+  "no-lease", "UnspecFail", "NoAddrsAvail", "NoBinding", "NotOnLink",
+  "UseMulticast", "NoPrefixAvail", "timeout", "dropped", "bad-reply"
+};
+
+enum { C_IDLE, C_READY, C_WAIT, C_DONE };
+
+typedef struct {
+  uint8_t state;
+  uint8_t kind;
+  uint8_t rapid;      // this SOLICIT carries Rapid Commit
+  uint8_t tries;
+  uint32_t txid;
+  uint32_t seq;       // bumps per exchange: stale timers are skipped
+  uint32_t lc_left;   // lifecycles still to run
+  uint32_t renews;    // renews left in this lifecycle
+  uint64_t t_first;   // first transmission of this exchange
+  uint64_t rt;        // current retransmission timeout
+} client_t;
+
+typedef struct { uint64_t at; uint32_t idx, seq; } timer_t_;
+
+typedef struct {
+  uint64_t* v;
+  size_t n, cap;
+} samples_t;
+
+typedef struct {
+  // options
+  int udp;
+  const char* conf;
+  uint32_t n, window, lifecycles, renews;
+  unsigned rebind_pct, rapid_pct, release_pct;
+  int want_na, want_pd;
+  double rate;
+  uint64_t irt_ns;
+  unsigned mrc;
+  struct sockaddr_in6 dst;
+  uint8_t run;
+
+  // clients
+  client_t* cl;
+  uint32_t* ready;     // FIFO of clients with a message to send
+  size_t rq_head, rq_len;
+  uint32_t next_new, active, done;
+  uint64_t rng;
+
+  // retransmission timers (min-heap)
+  timer_t_* tm;
+  size_t ntm, tmcap;
+
+  // server identity, learnt from the first answer
+  uint8_t srv[130];
+  size_t srv_len;
+
+  // in-process server
+  server_ctx_t ctx;
+  lease_store_t store;
+  // udp
+  int fd;
+
+  // results
+  uint64_t sent[K_N], rtx[K_N], ok[K_N], failed[K_N];
+  uint64_t fail[K_N][F_N];
+  samples_t lat[K_N];
+  uint64_t lifecycles_done, msgs_out, msgs_in, stale;
+  uint64_t handler_ns;
+} perf_t;
+
+static uint64_t now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t rng(perf_t* p){
+  p->rng += 0x9e3779b97f4a7c15ULL;
+  return hash_mix64(p->rng);
+}
+
+static int roll(perf_t* p, unsigned pct){ return pct && rng(p) % 100 < pct; }
+
+static int cmp_u64(const void* a, const void* b){
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static void sample(samples_t* s, uint64_t v){
+  if(s->n == s->cap){
+    size_t ncap = s->cap ? s->cap * 2 : 4096;
+    uint64_t* n = realloc(s->v, ncap * sizeof(*n));
+    if(!n) return;
+    s->v = n;
+    s->cap = ncap;
+  }
+  s->v[s->n++] = v;
+}
+
+// ---- timers ----
+
+static void tm_push(perf_t* p, uint64_t at, uint32_t idx, uint32_t seq){
+  if(p->ntm == p->tmcap){
+    size_t ncap = p->tmcap ? p->tmcap * 2 : 1024;
+    timer_t_* n = realloc(p->tm, ncap * sizeof(*n));
+    if(!n){ fprintf(stderr, "out of memory\n"); exit(1); }
+    p->tm = n;
+    p->tmcap = ncap;
+  }
+  size_t i = p->ntm++;
+  while(i > 0 && p->tm[(i - 1) / 2].at > at){
+    p->tm[i] = p->tm[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  p->tm[i] = (timer_t_){ at, idx, seq };
+}
+
+static timer_t_ tm_pop(perf_t* p){
+  timer_t_ top = p->tm[0], last = p->tm[--p->ntm];
+  size_t i = 0;
+  for(;;){
+    size_t c = 2 * i + 1;
+    if(c >= p->ntm) break;
+    if(c + 1 < p->ntm && p->tm[c + 1].at < p->tm[c].at) c++;
+    if(p->tm[c].at >= last.at) break;
+    p->tm[i] = p->tm[c];
+    i = c;
+  }
+  if(p->ntm) p->tm[i] = last;
+  return top;
+}
+
+// ---- messages ----
+
+static size_t put_opt(uint8_t* b, uint16_t code, const void* v, uint16_t len){
+  b[0] = (uint8_t)(code >> 8); b[1] = (uint8_t)code;
+  b[2] = (uint8_t)(len >> 8); b[3] = (uint8_t)len;
+  if(len) memcpy(b + 4, v, len);
+  return 4u + len;
+}
+
+// DUID-LL with a locally administered MAC: run id, then the client index
+static size_t client_duid(const perf_t* p, uint32_t idx, uint8_t* d){
+  static const uint8_t head[] = { 0x00, 0x03, 0x00, 0x01, 0x02 };
+  memcpy(d, head, sizeof(head));
+  d[5] = p->run;
+  d[6] = (uint8_t)(idx >> 24); d[7] = (uint8_t)(idx >> 16);
+  d[8] = (uint8_t)(idx >> 8);  d[9] = (uint8_t)idx;
+  return 10;
+}
+
+static size_t build(const perf_t* p, uint32_t idx, uint8_t* b){
+  const client_t* c = &p->cl[idx];
+  uint8_t* q = b;
+  *q++ = kind_msg[c->kind];
+  *q++ = (uint8_t)(c->txid >> 16); *q++ = (uint8_t)(c->txid >> 8); *q++ = (uint8_t)c->txid;
+
+  uint8_t duid[16];
+  q += put_opt(q, OPT_CLIENTID, duid, (uint16_t)client_duid(p, idx, duid));
+  if(p->srv_len && (c->kind == K_REQUEST || c->kind == K_RENEW || c->kind == K_RELEASE))
+    q += put_opt(q, OPT_SERVERID, p->srv, (uint16_t)p->srv_len);
+
+  uint64_t cs = (now_ns() - c->t_first) / 10000000ull;  // hundredths of a second
+  if(cs > 0xffff) cs = 0xffff;
+  uint8_t el[2] = { (uint8_t)(cs >> 8), (uint8_t)cs };
+  q += put_opt(q, OPT_ELAPSED, el, 2);
+  if(c->kind != K_RELEASE){
+    static const uint8_t oro[] = { 0, OPT_DNS };
+    q += put_opt(q, OPT_ORO, oro, sizeof(oro));
+  }
+  if(c->rapid) q += put_opt(q, OPT_RAPID_COMMIT, NULL, 0);
+
+  // IAID 1, T1/T2 left to the server
+  static const uint8_t ia[12] = { 0, 0, 0, 1 };
+  if(p->want_na) q += put_opt(q, OPT_IA_NA, ia, sizeof(ia));
+  if(p->want_pd) q += put_opt(q, OPT_IA_PD, ia, sizeof(ia));
+  return (size_t)(q - b);
+}
+
+// status of one IA answer: -1 with a lease in it, else the failure slot
+static int ia_status(const uint8_t* v, uint16_t len, uint16_t lease_opt){
+  if(len < 12) return F_BADREPLY;
+  rd_t r = rd_make(v + 12, len - 12u);
+  dh6_opt_view_t o;
+  int st = 0, lease = 0;
+  while(dh6_opt_next(&r, &o) == 1){
+    if(o.code == lease_opt) lease = 1;
+    else if(o.code == OPT_STATUS && o.vlen >= 2) st = (o.val[0] << 8) | o.val[1];
+  }
+  if(lease && st == 0) return -1;
+  return st > 0 && st < 7 ? st : 0;
+}
+
+// ---- lifecycle ----
+
+static void make_ready(perf_t* p, uint32_t idx){
+  client_t* c = &p->cl[idx];
+  c->state = C_READY;
+  p->ready[(p->rq_head + p->rq_len++) % p->n] = idx;
+}
+
+static void begin(perf_t* p, uint32_t idx, int kind){
+  client_t* c = &p->cl[idx];
+  c->kind = (uint8_t)kind;
+  c->rapid = kind == K_SOLICIT && roll(p, p->rapid_pct);
+  c->tries = 0;
+  c->seq++;
+  c->txid = (uint32_t)rng(p) & 0xffffff;
+  c->t_first = 0;
+  make_ready(p, idx);
+}
+
+static void start_lifecycle(perf_t* p, uint32_t idx){
+  p->cl[idx].renews = p->renews;
+  begin(p, idx, K_SOLICIT);
+}
+
+static void end_lifecycle(perf_t* p, uint32_t idx){
+  client_t* c = &p->cl[idx];
+  p->lifecycles_done++;
+  if(--c->lc_left){
+    start_lifecycle(p, idx);
+    return;
+  }
+  c->state = C_DONE;
+  c->seq++;
+  p->active--;
+  p->done++;
+}
+
+// a bound client: renew, then release or walk away
+static void bound(perf_t* p, uint32_t idx){
+  client_t* c = &p->cl[idx];
+  if(c->renews){
+    c->renews--;
+    begin(p, idx, roll(p, p->rebind_pct) ? K_REBIND : K_RENEW);
+  }else if(roll(p, p->release_pct)){
+    begin(p, idx, K_RELEASE);
+  }else{
+    end_lifecycle(p, idx);
+  }
+}
+
+static void failed(perf_t* p, uint32_t idx, int why){
+  client_t* c = &p->cl[idx];
+  p->failed[c->kind]++;
+  p->fail[c->kind][why]++;
+  end_lifecycle(p, idx);
+}
+
+static void on_reply(perf_t* p, const uint8_t* m, size_t len){
+  p->msgs_in++;
+  if(len < 4 || (m[0] != DHCP6_ADVERTISE && m[0] != DHCP6_REPLY)) return;
+  uint32_t txid = ((uint32_t)m[1] << 16) | ((uint32_t)m[2] << 8) | m[3];
+
+  rd_t r = rd_make(m + 4, len - 4);
+  dh6_opt_view_t o;
+  const uint8_t *cid = NULL, *sid = NULL;
+  uint16_t cid_len = 0, sid_len = 0;
+  int na = -2, pd = -2;   // -2 = IA absent, -1 = leased, else failure slot
+  while(dh6_opt_next(&r, &o) == 1){
+    if(o.code == OPT_CLIENTID){ cid = o.val; cid_len = o.vlen; }
+    else if(o.code == OPT_SERVERID){ sid = o.val; sid_len = o.vlen; }
+    else if(o.code == OPT_IA_NA) na = ia_status(o.val, o.vlen, OPT_IAADDR);
+    else if(o.code == OPT_IA_PD) pd = ia_status(o.val, o.vlen, OPT_IAPREFIX);
+  }
+
+  uint8_t duid[16];
+  size_t dl = client_duid(p, 0, duid);
+  if(!cid || cid_len != dl || memcmp(cid, duid, 6) != 0){ p->stale++; return; }
+  uint32_t idx = ((uint32_t)cid[6] << 24) | ((uint32_t)cid[7] << 16) | ((uint32_t)cid[8] << 8) | cid[9];
+  if(idx >= p->n){ p->stale++; return; }
+  client_t* c = &p->cl[idx];
+  if(c->state != C_WAIT || c->txid != txid){ p->stale++; return; }  // late duplicate
+
+  if(!p->srv_len && sid && sid_len <= sizeof(p->srv)){
+    memcpy(p->srv, sid, sid_len);
+    p->srv_len = sid_len;
+  }
+
+  int kind = c->kind;
+  int want = kind == K_SOLICIT && !c->rapid ? DHCP6_ADVERTISE : DHCP6_REPLY;
+  if(m[0] != want){
+    failed(p, idx, F_BADREPLY);
+    return;
+  }
+  sample(&p->lat[kind], now_ns() - c->t_first);
+  c->seq++;
+
+  if(kind == K_RELEASE){
+    p->ok[kind]++;
+    end_lifecycle(p, idx);
+    return;
+  }
+  // an IA we asked for and did not get counts against the exchange; the
+  // client carries on with what it got
+  int got = (na == -1) + (pd == -1);
+  if(p->want_na && na != -1) p->fail[kind][na >= 0 ? na : F_BADREPLY]++;
+  if(p->want_pd && pd != -1) p->fail[kind][pd >= 0 ? pd : F_BADREPLY]++;
+  if(!got){
+    p->failed[kind]++;
+    end_lifecycle(p, idx);
+    return;
+  }
+  p->ok[kind]++;
+  if(kind == K_SOLICIT && !c->rapid) begin(p, idx, K_REQUEST);
+  else bound(p, idx);
+}
+
+// ---- transports ----
+
+static int inproc_init(perf_t* p){
+  server_ctx_t* s = &p->ctx;
+  memset(s, 0, sizeof(*s));
+  s->duid_seed = 0xA5A5A5A5ULL;
+  s->offer_ttl = 30;
+  s->decline_ttl = 600;
+  s->preferred_lft = 43200;
+  s->valid_lft = 86400;
+  if(config_load(p->conf, s) < 0) return -1;
+  if(hash_select(s->duid_hash) < 0) s->duid_hash = hash_selected();
+
+  // the daemon's DUID-EN
+  static const uint8_t raw[] = { 0x00,0x02, 0x12,0x34,0x56,0x78, 0xaa,0xbb,0xcc,0xdd };
+  memcpy(s->server_duid.bytes, raw, sizeof(raw));
+  s->server_duid.len = sizeof(raw);
+  s->server_duid.h = hash64_bytes(raw, sizeof(raw), s->duid_seed);
+  dh6_reply_tmpl_build(s);
+
+  if(mem_store_init(&p->store, 1024, s->duid_seed) < 0) return -1;
+  s->store = &p->store;
+  return dh6_pools_init(s, 0, 1);
+}
+
+static int udp_init(perf_t* p){
+  p->fd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if(p->fd < 0) return -1;
+  struct sockaddr_in6 me;
+  memset(&me, 0, sizeof(me));
+  me.sin6_family = AF_INET6;
+  me.sin6_addr = in6addr_any;
+  me.sin6_port = htons(546);
+  int buf = 8 << 20;
+  setsockopt(p->fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+  setsockopt(p->fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+  if(bind(p->fd, (struct sockaddr*)&me, sizeof(me)) < 0){
+    fprintf(stderr, "bind [::]:546: %s (root, and no other DHCPv6 client)\n", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static void transmit(perf_t* p, uint32_t idx, uint64_t now){
+  client_t* c = &p->cl[idx];
+  uint8_t pkt[PKT_MAX];
+  if(!c->t_first){
+    c->t_first = now;
+    c->rt = p->irt_ns;
+  }
+  size_t len = build(p, idx, pkt);
+  c->state = C_WAIT;
+  c->tries++;
+  p->sent[c->kind]++;
+  p->msgs_out++;
+
+  if(!p->udp){
+    struct sockaddr_in6 peer = { .sin6_family = AF_INET6, .sin6_port = htons(546) };
+    uint8_t out[PKT_MAX];
+    size_t out_len = 0;
+    struct sockaddr_in6 out_peer;
+    int out_if;
+    uint64_t t0 = now_ns();
+    int rc = dh6_handle_packet(&p->ctx, pkt, len, &peer, 1, out, sizeof(out), &out_len, &out_peer, &out_if);
+    p->handler_ns += now_ns() - t0;
+    if(rc == 1) on_reply(p, out, out_len);
+    else failed(p, idx, F_DROPPED);  // nothing will ever answer it
+    return;
+  }
+
+  if(sendto(p->fd, pkt, len, 0, (struct sockaddr*)&p->dst, sizeof(p->dst)) < 0 &&
+     errno != EAGAIN && errno != ENOBUFS){
+    perror("sendto");
+    exit(1);
+  }
+  // RT for the next attempt: +-10% of the current one
+  uint64_t jitter = c->rt / 5 ? rng(p) % (c->rt / 5) : 0;
+  tm_push(p, now + c->rt - c->rt / 10 + jitter, idx, c->seq);
+  c->rt = c->rt * 2 > p->irt_ns * 16 ? p->irt_ns * 16 : c->rt * 2;
+}
+
+static void expire(perf_t* p, uint64_t now){
+  while(p->ntm && p->tm[0].at <= now){
+    timer_t_ t = tm_pop(p);
+    client_t* c = &p->cl[t.idx];
+    if(c->seq != t.seq || c->state != C_WAIT) continue;
+    if(c->tries >= p->mrc){
+      c->seq++;
+      failed(p, t.idx, F_TIMEOUT);
+      continue;
+    }
+    p->rtx[c->kind]++;
+    transmit(p, t.idx, now);
+  }
+}
+
+static void drain(perf_t* p){
+  uint8_t in[PKT_MAX];
+  for(;;){
+    ssize_t n = recv(p->fd, in, sizeof(in), 0);
+    if(n < 0) return;
+    on_reply(p, in, (size_t)n);
+  }
+}
+
+// ---- main loop ----
+
+static void run(perf_t* p){
+  double tokens = 0;
+  uint64_t last = now_ns();
+  while(p->done < p->n){
+    uint64_t now = now_ns();
+    if(p->rate > 0){
+      tokens += (double)(now - last) * p->rate / 1e9;
+      if(tokens > p->window) tokens = p->window;
+    }
+    last = now;
+
+    while(p->active < p->window && p->next_new < p->n){
+      p->active++;
+      start_lifecycle(p, p->next_new++);
+    }
+    while(p->rq_len && (p->rate <= 0 || tokens >= 1)){
+      uint32_t idx = p->ready[p->rq_head];
+      p->rq_head = (p->rq_head + 1) % p->n;
+      p->rq_len--;
+      transmit(p, idx, now_ns());
+      if(p->rate > 0) tokens -= 1;
+      if(p->udp && (p->msgs_out & 63) == 0) drain(p);
+    }
+    if(!p->udp) continue;
+
+    drain(p);
+    expire(p, now_ns());
+    if(p->rq_len && (p->rate <= 0 || tokens >= 1)) continue;
+
+    // nothing to send: sleep until an answer, a timer or a send token
+    int ms = 100;
+    if(p->ntm){
+      uint64_t t = now_ns();
+      ms = p->tm[0].at > t ? (int)((p->tm[0].at - t) / 1000000) : 0;
+    }
+    if(p->rq_len && p->rate > 0) ms = 0;
+    struct pollfd pf = { .fd = p->fd, .events = POLLIN };
+    poll(&pf, 1, ms > 100 ? 100 : ms);
+  }
+}
+
+static void report(perf_t* p, double secs){
+  uint64_t ex = 0;
+  for(int k = 0; k < K_N; k++) ex += p->ok[k] + p->failed[k];
+  printf("%u clients x %u lifecycles in %.2f s: %.0f exchanges/s, %.0f msgs/s out, "
+         "%.0f lifecycles/s\n", p->n, p->lifecycles, secs, (double)ex / secs,
+         (double)p->msgs_out / secs, (double)p->lifecycles_done / secs);
+  if(!p->udp)
+    printf("handler: %.0f ns/msg\n", p->msgs_out ? (double)p->handler_ns / (double)p->msgs_out : 0.0);
+  else
+    printf("answers %llu, stale/duplicate %llu\n",
+           (unsigned long long)p->msgs_in, (unsigned long long)p->stale);
+
+  printf("%-8s %9s %8s %9s %8s %10s %10s %10s\n",
+         "exchange", "sent", "rtx", "ok", "failed", "p50_us", "p99_us", "p999_us");
+  for(int k = 0; k < K_N; k++){
+    samples_t* s = &p->lat[k];
+    if(!p->sent[k]) continue;
+    qsort(s->v, s->n, sizeof(uint64_t), cmp_u64);
+    double q[3] = { 0, 0, 0 };
+    if(s->n){
+      q[0] = (double)s->v[s->n / 2] / 1e3;
+      q[1] = (double)s->v[s->n * 99 / 100] / 1e3;
+      q[2] = (double)s->v[s->n * 999 / 1000] / 1e3;
+    }
+    printf("%-8s %9llu %8llu %9llu %8llu %10.1f %10.1f %10.1f\n", kind_name[k],
+           (unsigned long long)p->sent[k], (unsigned long long)p->rtx[k],
+           (unsigned long long)p->ok[k], (unsigned long long)p->failed[k], q[0], q[1], q[2]);
+  }
+
+  int any = 0;
+  for(int k = 0; k < K_N; k++){
+    for(int f = 0; f < F_N; f++){
+      if(!p->fail[k][f]) continue;
+      if(!any++) printf("failures (per IA for status codes):\n");
+      printf("  %-8s %-14s %llu\n", kind_name[k], fail_name[f], (unsigned long long)p->fail[k][f]);
+    }
+  }
+}
+
+static void usage(const char* prog){
+  fprintf(stderr,
+    "usage: %s [-m inproc|udp] [-f conf] [-n clients] [-w window] [-L lifecycles]\n"
+    "          [-r renews] [-b rebind%%] [-q rapid%%] [-x release%%] [-I na|pd|both]\n"
+    "          [-R msgs/s] [-T irt_ms] [-M mrc] [-a addr] [-p port] [-s run]\n", prog);
+}
+
+int main(int argc, char** argv){
+  perf_t* p = calloc(1, sizeof(*p));
+  if(!p) return 1;
+  p->conf = "/etc/dhcpv6d.conf";
+  p->n = 100000;
+  p->window = 256;
+  p->lifecycles = 1;
+  p->renews = 1;
+  p->release_pct = 100;
+  p->want_na = p->want_pd = 1;
+  p->irt_ns = 1000000000ull;
+  p->mrc = 4;
+  p->dst.sin6_family = AF_INET6;
+  p->dst.sin6_addr = in6addr_loopback;
+  p->dst.sin6_port = htons(547);
+  p->fd = -1;
+  uint64_t seed = 1;
+
+  int opt;
+  while((opt = getopt(argc, argv, "m:f:n:w:L:r:b:q:x:I:R:T:M:a:p:s:")) != -1){
+    switch(opt){
+      case 'm':
+        if(strcmp(optarg, "udp") == 0) p->udp = 1;
+        else if(strcmp(optarg, "inproc") != 0){ usage(argv[0]); return 2; }
+        break;
+      case 'f': p->conf = optarg; break;
+      case 'n': p->n = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'w': p->window = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'L': p->lifecycles = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'r': p->renews = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'b': p->rebind_pct = (unsigned)atoi(optarg); break;
+      case 'q': p->rapid_pct = (unsigned)atoi(optarg); break;
+      case 'x': p->release_pct = (unsigned)atoi(optarg); break;
+      case 'I':
+        p->want_na = strcmp(optarg, "pd") != 0;
+        p->want_pd = strcmp(optarg, "na") != 0;
+        break;
+      case 'R': p->rate = atof(optarg); break;
+      case 'T': p->irt_ns = strtoull(optarg, NULL, 0) * 1000000ull; break;
+      case 'M': p->mrc = (unsigned)atoi(optarg); break;
+      case 'a':
+        if(inet_pton(AF_INET6, optarg, &p->dst.sin6_addr) != 1){ usage(argv[0]); return 2; }
+        break;
+      case 'p': p->dst.sin6_port = htons((uint16_t)atoi(optarg)); break;
+      case 's': seed = strtoull(optarg, NULL, 0); break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if(p->n == 0 || p->window == 0 || p->lifecycles == 0 || p->mrc == 0 || p->irt_ns == 0){
+    fprintf(stderr, "-n/-w/-L/-M/-T must be positive\n");
+    return 2;
+  }
+  if(p->window > p->n) p->window = p->n;
+  p->run = (uint8_t)seed;
+  p->rng = seed;
+
+  log_set_level(LOG_WARN);
+  p->cl = calloc(p->n, sizeof(*p->cl));
+  p->ready = malloc((size_t)p->n * sizeof(*p->ready));
+  if(!p->cl || !p->ready){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for(uint32_t i = 0; i < p->n; i++) p->cl[i].lc_left = p->lifecycles;
+
+  if(p->udp ? udp_init(p) < 0 : inproc_init(p) < 0){
+    fprintf(stderr, "%s setup failed\n", p->udp ? "udp" : "in-process server");
+    return 1;
+  }
+
+  uint64_t t0 = now_ns();
+  run(p);
+  report(p, (double)(now_ns() - t0) / 1e9);
+  return 0;
+}
@@ -0,0 +1,197 @@
+// DUID hash benchmark: throughput of each hash64 kind on realistic DUID
+// shapes, and how its output behaves as a lease-table key (probe length,
+// tag false positives, full 64-bit collisions) in a store/htab table.
+//
+//   make bench/hash_bench
+//   bench/hash_bench [-n duids] [-r rounds] [-s seed]
+#define _GNU_SOURCE
+#include "util/hash.h"
+#include "store/htab.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+typedef struct {
+  const char* name;
+  size_t len;
+} shape_t;
+
+// DUID-LLT (ethernet), DUID-EN with a short and a long identifier, DUID-UUID
+static const shape_t shapes[] = {
+  { "llt",    14 },
+  { "en",     12 },
+  { "en-long", 26 },
+  { "uuid",   18 },
+};
+#define NSHAPES (sizeof(shapes) / sizeof(shapes[0]))
+
+typedef struct {
+  uint64_t h;
+  uint32_t idx;
+} ent_t;
+
+static const uint8_t* g_duids;
+static size_t g_stride;
+static const size_t* g_lens;
+static uint64_t g_eq_calls;
+
+static uint64_t ent_hash(const void* e){ return ((const ent_t*)e)->h; }
+
+// compares the DUID bytes, as a key holding the identity would
+static int ent_eq(const void* e, const void* key){
+  uint32_t a = ((const ent_t*)e)->idx, b = *(const uint32_t*)key;
+  g_eq_calls++;
+  return g_lens[a] == g_lens[b] &&
+         memcmp(g_duids + a * g_stride, g_duids + b * g_stride, g_lens[a]) == 0;
+}
+
+static const htab_type_t ent_type = { sizeof(ent_t), ent_hash, ent_eq };
+
+static uint64_t now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t rng(uint64_t* s){
+  *s += 0x9e3779b97f4a7c15ULL;
+  return hash_mix64(*s);
+}
+
+// sequential-looking identifiers, as a fleet of one vendor's boxes produces
+static void make_duid(uint8_t* d, const shape_t* sh, uint32_t i, uint64_t* rs){
+  memset(d, 0, sh->len);
+  if(sh->len == 14){           // type 1, hw 1, time, MAC
+    d[1] = 1; d[3] = 1;
+    d[4] = 0x2a; d[5] = 0x11; d[6] = 0x30; d[7] = (uint8_t)(i >> 24);
+    d[8] = 0x00; d[9] = 0x1b; d[10] = 0x21;
+    d[11] = (uint8_t)(i >> 16); d[12] = (uint8_t)(i >> 8); d[13] = (uint8_t)i;
+  }else if(sh->len == 18){     // type 4, random UUID
+    d[1] = 4;
+    for(size_t k = 2; k < 18; k += 8){
+      uint64_t r = rng(rs);
+      memcpy(d + k, &r, 8);
+    }
+  }else{                       // type 2, enterprise 9, serial number
+    d[1] = 2; d[5] = 9;
+    for(size_t k = 6; k < sh->len; k++) d[k] = (uint8_t)('0' + (i >> (k % 4 * 3)) % 10);
+    d[sh->len - 1] = (uint8_t)i; d[sh->len - 2] = (uint8_t)(i >> 8);
+    d[sh->len - 3] = (uint8_t)(i >> 16);
+  }
+}
+
+static int cmp_u64(const void* a, const void* b){
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static void run(hash_kind_t k, const shape_t* sh, size_t n, unsigned rounds,
+                uint64_t seed, uint64_t* hs){
+  volatile uint64_t sink = 0;
+  uint64_t t0 = now_ns();
+  for(unsigned r = 0; r < rounds; r++)
+    for(size_t i = 0; i < n; i++)
+      sink ^= hash64_with(k, g_duids + i * g_stride, sh->len, seed);
+  double ns = (double)(now_ns() - t0) / ((double)n * rounds);
+  (void)sink;
+
+  for(size_t i = 0; i < n; i++)
+    hs[i] = hash64_with(k, g_duids + i * g_stride, sh->len, seed);
+
+  htab_t ht;
+  if(htab_init(&ht, &ent_type, 16) < 0 || htab_reserve(&ht, n) < 0){
+    fprintf(stderr, "htab: out of memory\n");
+    exit(1);
+  }
+  for(size_t i = 0; i < n; i++){
+    uint32_t idx = (uint32_t)i;
+    int existed;
+    ent_t* e = htab_insert(&ht, hs[i], &idx, &existed);
+    if(!e){ fprintf(stderr, "htab: out of memory\n"); exit(1); }
+    e->h = hs[i]; e->idx = idx;
+  }
+
+  // groups probed per lookup: triangular walk from the home group
+  size_t gmask = ht.cur.cap / HTAB_GROUP - 1;
+  uint64_t groups = 0;
+  g_eq_calls = 0;
+  for(size_t i = 0; i < n; i++){
+    uint32_t idx = (uint32_t)i;
+    ent_t* e = htab_find(&ht, hs[i], &idx);
+    if(!e || e->idx != idx){ fprintf(stderr, "htab: lost key %zu\n", i); exit(1); }
+    size_t g = (size_t)(hs[i] >> 7) & gmask;
+    size_t slot = (size_t)((uint8_t*)e - ht.cur.slots) / sizeof(ent_t);
+    for(size_t step = 0; g != slot / HTAB_GROUP; g = (g + ++step) & gmask) groups++;
+    groups++;
+  }
+  double eq = (double)g_eq_calls / (double)n;
+
+  qsort(hs, n, sizeof(*hs), cmp_u64);
+  size_t coll = 0;
+  for(size_t i = 1; i < n; i++) coll += hs[i] == hs[i - 1];
+
+  printf("%-8s %-8s %7.2f %10.3f %8.4f %9zu %9zu %6zu\n",
+         hash_kind_name(k), sh->name, ns, (double)groups / (double)n, eq,
+         ht.cur.cap, ht.cur.max_probe, coll);
+  htab_free(&ht);
+}
+
+int main(int argc, char** argv){
+  size_t n = 1000000;
+  unsigned rounds = 20;
+  uint64_t seed = 0xA5A5A5A5ULL;
+  int opt;
+  while((opt = getopt(argc, argv, "n:r:s:")) != -1){
+    switch(opt){
+      case 'n': n = strtoul(optarg, NULL, 0); break;
+      case 'r': rounds = (unsigned)strtoul(optarg, NULL, 0); break;
+      case 's': seed = strtoull(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "usage: %s [-n duids] [-r rounds] [-s seed]\n", argv[0]);
+        return 2;
+    }
+  }
+  if(n == 0 || n > UINT32_MAX || rounds == 0){
+    fprintf(stderr, "bad -n/-r\n");
+    return 2;
+  }
+
+  g_stride = 32;
+  uint8_t* duids = malloc(n * g_stride);
+  size_t* lens = malloc(n * sizeof(*lens));
+  uint64_t* hs = malloc(n * sizeof(*hs));
+  if(!duids || !lens || !hs){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  g_duids = duids;
+  g_lens = lens;
+
+  printf("%zu DUIDs per shape, %u rounds\n", n, rounds);
+  printf("%-8s %-8s %7s %10s %8s %9s %9s %6s\n",
+         "hash", "duid", "ns/hash", "groups/lk", "eq/lk", "cap", "maxprobe", "coll");
+  for(size_t s = 0; s < NSHAPES; s++){
+    uint64_t rs = seed;
+    for(size_t i = 0; i < n; i++){
+      make_duid(duids + i * g_stride, &shapes[s], (uint32_t)i, &rs);
+      lens[i] = shapes[s].len;
+    }
+    for(int k = 0; k < HASH_NKINDS; k++){
+      if(!hash_available((hash_kind_t)k)){
+        printf("%-8s %-8s (not available on this CPU)\n",
+               hash_kind_name((hash_kind_t)k), shapes[s].name);
+        continue;
+      }
+      run((hash_kind_t)k, &shapes[s], n, rounds, seed, hs);
+    }
+  }
+
+  free(hs);
+  free(lens);
+  free(duids);
+  return 0;
+}
@@ -0,0 +1,194 @@
+// Loopback datapath benchmark: recvmmsg/sendmmsg vs io_uring.
+// A server thread echoes datagrams through dh6_sock_recv_batch/send_batch
+// on its own reactor; the client keeps a window of requests in flight on
+// ::1 and measures round-trip latency per packet.
+//
+//   make bench/sock_bench [IO_URING=1]
+//   bench/sock_bench [-n packets] [-w window] [-s size] [-p port]
+#define _GNU_SOURCE
+#include "net/sock.h"
+#include "net/reactor.h"
+#include "util/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+typedef struct {
+  dh6_sock_t sock;
+  dh6_batch_t batch;
+  reactor_t rx;
+  reactor_ev_t ev;
+  int uring;
+  int ready;   // 1 = serving, -1 = setup failed
+  pthread_mutex_t mu;
+  pthread_cond_t cv;
+} echo_srv_t;
+
+static uint64_t now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void on_echo(reactor_ev_t* ev, uint32_t events){
+  (void)events;
+  echo_srv_t* e = (echo_srv_t*)ev->arg;
+  dh6_batch_t* b = &e->batch;
+  if(dh6_sock_recv_batch(&e->sock, b) <= 0) return;
+  for(size_t i=0;i<b->nrx;i++){
+    b->tx[i] = b->rx[i];
+  }
+  b->ntx = b->nrx;
+  dh6_sock_send_batch(&e->sock, b);
+}
+
+static void srv_ready(echo_srv_t* e, int v){
+  pthread_mutex_lock(&e->mu);
+  e->ready = v;
+  pthread_cond_signal(&e->cv);
+  pthread_mutex_unlock(&e->mu);
+}
+
+static void* srv_main(void* arg){
+  echo_srv_t* e = (echo_srv_t*)arg;
+  if(e->uring && dh6_sock_use_uring(&e->sock) < 0){
+    srv_ready(e, -1);
+    return NULL;
+  }
+  if(reactor_add(&e->rx, &e->ev, dh6_sock_poll_fd(&e->sock), EPOLLIN, on_echo, e) < 0){
+    srv_ready(e, -1);
+    return NULL;
+  }
+  srv_ready(e, 1);
+  reactor_run(&e->rx);
+  return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b){
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static int run(const char* name, int uring, uint16_t port,
+               size_t npkts, size_t window, size_t size){
+  echo_srv_t* e = calloc(1, sizeof(*e));
+  uint64_t* lat = malloc(npkts * sizeof(uint64_t));
+  if(!e || !lat) return -1;
+  pthread_mutex_init(&e->mu, NULL);
+  pthread_cond_init(&e->cv, NULL);
+  e->uring = uring;
+  dh6_batch_init(&e->batch);
+  if(dh6_sock_open(&e->sock, port) < 0 || reactor_init(&e->rx) < 0) return -1;
+
+  pthread_t thr;
+  pthread_create(&thr, NULL, srv_main, e);
+  pthread_mutex_lock(&e->mu);
+  while(e->ready == 0) pthread_cond_wait(&e->cv, &e->mu);
+  pthread_mutex_unlock(&e->mu);
+  if(e->ready < 0){
+    printf("%-9s unavailable\n", name);
+    pthread_join(thr, NULL);
+    goto out;
+  }
+
+  int fd = socket(AF_INET6, SOCK_DGRAM, 0);
+  struct sockaddr_in6 dst;
+  memset(&dst, 0, sizeof(dst));
+  dst.sin6_family = AF_INET6;
+  dst.sin6_addr = in6addr_loopback;
+  dst.sin6_port = htons(port);
+  connect(fd, (struct sockaddr*)&dst, sizeof(dst));
+  int rcvbuf = 4 << 20;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  uint8_t pkt[DH6_PKT_MAX];
+  memset(pkt, 0xab, sizeof(pkt));
+  size_t sent = 0, got = 0, lost = 0, inflight = 0;
+
+  uint64_t t0 = now_ns();
+  while(got + lost < npkts){
+    while(inflight < window && sent < npkts){
+      uint64_t ts = now_ns();
+      memcpy(pkt, &ts, sizeof(ts));
+      if(send(fd, pkt, size, 0) == (ssize_t)size){
+        inflight++;
+      } else {
+        lost++;
+      }
+      sent++;
+    }
+    uint8_t in[DH6_PKT_MAX];
+    ssize_t n = recv(fd, in, sizeof(in), 0);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      // window stalled: count what is outstanding as lost and refill
+      lost += inflight;
+      inflight = 0;
+      continue;
+    }
+    uint64_t ts;
+    memcpy(&ts, in, sizeof(ts));
+    lat[got++] = now_ns() - ts;
+    inflight--;
+  }
+  uint64_t t1 = now_ns();
+  close(fd);
+
+  qsort(lat, got, sizeof(uint64_t), cmp_u64);
+  double secs = (double)(t1 - t0) / 1e9;
+  printf("%-9s %9zu %10.0f %9.1f %9.1f %7zu\n", name, got,
+         (double)got / secs,
+         got ? (double)lat[got / 2] / 1e3 : 0.0,
+         got ? (double)lat[(got * 99) / 100] / 1e3 : 0.0,
+         lost);
+
+  reactor_stop(&e->rx);
+  pthread_join(thr, NULL);
+out:
+  reactor_free(&e->rx);
+  dh6_sock_close(&e->sock);
+  free(lat);
+  free(e);
+  return 0;
+}
+
+int main(int argc, char** argv){
+  size_t npkts = 200000, window = 64, size = 120;
+  uint16_t port = 15470;
+  int c;
+  while((c = getopt(argc, argv, "n:w:s:p:")) != -1){
+    switch(c){
+    case 'n': npkts = strtoul(optarg, NULL, 0); break;
+    case 'w': window = strtoul(optarg, NULL, 0); break;
+    case 's': size = strtoul(optarg, NULL, 0); break;
+    case 'p': port = (uint16_t)strtoul(optarg, NULL, 0); break;
+    default:
+      fprintf(stderr, "usage: %s [-n packets] [-w window] [-s size] [-p port]\n", argv[0]);
+      return 2;
+    }
+  }
+  if(size < sizeof(uint64_t)) size = sizeof(uint64_t);
+  if(size > DH6_PKT_MAX) size = DH6_PKT_MAX;
+  if(window < 1) window = 1;
+
+  log_set_level(LOG_WARN);
+  printf("%-9s %9s %10s %9s %9s %7s\n", "backend", "pkts", "pps", "p50_us", "p99_us", "lost");
+  run("mmsg", 0, port, npkts, window, size);
+#ifdef DH6_IO_URING
+  run("io_uring", 1, port, npkts, window, size);
+#else
+  printf("%-9s not built (make IO_URING=1)\n", "io_uring");
+#endif
+  return 0;
+}
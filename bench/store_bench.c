@@ -0,0 +1,565 @@
+// Lease store and allocator microbenchmarks.
+//   store - each hot lease_store_vtbl_t operation at 10/50/90/99% table
+//           fill, on heap tables (grown on demand) and on fixed arrays
+//           (map_store's mode: inserts fail at 7/8 load, tombstones are
+//           never purged), with every table's probe-length histogram
+//   alloc - acquire_na/acquire_pd for new clients at the same pool fills,
+//           per allocator (address bitmap or hash probe, PD buddy or hash
+//           probe): ns/op, candidates tried, clients turned away
+// Text by default, one JSON document with -j.
+//
+//   make bench             (builds the bench tools, runs this one with -j)
+//   bench/store_bench [-c slots] [-n ops] [-s seed] [-j]
+#define _GNU_SOURCE
+#include "store/mem_store.h"
+#include "alloc/alloc.h"
+#include "util/hash.h"
+#include "util/time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+
+#define BATCH 64           // ops per timed batch
+#define DUID_LEN 14
+#define PROBE_BINS 9       // extra groups 0..7, 8+
+#define CAND_BINS 12       // 1, 2, 3-4, ... 513-1024, more
+#define LEASE_SECS 3600
+
+static const double fills[] = { 0.10, 0.50, 0.90, 0.99 };
+#define NFILLS (sizeof(fills) / sizeof(fills[0]))
+
+static const char* const table_name[MEM_NTABLES] = {
+  "na", "pd", "addr_idx", "pfx_idx", "declined_addr", "declined_pfx", "duid_idx",
+};
+
+static size_t g_cap = 65536;
+static size_t g_ops = 200000;
+static uint64_t g_seed = 0xA5A5A5A5ULL;
+static int g_json;
+static uint64_t g_now;
+static uint32_t g_client;  // next fresh client number
+
+static uint64_t now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t rng(uint64_t* s){
+  *s += 0x9e3779b97f4a7c15ULL;
+  return hash_mix64(*s);
+}
+
+static void die(const char* what){
+  fprintf(stderr, "%s\n", what);
+  exit(1);
+}
+
+// random permutation of 0..n-1
+static uint64_t* perm_make(size_t n, uint64_t* rs){
+  uint64_t* p = malloc(n * sizeof(*p));
+  if(!p) die("out of memory");
+  for(size_t i=0;i<n;i++) p[i] = i;
+  for(size_t i=n; i>1; i--){
+    size_t j = (size_t)(rng(rs) % i);
+    uint64_t t = p[i - 1]; p[i - 1] = p[j]; p[j] = t;
+  }
+  return p;
+}
+
+// DUID-LLT of client c
+static void client_duid(uint8_t* d, uint32_t c){
+  memset(d, 0, DUID_LEN);
+  d[1] = 1; d[3] = 1;
+  d[4] = 0x2a; d[5] = 0x11; d[6] = (uint8_t)(c >> 24); d[7] = 0x30;
+  d[8] = 0x00; d[9] = 0x1b; d[10] = 0x21;
+  d[11] = (uint8_t)(c >> 16); d[12] = (uint8_t)(c >> 8); d[13] = (uint8_t)c;
+}
+
+// intern a fresh client; the caller holds one reference
+static uint32_t client_get(lease_store_t* st, uint8_t* d){
+  client_duid(d, g_client++);
+  uint32_t hd = st->v.duid_get(st, d, DUID_LEN, hash64_bytes(d, DUID_LEN, st->duid_seed));
+  if(!hd) die("duid_get failed");
+  return hd;
+}
+
+static void addr_in(struct in6_addr* a, uint16_t net, uint64_t host){
+  struct in6_addr p;
+  memset(&p, 0, sizeof(p));
+  p.s6_addr[0] = 0x20; p.s6_addr[1] = 0x01; p.s6_addr[2] = 0x0d; p.s6_addr[3] = 0xb8;
+  p.s6_addr[6] = (uint8_t)(net >> 8); p.s6_addr[7] = (uint8_t)net;
+  pool64_make_addr(a, &p, host);
+}
+
+static lease_na_t na_lease(const lease_key_t* k, const struct in6_addr* a){
+  lease_na_t l;
+  memset(&l, 0, sizeof(l));
+  l.key = *k;
+  l.addr = *a;
+  l.preferred_lft = l.valid_lft = LEASE_SECS;
+  l.preferred_until = l.valid_until = g_now + LEASE_SECS;
+  l.state = LS_ALLOCATED;
+  return l;
+}
+
+static lease_pd_t pd_lease(const lease_key_t* k, const struct in6_addr* p, uint8_t plen){
+  lease_pd_t l;
+  memset(&l, 0, sizeof(l));
+  l.key = *k;
+  l.prefix = *p;
+  l.prefix_len = plen;
+  l.preferred_lft = l.valid_lft = LEASE_SECS;
+  l.preferred_until = l.valid_until = g_now + LEASE_SECS;
+  l.state = LS_ALLOCATED;
+  return l;
+}
+
+// ---- fixed arrays ----
+
+typedef struct {
+  htab_arr_t arr[MEM_NTABLES];
+  duid_arena_arr_t duids;
+} fixed_t;
+
+static void fixed_alloc(fixed_t* f, size_t cap){
+  memset(f, 0, sizeof(*f));
+  for(int i=0;i<MEM_NTABLES;i++){
+    f->arr[i].ctrl = aligned_alloc(HTAB_GROUP, cap);
+    f->arr[i].slots = malloc(cap * mem_store_esize(i));
+    if(!f->arr[i].ctrl || !f->arr[i].slots) die("out of memory");
+    memset(f->arr[i].ctrl, 0x80, cap); // EMPTY
+    f->arr[i].cap = cap;
+  }
+  f->duids.recs = calloc(cap, sizeof(duid_rec_t));
+  f->duids.slab = malloc(cap * 32);
+  if(!f->duids.recs || !f->duids.slab) die("out of memory");
+  f->duids.rec_cap = (uint32_t)cap;
+  f->duids.slab_cap = (uint32_t)(cap * 32);
+  duid_arena_cnt_init(&f->duids.c);
+}
+
+static void fixed_free(fixed_t* f){
+  for(int i=0;i<MEM_NTABLES;i++){
+    free(f->arr[i].ctrl);
+    free(f->arr[i].slots);
+  }
+  free(f->duids.recs);
+  free(f->duids.slab);
+}
+
+// ---- store operations ----
+
+enum { OP_GET_NA, OP_PUT_NA, OP_DEL_NA, OP_ADDR_IN_USE, OP_IS_ADDR_DECLINED, OP_GC, OP_N };
+static const char* const op_name[OP_N] = {
+  "get_na", "put_na", "del_na", "addr_in_use", "is_addr_declined", "gc",
+};
+
+typedef struct {
+  size_t cap, count, tomb, max_probe;
+  size_t hist[PROBE_BINS];
+} table_stat_t;
+
+typedef struct {
+  const char* mode;
+  double fill;
+  size_t entries;
+  double ns[OP_N];        // gc: per expired entry
+  size_t put_fail;
+  table_stat_t t[MEM_NTABLES];
+} store_res_t;
+
+static void table_stats(lease_store_t* st, table_stat_t* t){
+  htab_arr_t arr[MEM_NTABLES];
+  mem_store_arrays(st, arr);
+  for(int i=0;i<MEM_NTABLES;i++){
+    t[i].cap = arr[i].cap;
+    t[i].tomb = arr[i].tomb;
+    t[i].max_probe = arr[i].max_probe;
+    // entries of a heap table still being resized count wherever they are
+    mem_store_probe_hist(st, i, t[i].hist, PROBE_BINS);
+    t[i].count = 0;
+    for(int b=0;b<PROBE_BINS;b++) t[i].count += t[i].hist[b];
+  }
+}
+
+static void run_store(int fixed, double fill, store_res_t* r){
+  lease_store_t st;
+  fixed_t fx;
+  memset(&st, 0, sizeof(st));
+  st.duid_seed = g_seed;
+  if(fixed){
+    fixed_alloc(&fx, g_cap);
+    if(mem_store_init_fixed(&st, fx.arr, &fx.duids, g_seed) < 0) die("mem_store_init_fixed failed");
+  }else if(mem_store_init(&st, 16, g_seed) < 0){
+    die("mem_store_init failed");
+  }
+
+  // the address range matches the fixed tables' limit: fill = pool fill too
+  size_t limit = g_cap / 8 * 7;
+  size_t n = (size_t)(fill * (double)limit);
+  if(n > limit - BATCH - 1) n = limit - BATCH - 1;
+  uint64_t rs = g_seed ^ (uint64_t)(fill * 1000);
+  uint64_t* perm = perm_make(limit, &rs);
+  lease_key_t* keys = malloc(n * sizeof(*keys));
+  if(!keys) die("out of memory");
+
+  uint8_t d[DUID_LEN];
+  for(size_t i=0;i<n;i++){
+    uint32_t hd = client_get(&st, d);
+    keys[i] = lease_key_make(hd, 1, IA_NA);
+    struct in6_addr a;
+    addr_in(&a, 1, 1 + perm[i]);
+    lease_na_t l = na_lease(&keys[i], &a);
+    if(st.v.put_na(&st, &l) < 0) die("fill: put_na failed");
+    st.v.duid_put(&st, hd);
+    addr_in(&a, 2, 1 + perm[limit - 1 - i]);
+    if(st.v.decline_addr(&st, &a, g_now + LEASE_SECS) < 0) die("fill: decline_addr failed");
+  }
+  // clients for the put/del churn, held for the whole run
+  uint32_t churn[BATCH];
+  for(int j=0;j<BATCH;j++) churn[j] = client_get(&st, d);
+
+  memset(r, 0, sizeof(*r));
+  r->mode = fixed ? "fixed" : "heap";
+  r->fill = fill;
+  r->entries = n;
+  table_stats(&st, r->t);
+
+  size_t rounds = (g_ops + BATCH - 1) / BATCH;
+  uint64_t t_op[OP_N] = { 0 };
+  volatile int sink = 0;
+  lease_na_t out;
+  for(size_t k=0;k<rounds;k++){
+    size_t idx[BATCH];
+    struct in6_addr probe[BATCH], decl[BATCH];
+    for(int j=0;j<BATCH;j++){
+      idx[j] = (size_t)(rng(&rs) % n);
+      addr_in(&probe[j], 1, 1 + rng(&rs) % limit);
+      addr_in(&decl[j], 2, 1 + rng(&rs) % limit);
+    }
+
+    uint64_t t0 = now_ns();
+    for(int j=0;j<BATCH;j++) sink += st.v.get_na(&st, &keys[idx[j]], &out);
+    uint64_t t1 = now_ns();
+    for(int j=0;j<BATCH;j++) sink += st.v.addr_in_use(&st, &probe[j]);
+    uint64_t t2 = now_ns();
+    for(int j=0;j<BATCH;j++) sink += st.v.is_addr_declined(&st, &decl[j], g_now);
+    uint64_t t3 = now_ns();
+    t_op[OP_GET_NA] += t1 - t0;
+    t_op[OP_ADDR_IN_USE] += t2 - t1;
+    t_op[OP_IS_ADDR_DECLINED] += t3 - t2;
+
+    // new keys in, then out again: the fill stays put
+    lease_na_t fresh[BATCH];
+    for(int j=0;j<BATCH;j++){
+      lease_key_t key = lease_key_make(churn[j], (uint32_t)(k + 2), IA_NA);
+      struct in6_addr a;
+      addr_in(&a, 3, (uint64_t)j + 1);
+      fresh[j] = na_lease(&key, &a);
+    }
+    t0 = now_ns();
+    for(int j=0;j<BATCH;j++) r->put_fail += st.v.put_na(&st, &fresh[j]) < 0;
+    t1 = now_ns();
+    for(int j=0;j<BATCH;j++) sink += st.v.del_na(&st, &fresh[j].key);
+    t2 = now_ns();
+    t_op[OP_PUT_NA] += t1 - t0;
+    t_op[OP_DEL_NA] += t2 - t1;
+  }
+  (void)sink;
+  double total = (double)(rounds * BATCH);
+  for(int o=0;o<OP_N;o++) r->ns[o] = (double)t_op[o] / total;
+
+  // every lease and decline is due: one gc pass expires them all
+  uint64_t t0 = now_ns();
+  st.v.gc(&st, g_now + LEASE_SECS + 1);
+  r->ns[OP_GC] = n ? (double)(now_ns() - t0) / (double)(2 * n) : 0;
+
+  for(int j=0;j<BATCH;j++) st.v.duid_put(&st, churn[j]);
+  mem_store_free(&st);
+  if(fixed) fixed_free(&fx);
+  free(keys);
+  free(perm);
+}
+
+// ---- allocators ----
+
+typedef struct {
+  const char* ia;
+  const char* allocator;
+  double fill;
+  size_t attempts, fail;
+  double ns, cand_avg;
+  size_t cand[CAND_BINS];
+} alloc_res_t;
+
+typedef struct {
+  pool64_t* na;
+  pd_pool_t* pd;
+} occ_ctx_t;
+
+static void on_occ(void* arg, const struct in6_addr* a, uint8_t plen, int occupied){
+  occ_ctx_t* c = arg;
+  if(plen == 128) pool64_occ_mark(c->na, a, occupied);
+  else pdpool_occ_mark(c->pd, a, plen, occupied);
+}
+
+// counts the candidates a store looks at
+typedef struct {
+  lease_cand_fn fn;
+  void* arg;
+  unsigned tried;
+} cand_count_t;
+
+static int cand_counted(void* arg, unsigned i, struct in6_addr* out, uint8_t* plen){
+  cand_count_t* c = arg;
+  int rc = c->fn(c->arg, i, out, plen);
+  if(rc == 0) c->tried++;
+  return rc;
+}
+
+static int cand_bin(unsigned n){
+  int b = 0;
+  while(b < CAND_BINS - 1 && (1u << b) < n) b++;
+  return b;
+}
+
+static void run_alloc(int pd, int map, double fill, alloc_res_t* r){
+  lease_store_t st;
+  memset(&st, 0, sizeof(st));
+  st.duid_seed = g_seed;
+  if(mem_store_init(&st, 16, g_seed) < 0) die("mem_store_init failed");
+
+  int bits = 0;
+  while(((size_t)1 << bits) < g_cap) bits++;
+  pool64_t na;
+  pd_pool_t pp;
+  memset(&na, 0, sizeof(na));
+  memset(&pp, 0, sizeof(pp));
+  addr_in(&na.prefix64, 4, 0);
+  na.host_start = 1;
+  na.host_end = g_cap;
+  na.secret = g_seed;
+  addr_in(&pp.base_prefix, 0x100, 0);
+  pp.delegated_len = pp.min_len = pp.max_len = 56;
+  pp.base_len = (uint8_t)(56 - bits);
+  pp.secret = g_seed;
+  if(map && (pd ? pdpool_occ_init(&pp) : pool64_occ_init(&na)) < 0) die("occupancy map: out of memory");
+  occ_ctx_t occ = { &na, &pp };
+  st.on_occ = on_occ;
+  st.occ_arg = &occ;
+
+  size_t n = (size_t)(fill * (double)g_cap);
+  uint64_t rs = g_seed ^ (uint64_t)(fill * 1000) ^ (uint64_t)pd << 32;
+  uint64_t* perm = perm_make(g_cap, &rs);
+  uint8_t d[DUID_LEN];
+  for(size_t i=0;i<n;i++){
+    uint32_t hd = client_get(&st, d);
+    struct in6_addr a;
+    int rc;
+    if(pd){
+      lease_key_t k = lease_key_make(hd, 1, IA_PD);
+      pdpool_make_prefix(&a, &pp.base_prefix, pp.base_len, 56, perm[i]);
+      lease_pd_t l = pd_lease(&k, &a, 56);
+      rc = st.v.put_pd(&st, &l);
+    }else{
+      lease_key_t k = lease_key_make(hd, 1, IA_NA);
+      pool64_make_addr(&a, &na.prefix64, 1 + perm[i]);
+      lease_na_t l = na_lease(&k, &a);
+      rc = st.v.put_na(&st, &l);
+    }
+    if(rc < 0) die("fill: put failed");
+    st.v.duid_put(&st, hd);
+  }
+
+  memset(r, 0, sizeof(*r));
+  r->ia = pd ? "pd" : "na";
+  r->allocator = pd ? (map ? "buddy" : "probe") : (map ? "bitmap" : "probe");
+  r->fill = fill;
+
+  size_t rounds = (g_ops + BATCH - 1) / BATCH;
+  uint64_t t_ns = 0, tried = 0;
+  for(size_t k=0;k<rounds;k++){
+    uint32_t hd[BATCH];
+    cand_count_t cc[BATCH];
+    addr_cand_t ac[BATCH];
+    pd_cand_t pc[BATCH];
+    lease_na_t nt[BATCH];
+    lease_pd_t pt[BATCH];
+    int rc[BATCH];
+    struct in6_addr zero;
+    memset(&zero, 0, sizeof(zero));
+    for(int j=0;j<BATCH;j++){
+      hd[j] = client_get(&st, d);
+      if(pd){
+        pd_cand_init(&pc[j], &pp, d, DUID_LEN, 1, 0, 0);
+        cc[j] = (cand_count_t){ pd_cand_next, &pc[j], 0 };
+        lease_key_t key = lease_key_make(hd[j], 1, IA_PD);
+        pt[j] = pd_lease(&key, &zero, 0);
+      }else{
+        addr_cand_init(&ac[j], &na, d, DUID_LEN, 1);
+        cc[j] = (cand_count_t){ addr_cand_next, &ac[j], 0 };
+        lease_key_t key = lease_key_make(hd[j], 1, IA_NA);
+        nt[j] = na_lease(&key, &zero);
+      }
+    }
+    uint64_t t0 = now_ns();
+    for(int j=0;j<BATCH;j++){
+      rc[j] = pd ? st.v.acquire_pd(&st, &pt[j], cand_counted, &cc[j], g_now, NULL)
+                 : st.v.acquire_na(&st, &nt[j], cand_counted, &cc[j], g_now, NULL);
+    }
+    t_ns += now_ns() - t0;
+
+    // turned away or not, the client leaves again: the fill stays put
+    for(int j=0;j<BATCH;j++){
+      r->attempts++;
+      tried += cc[j].tried;
+      if(rc[j] < 0) r->fail++;
+      else r->cand[cand_bin(cc[j].tried)]++;
+      if(rc[j] >= 0){
+        if(pd) st.v.del_pd(&st, &pt[j].key);
+        else st.v.del_na(&st, &nt[j].key);
+      }
+      st.v.duid_put(&st, hd[j]);
+    }
+  }
+  r->ns = (double)t_ns / (double)r->attempts;
+  r->cand_avg = (double)tried / (double)r->attempts;
+
+  mem_store_free(&st);
+  pool64_occ_free(&na);
+  pdpool_occ_free(&pp);
+  free(perm);
+}
+
+// ---- output ----
+
+static void hist_pct(const size_t* h, int n, size_t total, char* out, size_t cap){
+  size_t o = 0;
+  out[0] = 0;
+  for(int i=0;i<n && o < cap;i++){
+    double pct = total ? 100.0 * (double)h[i] / (double)total : 0;
+    o += (size_t)snprintf(out + o, cap - o, "%s%.1f", i ? "/" : "", pct);
+  }
+}
+
+static void print_hist(const size_t* h, int n){
+  printf("[");
+  for(int i=0;i<n;i++) printf("%s%zu", i ? "," : "", h[i]);
+  printf("]");
+}
+
+static void text_store(const store_res_t* r){
+  const table_stat_t* na = &r->t[MEM_T_NA];
+  char h[96];
+  hist_pct(na->hist, 4, na->count, h, sizeof(h));
+  printf("%-5s %4.0f%% %8zu %8zu %5.2f %3zu",
+         r->mode, r->fill * 100, r->entries, na->cap,
+         na->cap ? (double)(na->count + na->tomb) / (double)na->cap : 0, na->max_probe);
+  for(int o=0;o<OP_N;o++) printf(" %8.1f", r->ns[o]);
+  printf(" %8zu  %s\n", r->put_fail, h);
+}
+
+static void text_alloc(const alloc_res_t* r){
+  printf("%-3s %-7s %4.0f%% %8.1f %8.2f %9.5f%%  ",
+         r->ia, r->allocator, r->fill * 100, r->ns, r->cand_avg,
+         100.0 * (double)r->fail / (double)r->attempts);
+  char h[160];
+  hist_pct(r->cand, CAND_BINS, r->attempts - r->fail, h, sizeof(h));
+  printf("%s\n", h);
+}
+
+static void json_store(const store_res_t* r, int first){
+  printf("%s\n    {\"mode\": \"%s\", \"fill\": %.2f, \"entries\": %zu, \"put_fail\": %zu,\n",
+         first ? "" : ",", r->mode, r->fill, r->entries, r->put_fail);
+  printf("     \"ns_per_op\": {");
+  for(int o=0;o<OP_N;o++) printf("%s\"%s\": %.1f", o ? ", " : "", op_name[o], r->ns[o]);
+  printf("},\n     \"tables\": {");
+  for(int i=0;i<MEM_NTABLES;i++){
+    const table_stat_t* t = &r->t[i];
+    printf("%s\n       \"%s\": {\"cap\": %zu, \"count\": %zu, \"tomb\": %zu, \"load\": %.4f, "
+           "\"max_probe\": %zu, \"probe_hist\": ",
+           i ? "," : "", table_name[i], t->cap, t->count, t->tomb,
+           t->cap ? (double)(t->count + t->tomb) / (double)t->cap : 0, t->max_probe);
+    print_hist(t->hist, PROBE_BINS);
+    printf("}");
+  }
+  printf("}}");
+}
+
+static void json_alloc(const alloc_res_t* r, int first){
+  printf("%s\n    {\"ia\": \"%s\", \"allocator\": \"%s\", \"fill\": %.2f, \"attempts\": %zu, "
+         "\"fail\": %zu, \"fail_rate\": %.6f, \"ns_per_op\": %.1f, \"cand_avg\": %.3f, \"cand_hist\": ",
+         first ? "" : ",", r->ia, r->allocator, r->fill, r->attempts, r->fail,
+         (double)r->fail / (double)r->attempts, r->ns, r->cand_avg);
+  print_hist(r->cand, CAND_BINS);
+  printf("}");
+}
+
+int main(int argc, char** argv){
+  int opt;
+  while((opt = getopt(argc, argv, "c:n:s:j")) != -1){
+    switch(opt){
+      case 'c': g_cap = strtoul(optarg, NULL, 0); break;
+      case 'n': g_ops = strtoul(optarg, NULL, 0); break;
+      case 's': g_seed = strtoull(optarg, NULL, 0); break;
+      case 'j': g_json = 1; break;
+      default:
+        fprintf(stderr, "usage: %s [-c slots] [-n ops] [-s seed] [-j]\n", argv[0]);
+        return 2;
+    }
+  }
+  if(g_cap < 1024 || g_cap > ((size_t)1 << 24) || (g_cap & (g_cap - 1)) || g_ops == 0){
+    fprintf(stderr, "bad -c (power of two, 1024..2^24) or -n\n");
+    return 2;
+  }
+  g_now = now_epoch_sec();
+
+  if(g_json){
+    printf("{\"cap\": %zu, \"ops\": %zu, \"seed\": %llu, \"hash\": \"%s\", \"probe_bins\": %d, "
+           "\"cand_bins\": %d,\n  \"store\": [",
+           g_cap, g_ops, (unsigned long long)g_seed, hash_kind_name(hash_selected()),
+           PROBE_BINS, CAND_BINS);
+  }else{
+    printf("%zu slots per fixed table, %zu ops per measurement\n", g_cap, g_ops);
+    printf("%-5s %5s %8s %8s %5s %3s", "mode", "fill", "entries", "na cap", "load", "mp");
+    for(int o=0;o<OP_N;o++) printf(" %8.8s", op_name[o]);
+    printf(" %8s  %s\n", "put fail", "na probe % (0/1/2/3)");
+  }
+  int first = 1;
+  for(int fixed=0; fixed<2; fixed++){
+    for(size_t f=0; f<NFILLS; f++){
+      store_res_t r;
+      run_store(fixed, fills[f], &r);
+      if(g_json) json_store(&r, first);
+      else text_store(&r);
+      first = 0;
+    }
+  }
+
+  if(g_json){
+    printf("\n  ],\n  \"alloc\": [");
+  }else{
+    printf("\n%-3s %-7s %5s %8s %8s %10s  %s\n", "ia", "alloc", "fill", "ns/op", "cand",
+           "fail", "candidates tried % (1/2/3-4/.../513-1024/more)");
+  }
+  first = 1;
+  for(int pd=0; pd<2; pd++){
+    for(int map=1; map>=0; map--){
+      for(size_t f=0; f<NFILLS; f++){
+        alloc_res_t r;
+        run_alloc(pd, map, fills[f], &r);
+        if(g_json) json_alloc(&r, first);
+        else text_alloc(&r);
+        first = 0;
+      }
+    }
+  }
+  if(g_json) printf("\n  ]\n}\n");
+  return 0;
+}
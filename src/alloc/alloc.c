@@ -1,40 +1,191 @@
 #include "alloc/alloc.h"
 #include "util/hash.h"
-#include "util/time.h"
+#include <stdlib.h>
+#include <string.h>
 
-static uint64_t h64_duid_iaid(const duid_t* duid, uint32_t iaid, uint64_t secret){
-  uint64_t h = hash64_bytes(duid->bytes, duid->len, secret);
+__extension__ typedef unsigned __int128 u128;
+
+// [lo, hi) of the i-th of n near-equal slices of [0, total)
+static void slice_range(u128 total, unsigned i, unsigned n, u128* lo, u128* hi){
+  *lo = total * i / n;
+  *hi = total * (i + 1) / n;
+}
+
+static uint64_t h64_duid_iaid(const uint8_t* duid, size_t len, uint32_t iaid, uint64_t secret){
+  uint64_t h = hash64_bytes(duid, len, secret);
   h ^= ((uint64_t)iaid << 32) | (uint64_t)iaid;
   return h;
 }
 
-int alloc_addr64(const pool64_t* pool, const duid_t* duid, uint32_t iaid,
-                 lease_store_t* st, struct in6_addr* out_addr)
-{
-  uint64_t now = now_epoch_sec();
+void pool64_shard(pool64_t* pool, unsigned shard, unsigned nshards){
+  if(nshards < 2 || pool->host_end < pool->host_start) return;
+  u128 lo, hi;
+  slice_range((u128)(pool->host_end - pool->host_start) + 1, shard, nshards, &lo, &hi);
+  uint64_t base = pool->host_start;
+  pool->host_start = base + (uint64_t)lo;
+  pool->host_end = base + (uint64_t)hi - 1; // empty slice => end < start
+}
+
+void pdpool_shard(pd_pool_t* pool, unsigned shard, unsigned nshards){
+  pool->shard = (uint16_t)shard;
+  pool->nshards = (uint16_t)nshards;
+}
+
+uint64_t pool64_size(const pool64_t* pool){
+  if(pool->host_end < pool->host_start) return 0;
+  uint64_t n = pool->host_end - pool->host_start + 1;
+  return n ? n : UINT64_MAX;
+}
+
+// shards are cut at min_len blocks with a buddy, at delegated_len
+// (= max_len) blocks when probing
+uint64_t pdpool_units(const pd_pool_t* pool){
+  int top = pool->buddy ? pool->min_len : pool->max_len;
+  if(pool->max_len <= pool->base_len || top <= pool->base_len) return 0;
+  if(pool->max_len - pool->base_len >= 64) return UINT64_MAX;
+  u128 lo = 0, hi = (u128)1 << (top - pool->base_len);
+  if(pool->nshards > 1) slice_range(hi, pool->shard, pool->nshards, &lo, &hi);
+  return (uint64_t)(hi - lo) << (pool->max_len - top);
+}
 
-  uint64_t seed = h64_duid_iaid(duid, iaid, pool->secret);
+int pool64_occ_init(pool64_t* pool){
+  pool64_occ_free(pool);
+  if(pool->host_end < pool->host_start) return 0; // empty pool
   uint64_t range = (pool->host_end - pool->host_start) + 1;
+  if(range == 0 || range > POOL64_BITMAP_MAX) return 0; // probe fallback
+
+  bitmap_t* b = malloc(sizeof(*b));
+  if(!b) return -1;
+  if(bm_init(b, range) < 0){
+    free(b);
+    return -1;
+  }
+  pool->occ = b;
+  return 0;
+}
+
+void pool64_occ_free(pool64_t* pool){
+  if(!pool->occ) return;
+  bm_free(pool->occ);
+  free(pool->occ);
+  pool->occ = NULL;
+}
+
+void pool64_occ_mark(pool64_t* pool, const struct in6_addr* addr, int occupied){
+  if(!pool->occ) return;
+  if(memcmp(addr->s6_addr, pool->prefix64.s6_addr, 8) != 0) return;
 
-  for(uint64_t probe=0; probe<1024 && probe<range; probe++){
-    uint64_t host = pool->host_start + ((seed + probe) % range);
-    struct in6_addr cand;
-    pool64_make_addr(&cand, &pool->prefix64, host);
+  const uint8_t* p = addr->s6_addr + 8;
+  uint64_t host = 0;
+  for(int i=0;i<8;i++) host = (host << 8) | p[i];
+  if(host < pool->host_start || host > pool->host_end) return;
 
-    if(st->v.is_addr_declined(st, &cand, now)) continue;
-    if(st->v.addr_in_use(st, &cand)) continue;
+  if(occupied) bm_set(pool->occ, host - pool->host_start);
+  else bm_clear(pool->occ, host - pool->host_start);
+}
+
+void addr_cand_init(addr_cand_t* c, const pool64_t* pool,
+                    const uint8_t* duid, size_t duid_len, uint32_t iaid){
+  c->pool = pool;
+  c->seed = h64_duid_iaid(duid, duid_len, iaid, pool->secret);
+}
 
-    *out_addr = cand;
+int addr_cand_next(void* arg, unsigned i, struct in6_addr* out, uint8_t* plen){
+  const addr_cand_t* c = arg;
+  const pool64_t* pool = c->pool;
+  if(pool->host_end < pool->host_start) return -1;
+  uint64_t range = (pool->host_end - pool->host_start) + 1;
+  *plen = 128;
+
+  // bitmap: nearest free host at/after the client's stable preference
+  // (the bitmap mirrors the store, so one candidate is enough)
+  if(pool->occ){
+    uint64_t idx;
+    if(i > 0 || bm_find_clear(pool->occ, c->seed % range, &idx) < 0) return -1;
+    pool64_make_addr(out, &pool->prefix64, pool->host_start + idx);
     return 0;
   }
-  return -1;
+
+  if(i >= 1024 || i >= range) return -1;
+  pool64_make_addr(out, &pool->prefix64, pool->host_start + ((c->seed + i) % range));
+  return 0;
+}
+
+int pdpool_occ_init(pd_pool_t* pool){
+  pdpool_occ_free(pool);
+  if(pool->min_len == 0) pool->min_len = pool->delegated_len;
+  if(pool->max_len == 0) pool->max_len = pool->delegated_len;
+  if(pool->min_len > pool->delegated_len) pool->min_len = pool->delegated_len;
+  if(pool->max_len < pool->delegated_len) pool->max_len = pool->delegated_len;
+
+  if(pool->min_len <= pool->base_len || pool->max_len > 128) return 0; // probe fallback
+  if(pool->max_len - pool->base_len > PDPOOL_BUDDY_MAX_BITS) return 0;
+
+  buddy_t* b = malloc(sizeof(*b));
+  if(!b) return -1;
+  int top = pool->max_len - pool->min_len;
+  uint64_t top_blocks = (uint64_t)1 << (pool->min_len - pool->base_len);
+  if(buddy_init(b, top, top_blocks) < 0){
+    free(b);
+    return -1;
+  }
+  if(pool->nshards > 1){
+    u128 lo, hi;
+    slice_range(top_blocks, pool->shard, pool->nshards, &lo, &hi);
+    buddy_limit(b, (uint64_t)lo, (uint64_t)hi);
+  }
+  pool->buddy = b;
+  return 0;
 }
 
-int alloc_prefix_pd(const pd_pool_t* pool, const duid_t* duid, uint32_t iaid,
-                    uint8_t hint_len, int has_hint_len,
-                    lease_store_t* st, struct in6_addr* out_prefix, uint8_t* out_plen)
+void pdpool_occ_free(pd_pool_t* pool){
+  if(!pool->buddy) return;
+  buddy_free(pool->buddy);
+  free(pool->buddy);
+  pool->buddy = NULL;
+}
+
+void pdpool_occ_mark(pd_pool_t* pool, const struct in6_addr* pfx, uint8_t plen, int occupied){
+  if(!pool->buddy) return;
+  if(plen < pool->min_len || plen > pool->max_len) return;
+  uint64_t idx;
+  if(pdpool_prefix_index(pfx, &pool->base_prefix, pool->base_len, plen, &idx) < 0) return;
+
+  int order = pool->max_len - plen;
+  if(occupied) buddy_reserve(pool->buddy, order, idx);
+  else buddy_release(pool->buddy, order, idx);
+}
+
+void pd_cand_init(pd_cand_t* c, const pd_pool_t* pool,
+                  const uint8_t* duid, size_t duid_len, uint32_t iaid,
+                  uint8_t hint_len, int has_hint_len)
 {
-  uint64_t now = now_epoch_sec();
+  memset(c, 0, sizeof(*c));
+  c->pool = pool;
+  uint64_t h = h64_duid_iaid(duid, duid_len, iaid, pool->secret);
+
+  // buddy: any length in [min_len, max_len]; hint 0 means "no preference"
+  if(pool->buddy){
+    uint8_t plen = pool->delegated_len;
+    if(has_hint_len && hint_len != 0){
+      plen = hint_len;
+      if(plen < pool->min_len) plen = pool->min_len;
+      if(plen > pool->max_len) plen = pool->max_len;
+    }
+    // prefer a block inside this shard's slice (same slice at every order)
+    u128 lo = 0, hi = (u128)1 << (plen - pool->base_len);
+    if(pool->nshards > 1){
+      int shift = plen - pool->min_len;
+      slice_range((u128)1 << (pool->min_len - pool->base_len), pool->shard, pool->nshards, &lo, &hi);
+      lo <<= shift;
+      hi <<= shift;
+    }
+    if(hi == lo) return;
+    c->plen = plen;
+    c->seed = (uint64_t)lo + h % (uint64_t)(hi - lo);
+    c->blocks = 1;
+    return;
+  }
 
   uint8_t plen = pool->delegated_len;
   // minimal “RFC-friendly” hint handling: accept only if matches our supported len
@@ -43,22 +194,32 @@ int alloc_prefix_pd(const pd_pool_t* pool, const duid_t* duid, uint32_t iaid,
   }
 
   int bits = (int)plen - (int)pool->base_len;
-  if(bits <= 0 || bits > 63) return -1; // keep within uint64_t indexing for minimal impl
-
-  uint64_t blocks = 1ULL << bits;
-  uint64_t seed = h64_duid_iaid(duid, iaid, pool->secret) % blocks;
+  if(bits <= 0 || bits > 63) return; // keep within uint64_t indexing for minimal impl
 
-  for(uint64_t probe=0; probe<1024 && probe<blocks; probe++){
-    uint64_t idx = (seed + probe) % blocks;
-    struct in6_addr cand;
-    pdpool_make_prefix(&cand, &pool->base_prefix, pool->base_len, plen, idx);
+  u128 lo = 0, hi = (u128)1 << bits;
+  if(pool->nshards > 1) slice_range(hi, pool->shard, pool->nshards, &lo, &hi);
+  c->plen = plen;
+  c->lo = (uint64_t)lo;
+  c->blocks = (uint64_t)(hi - lo);
+  if(c->blocks) c->seed = h % c->blocks;
+}
 
-    if(st->v.is_prefix_declined(st, &cand, plen, now)) continue;
-    if(st->v.prefix_in_use(st, &cand, plen)) continue;
+int pd_cand_next(void* arg, unsigned i, struct in6_addr* out, uint8_t* plen){
+  const pd_cand_t* c = arg;
+  const pd_pool_t* pool = c->pool;
 
-    *out_prefix = cand;
-    *out_plen = plen;
+  if(pool->buddy){
+    uint64_t blk;
+    if(i > 0 || !c->blocks) return -1;
+    if(buddy_find(pool->buddy, pool->max_len - c->plen, c->seed, &blk) < 0) return -1;
+    pdpool_make_prefix(out, &pool->base_prefix, pool->base_len, c->plen, blk);
+    *plen = c->plen;
     return 0;
   }
-  return -1;
+
+  if(i >= 1024 || i >= c->blocks) return -1;
+  uint64_t idx = c->lo + (c->seed + i) % c->blocks;
+  pdpool_make_prefix(out, &pool->base_prefix, pool->base_len, c->plen, idx);
+  *plen = c->plen;
+  return 0;
 }
@@ -1,15 +1,57 @@
 #pragma once
 #include <stdint.h>
 #include <netinet/in.h>
-#include "dhcp/duid.h"
 #include "alloc/pool.h"
 #include "store/lease_store.h"
 
-// Address allocator
-int alloc_addr64(const pool64_t* pool, const duid_t* duid, uint32_t iaid,
-                 lease_store_t* st, struct in6_addr* out_addr);
+// ranges wider than this keep the hash-probe allocator (no bitmap)
+#define POOL64_BITMAP_MAX ((uint64_t)1 << 24)
 
-// Prefix allocator
-int alloc_prefix_pd(const pd_pool_t* pool, const duid_t* duid, uint32_t iaid,
-                    uint8_t hint_len, int has_hint_len,
-                    lease_store_t* st, struct in6_addr* out_prefix, uint8_t* out_plen);
+// Worker sharding: narrow a pool to the shard-th of nshards disjoint slices
+// (call before *_occ_init)
+void pool64_shard(pool64_t* pool, unsigned shard, unsigned nshards);
+void pdpool_shard(pd_pool_t* pool, unsigned shard, unsigned nshards);
+
+// addresses in the (sharded) pool; /max_len blocks of a PD pool's
+// shard (after pdpool_occ_init), UINT64_MAX when wider than that
+uint64_t pool64_size(const pool64_t* pool);
+uint64_t pdpool_units(const pd_pool_t* pool);
+
+// Address pool occupancy map, kept in sync from lease_store_t.on_occ
+int  pool64_occ_init(pool64_t* pool);
+void pool64_occ_free(pool64_t* pool);
+void pool64_occ_mark(pool64_t* pool, const struct in6_addr* addr, int occupied);
+
+// PD pools: buddy allocator when (max_len - base_len) fits this many unit bits
+#define PDPOOL_BUDDY_MAX_BITS 24
+
+int  pdpool_occ_init(pd_pool_t* pool);
+void pdpool_occ_free(pd_pool_t* pool);
+void pdpool_occ_mark(pd_pool_t* pool, const struct in6_addr* pfx, uint8_t plen, int occupied);
+
+/*
+ * Allocators are candidate generators (lease_cand_fn) for the store's
+ * acquire_na/acquire_pd: candidates come in preference order (the client's
+ * stable hash slot first) and the store rejects taken or declined ones in
+ * the same pass that claims the lease slot.
+ */
+typedef struct {
+  const pool64_t* pool;
+  uint64_t seed;
+} addr_cand_t;
+
+void addr_cand_init(addr_cand_t* c, const pool64_t* pool,
+                    const uint8_t* duid, size_t duid_len, uint32_t iaid);
+int  addr_cand_next(void* arg, unsigned i, struct in6_addr* out, uint8_t* plen);
+
+// PD: hint_len is clamped to [min_len, max_len] when a buddy is present
+typedef struct {
+  const pd_pool_t* pool;
+  uint8_t plen;
+  uint64_t lo, blocks, seed;
+} pd_cand_t;
+
+void pd_cand_init(pd_cand_t* c, const pd_pool_t* pool,
+                  const uint8_t* duid, size_t duid_len, uint32_t iaid,
+                  uint8_t hint_len, int has_hint_len);
+int  pd_cand_next(void* arg, unsigned i, struct in6_addr* out, uint8_t* plen);
@@ -0,0 +1,110 @@
+#include "alloc/bitmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FULL (~(uint64_t)0)
+
+int bm_init(bitmap_t* b, uint64_t nbits){
+  memset(b, 0, sizeof(*b));
+  if(nbits == 0) return -1;
+  b->nbits = nbits;
+
+  uint64_t n = nbits;
+  do{
+    if(b->levels == BM_MAX_LEVELS){
+      bm_free(b);
+      return -1;
+    }
+    uint64_t words = (n + 63) / 64;
+    b->lv[b->levels] = calloc(words, sizeof(uint64_t));
+    if(!b->lv[b->levels]){
+      bm_free(b);
+      return -1;
+    }
+    b->nwords[b->levels] = words;
+    // padding past the last real bit reads as taken
+    if(n % 64) b->lv[b->levels][words-1] = FULL << (n % 64);
+    b->levels++;
+    n = words;
+  }while(n > 1);
+
+  // a padded word may already be full; reflect that upwards
+  for(int l=0; l+1<b->levels; l++){
+    uint64_t w = b->nwords[l] - 1;
+    if(b->lv[l][w] == FULL) b->lv[l+1][w >> 6] |= (uint64_t)1 << (w & 63);
+  }
+  return 0;
+}
+
+void bm_free(bitmap_t* b){
+  for(int l=0;l<b->levels;l++) free(b->lv[l]);
+  memset(b, 0, sizeof(*b));
+}
+
+void bm_fill(bitmap_t* b){
+  for(int l=0;l<b->levels;l++) memset(b->lv[l], 0xff, b->nwords[l] * sizeof(uint64_t));
+  b->nset = b->nbits;
+}
+
+void bm_set(bitmap_t* b, uint64_t i){
+  if(i >= b->nbits) return;
+  for(int l=0;l<b->levels;l++){
+    uint64_t* w = &b->lv[l][i >> 6];
+    uint64_t bit = (uint64_t)1 << (i & 63);
+    if(*w & bit) return;
+    *w |= bit;
+    if(l == 0) b->nset++;
+    if(*w != FULL) return;
+    i >>= 6;
+  }
+}
+
+void bm_clear(bitmap_t* b, uint64_t i){
+  if(i >= b->nbits) return;
+  for(int l=0;l<b->levels;l++){
+    uint64_t* w = &b->lv[l][i >> 6];
+    uint64_t bit = (uint64_t)1 << (i & 63);
+    if(!(*w & bit)) return;
+    int was_full = (*w == FULL);
+    *w &= ~bit;
+    if(l == 0) b->nset--;
+    if(!was_full) return;
+    i >>= 6;
+  }
+}
+
+int bm_test(const bitmap_t* b, uint64_t i){
+  if(i >= b->nbits) return 1;
+  return (int)((b->lv[0][i >> 6] >> (i & 63)) & 1);
+}
+
+static int find_from(const bitmap_t* b, uint64_t pos, uint64_t* out){
+  uint64_t idx = pos;
+  int l = 0;
+  for(;;){
+    uint64_t w = idx >> 6;
+    if(w >= b->nwords[l]) return -1;
+    uint64_t bits = ~b->lv[l][w] & (FULL << (idx & 63));
+    if(bits){
+      idx = (w << 6) + (uint64_t)__builtin_ctzll(bits);
+      break;
+    }
+    // rest of this word is taken: ask the level above for the next non-full word
+    if(l + 1 == b->levels) return -1;
+    idx = w + 1;
+    l++;
+  }
+  while(l > 0){
+    l--;
+    idx = (idx << 6) + (uint64_t)__builtin_ctzll(~b->lv[l][idx]);
+  }
+  *out = idx;
+  return 0;
+}
+
+int bm_find_clear(const bitmap_t* b, uint64_t from, uint64_t* out){
+  if(b->nset >= b->nbits) return -1;
+  if(from >= b->nbits) from = 0;
+  if(find_from(b, from, out) == 0) return 0;
+  return find_from(b, 0, out);
+}
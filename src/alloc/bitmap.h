@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Hierarchical occupancy bitmap (1 = taken).
+ * Level 0 holds one bit per item; a bit at level l+1 is set when the
+ * matching 64-bit word at level l is full. Levels are added until the
+ * top is a single word, so finding a clear bit is one ctz per level.
+ */
+
+#define BM_MAX_LEVELS 6   // 64^6 = 2^36 items
+
+typedef struct {
+  uint64_t nbits;
+  uint64_t nset;
+  int levels;
+  uint64_t nwords[BM_MAX_LEVELS];
+  uint64_t* lv[BM_MAX_LEVELS];
+} bitmap_t;
+
+int  bm_init(bitmap_t* b, uint64_t nbits);
+void bm_free(bitmap_t* b);
+
+void bm_fill(bitmap_t* b); // mark every bit taken
+void bm_set(bitmap_t* b, uint64_t i);
+void bm_clear(bitmap_t* b, uint64_t i);
+int  bm_test(const bitmap_t* b, uint64_t i);
+
+// first clear bit at or after from, wrapping to 0; -1 when every bit is set
+int  bm_find_clear(const bitmap_t* b, uint64_t from, uint64_t* out);
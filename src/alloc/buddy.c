@@ -0,0 +1,101 @@
+#include "alloc/buddy.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int is_free(const buddy_t* b, int o, uint64_t blk){
+  return !bm_test(&b->free_[o], blk);
+}
+
+int buddy_init(buddy_t* b, int top, uint64_t top_blocks){
+  memset(b, 0, sizeof(*b));
+  if(top < 0 || top > 62 || top_blocks == 0) return -1;
+  b->top = top;
+  b->top_blocks = top_blocks;
+  b->free_ = calloc((size_t)top + 1, sizeof(bitmap_t));
+  b->used  = calloc((size_t)top + 1, sizeof(bitmap_t));
+  if(!b->free_ || !b->used){
+    buddy_free(b);
+    return -1;
+  }
+  for(int o=0;o<=top;o++){
+    uint64_t n = top_blocks << (top - o);
+    if(bm_init(&b->free_[o], n) < 0 || bm_init(&b->used[o], n) < 0){
+      buddy_free(b);
+      return -1;
+    }
+    // only whole top-order blocks start out free
+    if(o < top) bm_fill(&b->free_[o]);
+  }
+  b->free_units = top_blocks << top;
+  return 0;
+}
+
+void buddy_free(buddy_t* b){
+  for(int o=0; o<=b->top; o++){
+    if(b->free_) bm_free(&b->free_[o]);
+    if(b->used) bm_free(&b->used[o]);
+  }
+  free(b->free_);
+  free(b->used);
+  memset(b, 0, sizeof(*b));
+}
+
+void buddy_limit(buddy_t* b, uint64_t lo, uint64_t hi){
+  for(uint64_t k=0; k<b->top_blocks; k++){
+    if(k >= lo && k < hi) continue;
+    if(!is_free(b, b->top, k)) continue;
+    bm_set(&b->free_[b->top], k);
+    b->free_units -= (uint64_t)1 << b->top;
+  }
+}
+
+int buddy_find(const buddy_t* b, int order, uint64_t pref, uint64_t* out){
+  if(order < 0 || order > b->top) return -1;
+  uint64_t blk;
+  if(bm_find_clear(&b->free_[order], pref, &blk) == 0){
+    *out = blk;
+    return 0;
+  }
+  for(int j=order+1; j<=b->top; j++){
+    uint64_t pj = pref >> (j - order);
+    if(bm_find_clear(&b->free_[j], pj, &blk) == 0){
+      *out = (blk == pj) ? pref : (blk << (j - order));
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int buddy_reserve(buddy_t* b, int order, uint64_t blk){
+  if(order < 0 || order > b->top) return -1;
+  if(blk >= b->used[order].nbits) return -1;
+  if(bm_test(&b->used[order], blk)) return 0;
+
+  int j = order;
+  while(j <= b->top && !is_free(b, j, blk >> (j - order))) j++;
+  if(j > b->top) return -1; // overlaps something already handed out
+
+  // take the free ancestor and hand back the sibling at every split
+  bm_set(&b->free_[j], blk >> (j - order));
+  for(int k=j-1; k>=order; k--){
+    bm_clear(&b->free_[k], (blk >> (k - order)) ^ 1);
+  }
+  bm_set(&b->used[order], blk);
+  b->free_units -= (uint64_t)1 << order;
+  return 0;
+}
+
+int buddy_release(buddy_t* b, int order, uint64_t blk){
+  if(order < 0 || order > b->top) return -1;
+  if(blk >= b->used[order].nbits || !bm_test(&b->used[order], blk)) return -1;
+  bm_clear(&b->used[order], blk);
+  b->free_units += (uint64_t)1 << order;
+
+  while(order < b->top && is_free(b, order, blk ^ 1)){
+    bm_set(&b->free_[order], blk ^ 1);
+    blk >>= 1;
+    order++;
+  }
+  bm_clear(&b->free_[order], blk);
+  return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+#include "alloc/bitmap.h"
+
+/*
+ * Binary buddy allocator over block indexes.
+ * Order 0 is the smallest block (one unit); a block at order o spans
+ * 2^o units and splits into blocks 2b and 2b+1 of order o-1.
+ * Each order keeps a free set (hierarchical bitmap, clear bit = free),
+ * so "nearest free block to a preferred index" is a few word scans, and
+ * an allocated set so release/reserve are exact and idempotent.
+ */
+
+typedef struct {
+  int top;              // highest order; blocks there are the largest
+  uint64_t top_blocks;  // number of top-order blocks
+  bitmap_t* free_;      // [top+1]
+  bitmap_t* used;       // [top+1]
+  uint64_t free_units;
+} buddy_t;
+
+int  buddy_init(buddy_t* b, int top, uint64_t top_blocks);
+void buddy_free(buddy_t* b);
+
+// restrict allocation to top-order blocks [lo, hi); the rest is never free
+void buddy_limit(buddy_t* b, uint64_t lo, uint64_t hi);
+
+// block of the given order that buddy_reserve() would hand out for pref:
+// the nearest free block of that exact order, else a piece of the nearest
+// larger free block (the one holding pref when that block is free).
+int  buddy_find(const buddy_t* b, int order, uint64_t pref, uint64_t* out);
+
+// take a specific block (splitting the free block that contains it)
+int  buddy_reserve(buddy_t* b, int order, uint64_t blk);
+
+// give a block back, coalescing with free buddies
+int  buddy_release(buddy_t* b, int order, uint64_t blk);
@@ -17,34 +17,46 @@ void pool64_make_addr(struct in6_addr* out, const struct in6_addr* prefix64, uin
   p[15] = (uint8_t)(host);
 }
 
-// base_prefix/base_len -> delegated_len prefix by setting next bits from block_index
-// We treat IPv6 as 128-bit bitstring.
-static inline int get_bit(const uint8_t a[16], int bit){
-  int byte = bit/8;
-  int off = 7 - (bit%8);
-  return (a[byte] >> off) & 1;
+// IPv6 address as one 128-bit integer (network order in, host order value)
+__extension__ typedef unsigned __int128 u128;
+
+static u128 in6_to_u128(const struct in6_addr* a){
+  u128 v = 0;
+  for(int i=0;i<16;i++) v = (v << 8) | a->s6_addr[i];
+  return v;
+}
+static void u128_to_in6(u128 v, struct in6_addr* a){
+  for(int i=15;i>=0;i--){
+    a->s6_addr[i] = (uint8_t)v;
+    v >>= 8;
+  }
 }
-static inline void set_bit(uint8_t a[16], int bit, int v){
-  int byte = bit/8;
-  int off = 7 - (bit%8);
-  if(v) a[byte] |= (1u<<off);
-  else  a[byte] &= ~(1u<<off);
+static u128 mask128(uint8_t len){
+  if(len == 0) return 0;
+  if(len >= 128) return ~(u128)0;
+  return ~(u128)0 << (128 - len);
 }
+
+// base_prefix/base_len -> delegated_len prefix: bits [base_len, delegated_len)
+// come from block_index, everything after delegated_len is zero
 void pdpool_make_prefix(struct in6_addr* out_prefix, const struct in6_addr* base_prefix,
                         uint8_t base_len, uint8_t delegated_len, uint64_t block_index)
 {
-  *out_prefix = *base_prefix;
-
-  // fill bits [base_len, delegated_len) from block_index MSB->LSB
-  int bits = (int)delegated_len - (int)base_len;
-  for(int i=0;i<bits;i++){
-    int bitpos = (int)base_len + i;
-    int shift = bits - 1 - i;
-    int b = (block_index >> shift) & 1;
-    set_bit(out_prefix->s6_addr, bitpos, b);
-  }
-  // zero remaining bits [delegated_len, 128)
-  for(int bit=(int)delegated_len; bit<128; bit++){
-    set_bit(out_prefix->s6_addr, bit, 0);
+  u128 v = in6_to_u128(base_prefix) & mask128(base_len);
+  if(delegated_len > base_len && delegated_len <= 128){
+    v |= ((u128)block_index << (128 - delegated_len)) & mask128(delegated_len) & ~mask128(base_len);
   }
+  u128_to_in6(v, out_prefix);
+}
+
+int pdpool_prefix_index(const struct in6_addr* prefix, const struct in6_addr* base_prefix,
+                        uint8_t base_len, uint8_t plen, uint64_t* out_index)
+{
+  if(plen < base_len || plen > 128 || plen - base_len > 63) return -1;
+  u128 v = in6_to_u128(prefix);
+  u128 base = in6_to_u128(base_prefix) & mask128(base_len);
+  if((v & mask128(base_len)) != base) return -1;
+  if(v & ~mask128(plen)) return -1;
+  *out_index = (plen == base_len) ? 0 : (uint64_t)((v & ~mask128(base_len)) >> (128 - plen));
+  return 0;
 }
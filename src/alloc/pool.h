@@ -1,6 +1,8 @@
 #pragma once
 #include <stdint.h>
 #include <netinet/in.h>
+#include "alloc/bitmap.h"
+#include "alloc/buddy.h"
 
 // /64 기반 host-range 주소 풀
 typedef struct {
@@ -15,6 +17,9 @@ typedef struct {
   uint32_t valid_lft;
 
   uint64_t secret;
+
+  // host_start..host_end 점유 비트맵 (bound + declined); NULL이면 hash probe
+  bitmap_t* occ;
 } pool64_t;
 
 // PD 풀: base prefix에서 delegated_len 단위로 위임
@@ -24,14 +29,26 @@ typedef struct {
 
   struct in6_addr base_prefix;
   uint8_t base_len;       // e.g. 40, 48
-  uint8_t delegated_len;  // e.g. 56, 60
+  uint8_t delegated_len;  // e.g. 56, 60 (hint가 없을 때 기본값)
+  uint8_t min_len;        // hint 허용 범위, e.g. 48 (0이면 delegated_len)
+  uint8_t max_len;        // e.g. 64 (0이면 delegated_len)
 
   uint32_t preferred_lft;
   uint32_t valid_lft;
 
   uint64_t secret;
+
+  // worker shard: 블록 인덱스 공간의 shard번째 1/nshards 구간만 사용 (nshards<2: 전체)
+  uint16_t shard;
+  uint16_t nshards;
+
+  // order 0 = /max_len 블록; NULL이면 delegated_len 고정 hash probe
+  buddy_t* buddy;
 } pd_pool_t;
 
 void pool64_make_addr(struct in6_addr* out, const struct in6_addr* prefix64, uint64_t host);
 void pdpool_make_prefix(struct in6_addr* out_prefix, const struct in6_addr* base_prefix,
                         uint8_t base_len, uint8_t delegated_len, uint64_t block_index);
+// inverse of pdpool_make_prefix; -1 unless prefix is an aligned /plen block inside base
+int  pdpool_prefix_index(const struct in6_addr* prefix, const struct in6_addr* base_prefix,
+                         uint8_t base_len, uint8_t plen, uint64_t* out_index);
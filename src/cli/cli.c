@@ -12,9 +12,22 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <poll.h>
 
 static int cli_fd = -1;
 static server_ctx_t* g_ctx = NULL;
+static reactor_t* g_rx = NULL;
+static dh6_worker_t* g_workers = NULL;
+static int g_nw = 0;
+static reactor_ev_t listen_ev;
+
+typedef struct {
+  reactor_ev_t ev;   // first: the reactor hands back &ev
+} cli_conn_t;
+
+static void on_listen(reactor_ev_t* ev, uint32_t events);
 
 static void set_nonblock(int fd){
   int flags = fcntl(fd, F_GETFL, 0);
@@ -23,21 +36,122 @@ static void set_nonblock(int fd){
   }
 }
 
-static void write_all(int fd, const char* s){
-  size_t len = strlen(s);
+// the socket is non-blocking: a long answer waits (briefly) for the reader
+static void write_buf(int fd, const char* s, size_t len){
   size_t off = 0;
   while(off < len){
     ssize_t n = write(fd, s + off, len - off);
     if(n < 0){
       if(errno == EINTR) continue;
+      struct pollfd p = { .fd = fd, .events = POLLOUT };
+      if((errno == EAGAIN || errno == EWOULDBLOCK) && poll(&p, 1, 1000) > 0) continue;
       break;
     }
     off += (size_t)n;
   }
 }
 
-int cli_init(server_ctx_t* ctx, const char* path){
+static void write_all(int fd, const char* s){
+  write_buf(fd, s, strlen(s));
+}
+
+static void show_stats(int fd, int prometheus){
+  dh6_stats_t* v[g_nw > 0 ? g_nw : 1];
+  for(int i=0;i<g_nw;i++) v[i] = g_workers[i].stats;
+
+  char* text = NULL;
+  size_t len = 0;
+  FILE* f = open_memstream(&text, &len);
+  if(!f){
+    write_all(fd, "ERROR\n");
+    return;
+  }
+  if(!prometheus) fputs("OK\n", f);
+  dh6_stats_print(f, v, g_nw, prometheus);
+  fclose(f);
+  write_buf(fd, text, len);
+  free(text);
+}
+
+static const char* const table_name[MEM_NTABLES] = {
+  "na", "pd", "addr_idx", "pfx_idx", "declined_addr", "declined_pfx", "duid_idx",
+};
+
+static uint64_t load_u64(const uint64_t* c){
+  return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+static uint64_t sat_add(uint64_t a, uint64_t b){
+  return a + b < a ? UINT64_MAX : a + b;
+}
+
+static void print_use(FILE* f, uint32_t id, const char* kind, const dh6_pool_use_t* u){
+  uint64_t free_ = u->size > u->taken ? u->size - u->taken : 0;
+  double pct = u->size ? 100.0 * (double)u->taken / (double)u->size : 0;
+  fprintf(f, "%-8u %-4s %20llu %12llu %7.2f%% %20llu %12llu %12llu %12llu\n", id, kind,
+          (unsigned long long)u->size, (unsigned long long)u->taken, pct, (unsigned long long)free_,
+          (unsigned long long)u->offered, (unsigned long long)u->allocated, (unsigned long long)u->declined);
+}
+
+static void add_use(dh6_pool_use_t* sum, const dh6_pool_use_t* u){
+  sum->size = sat_add(sum->size, load_u64(&u->size));
+  sum->taken += load_u64(&u->taken);
+  sum->offered += load_u64(&u->offered);
+  sum->allocated += load_u64(&u->allocated);
+  sum->declined += load_u64(&u->declined);
+}
+
+// lease tables per worker (as of its last tick), then every subnet's pools
+// summed over the workers' slices; subnets no request has reached yet
+// have no maps (size 0) and are left out. PD space is in /max_len blocks.
+static void show_store(int fd){
+  char* text = NULL;
+  size_t len = 0;
+  FILE* f = open_memstream(&text, &len);
+  if(!f){
+    write_all(fd, "ERROR\n");
+    return;
+  }
+  fputs("OK\n", f);
+  fprintf(f, "%-6s %-14s %12s %12s %12s %7s %9s %9s\n",
+          "worker", "table", "count", "tomb", "cap", "load", "avg_probe", "max_probe");
+  for(int w=0;w<g_nw;w++){
+    htab_stat_t t[MEM_NTABLES];
+    pthread_mutex_lock(&g_workers[w].tab_mu);
+    memcpy(t, g_workers[w].tab, sizeof(t));
+    pthread_mutex_unlock(&g_workers[w].tab_mu);
+    for(int i=0;i<MEM_NTABLES;i++){
+      double load = t[i].cap ? 100.0 * (double)(t[i].count + t[i].tomb) / (double)t[i].cap : 0;
+      double avg = t[i].count ? (double)t[i].probe_sum / (double)t[i].count : 0;
+      fprintf(f, "%-6d %-14s %12zu %12zu %12zu %6.2f%% %9.3f %9zu%s\n", w, table_name[i],
+              t[i].count, t[i].tomb, t[i].cap, load, avg, t[i].max_probe, t[i].resizing ? " resizing" : "");
+    }
+  }
+
+  fprintf(f, "%-8s %-4s %20s %12s %8s %20s %12s %12s %12s\n",
+          "subnet", "kind", "size", "taken", "used", "free", "offered", "allocated", "declined");
+  const dh6_subnets_t* sn = &g_ctx->subnets;
+  for(uint32_t i=0;i<sn->n;i++){
+    dh6_pool_use_t na, pd;
+    memset(&na, 0, sizeof(na));
+    memset(&pd, 0, sizeof(pd));
+    for(int w=0;w<g_nw;w++){
+      add_use(&na, &g_workers[w].ctx.pools[i].na_use);
+      add_use(&pd, &g_workers[w].ctx.pools[i].pd_use);
+    }
+    if(na.size) print_use(f, sn->v[i].id, "na", &na);
+    if(pd.size) print_use(f, sn->v[i].id, "pd", &pd);
+  }
+  fclose(f);
+  write_buf(fd, text, len);
+  free(text);
+}
+
+int cli_init(server_ctx_t* ctx, const char* path, reactor_t* r, dh6_worker_t* workers, int nw){
   g_ctx = ctx;
+  g_rx = r;
+  g_workers = workers;
+  g_nw = nw;
 
   cli_fd = socket(AF_UNIX, SOCK_STREAM, 0);
   if(cli_fd < 0){
@@ -67,38 +181,72 @@ int cli_init(server_ctx_t* ctx, const char* path){
     return -1;
   }
 
+  if(reactor_add(r, &listen_ev, cli_fd, EPOLLIN, on_listen, NULL) < 0){
+    close(cli_fd);
+    cli_fd = -1;
+    return -1;
+  }
+
   log_printf(LOG_INFO, "CLI listening on %s", path);
   return 0;
 }
 
-int cli_get_fd(void){
-  return cli_fd;
+void cli_close(void){
+  if(cli_fd < 0) return;
+  reactor_del(g_rx, &listen_ev);
+  close(cli_fd);
+  cli_fd = -1;
 }
 
-static void handle_command(int cfd){
+// 0 = done (close), -1 = nothing to read yet
+static int handle_command(int cfd){
   char buf[256];
   ssize_t n = read(cfd, buf, sizeof(buf)-1);
-  if(n <= 0) return;
+  if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return -1;
+  if(n <= 0) return 0;
   buf[n] = 0;
 
-  if(strncmp(buf, "show config", 11) == 0){
+  if(strncmp(buf, "show stats", 10) == 0){
+    show_stats(cfd, strstr(buf + 10, "prometheus") != NULL);
+  }
+  else if(strncmp(buf, "show store", 10) == 0){
+    show_store(cfd);
+  }
+  else if(strncmp(buf, "show config", 11) == 0){
     write_all(cfd, "OK\n");
     config_dump(g_ctx);
   }
   else if(strncmp(buf, "set log", 7) == 0){
-    if(strstr(buf, "DEBUG")) log_set_level(LOG_DEBUG);
-    else if(strstr(buf, "INFO")) log_set_level(LOG_INFO);
-    else if(strstr(buf, "WARN")) log_set_level(LOG_WARN);
-    else if(strstr(buf, "ERROR")) log_set_level(LOG_ERR);
-    write_all(cfd, "OK\n");
+    // set log <LEVEL> [<sample> <rate>]: the limits apply to that level
+    char lv[16];
+    unsigned sample, rate;
+    log_level_t l;
+    int n = sscanf(buf + 7, "%15s %u %u", lv, &sample, &rate);
+    if(n >= 1 && log_level_parse(lv, &l) == 0 && n != 2){
+      log_set_level(l);
+      if(n == 3) log_set_limit(l, sample, rate);
+      write_all(cfd, "OK\n");
+    }else{
+      write_all(cfd, "ERROR\n");
+    }
   }
   else{
     write_all(cfd, "UNKNOWN COMMAND\n");
   }
+  return 0;
 }
 
-void cli_handle(void){
-  if(cli_fd < 0) return;
+static void on_conn(reactor_ev_t* ev, uint32_t events){
+  cli_conn_t* c = (cli_conn_t*)ev;
+  int more = (events & EPOLLIN) ? handle_command(ev->fd) < 0 : 0;
+  if(more && !(events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP))) return;
+
+  reactor_del_owned(g_rx, &c->ev);
+  free(c);
+}
+
+static void on_listen(reactor_ev_t* ev, uint32_t events){
+  (void)ev; (void)events;
 
   while(1){
     int cfd = accept(cli_fd, NULL, NULL);
@@ -110,7 +258,10 @@ void cli_handle(void){
     }
 
     set_nonblock(cfd);
-    handle_command(cfd);
-    close(cfd);
+    cli_conn_t* c = calloc(1, sizeof(*c));
+    if(!c || reactor_add(g_rx, &c->ev, cfd, EPOLLIN | EPOLLRDHUP, on_conn, NULL) < 0){
+      free(c);
+      close(cfd);
+    }
   }
 }
@@ -1,13 +1,20 @@
 #pragma once
 #include "dhcp/handlers.h"
+#include "net/reactor.h"
+#include "worker/worker.h"
 
 /*
  * Non-blocking CLI over UNIX domain socket
- * - cli_init(): create + bind + listen (non-blocking)
- * - cli_get_fd(): return listening fd
- * - cli_handle(): accept() + handle client command (non-blocking)
+ * - cli_init(): create + bind + listen (non-blocking), register on reactor
+ * - accepted connections are registered too and served when readable
+ * - cli_close(): deregister + close listener
+ *
+ * Commands: "show config" (to the log), "set log <LEVEL> [<sample> <rate>]"
+ * (level, and its sampling/rate limit, see util/log.h),
+ * "show stats [prometheus]" (packet counters and handling times of
+ * every worker, see dhcp/stats.h), "show store" (lease table load and
+ * probe lengths per worker, pool utilisation per subnet)
  */
 
-int cli_init(server_ctx_t* ctx, const char* path);
-int cli_get_fd(void);
-void cli_handle(void);
+int cli_init(server_ctx_t* ctx, const char* path, reactor_t* r, dh6_worker_t* workers, int nw);
+void cli_close(void);
@@ -19,6 +19,13 @@ int config_load(const char* path, server_ctx_t* ctx){
     return -1;
   }
 
+  // pool keys go to the current subnet: subnet 0 until the first "subnet="
+  if(dh6_subnets_init(&ctx->subnets) < 0){
+    fclose(f);
+    return -1;
+  }
+  uint32_t cur = 0;
+
   char line[256];
   while(fgets(line, sizeof(line), f)){
     if(line[0]=='#' || line[0]=='\n') continue;
@@ -30,12 +37,22 @@ int config_load(const char* path, server_ctx_t* ctx){
     char* key = line;
     char* val = eq+1;
     trim(key); trim(val);
+    dh6_subnet_t* sn = &ctx->subnets.v[cur];
+    if(strncmp(key, "na_", 3) == 0 || strncmp(key, "pd_", 3) == 0) sn->used = 1;
 
     if(strcmp(key,"log_level")==0){
-      if(strcmp(val,"DEBUG")==0) log_set_level(LOG_DEBUG);
-      else if(strcmp(val,"INFO")==0) log_set_level(LOG_INFO);
-      else if(strcmp(val,"WARN")==0) log_set_level(LOG_WARN);
-      else if(strcmp(val,"ERROR")==0) log_set_level(LOG_ERR);
+      log_level_t l;
+      if(log_level_parse(val, &l) == 0) log_set_level(l);
+    }
+    else if(strcmp(key,"log_limit")==0){
+      // LEVEL sample rate: keep 1 in sample, at most rate per second
+      char lv[16];
+      unsigned sample, rate;
+      log_level_t l;
+      if(sscanf(val, "%15s %u %u", lv, &sample, &rate) == 3 && log_level_parse(lv, &l) == 0)
+        log_set_limit(l, sample, rate);
+      else
+        log_printf(LOG_WARN, "config: bad log_limit '%s'", val);
     }
     else if(strcmp(key,"offer_ttl")==0){
       ctx->offer_ttl = atoi(val);
@@ -49,27 +66,79 @@ int config_load(const char* path, server_ctx_t* ctx){
     else if(strcmp(key,"valid_lifetime")==0){
       ctx->valid_lft = atoi(val);
     }
+    else if(strcmp(key,"subnet")==0){
+      dh6_prefix_t link;
+      if(dh6_prefix_parse(val, &link) < 0){
+        log_printf(LOG_WARN, "config: bad subnet link prefix '%s'", val);
+        continue;
+      }
+      if(!(sn = dh6_subnet_add(&ctx->subnets))){
+        log_printf(LOG_ERR, "config: out of memory at subnet %u", ctx->subnets.n);
+        break;
+      }
+      cur = sn->id;
+      dh6_subnet_add_link(sn, &link);
+    }
+    else if(strcmp(key,"link")==0){
+      dh6_prefix_t link;
+      if(dh6_prefix_parse(val, &link) < 0 || dh6_subnet_add_link(sn, &link) < 0)
+        log_printf(LOG_WARN, "config: subnet %u: bad link '%s' (at most %d)", sn->id, val, DH6_SUBNET_LINKS);
+    }
+    else if(strcmp(key,"interface")==0){
+      snprintf(sn->ifname, sizeof(sn->ifname), "%s", val);
+    }
     else if(strcmp(key,"na_prefix")==0){
       char* slash = strchr(val,'/');
       if(!slash) continue;
       *slash = 0;
-      inet_pton(AF_INET6, val, &ctx->na_pool.prefix64);
+      inet_pton(AF_INET6, val, &sn->na.prefix64);
     }
     else if(strcmp(key,"na_host_start")==0){
-      ctx->na_pool.host_start = strtoull(val,NULL,0);
+      sn->na.host_start = strtoull(val,NULL,0);
     }
     else if(strcmp(key,"na_host_end")==0){
-      ctx->na_pool.host_end = strtoull(val,NULL,0);
+      sn->na.host_end = strtoull(val,NULL,0);
     }
     else if(strcmp(key,"pd_base_prefix")==0){
       char* slash = strchr(val,'/');
       if(!slash) continue;
       *slash = 0;
-      inet_pton(AF_INET6, val, &ctx->pd_pool.base_prefix);
-      ctx->pd_pool.base_len = atoi(slash+1);
+      inet_pton(AF_INET6, val, &sn->pd.base_prefix);
+      sn->pd.base_len = atoi(slash+1);
     }
     else if(strcmp(key,"pd_delegated_len")==0){
-      ctx->pd_pool.delegated_len = atoi(val);
+      sn->pd.delegated_len = atoi(val);
+    }
+    else if(strcmp(key,"pd_min_len")==0){
+      sn->pd.min_len = atoi(val);
+    }
+    else if(strcmp(key,"pd_max_len")==0){
+      sn->pd.max_len = atoi(val);
+    }
+    else if(strcmp(key,"workers")==0){
+      ctx->workers = (uint32_t)atoi(val);
+    }
+    else if(strcmp(key,"journal_path")==0){
+      snprintf(ctx->journal_path, sizeof(ctx->journal_path), "%s", val);
+    }
+    else if(strcmp(key,"journal_sync_ms")==0){
+      ctx->journal_sync_ms = (uint32_t)atoi(val);
+    }
+    else if(strcmp(key,"snapshot_interval")==0){
+      ctx->snapshot_interval = (uint32_t)atoi(val);
+    }
+    else if(strcmp(key,"store_path")==0){
+      snprintf(ctx->store_path, sizeof(ctx->store_path), "%s", val);
+    }
+    else if(strcmp(key,"store_msync_ms")==0){
+      ctx->store_msync_ms = (uint32_t)atoi(val);
+    }
+    else if(strcmp(key,"duid_hash")==0){
+      if(hash_kind_parse(val, &ctx->duid_hash) < 0)
+        log_printf(LOG_WARN, "config: unknown duid_hash '%s' (siphash, wyhash, crc32c)", val);
+    }
+    else if(strcmp(key,"reply_cache_ms")==0){
+      ctx->reply_cache_ms = (uint32_t)atoi(val);
     }
     else if(strcmp(key,"dns")==0){
       if(ctx->dns_cnt < 4){
@@ -79,6 +148,44 @@ int config_load(const char* path, server_ctx_t* ctx){
   }
 
   fclose(f);
+
+  if(dh6_subnets_build(&ctx->subnets) < 0){
+    log_printf(LOG_ERR, "config: subnet lookup build failed (%u subnets)", ctx->subnets.n);
+    dh6_subnets_free(&ctx->subnets);
+    return -1;
+  }
+  dh6_reply_tmpl_build(ctx);
+  return 0;
+}
+
+void config_apply_runtime(server_ctx_t* dst, const server_ctx_t* src){
+  dst->offer_ttl = src->offer_ttl;
+  dst->decline_ttl = src->decline_ttl;
+  dst->preferred_lft = src->preferred_lft;
+  dst->valid_lft = src->valid_lft;
+  memcpy(dst->dns, src->dns, sizeof(dst->dns));
+  dst->dns_cnt = src->dns_cnt;
+  dst->reply = src->reply;
+  dst->snapshot_interval = src->snapshot_interval;
+  dst->reply_cache_ms = src->reply_cache_ms;
+}
+
+int config_reload(const char* path, server_ctx_t* ctx){
+  server_ctx_t n = *ctx;
+  n.dns_cnt = 0;
+  if(config_load(path, &n) < 0) return -1;
+
+  if(!dh6_subnets_same(&n.subnets, &ctx->subnets) ||
+     n.workers != ctx->workers ||
+     n.duid_hash != ctx->duid_hash ||
+     strcmp(n.journal_path, ctx->journal_path) != 0 ||
+     strcmp(n.store_path, ctx->store_path) != 0){
+    log_printf(LOG_WARN, "config reload: pool/worker/hash changes need a restart (ignored)");
+  }
+  dh6_subnets_free(&n.subnets);
+
+  config_apply_runtime(ctx, &n);
+  log_printf(LOG_INFO, "config reloaded: %s", path);
   return 0;
 }
 
@@ -86,15 +193,45 @@ void config_dump(const server_ctx_t* ctx){
   char buf[INET6_ADDRSTRLEN];
   log_printf(LOG_INFO, "=== DHCPv6 config ===");
 
-  inet_ntop(AF_INET6, &ctx->na_pool.prefix64, buf, sizeof(buf));
-  log_printf(LOG_INFO, "NA prefix: %s", buf);
+  // the top-level pools, then a line per subnet block (debug: there may
+  // be thousands)
+  const dh6_subnets_t* t = &ctx->subnets;
+  for(uint32_t i=0;i<t->n;i++){
+    const dh6_subnet_t* sn = &t->v[i];
+    if(!sn->used) continue;
+    int lvl = i ? LOG_DEBUG : LOG_INFO;
+    if(i){
+      inet_ntop(AF_INET6, &sn->link[0].prefix, buf, sizeof(buf));
+      log_printf(lvl, "subnet %u: link %s/%u (+%u) interface %s", sn->id, buf, sn->link[0].plen,
+                 sn->nlink - 1, sn->ifname[0] ? sn->ifname : "-");
+    }
+
+    inet_ntop(AF_INET6, &sn->na.prefix64, buf, sizeof(buf));
+    log_printf(lvl, "NA prefix: %s", buf);
 
-  inet_ntop(AF_INET6, &ctx->pd_pool.base_prefix, buf, sizeof(buf));
-  log_printf(LOG_INFO, "PD base: %s/%u → /%u",
-             buf, ctx->pd_pool.base_len, ctx->pd_pool.delegated_len);
+    inet_ntop(AF_INET6, &sn->pd.base_prefix, buf, sizeof(buf));
+    log_printf(lvl, "PD base: %s/%u → /%u (hint /%u../%u)",
+               buf, sn->pd.base_len, sn->pd.delegated_len,
+               sn->pd.min_len, sn->pd.max_len);
+  }
+  if(t->n > 1)
+    log_printf(LOG_INFO, "subnets=%u (link trie %u nodes, NA %u, PD %u)", t->n - 1,
+               t->link.nnodes, t->na.nnodes, t->pd.nnodes);
 
   log_printf(LOG_INFO, "preferred=%u valid=%u",
              ctx->preferred_lft, ctx->valid_lft);
+  log_printf(LOG_INFO, "workers=%u", ctx->workers ? ctx->workers : 1);
+  log_printf(LOG_INFO, "duid_hash=%s", hash_kind_name(hash_selected()));
+  if(ctx->journal_path[0])
+    log_printf(LOG_INFO, "journal=%s sync=%ums snapshot=%us", ctx->journal_path,
+               ctx->journal_sync_ms, ctx->snapshot_interval);
+  else
+    log_printf(LOG_INFO, "journal=off");
+  if(ctx->store_path[0])
+    log_printf(LOG_INFO, "store=%s msync=%ums", ctx->store_path, ctx->store_msync_ms);
+  else
+    log_printf(LOG_INFO, "store=memory");
+  log_printf(LOG_INFO, "reply_cache=%ums", ctx->reply_cache_ms);
 
   for(size_t i=0;i<ctx->dns_cnt;i++){
     inet_ntop(AF_INET6, &ctx->dns[i], buf, sizeof(buf));
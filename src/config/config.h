@@ -3,3 +3,8 @@
 
 int config_load(const char* path, server_ctx_t* ctx);
 void config_dump(const server_ctx_t* ctx);
+
+// SIGHUP: re-read path and apply what can change without a restart
+// (lifetimes, TTLs, DNS, log level); pool/worker changes are reported only
+int config_reload(const char* path, server_ctx_t* ctx);
+void config_apply_runtime(server_ctx_t* dst, const server_ctx_t* src);
@@ -2,8 +2,10 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#define DUID_MAX 128
+
 typedef struct {
-  uint8_t bytes[128];
+  uint8_t bytes[DUID_MAX];
   uint16_t len;
   uint64_t h;
 } duid_t;
@@ -3,21 +3,30 @@
 #include "util/buf.h"
 #include "util/time.h"
 #include "util/log.h"
+#include "util/hash.h"
 #include "alloc/alloc.h"
+#include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
 
+// an option value inside the receive buffer
+typedef struct { uint16_t off, len; } span_t;
+
+// request view: options stay in the receive buffer, nothing is copied;
+// the Client-ID hash is computed on first use (req_client_hash)
 typedef struct {
   dh6_hdr_t hdr;
+  const uint8_t* pkt;
 
-  duid_t client_id;
+  span_t client_id;  // 1..128 bytes (duid_t limit)
   int has_client;
+  uint64_t client_hash;
+  int hashed;
 
-  duid_t server_id;
+  span_t server_id;
   int has_server;
 
-  uint16_t oro[32];
-  size_t oro_cnt;
+  span_t oro;        // raw code list
 
   // Rapid Commit (Option 14)
   int has_rapid_commit;
@@ -37,11 +46,27 @@ typedef struct {
   struct in6_addr pd_hint_prefix;
 } req_t;
 
+static const uint8_t* span_ptr(const req_t* r, span_t s){ return r->pkt + s.off; }
+
+static span_t span_of(const req_t* r, const dh6_opt_view_t* ov){
+  span_t s = { (uint16_t)(ov->val - r->pkt), ov->vlen };
+  return s;
+}
+
 static int oro_wants(const req_t* r, uint16_t code){
-  for(size_t i=0;i<r->oro_cnt;i++) if(r->oro[i]==code) return 1;
+  const uint8_t* p = span_ptr(r, r->oro);
+  for(size_t i=0;i+1<r->oro.len;i+=2) if((uint16_t)(p[i]<<8 | p[i+1])==code) return 1;
   return 0;
 }
 
+static uint64_t req_client_hash(const server_ctx_t* s, req_t* r){
+  if(!r->hashed){
+    r->client_hash = hash64_bytes(span_ptr(r, r->client_id), r->client_id.len, s->duid_seed);
+    r->hashed = 1;
+  }
+  return r->client_hash;
+}
+
 static int parse_ia_na(req_t* rq, const uint8_t* v, uint16_t vlen){
   rd_t r = rd_make(v, vlen);
   if(vlen < 12) return -1;
@@ -90,8 +115,9 @@ static int parse_ia_pd(req_t* rq, const uint8_t* v, uint16_t vlen){
   return 0;
 }
 
-static int parse_req(server_ctx_t* s, const uint8_t* pkt, size_t len, req_t* rq){
+static int parse_req(const uint8_t* pkt, size_t len, req_t* rq){
   memset(rq, 0, sizeof(*rq));
+  rq->pkt = pkt;
   rd_t body;
   if(dh6_parse_hdr(pkt, len, &rq->hdr, &body) < 0) return -1;
 
@@ -103,20 +129,19 @@ static int parse_req(server_ctx_t* s, const uint8_t* pkt, size_t len, req_t* rq)
 
     switch(ov.code){
       case OPT_CLIENTID:
-        if(duid_from_opt(&rq->client_id, ov.val, ov.vlen, s->duid_seed)==0) rq->has_client=1;
+        if(ov.vlen > 0 && ov.vlen <= DUID_MAX){
+          rq->client_id = span_of(rq, &ov);
+          rq->has_client = 1;
+        }
         break;
       case OPT_SERVERID:
-        if(duid_from_opt(&rq->server_id, ov.val, ov.vlen, s->duid_seed)==0) rq->has_server=1;
+        if(ov.vlen > 0 && ov.vlen <= DUID_MAX){
+          rq->server_id = span_of(rq, &ov);
+          rq->has_server = 1;
+        }
         break;
       case OPT_ORO:
-        if(ov.vlen % 2 == 0){
-          size_t n = ov.vlen/2;
-          if(n > 32) n = 32;
-          for(size_t i=0;i<n;i++){
-            rq->oro[i] = (uint16_t)(ov.val[2*i]<<8 | ov.val[2*i+1]);
-          }
-          rq->oro_cnt = n;
-        }
+        if(ov.vlen % 2 == 0) rq->oro = span_of(rq, &ov);
         break;
       case OPT_RAPID_COMMIT:
         rq->has_rapid_commit = 1;
@@ -143,143 +168,252 @@ static void calc_t1_t2(uint32_t valid, uint32_t* t1, uint32_t* t2){
   if(*t2 <= *t1) *t2 = *t1 + 1;
 }
 
-static int write_duid_opt(wr_t* w, uint16_t code, const duid_t* d){
-  opt_mark_t m;
-  if(opt_begin(w, code, &m)<0) return -1;
-  if(wr_bytes(w, d->bytes, d->len)<0) return -1;
-  if(opt_end(w, &m)<0) return -1;
-  return 0;
+// ---- reply encoding ----
+// the skeleton is prebuilt; per reply only fixed-layout fields are stored,
+// after a single bounds check of the whole reply
+
+#define IA_HDR_LEN     16              // option hdr + iaid, t1, t2
+#define IA_STATUS_LEN  (4 + 2)         // Status Code, no message
+#define IAADDR_LEN     (4 + 16 + 4 + 4)
+#define IAPREFIX_LEN   (4 + 4 + 4 + 1 + 16)
+#define IA_NA_MAX      (IA_HDR_LEN + IAADDR_LEN)
+#define IA_PD_MAX      (IA_HDR_LEN + IAPREFIX_LEN)
+
+static uint8_t* put16(uint8_t* p, uint16_t v){
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+  return p + 2;
 }
-
-static int write_dns_if_requested(server_ctx_t* s, const req_t* rq, wr_t* w){
-  if(s->dns_cnt == 0) return 0;
-  if(!oro_wants(rq, OPT_DNS)) return 0;
-  opt_mark_t m;
-  if(opt_begin(w, OPT_DNS, &m)<0) return -1;
-  for(size_t i=0;i<s->dns_cnt;i++){
-    if(wr_bytes(w, (const uint8_t*)&s->dns[i], 16)<0) return -1;
-  }
-  if(opt_end(w, &m)<0) return -1;
-  return 0;
+static uint8_t* put32(uint8_t* p, uint32_t v){
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+  return p + 4;
 }
-
-static int write_status_in_ia(wr_t* w, uint16_t status_code){
-  // Status Code option: code(13), len, status(2), msg(n)
-  // Keep msg empty for minimal.
-  opt_mark_t m;
-  if(opt_begin(w, OPT_STATUS, &m)<0) return -1;
-  if(wr_u16(w, status_code)<0) return -1;
-  // no message
-  if(opt_end(w, &m)<0) return -1;
-  return 0;
+static uint8_t* put_opt(uint8_t* p, uint16_t code, uint16_t len){
+  return put16(put16(p, code), len);
 }
 
-static int write_ia_na(wr_t* w, const req_t* rq, const lease_na_t* na, int ok, uint16_t fail_status){
-  opt_mark_t m;
-  if(opt_begin(w, OPT_IA_NA, &m)<0) return -1;
-
-  uint32_t t1=0,t2=0;
-  if(na) calc_t1_t2(na->valid_lft, &t1, &t2);
-
-  uint32_t iaid = rq->na_iaid;
-  if(wr_u32(w, iaid)<0) return -1;
-  if(wr_u32(w, t1)<0) return -1;
-  if(wr_u32(w, t2)<0) return -1;
-
-  if(ok && na){
-    // IAADDR
-    opt_mark_t m2;
-    if(opt_begin(w, OPT_IAADDR, &m2)<0) return -1;
-    if(wr_bytes(w, (const uint8_t*)&na->addr, 16)<0) return -1;
-    if(wr_u32(w, na->preferred_lft)<0) return -1;
-    if(wr_u32(w, na->valid_lft)<0) return -1;
-    if(opt_end(w, &m2)<0) return -1;
-  }else{
-    if(write_status_in_ia(w, fail_status)<0) return -1;
-  }
+void dh6_reply_tmpl_build(server_ctx_t* s){
+  dh6_reply_tmpl_t* t = &s->reply;
+  memset(t, 0, sizeof(*t));
+
+  // msg type and txid are patched per reply
+  uint8_t* p = put_opt(t->head + 4, OPT_SERVERID, s->server_duid.len);
+  memcpy(p, s->server_duid.bytes, s->server_duid.len);
+  t->head_len = (uint16_t)(p + s->server_duid.len - t->head);
+
+  size_t n = s->dns_cnt;
+  if(n > sizeof(s->dns) / sizeof(s->dns[0])) n = sizeof(s->dns) / sizeof(s->dns[0]);
+  if(n == 0) return;
+  p = put_opt(t->dns, OPT_DNS, (uint16_t)(n * 16));
+  memcpy(p, s->dns, n * 16);
+  t->dns_len = (uint16_t)(4 + n * 16);
+}
 
-  if(opt_end(w, &m)<0) return -1;
-  return 0;
+// IA_NA/IA_PD header; body_len follows it
+static uint8_t* put_ia(uint8_t* p, uint16_t code, uint32_t iaid, uint32_t valid_lft, uint16_t body_len){
+  uint32_t t1 = 0, t2 = 0;
+  if(valid_lft) calc_t1_t2(valid_lft, &t1, &t2);
+  p = put_opt(p, code, (uint16_t)(IA_HDR_LEN - 4 + body_len));
+  p = put32(p, iaid);
+  p = put32(p, t1);
+  return put32(p, t2);
+}
+static uint8_t* put_status(uint8_t* p, uint16_t status_code){
+  return put16(put_opt(p, OPT_STATUS, 2), status_code);
 }
 
-static int write_ia_pd(wr_t* w, const req_t* rq, const lease_pd_t* pd, int ok, uint16_t fail_status){
-  opt_mark_t m;
-  if(opt_begin(w, OPT_IA_PD, &m)<0) return -1;
-
-  uint32_t t1=0,t2=0;
-  if(pd) calc_t1_t2(pd->valid_lft, &t1, &t2);
-
-  uint32_t iaid = rq->pd_iaid;
-  if(wr_u32(w, iaid)<0) return -1;
-  if(wr_u32(w, t1)<0) return -1;
-  if(wr_u32(w, t2)<0) return -1;
-
-  if(ok && pd){
-    // IAPREFIX
-    opt_mark_t m2;
-    if(opt_begin(w, OPT_IAPREFIX, &m2)<0) return -1;
-    if(wr_u32(w, pd->preferred_lft)<0) return -1;
-    if(wr_u32(w, pd->valid_lft)<0) return -1;
-    if(wr_u8(w, pd->prefix_len)<0) return -1;
-    if(wr_bytes(w, (const uint8_t*)&pd->prefix, 16)<0) return -1;
-    if(opt_end(w, &m2)<0) return -1;
-  }else{
-    if(write_status_in_ia(w, fail_status)<0) return -1;
-  }
+// na = NULL: no binding, fail_status goes inside the IA
+static uint8_t* put_ia_na(uint8_t* p, uint32_t iaid, const lease_na_t* na, uint16_t fail_status){
+  if(!na) return put_status(put_ia(p, OPT_IA_NA, iaid, 0, IA_STATUS_LEN), fail_status);
+  p = put_ia(p, OPT_IA_NA, iaid, na->valid_lft, IAADDR_LEN);
+  p = put_opt(p, OPT_IAADDR, IAADDR_LEN - 4);
+  memcpy(p, &na->addr, 16);
+  p = put32(p + 16, na->preferred_lft);
+  return put32(p, na->valid_lft);
+}
+static uint8_t* put_ia_pd(uint8_t* p, uint32_t iaid, const lease_pd_t* pd, uint16_t fail_status){
+  if(!pd) return put_status(put_ia(p, OPT_IA_PD, iaid, 0, IA_STATUS_LEN), fail_status);
+  p = put_ia(p, OPT_IA_PD, iaid, pd->valid_lft, IAPREFIX_LEN);
+  p = put_opt(p, OPT_IAPREFIX, IAPREFIX_LEN - 4);
+  p = put32(p, pd->preferred_lft);
+  p = put32(p, pd->valid_lft);
+  *p++ = pd->prefix_len;
+  memcpy(p, &pd->prefix, 16);
+  return p + 16;
+}
 
-  if(opt_end(w, &m)<0) return -1;
-  return 0;
+static int serverid_is_ours(const server_ctx_t* s, const req_t* rq){
+  return rq->server_id.len == s->server_duid.len &&
+         memcmp(span_ptr(rq, rq->server_id), s->server_duid.bytes, s->server_duid.len) == 0;
 }
 
-static int serverid_is_ours(server_ctx_t* s, const duid_t* req_sid){
-  return duid_equal(&s->server_duid, req_sid);
+// a live binding (or offer) for key, copied to out; 1 = found
+static int lookup_na(lease_store_t* st, const lease_key_t* key, uint64_t now, lease_na_t* out){
+  lease_na_t l;
+  if(st->v.get_na(st, key, &l) < 0) return 0;
+  if(!((l.state == LS_OFFERED && l.hold_until > now) ||
+       (l.state == LS_ALLOCATED && l.valid_until > now))) return 0;
+  *out = l;
+  return 1;
+}
+static int lookup_pd(lease_store_t* st, const lease_key_t* key, uint64_t now, lease_pd_t* out){
+  lease_pd_t l;
+  if(st->v.get_pd(st, key, &l) < 0) return 0;
+  if(!((l.state == LS_OFFERED && l.hold_until > now) ||
+       (l.state == LS_ALLOCATED && l.valid_until > now))) return 0;
+  *out = l;
+  return 1;
 }
 
-static void init_na_lease_defaults(server_ctx_t* s, lease_na_t* l, lease_key_t key){
+static void init_na_lease_defaults(server_ctx_t* s, const pool64_t* pool, lease_na_t* l, lease_key_t key){
   memset(l, 0, sizeof(*l));
   l->key = key;
-  l->preferred_lft = s->preferred_lft ? s->preferred_lft : s->na_pool.preferred_lft;
-  l->valid_lft = s->valid_lft ? s->valid_lft : s->na_pool.valid_lft;
-  l->subnet_id = s->na_pool.subnet_id;
-  l->pool_id = s->na_pool.pool_id;
+  l->preferred_lft = s->preferred_lft ? s->preferred_lft : pool->preferred_lft;
+  l->valid_lft = s->valid_lft ? s->valid_lft : pool->valid_lft;
+  l->subnet_id = pool->subnet_id;
+  l->pool_id = pool->pool_id;
 }
 
-static void init_pd_lease_defaults(server_ctx_t* s, lease_pd_t* l, lease_key_t key){
+static void init_pd_lease_defaults(server_ctx_t* s, const pd_pool_t* pool, lease_pd_t* l, lease_key_t key){
   memset(l, 0, sizeof(*l));
   l->key = key;
-  l->preferred_lft = s->preferred_lft ? s->preferred_lft : s->pd_pool.preferred_lft;
-  l->valid_lft = s->valid_lft ? s->valid_lft : s->pd_pool.valid_lft;
-  l->subnet_id = s->pd_pool.subnet_id;
-  l->pool_id = s->pd_pool.pool_id;
+  l->preferred_lft = s->preferred_lft ? s->preferred_lft : pool->preferred_lft;
+  l->valid_lft = s->valid_lft ? s->valid_lft : pool->valid_lft;
+  l->subnet_id = pool->subnet_id;
+  l->pool_id = pool->pool_id;
 }
 
-static int prefix_match_bits(const struct in6_addr* a, const struct in6_addr* b, uint8_t plen){
-  // returns 1 if first plen bits match
-  const uint8_t* pa = a->s6_addr;
-  const uint8_t* pb = b->s6_addr;
+// the client's link as relays report it: the link-address of the relay
+// closest to the client, or of the next one out where that is
+// unspecified. 0 = direct client (or no relay knows), the receiving
+// interface decides.
+static int relay_link(const dh6_relay_path_t* rp, struct in6_addr* out){
+  static const struct in6_addr any = IN6ADDR_ANY_INIT;
+  for(int i=rp->n-1;i>=0;i--){
+    memcpy(out, rp->hop[i].hdr + 2, 16);
+    if(!in6_equal(out, &any)) return 1;
+  }
+  return 0;
+}
 
-  uint8_t full = plen / 8;
-  uint8_t rem  = plen % 8;
+// the subnet serving the client's link (LPM_NONE = none): the relayed
+// link's longest match, else the receiving interface's
+static uint32_t select_subnet(const server_ctx_t* s, const dh6_relay_path_t* rp, int ifindex){
+  struct in6_addr link;
+  if(relay_link(rp, &link)) return dh6_subnet_by_link(&s->subnets, &link);
+  return dh6_subnet_by_ifindex(&s->subnets, ifindex);
+}
 
-  if(full > 0 && memcmp(pa, pb, full) != 0) return 0;
-  if(rem == 0) return 1;
+// this worker's pools of subnet i, free-space maps built on first use
+static dh6_pools_t* pools_of(server_ctx_t* s, uint32_t i){
+  dh6_pools_t* p = &s->pools[i];
+  if(!p->ready){
+    p->ready = 1;
+    int rc = pool64_occ_init(&p->na);
+    if(pdpool_occ_init(&p->pd) < 0 || rc < 0)
+      log_printf(LOG_WARN, "subnet %u: no memory for pool maps, probing instead", i);
+    __atomic_store_n(&p->na_use.size, pool64_size(&p->na), __ATOMIC_RELAXED);
+    __atomic_store_n(&p->pd_use.size, pdpool_units(&p->pd), __ATOMIC_RELAXED);
+  }
+  return p;
+}
 
-  uint8_t mask = (uint8_t)(0xFF << (8 - rem));
-  return (pa[full] & mask) == (pb[full] & mask);
+// PD space in /max_len blocks (0 = outside the pool's lengths)
+static uint64_t pd_units(const pd_pool_t* pd, uint8_t plen){
+  if(plen > pd->max_len || pd->max_len - plen >= 64) return 0;
+  return (uint64_t)1 << (pd->max_len - plen);
 }
 
-int dh6_handle_packet(server_ctx_t* sctx,
-                      const uint8_t* in, size_t in_len,
-                      const struct sockaddr_in6* peer, int ifindex,
-                      uint8_t* out, size_t out_cap, size_t* out_len,
-                      struct sockaddr_in6* out_peer, int* out_ifindex)
+static void on_store_occ(void* arg, const struct in6_addr* a, uint8_t plen, int occupied){
+  server_ctx_t* s = (server_ctx_t*)arg;
+  uint32_t i = lpm_lookup(plen == 128 ? &s->subnets.na : &s->subnets.pd, a);
+  if(i == LPM_NONE || (!occupied && !s->pools[i].ready)) return;
+  dh6_pools_t* p = pools_of(s, i);
+  if(plen == 128){
+    pool64_occ_mark(&p->na, a, occupied);
+    dh6_stats_add(&p->na_use.taken, occupied ? 1 : (uint64_t)-1);
+  }else{
+    pdpool_occ_mark(&p->pd, a, plen, occupied);
+    uint64_t n = pd_units(&p->pd, plen);
+    dh6_stats_add(&p->pd_use.taken, occupied ? n : -n);
+  }
+}
+
+static uint64_t* use_slot(dh6_pool_use_t* u, int state){
+  if(state == LS_OFFERED) return &u->offered;
+  if(state == LS_ALLOCATED) return &u->allocated;
+  if(state == LS_DECLINED) return &u->declined;
+  return NULL;
+}
+
+static void on_store_use(void* arg, const struct in6_addr* a, uint8_t plen, int from, int to){
+  server_ctx_t* s = (server_ctx_t*)arg;
+  uint32_t i = lpm_lookup(plen == 128 ? &s->subnets.na : &s->subnets.pd, a);
+  if(i == LPM_NONE) return;
+  dh6_pool_use_t* u = plen == 128 ? &s->pools[i].na_use : &s->pools[i].pd_use;
+  uint64_t* c;
+  if((c = use_slot(u, from)) != NULL) dh6_stats_add(c, (uint64_t)-1);
+  if((c = use_slot(u, to)) != NULL) dh6_stats_add(c, 1);
+}
+
+int dh6_pools_init(server_ctx_t* sctx, unsigned shard, unsigned nshards){
+  const dh6_subnets_t* t = &sctx->subnets;
+  sctx->pools = calloc(t->n ? t->n : 1, sizeof(*sctx->pools));
+  if(!sctx->pools) return -1;
+  for(uint32_t i=0;i<t->n;i++){
+    dh6_pools_t* p = &sctx->pools[i];
+    p->na = t->v[i].na;
+    p->pd = t->v[i].pd;
+    pool64_shard(&p->na, shard, nshards);
+    pdpool_shard(&p->pd, shard, nshards);
+  }
+  sctx->store->on_occ = on_store_occ;
+  sctx->store->on_use = on_store_use;
+  sctx->store->occ_arg = sctx;
+  return 0;
+}
+
+void dh6_pools_free(server_ctx_t* sctx){
+  if(!sctx->pools) return;
+  for(uint32_t i=0;i<sctx->subnets.n;i++){
+    pool64_occ_free(&sctx->pools[i].na);
+    pdpool_occ_free(&sctx->pools[i].pd);
+  }
+  free(sctx->pools);
+  sctx->pools = NULL;
+}
+
+// *type = the client's message type once known, *why = DH6_DROP_* when
+// nothing is sent
+static int handle(server_ctx_t* sctx,
+                  const uint8_t* in, size_t in_len,
+                  const struct sockaddr_in6* peer, int ifindex,
+                  uint8_t* out, size_t out_cap, size_t* out_len,
+                  struct sockaddr_in6* out_peer, int* out_ifindex,
+                  unsigned* type, int* why)
 {
+  *why = DH6_DROP_PARSE;
+  *type = in_len ? in[0] : 0;
+
+  // relayed: parse the client message in place, the reply goes out
+  // wrapped in as many Relay-Reply layers
+  dh6_relay_path_t rp;
+  if(dh6_relay_unwrap(in, in_len, &rp) < 0) return 0;
+  size_t pre = dh6_relay_overhead(&rp);
+  *type = rp.len ? rp.msg[0] : 0;
+
   req_t rq;
-  int prc = parse_req(sctx, in, in_len, &rq);
-  if(prc < 0) return 0;
+  int prc = parse_req(rp.msg, rp.len, &rq);
+  if(prc < 0){
+    if(prc == -2) *why = DH6_DROP_NO_CLIENTID;
+    return 0;
+  }
 
+  // lease expiry runs from the event loop tick (see main.c), not per packet
   uint64_t now = now_epoch_sec();
-  sctx->store->v.gc(sctx->store, now);
 
   // ===== 3) Server-ID rules (RFC-faithful) =====
   // - REQUEST/RENEW/RELEASE: if Server-ID present and not ours -> IGNORE
@@ -288,7 +422,8 @@ int dh6_handle_packet(server_ctx_t* sctx,
     case DHCP6_REQUEST:
     case DHCP6_RENEW:
     case DHCP6_RELEASE:
-      if(rq.has_server && !serverid_is_ours(sctx, &rq.server_id)){
+      if(rq.has_server && !serverid_is_ours(sctx, &rq)){
+        *why = DH6_DROP_SERVERID;
         return 0;
       }
       break;
@@ -322,6 +457,7 @@ int dh6_handle_packet(server_ctx_t* sctx,
       break;
 
     default:
+      *why = DH6_DROP_UNSUPPORTED;
       return 0;
   }
 
@@ -343,132 +479,106 @@ int dh6_handle_packet(server_ctx_t* sctx,
   uint16_t na_fail = 2; // NoAddrsAvail
   uint16_t pd_fail = 2; // NoAddrsAvail (works for PD too in minimal interoperable deployments)
 
+  // the client's subnet: one lookup on its link
+  uint32_t si = select_subnet(sctx, &rp, ifindex);
+  const dh6_subnet_t* sn = si != LPM_NONE ? &sctx->subnets.v[si] : NULL;
+
   // ===== CONFIRM on-link evaluation =====
+  // on-link if the address / prefix falls in the client's subnet: the
+  // NA /64 and PD base tries map it to its subnet in one lookup
   int na_onlink = 0;
   int pd_onlink = 0;
-  if(rq.hdr.msg_type == DHCP6_CONFIRM){
+  if(rq.hdr.msg_type == DHCP6_CONFIRM && sn){
     if(rq.has_ia_na && rq.has_na_addr_hint){
-      // on-link if addr matches our /64 prefix (minimal policy)
-      struct in6_addr masked = rq.na_addr_hint;
-      memset(&masked.s6_addr[8], 0, 8);
-      if(memcmp(&masked, &sctx->na_pool.prefix64, 16) == 0){
-        na_onlink = 1;
-      }
+      na_onlink = lpm_lookup(&sctx->subnets.na, &rq.na_addr_hint) == si;
     }
     if(rq.has_ia_pd && rq.has_pd_hint_prefix){
-      // on-link if requested prefix is within our base_prefix/base_len
-      if(prefix_match_bits(&rq.pd_hint_prefix, &sctx->pd_pool.base_prefix, sctx->pd_pool.base_len)){
-        pd_onlink = 1;
-      }
+      pd_onlink = lpm_lookup(&sctx->subnets.pd, &rq.pd_hint_prefix) == si;
     }
   }
 
   // ===== Normal processing (alloc/renew) =====
-  if(wants_ia){
+  // SOLICIT offers (or commits, with Rapid Commit); REQUEST/RENEW/REBIND
+  // commit and refresh the lifetimes. One store call per IA: RENEW/REBIND
+  // touch the existing binding, a miss falls through to acquire.
+  // RELEASE/DECLINE only report the binding as it stands.
+  int binds = wants_ia && sn &&
+              (rq.hdr.msg_type == DHCP6_SOLICIT || rq.hdr.msg_type == DHCP6_REQUEST ||
+               rq.hdr.msg_type == DHCP6_RENEW || rq.hdr.msg_type == DHCP6_REBIND);
+  int commit = rq.hdr.msg_type != DHCP6_SOLICIT || rq.has_rapid_commit;
+  int renew = rq.hdr.msg_type == DHCP6_RENEW || rq.hdr.msg_type == DHCP6_REBIND;
+
+  // the client's DUID handle in the store: binding messages intern it
+  // (held until the reply is built), the others only look it up; 0 = no
+  // leases (or no room), so nothing to find or release
+  lease_store_t* st = sctx->store;
+  uint32_t cid = 0;
+  if(wants_ia && (rq.has_ia_na || rq.has_ia_pd)){
+    const uint8_t* id = span_ptr(&rq, rq.client_id);
+    uint64_t h = req_client_hash(sctx, &rq);
+    cid = binds ? st->v.duid_get(st, id, rq.client_id.len, h)
+                : st->v.duid_find(st, id, rq.client_id.len, h);
+  }
+
+  if(wants_ia && cid){
+    dh6_pools_t* pools = binds ? pools_of(sctx, si) : NULL;
+
     // IA_NA
     if(rq.has_ia_na){
-      lease_key_t key = lease_key_make(&rq.client_id, rq.na_iaid, IA_NA);
-      init_na_lease_defaults(sctx, &na, key);
-
-      lease_na_t existing;
-      if(sctx->store->v.get_na(sctx->store, &key, &existing) == 0){
-        if((existing.state == LS_OFFERED && existing.hold_until > now) ||
-           (existing.state == LS_ALLOCATED && existing.valid_until > now)){
-          na = existing;
+      lease_key_t key = lease_key_make(cid, rq.na_iaid, IA_NA);
+      if(!binds){
+        na_ok = lookup_na(sctx->store, &key, now, &na);
+      }else{
+        init_na_lease_defaults(sctx, &pools->na, &na, key);
+        na.preferred_until = now + na.preferred_lft;
+        na.valid_until = now + na.valid_lft;
+        na.state = commit ? LS_ALLOCATED : LS_OFFERED;
+        na.hold_until = commit ? 0 : now + sctx->offer_ttl;
+
+        lease_times_t t = { na.state, na.preferred_until, na.valid_until, na.hold_until, na.subnet_id };
+        if(renew && sctx->store->v.touch_na(sctx->store, &key, &t, now, &na) == 0){
           na_ok = 1;
-        }
-      }
-
-      if(!na_ok){
-        struct in6_addr addr;
-        if(alloc_addr64(&sctx->na_pool, &rq.client_id, rq.na_iaid, sctx->store, &addr) == 0){
-          na.addr = addr;
-          na.preferred_until = now + na.preferred_lft;
-          na.valid_until = now + na.valid_lft;
-
-          if(rq.hdr.msg_type == DHCP6_SOLICIT){
-            if(rq.has_rapid_commit){
-              // Rapid Commit -> commit immediately
-              na.state = LS_ALLOCATED;
-              na.hold_until = 0;
-            }else{
-              na.state = LS_OFFERED;
-              na.hold_until = now + sctx->offer_ttl;
-            }
-          }else if(rq.hdr.msg_type == DHCP6_REQUEST || rq.hdr.msg_type == DHCP6_RENEW || rq.hdr.msg_type == DHCP6_REBIND){
-            na.state = LS_ALLOCATED;
-            na.hold_until = 0;
-          }
-
-          if(rq.hdr.msg_type==DHCP6_SOLICIT || rq.hdr.msg_type==DHCP6_REQUEST ||
-             rq.hdr.msg_type==DHCP6_RENEW || rq.hdr.msg_type==DHCP6_REBIND){
-            sctx->store->v.put_na(sctx->store, &na);
-            na_ok = 1;
-          }
+        }else{
+          addr_cand_t c;
+          addr_cand_init(&c, &pools->na, span_ptr(&rq, rq.client_id), rq.client_id.len, rq.na_iaid);
+          na_ok = sctx->store->v.acquire_na(sctx->store, &na, addr_cand_next, &c, now, &na) >= 0;
         }
       }
     }
 
     // IA_PD
     if(rq.has_ia_pd){
-      lease_key_t key = lease_key_make(&rq.client_id, rq.pd_iaid, IA_PD);
-      init_pd_lease_defaults(sctx, &pd, key);
-
-      lease_pd_t existing;
-      if(sctx->store->v.get_pd(sctx->store, &key, &existing) == 0){
-        if((existing.state == LS_OFFERED && existing.hold_until > now) ||
-           (existing.state == LS_ALLOCATED && existing.valid_until > now)){
-          pd = existing;
+      lease_key_t key = lease_key_make(cid, rq.pd_iaid, IA_PD);
+      if(!binds){
+        pd_ok = lookup_pd(sctx->store, &key, now, &pd);
+      }else{
+        init_pd_lease_defaults(sctx, &pools->pd, &pd, key);
+        pd.preferred_until = now + pd.preferred_lft;
+        pd.valid_until = now + pd.valid_lft;
+        pd.state = commit ? LS_ALLOCATED : LS_OFFERED;
+        pd.hold_until = commit ? 0 : now + sctx->offer_ttl;
+
+        lease_times_t t = { pd.state, pd.preferred_until, pd.valid_until, pd.hold_until, pd.subnet_id };
+        if(renew && sctx->store->v.touch_pd(sctx->store, &key, &t, now, &pd) == 0){
           pd_ok = 1;
-        }
-      }
-
-      if(!pd_ok){
-        struct in6_addr pfx;
-        uint8_t plen;
-        int has_hint_len = rq.has_pd_hint_len;
-        uint8_t hint_len = rq.pd_hint_len;
-
-        if(alloc_prefix_pd(&sctx->pd_pool, &rq.client_id, rq.pd_iaid,
-                           hint_len, has_hint_len,
-                           sctx->store, &pfx, &plen) == 0){
-          pd.prefix = pfx;
-          pd.prefix_len = plen;
-          pd.preferred_until = now + pd.preferred_lft;
-          pd.valid_until = now + pd.valid_lft;
-
-          if(rq.hdr.msg_type == DHCP6_SOLICIT){
-            if(rq.has_rapid_commit){
-              pd.state = LS_ALLOCATED;
-              pd.hold_until = 0;
-            }else{
-              pd.state = LS_OFFERED;
-              pd.hold_until = now + sctx->offer_ttl;
-            }
-          }else if(rq.hdr.msg_type == DHCP6_REQUEST || rq.hdr.msg_type == DHCP6_RENEW || rq.hdr.msg_type == DHCP6_REBIND){
-            pd.state = LS_ALLOCATED;
-            pd.hold_until = 0;
-          }
-
-          if(rq.hdr.msg_type==DHCP6_SOLICIT || rq.hdr.msg_type==DHCP6_REQUEST ||
-             rq.hdr.msg_type==DHCP6_RENEW || rq.hdr.msg_type==DHCP6_REBIND){
-            sctx->store->v.put_pd(sctx->store, &pd);
-            pd_ok = 1;
-          }
+        }else{
+          pd_cand_t c;
+          pd_cand_init(&c, &pools->pd, span_ptr(&rq, rq.client_id), rq.client_id.len, rq.pd_iaid, rq.pd_hint_len, rq.has_pd_hint_len);
+          pd_ok = sctx->store->v.acquire_pd(sctx->store, &pd, pd_cand_next, &c, now, &pd) >= 0;
         }
       }
     }
   }
 
   // RELEASE
-  if(rq.hdr.msg_type == DHCP6_RELEASE){
+  if(rq.hdr.msg_type == DHCP6_RELEASE && cid){
     if(rq.has_ia_na){
-      lease_key_t k = lease_key_make(&rq.client_id, rq.na_iaid, IA_NA);
-      sctx->store->v.del_na(sctx->store, &k);
+      lease_key_t k = lease_key_make(cid, rq.na_iaid, IA_NA);
+      st->v.del_na(st, &k);
     }
     if(rq.has_ia_pd){
-      lease_key_t k = lease_key_make(&rq.client_id, rq.pd_iaid, IA_PD);
-      sctx->store->v.del_pd(sctx->store, &k);
+      lease_key_t k = lease_key_make(cid, rq.pd_iaid, IA_PD);
+      st->v.del_pd(st, &k);
     }
   }
 
@@ -476,69 +586,87 @@ int dh6_handle_packet(server_ctx_t* sctx,
   if(rq.hdr.msg_type == DHCP6_DECLINE){
     uint64_t until = now + sctx->decline_ttl;
     if(rq.has_ia_na && rq.has_na_addr_hint){
-      sctx->store->v.decline_addr(sctx->store, &rq.na_addr_hint, until);
-      lease_key_t k = lease_key_make(&rq.client_id, rq.na_iaid, IA_NA);
-      sctx->store->v.del_na(sctx->store, &k);
+      st->v.decline_addr(st, &rq.na_addr_hint, until);
+      lease_key_t k = lease_key_make(cid, rq.na_iaid, IA_NA);
+      if(cid) st->v.del_na(st, &k);
     }
     if(rq.has_ia_pd && rq.has_pd_hint_prefix && rq.has_pd_hint_len){
-      sctx->store->v.decline_prefix(sctx->store, &rq.pd_hint_prefix, rq.pd_hint_len, until);
-      lease_key_t k = lease_key_make(&rq.client_id, rq.pd_iaid, IA_PD);
-      sctx->store->v.del_pd(sctx->store, &k);
+      st->v.decline_prefix(st, &rq.pd_hint_prefix, rq.pd_hint_len, until);
+      lease_key_t k = lease_key_make(cid, rq.pd_iaid, IA_PD);
+      if(cid) st->v.del_pd(st, &k);
     }
   }
+  if(binds && cid) st->v.duid_put(st, cid);
+
+  // Build response: skeleton, Client-ID, then DNS/IAs as requested
+  const dh6_reply_tmpl_t* t = &sctx->reply;
+  int dns = t->dns_len && oro_wants(&rq, OPT_DNS);
+  int ias = rq.hdr.msg_type != DHCP6_INFOREQ;
+  size_t need = t->head_len + 4 + rq.client_id.len + (dns ? t->dns_len : 0) +
+                (ias && rq.has_ia_na ? IA_NA_MAX : 0) + (ias && rq.has_ia_pd ? IA_PD_MAX : 0);
+  if(pre + need > out_cap){
+    *why = DH6_DROP_ENCODE;
+    return -1;
+  }
 
-  // Build response
-  wr_t w = wr_make(out, out_cap);
-  if(dh6_write_hdr(&w, resp_type, rq.hdr.txid) < 0) return -1;
+  uint8_t* msg = out + pre;
+  uint8_t* p = msg;
+  memcpy(p, t->head, t->head_len);
+  p[0] = resp_type;
+  memcpy(p + 1, rq.hdr.txid, 3);
+  p += t->head_len;
 
   // MUST include ServerID + ClientID in ADVERTISE/REPLY
-  if(write_duid_opt(&w, OPT_SERVERID, &sctx->server_duid) < 0) return -1;
-  if(write_duid_opt(&w, OPT_CLIENTID, &rq.client_id) < 0) return -1;
+  p = put_opt(p, OPT_CLIENTID, rq.client_id.len);
+  memcpy(p, span_ptr(&rq, rq.client_id), rq.client_id.len);
+  p += rq.client_id.len;
 
-  // Options only reply (INFOREQ)
-  if(rq.hdr.msg_type == DHCP6_INFOREQ){
-    if(write_dns_if_requested(sctx, &rq, &w) < 0) return -1;
-  }else if(rq.hdr.msg_type == DHCP6_CONFIRM){
-    // CONFIRM: do NOT allocate; only SUCCESS / NotOnLink
-    if(write_dns_if_requested(sctx, &rq, &w) < 0) return -1;
-
-    if(rq.has_ia_na){
-      uint16_t st = na_onlink ? 0 : 6; // SUCCESS : NotOnLink
-      if(write_ia_na(&w, &rq, NULL, 0, st) < 0) return -1;
-    }
-    if(rq.has_ia_pd){
-      uint16_t st = pd_onlink ? 0 : 6; // SUCCESS : NotOnLink
-      if(write_ia_pd(&w, &rq, NULL, 0, st) < 0) return -1;
-    }
-  }else{
-    // Provide DNS if requested
-    if(write_dns_if_requested(sctx, &rq, &w) < 0) return -1;
+  if(dns){
+    memcpy(p, t->dns, t->dns_len);
+    p += t->dns_len;
+  }
 
+  if(rq.hdr.msg_type == DHCP6_CONFIRM){
+    // CONFIRM: do NOT allocate; only SUCCESS / NotOnLink
+    if(rq.has_ia_na) p = put_ia_na(p, rq.na_iaid, NULL, na_onlink ? 0 : 6);
+    if(rq.has_ia_pd) p = put_ia_pd(p, rq.pd_iaid, NULL, pd_onlink ? 0 : 6);
+  }else if(ias){
     // Include IA_NA/IA_PD if present in request (RFC-friendly behavior)
-    if(rq.has_ia_na){
-      if(write_ia_na(&w, &rq, na_ok?&na:NULL, na_ok, na_fail) < 0) return -1;
-    }
-    if(rq.has_ia_pd){
-      if(write_ia_pd(&w, &rq, pd_ok?&pd:NULL, pd_ok, pd_fail) < 0) return -1;
-    }
+    if(rq.has_ia_na) p = put_ia_na(p, rq.na_iaid, na_ok ? &na : NULL, na_fail);
+    if(rq.has_ia_pd) p = put_ia_pd(p, rq.pd_iaid, pd_ok ? &pd : NULL, pd_fail);
   }
 
-  *out_len = w.off;
-
-  // ===== 4) Multicast / Unicast response rule (RFC-faithful minimal) =====
-  // - ADVERTISE: multicast to ff02::1:2
-  // - SOLICIT+RapidCommit => REPLY: multicast to ff02::1:2
-  // - otherwise: unicast to source address (peer)
-  *out_peer = *peer;
-  out_peer->sin6_port = htons(546);
+  *out_len = pre + (size_t)(p - msg);
   *out_ifindex = ifindex;
+  *out_peer = *peer;
 
-  if(resp_type == DHCP6_ADVERTISE ||
-     (rq.hdr.msg_type == DHCP6_SOLICIT && rq.has_rapid_commit && resp_type == DHCP6_REPLY)){
-    inet_pton(AF_INET6, "ff02::1:2", &out_peer->sin6_addr);
-    // link-local multicast should carry scope
-    out_peer->sin6_scope_id = (uint32_t)ifindex;
+  // relayed: Relay-Reply back to the relay's server port
+  if(rp.n){
+    dh6_relay_wrap(&rp, out, (size_t)(p - msg));
+    out_peer->sin6_port = htons(547);
+    return 1;
   }
 
+  // ===== 4) Response destination =====
+  // ADVERTISE and REPLY alike go back to the client's source address
+  // (RFC 8415 18.3): ff02::1:2 is the servers' group, no client joins it
+  out_peer->sin6_port = htons(546);
   return 1;
 }
+
+int dh6_handle_packet(server_ctx_t* sctx,
+                      const uint8_t* in, size_t in_len,
+                      const struct sockaddr_in6* peer, int ifindex,
+                      uint8_t* out, size_t out_cap, size_t* out_len,
+                      struct sockaddr_in6* out_peer, int* out_ifindex)
+{
+  unsigned type;
+  int why;
+  if(!sctx->stats)
+    return handle(sctx, in, in_len, peer, ifindex, out, out_cap, out_len, out_peer, out_ifindex, &type, &why);
+
+  uint64_t t0 = cycles_now();
+  int rc = handle(sctx, in, in_len, peer, ifindex, out, out_cap, out_len, out_peer, out_ifindex, &type, &why);
+  dh6_stats_record(sctx->stats, type, rc, why, cycles_to_ns(cycles_now() - t0));
+  return rc;
+}
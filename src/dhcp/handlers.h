@@ -5,15 +5,29 @@
 #include "dhcp/msg.h"
 #include "dhcp/duid.h"
 #include "store/lease_store.h"
-#include "alloc/pool.h"
+#include "dhcp/subnet.h"
+#include "dhcp/stats.h"
+#include "util/hash.h"
+
+// reply skeleton, compiled from the config by dh6_reply_tmpl_build():
+// message header + our Server-ID, and the DNS option. A reply copies it
+// and patches msg type and txid; Client-ID and IAs are appended.
+typedef struct {
+  uint8_t head[4 + 4 + 128];
+  uint16_t head_len;
+  uint8_t dns[4 + 2 * 16];
+  uint16_t dns_len;  // 0 = no DNS configured
+} dh6_reply_tmpl_t;
 
 typedef struct {
   duid_t server_duid;
   uint64_t duid_seed; // for hashing duid from option
+  hash_kind_t duid_hash; // config "duid_hash" (util/hash.h); applied at startup only
 
-  // per-interface policy (minimal: single policy)
-  pool64_t na_pool;
-  pd_pool_t pd_pool;
+  // pools per client link (dhcp/subnet.h): compiled by config_load and
+  // shared by the workers; pools = this worker's copies, one per subnet
+  dh6_subnets_t subnets;
+  dh6_pools_t* pools;
 
   struct in6_addr dns[2];
   size_t dns_cnt;
@@ -26,10 +40,42 @@ typedef struct {
   uint32_t offer_ttl;      // seconds
   uint32_t decline_ttl;    // seconds
 
+  // shard-per-core worker threads (config "workers"; 0/1 = single-threaded)
+  uint32_t workers;
+
+  // lease journal (config "journal_path"; empty = in-memory only);
+  // with several workers each shard appends to "<path>.<id>"
+  char journal_path[128];
+  uint32_t journal_sync_ms; // group commit window; 0 = one sync per receive batch
+  uint32_t snapshot_interval; // seconds between forked snapshots ("<path>.snap"); 0 = off
+
+  // persistent lease map (config "store_path"; empty = heap mem_store);
+  // "<path>.<id>" per shard like the journal
+  char store_path[128];
+  uint32_t store_msync_ms; // msync + journal truncation period; 0 = at shutdown only
+
+  // retransmission reply cache lifetime (config "reply_cache_ms"; 0 = off)
+  uint32_t reply_cache_ms;
+
+  dh6_reply_tmpl_t reply;
+
   lease_store_t* store;
+
+  // this worker's packet counters (dhcp/stats.h); NULL = not recorded
+  dh6_stats_t* stats;
 } server_ctx_t;
 
+// take this worker's shard of every subnet's pools and subscribe their
+// free-space maps to store occupancy changes; call after config load and
+// before any lease is inserted
+int  dh6_pools_init(server_ctx_t* sctx, unsigned shard, unsigned nshards);
+void dh6_pools_free(server_ctx_t* sctx);
+
+// (re)build sctx->reply from server_duid and dns; config_load does this
+void dh6_reply_tmpl_build(server_ctx_t* sctx);
+
 // handle one packet; returns 1 if response produced, 0 if ignore/drop, <0 on error.
+// Counted in sctx->stats when set.
 int dh6_handle_packet(server_ctx_t* sctx,
                       const uint8_t* in, size_t in_len,
                       const struct sockaddr_in6* peer, int ifindex,
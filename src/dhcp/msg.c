@@ -1,4 +1,5 @@
 #include "dhcp/msg.h"
+#include "dhcp/opt.h"
 #include <string.h>
 
 int dh6_parse_hdr(const uint8_t* pkt, size_t len, dh6_hdr_t* h, rd_t* body){
@@ -17,3 +18,71 @@ int dh6_write_hdr(wr_t* w, uint8_t msg_type, const uint8_t txid[3]){
   if(wr_bytes(w, txid, 3) < 0) return -1;
   return 0;
 }
+
+int dh6_relay_unwrap(const uint8_t* pkt, size_t len, dh6_relay_path_t* rp){
+  rp->n = 0;
+  while(len > 0 && pkt[0] == DHCP6_RELAYFWD){
+    if(rp->n == DH6_RELAY_MAX || len < DH6_RELAY_HDR_LEN) return -1;
+    dh6_relay_t* h = &rp->hop[rp->n++];
+    h->hdr = pkt;
+    h->ifid = NULL;
+    h->ifid_len = 0;
+
+    rd_t r = rd_make(pkt + DH6_RELAY_HDR_LEN, len - DH6_RELAY_HDR_LEN);
+    const uint8_t* inner = NULL;
+    size_t inner_len = 0;
+    dh6_opt_view_t ov;
+    int rc;
+    while((rc = dh6_opt_next(&r, &ov)) > 0){
+      if(ov.code == OPT_RELAY_MSG){
+        inner = ov.val;
+        inner_len = ov.vlen;
+      }else if(ov.code == OPT_INTERFACE_ID){
+        h->ifid = ov.val;
+        h->ifid_len = ov.vlen;
+      }
+    }
+    if(rc < 0 || !inner) return -1;
+    pkt = inner;
+    len = inner_len;
+  }
+  rp->msg = pkt;
+  rp->len = len;
+  return 0;
+}
+
+// Relay-Reply header + echoed Interface-ID + Relay Message option header
+static size_t hop_overhead(const dh6_relay_t* h){
+  return DH6_RELAY_HDR_LEN + (h->ifid ? 4 + (size_t)h->ifid_len : 0) + 4;
+}
+
+size_t dh6_relay_overhead(const dh6_relay_path_t* rp){
+  size_t n = 0;
+  for(int i=0;i<rp->n;i++) n += hop_overhead(&rp->hop[i]);
+  return n;
+}
+
+static uint8_t* put_opt_hdr(uint8_t* p, uint16_t code, size_t len){
+  p[0] = (uint8_t)(code >> 8);
+  p[1] = (uint8_t)code;
+  p[2] = (uint8_t)(len >> 8);
+  p[3] = (uint8_t)len;
+  return p + 4;
+}
+
+void dh6_relay_wrap(const dh6_relay_path_t* rp, uint8_t* out, size_t msg_len){
+  size_t rest = dh6_relay_overhead(rp) + msg_len;
+  for(int i=0;i<rp->n;i++){
+    const dh6_relay_t* h = &rp->hop[i];
+    rest -= hop_overhead(h);
+    out[0] = DHCP6_RELAYREPL;
+    memcpy(out + 1, h->hdr + 1, DH6_RELAY_HDR_LEN - 1);
+    out += DH6_RELAY_HDR_LEN;
+    if(h->ifid){
+      out = put_opt_hdr(out, OPT_INTERFACE_ID, h->ifid_len);
+      memcpy(out, h->ifid, h->ifid_len);
+      out += h->ifid_len;
+    }
+    out = put_opt_hdr(out, OPT_RELAY_MSG, rest);
+  }
+}
@@ -26,3 +26,35 @@ enum {
 
 int dh6_parse_hdr(const uint8_t* pkt, size_t len, dh6_hdr_t* h, rd_t* body);
 int dh6_write_hdr(wr_t* w, uint8_t msg_type, const uint8_t txid[3]);
+
+// Relay-Forward/Relay-Reply: msg-type, hop-count, link-address,
+// peer-address, then options
+#define DH6_RELAY_HDR_LEN   34
+#define DH6_HOP_COUNT_LIMIT 8                          // RFC 8415
+#define DH6_RELAY_MAX       (DH6_HOP_COUNT_LIMIT + 1)  // nesting accepted
+
+// one Relay-Forward layer, in place in the received packet
+typedef struct {
+  const uint8_t* hdr;    // hop-count at hdr[1], link-address at hdr+2, peer-address at hdr+18
+  const uint8_t* ifid;   // Interface-ID option value, NULL = none
+  uint16_t ifid_len;
+} dh6_relay_t;
+
+typedef struct {
+  dh6_relay_t hop[DH6_RELAY_MAX]; // hop[0] = outermost, the relay that sent it to us
+  int n;                          // 0 = sent by the client directly
+  const uint8_t* msg;             // the client message (inside pkt)
+  size_t len;
+} dh6_relay_path_t;
+
+// peel the Relay-Forward layers off pkt without copying; a client message
+// comes back as is (n = 0). -1 = malformed or nested too deep.
+int dh6_relay_unwrap(const uint8_t* pkt, size_t len, dh6_relay_path_t* rp);
+
+// bytes the Relay-Reply layers take in front of the reply
+size_t dh6_relay_overhead(const dh6_relay_path_t* rp);
+
+// write the Relay-Reply layers (hop-count, addresses and Interface-ID
+// echoed) into out, around a reply of msg_len bytes that is already at
+// out + dh6_relay_overhead(rp)
+void dh6_relay_wrap(const dh6_relay_path_t* rp, uint8_t* out, size_t msg_len);
@@ -26,8 +26,10 @@ enum {
   OPT_ORO=6,
   OPT_PREFERENCE=7,
   OPT_ELAPSED=8,
+  OPT_RELAY_MSG=9,
   OPT_STATUS=13,
   OPT_RAPID_COMMIT=14,
+  OPT_INTERFACE_ID=18,
   OPT_DNS=23,
   OPT_DOMAIN_SEARCH=24,
   OPT_IA_PD=25,
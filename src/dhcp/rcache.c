@@ -0,0 +1,81 @@
+// src/dhcp/rcache.c
+#include "dhcp/rcache.h"
+#include "dhcp/msg.h"
+#include "dhcp/opt.h"
+#include "dhcp/duid.h"
+#include "util/hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+void rcache_free(rcache_t* c){
+  free(c->ent);
+  c->ent = NULL;
+}
+
+int rcache_key(const uint8_t* pkt, size_t len, uint64_t seed, rcache_key_t* out){
+  dh6_relay_path_t rp;
+  dh6_hdr_t h;
+  rd_t body;
+  if(dh6_relay_unwrap(pkt, len, &rp) < 0) return -1;
+  if(dh6_parse_hdr(rp.msg, rp.len, &h, &body) < 0) return -1;
+  switch(h.msg_type){
+    case DHCP6_SOLICIT: case DHCP6_REQUEST: case DHCP6_CONFIRM: case DHCP6_RENEW:
+    case DHCP6_REBIND: case DHCP6_RELEASE: case DHCP6_DECLINE: case DHCP6_INFOREQ:
+      break;
+    default:
+      return -1;
+  }
+
+  dh6_opt_view_t ov;
+  while(dh6_opt_next(&body, &ov) > 0){
+    if(ov.code != OPT_CLIENTID) continue;
+    if(ov.vlen == 0 || ov.vlen > DUID_MAX) return -1;
+    memset(out, 0, sizeof(*out));
+    out->duid_hash = hash64_bytes(ov.val, ov.vlen, seed);
+    out->txid = (uint32_t)h.txid[0] << 16 | (uint32_t)h.txid[1] << 8 | h.txid[2];
+    out->msg_type = h.msg_type;
+    return 0;
+  }
+  return -1;
+}
+
+static rcache_ent_t* slot(rcache_t* c, const rcache_key_t* k){
+  uint64_t x = k->duid_hash ^ ((uint64_t)k->txid << 8 | k->msg_type);
+  x ^= x >> 29;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 32;
+  return &c->ent[x & (RCACHE_SLOTS - 1)];
+}
+
+static int key_eq(const rcache_key_t* a, const rcache_key_t* b){
+  return a->duid_hash == b->duid_hash && a->txid == b->txid && a->msg_type == b->msg_type;
+}
+
+const rcache_ent_t* rcache_get(rcache_t* c, const rcache_key_t* k, const struct sockaddr_in6* src,
+                               uint64_t now_ms){
+  if(c->ent){
+    const rcache_ent_t* e = slot(c, k);
+    if(e->expires > now_ms && key_eq(&e->key, k) &&
+       memcmp(&e->src, &src->sin6_addr, sizeof(e->src)) == 0){
+      c->hits++;
+      return e;
+    }
+  }
+  c->misses++;
+  return NULL;
+}
+
+void rcache_put(rcache_t* c, const rcache_key_t* k, const struct sockaddr_in6* src,
+                const uint8_t* reply, size_t len, const struct sockaddr_in6* peer, int ifindex,
+                uint64_t now_ms, uint32_t ttl_ms){
+  if(len > RCACHE_REPLY_MAX || ttl_ms == 0) return;
+  if(!c->ent && !(c->ent = calloc(RCACHE_SLOTS, sizeof(*c->ent)))) return;
+  rcache_ent_t* e = slot(c, k);
+  e->key = *k;
+  e->src = src->sin6_addr;
+  e->expires = now_ms + ttl_ms;
+  e->peer = *peer;
+  e->ifindex = ifindex;
+  e->len = (uint16_t)len;
+  memcpy(e->reply, reply, len);
+}
@@ -0,0 +1,57 @@
+// src/dhcp/rcache.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+/*
+ * Reply cache for client retransmissions. A client repeats a message with
+ * the same transaction id until it gets an answer, so (Client-ID hash,
+ * txid, msg type) plus the source address identifies a retransmission;
+ * it is answered with the reply bytes already sent instead of going
+ * through parse, allocation and encoding again. Relayed messages are keyed
+ * on the client message inside; the source is then the relay, and the
+ * cached reply carries the Relay-Reply layers.
+ *
+ * Direct-mapped and fixed size: a colliding insert simply overwrites, and
+ * an entry lives ttl_ms. Replies larger than RCACHE_REPLY_MAX are not kept.
+ * Single-threaded (one per worker).
+ */
+
+#define RCACHE_SLOTS     1024
+#define RCACHE_REPLY_MAX 640
+
+typedef struct {
+  uint64_t duid_hash;
+  uint32_t txid;
+  uint8_t msg_type;
+} rcache_key_t;
+
+typedef struct {
+  rcache_key_t key;
+  struct in6_addr src;      // requester
+  uint64_t expires;         // monotonic ms; 0 = empty
+  struct sockaddr_in6 peer; // reply destination
+  int ifindex;
+  uint16_t len;
+  uint8_t reply[RCACHE_REPLY_MAX];
+} rcache_ent_t;
+
+typedef struct {
+  rcache_ent_t* ent;        // allocated on first insert
+  uint64_t hits, misses;
+} rcache_t;
+
+void rcache_free(rcache_t* c);
+
+// key of a client message, relayed or not (Client-ID hashed with seed);
+// -1 = not cacheable (server message, no Client-ID, malformed)
+int rcache_key(const uint8_t* pkt, size_t len, uint64_t seed, rcache_key_t* out);
+
+// cached reply for a retransmission from src, or NULL (counts hit/miss)
+const rcache_ent_t* rcache_get(rcache_t* c, const rcache_key_t* k, const struct sockaddr_in6* src,
+                               uint64_t now_ms);
+
+void rcache_put(rcache_t* c, const rcache_key_t* k, const struct sockaddr_in6* src,
+                const uint8_t* reply, size_t len, const struct sockaddr_in6* peer, int ifindex,
+                uint64_t now_ms, uint32_t ttl_ms);
@@ -0,0 +1,165 @@
+// src/dhcp/stats.c
+#include "dhcp/stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* const type_name[DH6_STATS_TYPES] = {
+  "other", "solicit", "advertise", "request", "confirm", "renew", "rebind", "reply",
+  "release", "decline", "reconfigure", "information-request", "relay-forw", "relay-repl",
+};
+
+static const char* const drop_name[DH6_DROP_N] = {
+  "parse", "no-client-id", "server-id", "unsupported", "encode",
+};
+
+dh6_stats_t* dh6_stats_new(void){
+  dh6_stats_t* s = aligned_alloc(64, sizeof(*s));
+  if(s) memset(s, 0, sizeof(*s));
+  return s;
+}
+
+void dh6_stats_free(dh6_stats_t* s){
+  free(s);
+}
+
+static uint64_t ld(const uint64_t* c){ return __atomic_load_n(c, __ATOMIC_RELAXED); }
+
+void dh6_stats_sum(dh6_stats_t* out, dh6_stats_t* const* v, int n){
+  memset(out, 0, sizeof(*out));
+  for(int w=0;w<n;w++){
+    const dh6_stats_t* s = v[w];
+    for(int t=0;t<DH6_STATS_TYPES;t++){
+      out->rx[t] += ld(&s->rx[t]);
+      out->replied[t] += ld(&s->replied[t]);
+      out->lat_ns[t] += ld(&s->lat_ns[t]);
+      for(int d=0;d<DH6_DROP_N;d++) out->drop[t][d] += ld(&s->drop[t][d]);
+      for(int b=0;b<DH6_LAT_BUCKETS;b++) out->lat[t][b] += ld(&s->lat[t][b]);
+    }
+    out->cached += ld(&s->cached);
+  }
+}
+
+// exclusive upper bound of bucket b, in ns
+static uint64_t bucket_end(unsigned b){
+  if(b < DH6_LAT_EXACT) return b + 1;
+  unsigned e = 4 + (b - DH6_LAT_EXACT) / 8, sub = (b - DH6_LAT_EXACT) % 8;
+  return (uint64_t)(8 + sub + 1) << (e - 3);
+}
+
+// upper bound of the bucket holding the q-quantile
+static uint64_t quantile(const uint64_t* h, uint64_t total, double q){
+  uint64_t rank = (uint64_t)(q * (double)total + 0.999999), cum = 0;
+  if(rank == 0) rank = 1;
+  for(unsigned b=0;b<DH6_LAT_BUCKETS;b++){
+    cum += h[b];
+    if(cum >= rank) return bucket_end(b);
+  }
+  return bucket_end(DH6_LAT_BUCKETS - 1);
+}
+
+static uint64_t dropped(const dh6_stats_t* s, int t){
+  uint64_t n = 0;
+  for(int d=0;d<DH6_DROP_N;d++) n += s->drop[t][d];
+  return n;
+}
+
+static void print_table(FILE* f, const dh6_stats_t* sum, dh6_stats_t* const* v, int n){
+  fprintf(f, "%-20s %12s %12s %10s %9s %9s %9s %9s\n",
+          "type", "received", "replied", "dropped", "avg_us", "p50_us", "p99_us", "p999_us");
+  for(int t=0;t<DH6_STATS_TYPES;t++){
+    uint64_t rx = sum->rx[t];
+    if(!rx) continue;
+    fprintf(f, "%-20s %12llu %12llu %10llu %9.2f %9.2f %9.2f %9.2f\n", type_name[t],
+            (unsigned long long)rx, (unsigned long long)sum->replied[t],
+            (unsigned long long)dropped(sum, t), (double)sum->lat_ns[t] / (double)rx / 1e3,
+            (double)quantile(sum->lat[t], rx, 0.50) / 1e3,
+            (double)quantile(sum->lat[t], rx, 0.99) / 1e3,
+            (double)quantile(sum->lat[t], rx, 0.999) / 1e3);
+  }
+  for(int t=0;t<DH6_STATS_TYPES;t++){
+    for(int d=0;d<DH6_DROP_N;d++){
+      if(sum->drop[t][d])
+        fprintf(f, "dropped %s %s: %llu\n", type_name[t], drop_name[d],
+                (unsigned long long)sum->drop[t][d]);
+    }
+  }
+  fprintf(f, "reply cache hits: %llu\n", (unsigned long long)sum->cached);
+  for(int w=0;w<n;w++){
+    uint64_t rx = 0, tx = 0, dr = 0;
+    for(int t=0;t<DH6_STATS_TYPES;t++){
+      rx += ld(&v[w]->rx[t]);
+      tx += ld(&v[w]->replied[t]);
+      for(int d=0;d<DH6_DROP_N;d++) dr += ld(&v[w]->drop[t][d]);
+    }
+    fprintf(f, "worker %d: received %llu replied %llu dropped %llu cached %llu\n", w,
+            (unsigned long long)rx, (unsigned long long)tx, (unsigned long long)dr,
+            (unsigned long long)ld(&v[w]->cached));
+  }
+}
+
+static void prom_head(FILE* f, const char* name, const char* type, const char* help){
+  fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// histogram buckets at powers of two from 256 ns to ~1 s: each ends on a
+// bucket boundary, so the cumulative counts are exact
+#define PROM_LE_MIN 8
+#define PROM_LE_MAX 30
+
+static void print_prom(FILE* f, const dh6_stats_t* sum, dh6_stats_t* const* v, int n){
+  prom_head(f, "dhcpv6_packets_received_total", "counter", "Client messages handled, by message type.");
+  for(int t=0;t<DH6_STATS_TYPES;t++){
+    if(sum->rx[t])
+      fprintf(f, "dhcpv6_packets_received_total{type=\"%s\"} %llu\n", type_name[t],
+              (unsigned long long)sum->rx[t]);
+  }
+  prom_head(f, "dhcpv6_packets_replied_total", "counter", "Messages answered, by message type.");
+  for(int t=0;t<DH6_STATS_TYPES;t++){
+    if(sum->rx[t])
+      fprintf(f, "dhcpv6_packets_replied_total{type=\"%s\"} %llu\n", type_name[t],
+              (unsigned long long)sum->replied[t]);
+  }
+  prom_head(f, "dhcpv6_packets_dropped_total", "counter", "Messages left unanswered, by message type and reason.");
+  for(int t=0;t<DH6_STATS_TYPES;t++){
+    for(int d=0;d<DH6_DROP_N;d++){
+      if(sum->drop[t][d])
+        fprintf(f, "dhcpv6_packets_dropped_total{type=\"%s\",reason=\"%s\"} %llu\n",
+                type_name[t], drop_name[d], (unsigned long long)sum->drop[t][d]);
+    }
+  }
+  prom_head(f, "dhcpv6_reply_cache_hits_total", "counter", "Retransmissions answered from the reply cache.");
+  fprintf(f, "dhcpv6_reply_cache_hits_total %llu\n", (unsigned long long)sum->cached);
+
+  prom_head(f, "dhcpv6_handle_seconds", "histogram", "Time spent handling a message, by message type.");
+  for(int t=0;t<DH6_STATS_TYPES;t++){
+    if(!sum->rx[t]) continue;
+    uint64_t cum = 0;
+    unsigned b = 0;
+    for(int k=PROM_LE_MIN;k<=PROM_LE_MAX;k++){
+      uint64_t le = (uint64_t)1 << k;
+      while(b < DH6_LAT_BUCKETS && bucket_end(b) <= le) cum += sum->lat[t][b++];
+      fprintf(f, "dhcpv6_handle_seconds_bucket{type=\"%s\",le=\"%.10g\"} %llu\n",
+              type_name[t], (double)le / 1e9, (unsigned long long)cum);
+    }
+    fprintf(f, "dhcpv6_handle_seconds_bucket{type=\"%s\",le=\"+Inf\"} %llu\n",
+            type_name[t], (unsigned long long)sum->rx[t]);
+    fprintf(f, "dhcpv6_handle_seconds_sum{type=\"%s\"} %.9f\n", type_name[t], (double)sum->lat_ns[t] / 1e9);
+    fprintf(f, "dhcpv6_handle_seconds_count{type=\"%s\"} %llu\n", type_name[t], (unsigned long long)sum->rx[t]);
+  }
+
+  prom_head(f, "dhcpv6_worker_packets_received_total", "counter", "Client messages handled, by worker.");
+  for(int w=0;w<n;w++){
+    uint64_t rx = 0;
+    for(int t=0;t<DH6_STATS_TYPES;t++) rx += ld(&v[w]->rx[t]);
+    fprintf(f, "dhcpv6_worker_packets_received_total{worker=\"%d\"} %llu\n", w, (unsigned long long)rx);
+  }
+}
+
+void dh6_stats_print(FILE* f, dh6_stats_t* const* v, int n, int prometheus){
+  dh6_stats_t* sum = dh6_stats_new();
+  if(!sum) return;
+  dh6_stats_sum(sum, v, n);
+  if(prometheus) print_prom(f, sum, v, n);
+  else print_table(f, sum, v, n);
+  dh6_stats_free(sum);
+}
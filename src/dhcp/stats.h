@@ -0,0 +1,74 @@
+// src/dhcp/stats.h
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Per-worker packet counters and handling-time histograms.
+ *
+ * Each worker owns one dh6_stats_t and is its only writer: a count is a
+ * plain load/add/store (relaxed atomics, no lock prefix) on lines no other
+ * thread writes. Readers (the CLI) sum the workers' copies with relaxed
+ * loads; a reading may lag by a packet or two but a counter is never torn.
+ *
+ * Latency is the time spent in dh6_handle_packet(), in ns, in HDR-style
+ * buckets: exact below 16 ns, then 8 sub-buckets per power of two (at most
+ * 12.5% off) up to 2^36 ns; longer goes to the last bucket.
+ */
+
+#define DH6_STATS_TYPES 14  // by message type (1..13); 0 = unparsed or unknown
+
+// why a received message got no answer
+enum {
+  DH6_DROP_PARSE,        // malformed message or relay wrapping
+  DH6_DROP_NO_CLIENTID,
+  DH6_DROP_SERVERID,     // Server-ID of another server
+  DH6_DROP_UNSUPPORTED,  // not a message type a server answers
+  DH6_DROP_ENCODE,       // reply does not fit the buffer
+  DH6_DROP_N
+};
+
+#define DH6_LAT_EXACT   16
+#define DH6_LAT_MAX_EXP 36
+#define DH6_LAT_BUCKETS (DH6_LAT_EXACT + (DH6_LAT_MAX_EXP - 4) * 8)
+
+typedef struct {
+  uint64_t rx[DH6_STATS_TYPES];
+  uint64_t replied[DH6_STATS_TYPES];
+  uint64_t drop[DH6_STATS_TYPES][DH6_DROP_N];
+  uint64_t lat_ns[DH6_STATS_TYPES];  // sum
+  uint64_t lat[DH6_STATS_TYPES][DH6_LAT_BUCKETS];
+  uint64_t cached;  // answered from the reply cache, handler not run
+} __attribute__((aligned(64))) dh6_stats_t;
+
+dh6_stats_t* dh6_stats_new(void);  // zeroed, NULL = out of memory
+void dh6_stats_free(dh6_stats_t* s);
+
+static inline void dh6_stats_add(uint64_t* c, uint64_t n){
+  __atomic_store_n(c, *c + n, __ATOMIC_RELAXED);
+}
+
+static inline unsigned dh6_lat_bucket(uint64_t ns){
+  if(ns < DH6_LAT_EXACT) return (unsigned)ns;
+  unsigned e = 63u - (unsigned)__builtin_clzll(ns);
+  if(e >= DH6_LAT_MAX_EXP) return DH6_LAT_BUCKETS - 1;
+  return DH6_LAT_EXACT + (e - 4) * 8 + (unsigned)((ns >> (e - 3)) & 7);
+}
+
+// one handled message: rc as dh6_handle_packet returns it (1 = replied),
+// why = DH6_DROP_* otherwise
+static inline void dh6_stats_record(dh6_stats_t* s, unsigned type, int rc, int why, uint64_t ns){
+  unsigned t = type < DH6_STATS_TYPES ? type : 0;
+  dh6_stats_add(&s->rx[t], 1);
+  if(rc == 1) dh6_stats_add(&s->replied[t], 1);
+  else dh6_stats_add(&s->drop[t][why], 1);
+  dh6_stats_add(&s->lat_ns[t], ns);
+  dh6_stats_add(&s->lat[t][dh6_lat_bucket(ns)], 1);
+}
+
+// sum of n workers' counters (any thread)
+void dh6_stats_sum(dh6_stats_t* out, dh6_stats_t* const* v, int n);
+
+// "show stats": a table with p50/p99/p999 per message type, or the
+// Prometheus text format (per-type totals, per-worker packet counts)
+void dh6_stats_print(FILE* f, dh6_stats_t* const* v, int n, int prometheus);
@@ -0,0 +1,172 @@
+// src/dhcp/subnet.c
+#include "dhcp/subnet.h"
+#include "util/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+int dh6_subnets_init(dh6_subnets_t* t){
+  memset(t, 0, sizeof(*t));
+  return dh6_subnet_add(t) ? 0 : -1;
+}
+
+void dh6_subnets_free(dh6_subnets_t* t){
+  lpm_free(&t->link);
+  lpm_free(&t->na);
+  lpm_free(&t->pd);
+  free(t->by_ifindex);
+  free(t->v);
+  memset(t, 0, sizeof(*t));
+}
+
+dh6_subnet_t* dh6_subnet_add(dh6_subnets_t* t){
+  if(t->n == t->cap){
+    uint32_t ncap = t->cap ? t->cap * 2 : 4;
+    dh6_subnet_t* n = realloc(t->v, (size_t)ncap * sizeof(*n));
+    if(!n) return NULL;
+    t->v = n;
+    t->cap = ncap;
+  }
+  dh6_subnet_t* s = &t->v[t->n];
+  memset(s, 0, sizeof(*s));
+  s->id = t->n++;
+  s->used = s->id != 0;
+  return s;
+}
+
+int dh6_subnet_add_link(dh6_subnet_t* s, const dh6_prefix_t* link){
+  if(s->nlink >= DH6_SUBNET_LINKS) return -1;
+  s->link[s->nlink++] = *link;
+  return 0;
+}
+
+int dh6_prefix_parse(const char* s, dh6_prefix_t* out){
+  char buf[INET6_ADDRSTRLEN + 4];
+  snprintf(buf, sizeof(buf), "%s", s);
+  char* slash = strchr(buf, '/');
+  if(!slash) return -1;
+  *slash = 0;
+  int plen = atoi(slash + 1);
+  if(plen < 0 || plen > 128 || inet_pton(AF_INET6, buf, &out->prefix) != 1) return -1;
+  out->plen = (uint8_t)plen;
+  return 0;
+}
+
+// links a subnet is matched on: its own, else its NA /64 and PD base
+static size_t links_of(const dh6_subnet_t* s, dh6_prefix_t* out){
+  if(s->nlink){
+    memcpy(out, s->link, s->nlink * sizeof(*out));
+    return s->nlink;
+  }
+  out[0].prefix = s->na.prefix64;
+  out[0].plen = 64;
+  if(!s->pd.delegated_len) return 1;
+  out[1].prefix = s->pd.base_prefix;
+  out[1].plen = s->pd.base_len;
+  return 2;
+}
+
+static int prefix_eq(const dh6_prefix_t* a, const dh6_prefix_t* b){
+  return a->plen == b->plen && memcmp(&a->prefix, &b->prefix, sizeof(a->prefix)) == 0;
+}
+
+static int build_ifindex(dh6_subnets_t* t){
+  uint32_t max = 0;
+  for(uint32_t i=0;i<t->n;i++){
+    dh6_subnet_t* s = &t->v[i];
+    s->ifindex = 0;
+    if(!s->ifname[0]) continue;
+    s->ifindex = (int)if_nametoindex(s->ifname);
+    if(!s->ifindex){
+      log_printf(LOG_WARN, "subnet %u: no interface %s (direct clients not served)", s->id, s->ifname);
+      continue;
+    }
+    if((uint32_t)s->ifindex + 1 > max) max = (uint32_t)s->ifindex + 1;
+  }
+  if(!max) return 0;
+  t->by_ifindex = malloc(max * sizeof(uint32_t));
+  if(!t->by_ifindex) return -1;
+  t->nifindex = max;
+  for(uint32_t k=0;k<max;k++) t->by_ifindex[k] = LPM_NONE;
+  for(uint32_t i=0;i<t->n;i++){
+    const dh6_subnet_t* s = &t->v[i];
+    if(!s->ifindex) continue;
+    if(t->by_ifindex[s->ifindex] != LPM_NONE)
+      log_printf(LOG_WARN, "subnet %u: interface %s already bound to subnet %u",
+                 s->id, s->ifname, t->by_ifindex[s->ifindex]);
+    else t->by_ifindex[s->ifindex] = i;
+  }
+  return 0;
+}
+
+int dh6_subnets_build(dh6_subnets_t* t){
+  lpm_free(&t->link);
+  lpm_free(&t->na);
+  lpm_free(&t->pd);
+  free(t->by_ifindex);
+  t->by_ifindex = NULL;
+  t->nifindex = 0;
+
+  lpm_route_t* link = malloc(((size_t)t->n * DH6_SUBNET_LINKS + 1) * sizeof(*link));
+  lpm_route_t* na = malloc(((size_t)t->n + 1) * sizeof(*na));
+  lpm_route_t* pd = malloc(((size_t)t->n + 1) * sizeof(*pd));
+  size_t nl = 0, nn = 0, np = 0;
+  int rc = -1;
+  if(!link || !na || !pd) goto out;
+
+  for(uint32_t i=0;i<t->n;i++){
+    dh6_subnet_t* s = &t->v[i];
+    pd_pool_t* p = &s->pd;
+    if(p->min_len == 0) p->min_len = p->delegated_len;
+    if(p->max_len == 0) p->max_len = p->delegated_len;
+    s->na.subnet_id = s->na.pool_id = s->id;
+    p->subnet_id = p->pool_id = s->id;
+    if(!s->used) continue;
+
+    dh6_prefix_t l[DH6_SUBNET_LINKS];
+    size_t k = links_of(s, l);
+    for(size_t j=0;j<k;j++) link[nl++] = (lpm_route_t){ l[j].prefix, l[j].plen, i };
+    na[nn++] = (lpm_route_t){ s->na.prefix64, 64, i };
+    if(p->delegated_len) pd[np++] = (lpm_route_t){ p->base_prefix, p->base_len, i };
+  }
+
+  if(lpm_build(&t->link, link, nl) < 0 || lpm_build(&t->na, na, nn) < 0 ||
+     lpm_build(&t->pd, pd, np) < 0 || build_ifindex(t) < 0) goto out;
+  rc = 0;
+
+out:
+  free(link);
+  free(na);
+  free(pd);
+  return rc;
+}
+
+int dh6_subnets_same(const dh6_subnets_t* a, const dh6_subnets_t* b){
+  if(a->n != b->n) return 0;
+  for(uint32_t i=0;i<a->n;i++){
+    const dh6_subnet_t* x = &a->v[i];
+    const dh6_subnet_t* y = &b->v[i];
+    if(x->used != y->used || x->nlink != y->nlink) return 0;
+    for(uint8_t j=0;j<x->nlink;j++){
+      if(!prefix_eq(&x->link[j], &y->link[j])) return 0;
+    }
+    if(strcmp(x->ifname, y->ifname) != 0 ||
+       memcmp(&x->na.prefix64, &y->na.prefix64, sizeof(x->na.prefix64)) != 0 ||
+       x->na.host_start != y->na.host_start || x->na.host_end != y->na.host_end ||
+       memcmp(&x->pd.base_prefix, &y->pd.base_prefix, sizeof(x->pd.base_prefix)) != 0 ||
+       x->pd.base_len != y->pd.base_len || x->pd.delegated_len != y->pd.delegated_len ||
+       x->pd.min_len != y->pd.min_len || x->pd.max_len != y->pd.max_len) return 0;
+  }
+  return 1;
+}
+
+uint32_t dh6_subnet_by_link(const dh6_subnets_t* t, const struct in6_addr* link){
+  return lpm_lookup(&t->link, link);
+}
+
+uint32_t dh6_subnet_by_ifindex(const dh6_subnets_t* t, int ifindex){
+  if(ifindex > 0 && (uint32_t)ifindex < t->nifindex && t->by_ifindex[ifindex] != LPM_NONE)
+    return t->by_ifindex[ifindex];
+  return t->n && t->v[0].used ? 0 : LPM_NONE;
+}
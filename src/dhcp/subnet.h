@@ -0,0 +1,89 @@
+// src/dhcp/subnet.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include "alloc/pool.h"
+#include "util/lpm.h"
+
+/*
+ * Subnets: an NA pool and a PD pool per client link. A request is served
+ * by the subnet of its link: relayed ones by the relay's link-address
+ * (longest match over every subnet's link prefixes), direct ones by the
+ * receiving interface. Either is one lookup, whatever the subnet count.
+ *
+ * Subnet 0 holds the top-level pool keys and is matched on its NA /64 and
+ * PD base when it lists no links; it also serves direct clients on
+ * interfaces no subnet claims. The others come from "subnet=" blocks.
+ *
+ * The table is compiled once by config_load and shared read-only by the
+ * workers; each worker keeps its own sharded pools (dh6_pools_init).
+ */
+
+#define DH6_SUBNET_LINKS 4   // link prefixes per subnet
+
+typedef struct {
+  struct in6_addr prefix;
+  uint8_t plen;
+} dh6_prefix_t;
+
+typedef struct {
+  uint32_t id;           // 0 = top-level pools, then config order
+  int used;              // pool keys given (subnet 0 may have none)
+  dh6_prefix_t link[DH6_SUBNET_LINKS];
+  uint8_t nlink;
+  char ifname[IF_NAMESIZE];  // "" = not bound to an interface
+  int ifindex;
+  pool64_t na;
+  pd_pool_t pd;
+} dh6_subnet_t;
+
+typedef struct {
+  dh6_subnet_t* v;
+  uint32_t n, cap;
+  lpm_t link;            // link prefix -> subnet
+  lpm_t na;              // NA /64 -> subnet (store occupancy)
+  lpm_t pd;              // PD base -> subnet
+  uint32_t* by_ifindex;  // [nifindex], LPM_NONE = unbound
+  uint32_t nifindex;
+} dh6_subnets_t;
+
+// leases by state and occupied space (bound or declined; PD in /max_len
+// blocks), kept from the store observers. The worker is the only writer;
+// the CLI reads them with relaxed loads.
+typedef struct {
+  uint64_t offered, allocated, declined;
+  uint64_t taken;
+  uint64_t size;  // this worker's slice, set once the maps are built
+} dh6_pool_use_t;
+
+// a worker's pools for one subnet; occupancy maps are built on first use,
+// so idle subnets cost nothing per worker
+typedef struct {
+  pool64_t na;
+  pd_pool_t pd;
+  int ready;
+  dh6_pool_use_t na_use, pd_use;
+} dh6_pools_t;
+
+// empty table holding subnet 0
+int  dh6_subnets_init(dh6_subnets_t* t);
+void dh6_subnets_free(dh6_subnets_t* t);
+
+// append a subnet; NULL = out of memory (pointers into v move)
+dh6_subnet_t* dh6_subnet_add(dh6_subnets_t* t);
+int dh6_subnet_add_link(dh6_subnet_t* s, const dh6_prefix_t* link); // -1 = full
+
+// resolve interfaces and compile the lookups (after the last add)
+int  dh6_subnets_build(dh6_subnets_t* t);
+
+// same subnets and pool settings (lookups and occupancy not compared)
+int  dh6_subnets_same(const dh6_subnets_t* a, const dh6_subnets_t* b);
+
+// subnet index, LPM_NONE = not served
+uint32_t dh6_subnet_by_link(const dh6_subnets_t* t, const struct in6_addr* link);
+uint32_t dh6_subnet_by_ifindex(const dh6_subnets_t* t, int ifindex);
+
+// "addr/len"; -1 = malformed
+int dh6_prefix_parse(const char* s, dh6_prefix_t* out);
@@ -4,15 +4,40 @@
 #include "util/hash.h"
 
 #include "dhcp/handlers.h"
-#include "store/mem_store.h"
+#include "worker/worker.h"
 #include "config/config.h"
 #include "cli/cli.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
-#include <sys/select.h>
+#include <signal.h>
 #include <unistd.h>
 
+#define CONFIG_PATH "/etc/dhcpv6d.conf"
+
+typedef struct {
+  server_ctx_t* tmpl;
+  dh6_worker_t* workers;
+  int nw;
+  reactor_t* rx;
+} dh6_main_t;
+
+static void on_signal(reactor_ev_t* ev, uint32_t events){
+  (void)events;
+  dh6_main_t* m = (dh6_main_t*)ev->arg;
+
+  if(ev->signo == SIGHUP){
+    if(config_reload(CONFIG_PATH, m->tmpl) == 0){
+      for(int i=0;i<m->nw;i++) worker_post_config(&m->workers[i], m->tmpl);
+    }
+    return;
+  }
+
+  log_printf(LOG_INFO, "signal %d: shutting down", ev->signo);
+  reactor_stop(m->rx);
+}
+
 static void make_server_duid(duid_t* d, uint64_t seed){
   static const uint8_t raw[] = {
     0x00,0x02, /* DUID-EN */
@@ -26,19 +51,12 @@ static void make_server_duid(duid_t* d, uint64_t seed){
 
 int main(){
   log_set_level(LOG_INFO);
+  /* log lines are formatted and written by a background thread */
+  log_start();
 
-  /* socket */
-  dh6_sock_t sock;
-  if(dh6_sock_open(&sock, 547) < 0) return 1;
-
-  /* store */
-  lease_store_t st;
-  if(mem_store_init(&st, 4096) < 0) return 1;
-
-  /* server context */
+  /* server context (template; each worker clones it) */
   server_ctx_t s;
   memset(&s, 0, sizeof(s));
-  s.store = &st;
   s.duid_seed = 0xA5A5A5A5ULL;
 
   make_server_duid(&s.server_duid, s.duid_seed);
@@ -50,56 +68,81 @@ int main(){
   s.valid_lft = 86400;
 
   /* load config */
-  config_load("/etc/dhcpv6d.conf", &s);
-  config_dump(&s);
-
-  /* CLI */
-  cli_init(&s, "/run/dhcpv6d.sock");
+  config_load(CONFIG_PATH, &s);
 
-  log_printf(LOG_INFO, "dhcpv6d started");
+  /* DUID hash: before any lease is keyed (journal/map replay included) */
+  if(hash_select(s.duid_hash) < 0){
+    log_printf(LOG_WARN, "duid_hash=%s not supported on this CPU, using %s",
+               hash_kind_name(s.duid_hash), hash_kind_name(hash_selected()));
+    s.duid_hash = hash_selected();
+  }
+  make_server_duid(&s.server_duid, s.duid_seed);
 
-  while(1){
-    fd_set rfds;
-    FD_ZERO(&rfds);
+  /* SIGHUP/SIGTERM/SIGINT arrive through a signalfd on the main reactor;
+     block them before any worker exists so every thread inherits the mask */
+  sigset_t sigs;
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGHUP);
+  sigaddset(&sigs, SIGTERM);
+  sigaddset(&sigs, SIGINT);
+  if(reactor_block_signals(&sigs) < 0) return 1;
+
+  /* packet timing scale, before any worker handles a packet */
+  cycles_init();
+
+  /* workers: socket + store + pool slice each; bound in shard order so the
+     reuseport group index matches the steering hash */
+  int nw = s.workers > 1 ? (int)s.workers : 1;
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if(ncpu < 1) ncpu = 1;
+
+  dh6_worker_t* workers = calloc((size_t)nw, sizeof(*workers));
+  if(!workers) return 1;
+  for(int i=0;i<nw;i++){
+    if(worker_init(&workers[i], &s, i, nw, 547) < 0) return 1;
+    if(nw > 1) workers[i].cpu = (int)(i % ncpu);
+  }
 
-    int maxfd = 0;
+  /* single worker runs inline on its own reactor; with shards the main
+     thread keeps a reactor for the CLI and signals only */
+  reactor_t main_rx;
+  reactor_t* rx = &workers[0].rx;
+  if(nw > 1){
+    if(reactor_init(&main_rx) < 0) return 1;
+    rx = &main_rx;
+  }
 
-    FD_SET(sock.fd, &rfds);
-    if(sock.fd > maxfd) maxfd = sock.fd;
+  server_ctx_t* view = nw > 1 ? &s : &workers[0].ctx;
+  config_dump(view);
 
-    int cli_fd = cli_get_fd();
-    if(cli_fd >= 0){
-      FD_SET(cli_fd, &rfds);
-      if(cli_fd > maxfd) maxfd = cli_fd;
-    }
+  /* CLI */
+  cli_init(view, "/run/dhcpv6d.sock", rx, workers, nw);
 
-    int rc = select(maxfd + 1, &rfds, NULL, NULL, NULL);
-    if(rc < 0) continue;
-
-    /* DHCPv6 packet */
-    if(FD_ISSET(sock.fd, &rfds)){
-      uint8_t inbuf[2048], outbuf[2048];
-      size_t inlen=0, outlen=0;
-      struct sockaddr_in6 peer, out_peer;
-      int ifindex=0, out_ifindex=0;
-
-      int r = dh6_sock_recv(&sock, inbuf, sizeof(inbuf), &inlen, &peer, &ifindex);
-      if(r > 0){
-        int h = dh6_handle_packet(&s, inbuf, inlen,
-                                  &peer, ifindex,
-                                  outbuf, sizeof(outbuf), &outlen,
-                                  &out_peer, &out_ifindex);
-        if(h == 1){
-          dh6_sock_send(&sock, outbuf, outlen, &out_peer, out_ifindex);
-        }
-      }
-    }
+  dh6_main_t m = { .tmpl = &s, .workers = workers, .nw = nw, .rx = rx };
+  reactor_ev_t sig_ev;
+  if(reactor_add_signals(rx, &sig_ev, &sigs, on_signal, &m) < 0) return 1;
 
-    /* CLI */
-    if(cli_fd >= 0 && FD_ISSET(cli_fd, &rfds)){
-      cli_handle();
+  if(nw > 1){
+    for(int i=0;i<nw;i++){
+      if(worker_spawn(&workers[i]) < 0) return 1;
     }
   }
 
+  log_printf(LOG_INFO, "dhcpv6d started (%d worker%s)", nw, nw > 1 ? "s" : "");
+
+  if(nw > 1) reactor_run(rx);
+  else worker_run(&workers[0]);
+
+  /* shutdown */
+  cli_close();
+  reactor_del_owned(rx, &sig_ev);
+  for(int i=0;i<nw;i++) worker_stop(&workers[i]);
+  for(int i=0;i<nw;i++) worker_destroy(&workers[i]);
+  if(nw > 1) reactor_free(&main_rx);
+  free(workers);
+  dh6_subnets_free(&s.subnets);
+
+  log_printf(LOG_INFO, "dhcpv6d stopped");
+  log_stop();
   return 0;
 }
@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include "net/reactor.h"
+#include "util/log.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#define RX_MAX_EVENTS 64
+
+static int ctl_add(reactor_t* r, reactor_ev_t* ev, uint32_t events){
+  struct epoll_event e;
+  memset(&e, 0, sizeof(e));
+  e.events = events;
+  e.data.ptr = ev;
+  if(epoll_ctl(r->epfd, EPOLL_CTL_ADD, ev->fd, &e) < 0){
+    log_printf(LOG_ERR, "epoll_ctl(ADD, %d) failed: %s", ev->fd, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+int reactor_init(reactor_t* r){
+  memset(r, 0, sizeof(*r));
+  r->wake.fd = -1;
+  r->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if(r->epfd < 0){
+    log_printf(LOG_ERR, "epoll_create1 failed: %s", strerror(errno));
+    return -1;
+  }
+  r->wake.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  r->wake.kind = RX_WAKE;
+  if(r->wake.fd < 0 || ctl_add(r, &r->wake, EPOLLIN) < 0){
+    reactor_free(r);
+    return -1;
+  }
+  return 0;
+}
+
+void reactor_free(reactor_t* r){
+  if(r->wake.fd >= 0) close(r->wake.fd);
+  if(r->epfd >= 0) close(r->epfd);
+  r->wake.fd = -1;
+  r->epfd = -1;
+}
+
+int reactor_add(reactor_t* r, reactor_ev_t* ev, int fd, uint32_t events,
+                reactor_fn fn, void* arg){
+  ev->fd = fd;
+  ev->kind = RX_FD;
+  ev->fn = fn;
+  ev->arg = arg;
+  ev->signo = 0;
+  return ctl_add(r, ev, events);
+}
+
+void reactor_del(reactor_t* r, reactor_ev_t* ev){
+  if(ev->fd >= 0) epoll_ctl(r->epfd, EPOLL_CTL_DEL, ev->fd, NULL);
+}
+
+int reactor_add_timer(reactor_t* r, reactor_ev_t* ev, uint32_t period_ms,
+                      reactor_fn fn, void* arg){
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if(fd < 0){
+    log_printf(LOG_ERR, "timerfd_create failed: %s", strerror(errno));
+    return -1;
+  }
+  struct itimerspec its;
+  its.it_interval.tv_sec = period_ms / 1000;
+  its.it_interval.tv_nsec = (long)(period_ms % 1000) * 1000000L;
+  its.it_value = its.it_interval;
+  if(timerfd_settime(fd, 0, &its, NULL) < 0 ||
+     reactor_add(r, ev, fd, EPOLLIN, fn, arg) < 0){
+    close(fd);
+    return -1;
+  }
+  ev->kind = RX_TIMER;
+  return 0;
+}
+
+int reactor_add_signals(reactor_t* r, reactor_ev_t* ev, const sigset_t* set,
+                        reactor_fn fn, void* arg){
+  int fd = signalfd(-1, set, SFD_NONBLOCK | SFD_CLOEXEC);
+  if(fd < 0){
+    log_printf(LOG_ERR, "signalfd failed: %s", strerror(errno));
+    return -1;
+  }
+  if(reactor_add(r, ev, fd, EPOLLIN, fn, arg) < 0){
+    close(fd);
+    return -1;
+  }
+  ev->kind = RX_SIGNAL;
+  return 0;
+}
+
+void reactor_del_owned(reactor_t* r, reactor_ev_t* ev){
+  reactor_del(r, ev);
+  if(ev->fd >= 0) close(ev->fd);
+  ev->fd = -1;
+}
+
+int reactor_block_signals(const sigset_t* set){
+  int rc = pthread_sigmask(SIG_BLOCK, set, NULL);
+  if(rc != 0){
+    log_printf(LOG_ERR, "pthread_sigmask failed: %s", strerror(rc));
+    return -1;
+  }
+  return 0;
+}
+
+static void dispatch(reactor_t* r, reactor_ev_t* ev, uint32_t events){
+  switch(ev->kind){
+  case RX_WAKE: {
+    uint64_t v;
+    while(read(ev->fd, &v, sizeof(v)) == (ssize_t)sizeof(v)) {}
+    return;
+  }
+  case RX_TIMER: {
+    uint64_t exp;
+    if(read(ev->fd, &exp, sizeof(exp)) != (ssize_t)sizeof(exp)) return;
+    break;
+  }
+  case RX_SIGNAL: {
+    struct signalfd_siginfo si;
+    while(r->running && read(ev->fd, &si, sizeof(si)) == (ssize_t)sizeof(si)){
+      ev->signo = (int)si.ssi_signo;
+      ev->fn(ev, events);
+    }
+    return;
+  }
+  case RX_FD:
+    break;
+  }
+  ev->fn(ev, events);
+}
+
+int reactor_run(reactor_t* r){
+  struct epoll_event evs[RX_MAX_EVENTS];
+  r->running = 1;
+  while(r->running){
+    int n = epoll_wait(r->epfd, evs, RX_MAX_EVENTS, -1);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      log_printf(LOG_ERR, "epoll_wait failed: %s", strerror(errno));
+      return -1;
+    }
+    for(int i=0;i<n && r->running;i++){
+      dispatch(r, (reactor_ev_t*)evs[i].data.ptr, evs[i].events);
+    }
+  }
+  return 0;
+}
+
+void reactor_stop(reactor_t* r){
+  uint64_t one = 1;
+  r->running = 0;
+  (void)!write(r->wake.fd, &one, sizeof(one));
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include <signal.h>
+
+/*
+ * epoll reactor: one per thread.
+ * Sources are caller-owned reactor_ev_t records (embed them in the owning
+ * object); the record pointer rides in epoll_data, so dispatch is O(ready)
+ * with no fd table and no FD_SETSIZE limit.
+ * - plain fd: fn(ev, epoll events)
+ * - timer:    timerfd, expirations drained before fn
+ * - signals:  signalfd, ev->signo set before fn (block the set first,
+ *             before any thread is spawned, with reactor_block_signals)
+ */
+
+typedef struct reactor_ev reactor_ev_t;
+typedef void (*reactor_fn)(reactor_ev_t* ev, uint32_t events);
+
+typedef enum { RX_FD=0, RX_TIMER, RX_SIGNAL, RX_WAKE } reactor_kind_t;
+
+struct reactor_ev {
+  int fd;
+  reactor_kind_t kind;
+  reactor_fn fn;
+  void* arg;
+  int signo;      // RX_SIGNAL: last delivered signal
+};
+
+typedef struct {
+  int epfd;
+  reactor_ev_t wake;   // eventfd for reactor_stop() from other threads
+  volatile int running;
+} reactor_t;
+
+int  reactor_init(reactor_t* r);
+void reactor_free(reactor_t* r);
+
+int  reactor_add(reactor_t* r, reactor_ev_t* ev, int fd, uint32_t events,
+                 reactor_fn fn, void* arg);
+void reactor_del(reactor_t* r, reactor_ev_t* ev); // deregister only, fd stays open
+
+// periodic timer; closes its fd on reactor_del_owned
+int  reactor_add_timer(reactor_t* r, reactor_ev_t* ev, uint32_t period_ms,
+                       reactor_fn fn, void* arg);
+int  reactor_add_signals(reactor_t* r, reactor_ev_t* ev, const sigset_t* set,
+                         reactor_fn fn, void* arg);
+void reactor_del_owned(reactor_t* r, reactor_ev_t* ev); // deregister + close
+
+int  reactor_block_signals(const sigset_t* set); // for the calling thread and its children
+
+int  reactor_run(reactor_t* r);   // until reactor_stop(); -1 on epoll error
+void reactor_stop(reactor_t* r);  // async-safe, any thread
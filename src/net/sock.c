@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 #include "net/sock.h"
+#include "net/uring.h"
 #include "util/log.h"
 
 #include <string.h>
@@ -10,7 +11,7 @@
 #include <netinet/ip6.h>
 #include <arpa/inet.h>
 
-int dh6_sock_open(dh6_sock_t* s, uint16_t port){
+static int sock_open(dh6_sock_t* s, uint16_t port, int reuseport){
   memset(s, 0, sizeof(*s));
   int fd = socket(AF_INET6, SOCK_DGRAM, 0);
   if(fd < 0){
@@ -21,6 +22,14 @@ int dh6_sock_open(dh6_sock_t* s, uint16_t port){
   int on = 1;
   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
   setsockopt(fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &on, sizeof(on));
+  // absorb mass-reboot SOLICIT bursts between wakeups (capped by rmem_max)
+  int rcvbuf = DH6_SOCK_RCVBUF;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  if(reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0){
+    log_printf(LOG_ERR, "SO_REUSEPORT failed: %s", strerror(errno));
+    close(fd);
+    return -1;
+  }
 
   struct sockaddr_in6 addr;
   memset(&addr, 0, sizeof(addr));
@@ -38,6 +47,30 @@ int dh6_sock_open(dh6_sock_t* s, uint16_t port){
   return 0;
 }
 
+int dh6_sock_open(dh6_sock_t* s, uint16_t port){
+  return sock_open(s, port, 0);
+}
+
+int dh6_sock_open_reuseport(dh6_sock_t* s, uint16_t port){
+  return sock_open(s, port, 1);
+}
+
+void dh6_sock_close(dh6_sock_t* s){
+  if(s->ring) dh6_uring_close(s->ring);
+  s->ring = NULL;
+  if(s->fd >= 0) close(s->fd);
+  s->fd = -1;
+}
+
+int dh6_sock_use_uring(dh6_sock_t* s){
+  if(s->ring) return 0;
+  return dh6_uring_open(&s->ring, s->fd);
+}
+
+int dh6_sock_poll_fd(const dh6_sock_t* s){
+  return s->ring ? dh6_uring_fd(s->ring) : s->fd;
+}
+
 int dh6_sock_recv(dh6_sock_t* s, uint8_t* buf, size_t cap, size_t* out_len,
                   struct sockaddr_in6* peer, int* out_ifindex)
 {
@@ -110,3 +143,116 @@ int dh6_sock_send(dh6_sock_t* s, const uint8_t* buf, size_t len,
   }
   return 0;
 }
+
+void dh6_batch_init(dh6_batch_t* b){
+  b->nrx = 0;
+  b->ntx = 0;
+  b->want = 1;
+}
+
+static int pktinfo_ifindex(struct msghdr* msg){
+  for(struct cmsghdr* c = CMSG_FIRSTHDR(msg);
+      c != NULL;
+      c = CMSG_NXTHDR(msg, c)){
+    if(c->cmsg_level == IPPROTO_IPV6 &&
+       c->cmsg_type == IPV6_PKTINFO){
+      return (int)((struct in6_pktinfo*)CMSG_DATA(c))->ipi6_ifindex;
+    }
+  }
+  return 0;
+}
+
+int dh6_sock_recv_batch(dh6_sock_t* s, dh6_batch_t* b){
+  if(s->ring) return dh6_uring_recv_batch(s->ring, b);
+
+  struct mmsghdr mm[DH6_BATCH_MAX];
+  struct iovec iov[DH6_BATCH_MAX];
+  uint8_t cmsgbuf[DH6_BATCH_MAX][CMSG_SPACE(sizeof(struct in6_pktinfo))];
+
+  unsigned want = b->want;
+  if(want < 1) want = 1;
+  if(want > DH6_BATCH_MAX) want = DH6_BATCH_MAX;
+
+  memset(mm, 0, sizeof(mm[0]) * want);
+  for(unsigned i=0;i<want;i++){
+    iov[i].iov_base = b->rx[i].buf;
+    iov[i].iov_len = sizeof(b->rx[i].buf);
+    mm[i].msg_hdr.msg_name = &b->rx[i].peer;
+    mm[i].msg_hdr.msg_namelen = sizeof(b->rx[i].peer);
+    mm[i].msg_hdr.msg_iov = &iov[i];
+    mm[i].msg_hdr.msg_iovlen = 1;
+    mm[i].msg_hdr.msg_control = cmsgbuf[i];
+    mm[i].msg_hdr.msg_controllen = sizeof(cmsgbuf[i]);
+  }
+
+  b->nrx = 0;
+  int n = recvmmsg(s->fd, mm, want, MSG_DONTWAIT, NULL);
+  if(n < 0){
+    if(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+    log_printf(LOG_ERR, "recvmmsg failed: %s", strerror(errno));
+    return -1;
+  }
+
+  for(int i=0;i<n;i++){
+    b->rx[i].len = mm[i].msg_len;
+    b->rx[i].ifindex = pktinfo_ifindex(&mm[i].msg_hdr);
+  }
+  b->nrx = (size_t)n;
+
+  // full batch: more is probably queued; short batch: follow the load down
+  if((unsigned)n == want){
+    b->want = want * 2 > DH6_BATCH_MAX ? DH6_BATCH_MAX : want * 2;
+  } else {
+    unsigned next = (want + (unsigned)n) / 2;
+    b->want = next ? next : 1;
+  }
+  return n;
+}
+
+int dh6_sock_send_batch(dh6_sock_t* s, dh6_batch_t* b){
+  if(s->ring) return dh6_uring_send_batch(s->ring, b);
+
+  struct mmsghdr mm[DH6_BATCH_MAX];
+  struct iovec iov[DH6_BATCH_MAX];
+  uint8_t cmsgbuf[DH6_BATCH_MAX][CMSG_SPACE(sizeof(struct in6_pktinfo))];
+
+  size_t cnt = b->ntx;
+  b->ntx = 0;
+  if(cnt == 0) return 0;
+
+  memset(mm, 0, sizeof(mm[0]) * cnt);
+  memset(cmsgbuf, 0, sizeof(cmsgbuf[0]) * cnt);
+  for(size_t i=0;i<cnt;i++){
+    iov[i].iov_base = b->tx[i].buf;
+    iov[i].iov_len = b->tx[i].len;
+    struct msghdr* msg = &mm[i].msg_hdr;
+    msg->msg_name = &b->tx[i].peer;
+    msg->msg_namelen = sizeof(b->tx[i].peer);
+    msg->msg_iov = &iov[i];
+    msg->msg_iovlen = 1;
+    msg->msg_control = cmsgbuf[i];
+    msg->msg_controllen = sizeof(cmsgbuf[i]);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg);
+    cmsg->cmsg_level = IPPROTO_IPV6;
+    cmsg->cmsg_type = IPV6_PKTINFO;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+    ((struct in6_pktinfo*)CMSG_DATA(cmsg))->ipi6_ifindex = (unsigned)b->tx[i].ifindex;
+  }
+
+  // sendmmsg stops at the first failing message: report and skip it
+  size_t off = 0;
+  int sent = 0;
+  while(off < cnt){
+    int n = sendmmsg(s->fd, mm + off, (unsigned)(cnt - off), 0);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      log_printf(LOG_WARN, "sendmmsg failed: %s", strerror(errno));
+      off++;
+      continue;
+    }
+    sent += n;
+    off += (size_t)n;
+  }
+  return sent;
+}
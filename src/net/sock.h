@@ -5,10 +5,49 @@
 
 typedef struct {
   int fd;
+  struct dh6_uring* ring;   // io_uring datapath, NULL = recvmmsg/sendmmsg
 } dh6_sock_t;
 
+#define DH6_SOCK_RCVBUF (4 << 20)
+#define DH6_PKT_MAX   2048
+#define DH6_BATCH_MAX 32
+
+typedef struct {
+  uint8_t buf[DH6_PKT_MAX];
+  size_t len;
+  struct sockaddr_in6 peer;
+  int ifindex;
+} dh6_pkt_t;
+
+/*
+ * Batched datapath: recv_batch drains up to `want` datagrams with one
+ * recvmmsg (never blocks), the caller fills tx[0..ntx), send_batch
+ * flushes them with one sendmmsg. `want` adapts to queue depth: it
+ * doubles while batches come back full and decays toward the observed
+ * size, so a lone packet at low load is handled as soon as it arrives.
+ */
+typedef struct {
+  dh6_pkt_t rx[DH6_BATCH_MAX];
+  size_t nrx;
+  dh6_pkt_t tx[DH6_BATCH_MAX];
+  size_t ntx;
+  unsigned want;
+} dh6_batch_t;
+
 int dh6_sock_open(dh6_sock_t* s, uint16_t port); // bind :: port
+// same, joining a SO_REUSEPORT group; group index = bind order
+int dh6_sock_open_reuseport(dh6_sock_t* s, uint16_t port);
+void dh6_sock_close(dh6_sock_t* s);
 int dh6_sock_recv(dh6_sock_t* s, uint8_t* buf, size_t cap, size_t* out_len,
                   struct sockaddr_in6* peer, int* out_ifindex);
 int dh6_sock_send(dh6_sock_t* s, const uint8_t* buf, size_t len,
                   const struct sockaddr_in6* peer, int ifindex);
+
+// switch the batch calls to io_uring (IO_URING=1 builds); -1 = stays on
+// syscalls. Call from the servicing thread, then wait on dh6_sock_poll_fd().
+int dh6_sock_use_uring(dh6_sock_t* s);
+int dh6_sock_poll_fd(const dh6_sock_t* s);
+
+void dh6_batch_init(dh6_batch_t* b);
+int dh6_sock_recv_batch(dh6_sock_t* s, dh6_batch_t* b); // count, 0 = none, -1 = error
+int dh6_sock_send_batch(dh6_sock_t* s, dh6_batch_t* b); // sent count; clears tx
@@ -0,0 +1,101 @@
+#define _GNU_SOURCE
+#include "net/steer.h"
+#include "dhcp/msg.h"
+#include "dhcp/opt.h"
+#include "util/log.h"
+
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+// per unrolled option step: 6 insns
+#define STEP_INSNS 6
+// per Relay-Forward layer: type check, skip the header, find Relay Message
+#define HOP_INSNS  (3 + 3 + DHCP6_STEER_MAX_OPTS*STEP_INSNS + 1 + 3)
+#define PROG_INSNS (1 + DH6_RELAY_MAX*HOP_INSNS + 3 + 1 + 3 + DHCP6_STEER_MAX_OPTS*STEP_INSNS + 1 + 12)
+
+// X += k
+static size_t add_x(struct sock_filter* prog, size_t n, uint32_t k){
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_MISC|BPF_TXA, 0);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_ALU|BPF_ADD|BPF_K, k);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_MISC|BPF_TAX, 0);
+  return n;
+}
+
+// walk the options at X for code; X = the option on a match, which jumps
+// to found
+static size_t find_opt(struct sock_filter* prog, size_t n, uint16_t code, size_t found){
+  for(int i=0;i<DHCP6_STEER_MAX_OPTS;i++){
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD|BPF_H|BPF_IND, 0);      // A = code
+    prog[n] = (struct sock_filter)BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, code, (uint8_t)(found - n - 1), 0);
+    n++;
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD|BPF_H|BPF_IND, 2);      // A = len
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_ALU|BPF_ADD|BPF_K, 4);
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0);
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_MISC|BPF_TAX, 0);          // X = next option
+  }
+  return n;
+}
+
+int dh6_steer_attach(int fd, uint32_t nshards){
+  if(nshards < 2) return 0;
+
+  struct sock_filter prog[PROG_INSNS];
+  size_t n = 0;
+  size_t ja[DH6_RELAY_MAX + 1];
+
+  // skb data starts at the UDP payload; X = start of the message
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_LDX|BPF_IMM, 0);
+
+  // Relay-Forward layers (relays send everything we see in production):
+  // step into the Relay Message until the client message shows up
+  for(int h=0;h<=DH6_RELAY_MAX;h++){
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD|BPF_B|BPF_IND, 0);      // A = msg-type
+    prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, DHCP6_RELAYFWD, 1, 0);
+    ja[h] = n;
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_JMP|BPF_JA, 0);            // -> client message
+    if(h == DH6_RELAY_MAX) break;
+    n = add_x(prog, n, DH6_RELAY_HDR_LEN);
+    size_t found = n + DHCP6_STEER_MAX_OPTS*STEP_INSNS + 1;
+    n = find_opt(prog, n, OPT_RELAY_MSG, found);
+    prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET|BPF_K, 0xffffffffu);
+    n = add_x(prog, n, 4);                                                  // X = inner message
+  }
+  // nested too deep
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET|BPF_K, 0xffffffffu);
+
+  // client message: msg-type(1) txid(3) options...
+  for(int h=0;h<=DH6_RELAY_MAX;h++) prog[ja[h]].k = (uint32_t)(n - ja[h] - 1);
+  n = add_x(prog, n, 4);
+  size_t found = n + DHCP6_STEER_MAX_OPTS*STEP_INSNS + 1;
+  n = find_opt(prog, n, OPT_CLIENTID, found);
+  // out of range index => kernel falls back to its own hash
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET|BPF_K, 0xffffffffu);
+
+  // found: X = option start; hash the last 4 DUID bytes (MAC/UUID tail)
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD|BPF_H|BPF_IND, 2);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_ALU|BPF_ADD|BPF_X, 0);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_MISC|BPF_TAX, 0);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD|BPF_W|BPF_IND, 0);
+  // mul / xor-fold / mul: DUID tails are often sequential
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_ALU|BPF_MUL|BPF_K, 0x9e3779b1u);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_MISC|BPF_TAX, 0);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_ALU|BPF_RSH|BPF_K, 16);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_ALU|BPF_XOR|BPF_X, 0);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_ALU|BPF_MUL|BPF_K, 0x85ebca6bu);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_ALU|BPF_RSH|BPF_K, 16);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_ALU|BPF_MOD|BPF_K, nshards);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET|BPF_A, 0);
+
+  struct sock_fprog fp = { .len = (unsigned short)n, .filter = prog };
+  if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fp, sizeof(fp)) < 0){
+    log_printf(LOG_WARN, "SO_ATTACH_REUSEPORT_CBPF failed: %s (kernel hash steering)", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * SO_REUSEPORT steering: classic BPF program that finds the Client-ID
+ * option (first DHCP6_STEER_MAX_OPTS options) and picks socket
+ * hash(last 4 DUID bytes) % nshards, so a client always reaches the same
+ * shard. Relay-Forward layers are stepped through (the Relay Message
+ * among their first DHCP6_STEER_MAX_OPTS options), so relayed and direct
+ * messages of a client steer alike. Packets without a reachable
+ * Client-ID fall back to the kernel's 4-tuple hash. Attach to any socket
+ * of the group once it is bound.
+ */
+
+#define DHCP6_STEER_MAX_OPTS 8
+
+int dh6_steer_attach(int fd, uint32_t nshards);
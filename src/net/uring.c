@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+#include "net/uring.h"
+#include "util/log.h"
+
+#ifdef DH6_IO_URING
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define UR_SQ      256
+#define UR_CQ      4096
+#define UR_NBUF    256          // provided receive buffers (power of two)
+#define UR_BGID    0
+#define UR_CMSG    CMSG_SPACE(sizeof(struct in6_pktinfo))
+#define UR_BUFSZ   (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in6) + UR_CMSG + DH6_PKT_MAX)
+#define UR_TX      (4 * DH6_BATCH_MAX)
+#define UD_RECV    (~(uint64_t)0)
+
+// reply kept alive until its SENDMSG completes
+typedef struct {
+  struct msghdr msg;
+  struct iovec iov;
+  struct sockaddr_in6 peer;
+  uint8_t cmsg[UR_CMSG];
+  uint8_t buf[DH6_PKT_MAX];
+} ur_tx_t;
+
+struct dh6_uring {
+  int fd;
+  int sock_fd;
+
+  // SQ / CQ rings (single mmap)
+  void* ring;
+  size_t ring_sz;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe* sqes;
+  size_t sqes_sz;
+  struct io_uring_cqe* cqes;
+  unsigned sq_entries;
+  unsigned to_submit;
+
+  // provided buffer ring
+  struct io_uring_buf_ring* br;
+  size_t br_sz;
+  uint8_t* bufs;
+  uint16_t br_tail;
+
+  struct msghdr rx_tmpl;
+  int armed;
+
+  ur_tx_t* tx;
+  int tx_free[UR_TX];
+  int ntx_free;
+};
+
+static int ur_setup(unsigned entries, struct io_uring_params* p){
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ur_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags){
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int ur_register(int fd, unsigned op, void* arg, unsigned nr){
+  return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+static struct io_uring_sqe* get_sqe(struct dh6_uring* u){
+  unsigned tail = *u->sq_tail;
+  unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+  if(tail - head >= u->sq_entries){
+    // SQ full: hand what we have to the kernel first
+    if(ur_enter(u->fd, u->to_submit, 0, 0) < 0) return NULL;
+    u->to_submit = 0;
+    head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if(tail - head >= u->sq_entries) return NULL;
+  }
+  unsigned idx = tail & *u->sq_mask;
+  struct io_uring_sqe* sqe = &u->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  u->sq_array[idx] = idx;
+  __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  u->to_submit++;
+  return sqe;
+}
+
+static int submit(struct dh6_uring* u){
+  if(u->to_submit == 0) return 0;
+  int n = ur_enter(u->fd, u->to_submit, 0, 0);
+  if(n < 0){
+    if(errno == EINTR || errno == EAGAIN || errno == EBUSY) return 0;
+    log_printf(LOG_ERR, "io_uring_enter failed: %s", strerror(errno));
+    return -1;
+  }
+  u->to_submit -= (unsigned)n;
+  return 0;
+}
+
+static int arm_recv(struct dh6_uring* u){
+  struct io_uring_sqe* sqe = get_sqe(u);
+  if(!sqe) return -1;
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = u->sock_fd;
+  sqe->addr = (uint64_t)(uintptr_t)&u->rx_tmpl;
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = UR_BGID;
+  sqe->user_data = UD_RECV;
+  u->armed = 1;
+  return submit(u);
+}
+
+static void buf_recycle(struct dh6_uring* u, uint16_t bid){
+  struct io_uring_buf* e = &u->br->bufs[u->br_tail & (UR_NBUF - 1)];
+  e->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * UR_BUFSZ);
+  e->len = (uint32_t)UR_BUFSZ;
+  e->bid = bid;
+  u->br_tail++;
+}
+
+static void buf_publish(struct dh6_uring* u){
+  __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+}
+
+static void unmap(void* p, size_t sz){
+  if(p && p != MAP_FAILED) munmap(p, sz);
+}
+
+void dh6_uring_close(struct dh6_uring* u){
+  if(!u) return;
+  if(u->fd >= 0) close(u->fd); // cancels the armed receive
+  unmap(u->ring, u->ring_sz);
+  unmap(u->sqes, u->sqes_sz);
+  unmap(u->br, u->br_sz);
+  free(u->bufs);
+  free(u->tx);
+  free(u);
+}
+
+int dh6_uring_fd(const struct dh6_uring* u){
+  return u->fd;
+}
+
+static int ur_fail(struct dh6_uring* u, const char* what, int err){
+  log_printf(LOG_WARN, "io_uring unavailable (%s: %s), using recvmmsg/sendmmsg",
+             what, strerror(err));
+  dh6_uring_close(u);
+  return -1;
+}
+
+int dh6_uring_open(struct dh6_uring** out, int sock_fd){
+  *out = NULL;
+  struct dh6_uring* u = calloc(1, sizeof(*u));
+  if(!u) return -1;
+  u->sock_fd = sock_fd;
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = UR_CQ;
+  u->fd = ur_setup(UR_SQ, &p);
+  if(u->fd < 0) return ur_fail(u, "setup", errno);
+  if(!(p.features & IORING_FEAT_SINGLE_MMAP)) return ur_fail(u, "features", ENOTSUP);
+
+  size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  u->ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+  u->ring = mmap(NULL, u->ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 u->fd, IORING_OFF_SQ_RING);
+  if(u->ring == MAP_FAILED){ u->ring = NULL; return ur_fail(u, "mmap rings", errno); }
+  u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 u->fd, IORING_OFF_SQES);
+  if(u->sqes == MAP_FAILED){ u->sqes = NULL; return ur_fail(u, "mmap sqes", errno); }
+
+  uint8_t* r = (uint8_t*)u->ring;
+  u->sq_head  = (unsigned*)(r + p.sq_off.head);
+  u->sq_tail  = (unsigned*)(r + p.sq_off.tail);
+  u->sq_mask  = (unsigned*)(r + p.sq_off.ring_mask);
+  u->sq_array = (unsigned*)(r + p.sq_off.array);
+  u->cq_head  = (unsigned*)(r + p.cq_off.head);
+  u->cq_tail  = (unsigned*)(r + p.cq_off.tail);
+  u->cq_mask  = (unsigned*)(r + p.cq_off.ring_mask);
+  u->cqes     = (struct io_uring_cqe*)(r + p.cq_off.cqes);
+  u->sq_entries = p.sq_entries;
+
+  // provided buffers: the kernel picks one per datagram
+  u->br_sz = UR_NBUF * sizeof(struct io_uring_buf);
+  u->br = mmap(NULL, u->br_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(u->br == MAP_FAILED){ u->br = NULL; return ur_fail(u, "mmap buffer ring", errno); }
+  u->bufs = malloc((size_t)UR_NBUF * UR_BUFSZ);
+  u->tx = malloc(UR_TX * sizeof(ur_tx_t));
+  if(!u->bufs || !u->tx) return ur_fail(u, "alloc", ENOMEM);
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+  reg.ring_entries = UR_NBUF;
+  reg.bgid = UR_BGID;
+  if(ur_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    return ur_fail(u, "register buffer ring", errno);
+  for(uint16_t i=0;i<UR_NBUF;i++) buf_recycle(u, i);
+  buf_publish(u);
+
+  for(int i=0;i<UR_TX;i++) u->tx_free[i] = i;
+  u->ntx_free = UR_TX;
+
+  // recvmsg_out layout: fixed name + control room ahead of the payload
+  u->rx_tmpl.msg_namelen = sizeof(struct sockaddr_in6);
+  u->rx_tmpl.msg_controllen = UR_CMSG;
+
+  if(arm_recv(u) < 0) return ur_fail(u, "arm recvmsg", errno);
+
+  // kernels without multishot recvmsg reject it at submit time
+  unsigned head = *u->cq_head;
+  if(head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)){
+    struct io_uring_cqe* c = &u->cqes[head & *u->cq_mask];
+    if(c->user_data == UD_RECV && c->res < 0 && !(c->flags & IORING_CQE_F_MORE))
+      return ur_fail(u, "multishot recvmsg", -c->res);
+  }
+
+  log_printf(LOG_INFO, "io_uring datapath on fd %d", sock_fd);
+  *out = u;
+  return 0;
+}
+
+static void on_recv(struct dh6_uring* u, const struct io_uring_cqe* c, dh6_batch_t* b){
+  if(!(c->flags & IORING_CQE_F_MORE)) u->armed = 0;
+  if(c->res < 0){
+    if(c->res != -ENOBUFS)
+      log_printf(LOG_ERR, "io_uring recvmsg failed: %s", strerror(-c->res));
+    return;
+  }
+  if(!(c->flags & IORING_CQE_F_BUFFER)) return;
+
+  uint16_t bid = (uint16_t)(c->flags >> IORING_CQE_BUFFER_SHIFT);
+  uint8_t* base = u->bufs + (size_t)bid * UR_BUFSZ;
+  struct msghdr view = u->rx_tmpl;
+  struct io_uring_recvmsg_out* o = (struct io_uring_recvmsg_out*)base;
+  uint8_t* name = base + sizeof(*o);
+  uint8_t* ctl = name + u->rx_tmpl.msg_namelen;
+  uint8_t* payload = ctl + u->rx_tmpl.msg_controllen;
+
+  if(!(o->flags & MSG_TRUNC) && o->payloadlen <= DH6_PKT_MAX){
+    dh6_pkt_t* pk = &b->rx[b->nrx++];
+    memset(&pk->peer, 0, sizeof(pk->peer));
+    memcpy(&pk->peer, name, o->namelen < sizeof(pk->peer) ? o->namelen : sizeof(pk->peer));
+    memcpy(pk->buf, payload, o->payloadlen);
+    pk->len = o->payloadlen;
+    pk->ifindex = 0;
+
+    view.msg_control = ctl;
+    view.msg_controllen = o->controllen;
+    for(struct cmsghdr* cm = CMSG_FIRSTHDR(&view); cm; cm = CMSG_NXTHDR(&view, cm)){
+      if(cm->cmsg_level == IPPROTO_IPV6 && cm->cmsg_type == IPV6_PKTINFO){
+        pk->ifindex = (int)((struct in6_pktinfo*)CMSG_DATA(cm))->ipi6_ifindex;
+        break;
+      }
+    }
+  }
+  buf_recycle(u, bid);
+}
+
+static void on_send(struct dh6_uring* u, const struct io_uring_cqe* c){
+  if(c->res < 0) log_printf(LOG_WARN, "io_uring sendmsg failed: %s", strerror(-c->res));
+  if(c->user_data < UR_TX) u->tx_free[u->ntx_free++] = (int)c->user_data;
+}
+
+int dh6_uring_recv_batch(struct dh6_uring* u, dh6_batch_t* b){
+  b->nrx = 0;
+
+  unsigned head = *u->cq_head;
+  unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+  while(head != tail){
+    struct io_uring_cqe* c = &u->cqes[head & *u->cq_mask];
+    if(c->user_data == UD_RECV){
+      if(b->nrx == DH6_BATCH_MAX) break; // rest stays queued; fd stays readable
+      on_recv(u, c, b);
+    } else {
+      on_send(u, c);
+    }
+    head++;
+  }
+  __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+  buf_publish(u);
+
+  // multishot ends on ENOBUFS or error: buffers are back, re-arm
+  if(!u->armed && arm_recv(u) < 0) return -1;
+  return (int)b->nrx;
+}
+
+int dh6_uring_send_batch(struct dh6_uring* u, dh6_batch_t* b){
+  size_t cnt = b->ntx;
+  b->ntx = 0;
+  int sent = 0;
+
+  for(size_t i=0;i<cnt;i++){
+    const dh6_pkt_t* pk = &b->tx[i];
+    struct io_uring_sqe* sqe = (u->ntx_free > 0) ? get_sqe(u) : NULL;
+    if(!sqe){
+      // every slot still in flight: plain sendmsg keeps the reply
+      dh6_sock_t s = { .fd = u->sock_fd, .ring = NULL };
+      if(dh6_sock_send(&s, pk->buf, pk->len, &pk->peer, pk->ifindex) == 0) sent++;
+      continue;
+    }
+
+    int slot = u->tx_free[--u->ntx_free];
+    ur_tx_t* t = &u->tx[slot];
+    memcpy(t->buf, pk->buf, pk->len);
+    t->peer = pk->peer;
+    t->iov.iov_base = t->buf;
+    t->iov.iov_len = pk->len;
+    memset(&t->msg, 0, sizeof(t->msg));
+    memset(t->cmsg, 0, sizeof(t->cmsg));
+    t->msg.msg_name = &t->peer;
+    t->msg.msg_namelen = sizeof(t->peer);
+    t->msg.msg_iov = &t->iov;
+    t->msg.msg_iovlen = 1;
+    t->msg.msg_control = t->cmsg;
+    t->msg.msg_controllen = sizeof(t->cmsg);
+    struct cmsghdr* cm = CMSG_FIRSTHDR(&t->msg);
+    cm->cmsg_level = IPPROTO_IPV6;
+    cm->cmsg_type = IPV6_PKTINFO;
+    cm->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+    ((struct in6_pktinfo*)CMSG_DATA(cm))->ipi6_ifindex = (unsigned)pk->ifindex;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = u->sock_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&t->msg;
+    sqe->len = 1;
+    sqe->user_data = (uint64_t)slot;
+    sent++;
+  }
+  if(submit(u) < 0) return -1;
+  return sent;
+}
+
+#else /* !DH6_IO_URING */
+
+int dh6_uring_open(struct dh6_uring** out, int sock_fd){
+  (void)sock_fd;
+  *out = NULL;
+  return -1;
+}
+
+void dh6_uring_close(struct dh6_uring* u){ (void)u; }
+int  dh6_uring_fd(const struct dh6_uring* u){ (void)u; return -1; }
+int  dh6_uring_recv_batch(struct dh6_uring* u, dh6_batch_t* b){ (void)u; b->nrx = 0; return -1; }
+int  dh6_uring_send_batch(struct dh6_uring* u, dh6_batch_t* b){ (void)u; b->ntx = 0; return -1; }
+
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+#include "net/sock.h"
+
+/*
+ * io_uring datapath behind dh6_sock_recv_batch/send_batch (make IO_URING=1).
+ * One multishot IORING_OP_RECVMSG stays armed on the socket and lands
+ * datagrams in a provided-buffer ring; completions are reaped straight
+ * from the mmap'ed CQ, so receiving costs no syscalls beyond the wakeup.
+ * Replies are queued as SENDMSG SQEs and submitted with one
+ * io_uring_enter per batch. Without IO_URING, dh6_uring_open() fails and
+ * sockets stay on recvmmsg/sendmmsg.
+ */
+
+struct dh6_uring;
+
+// create ring + buffer ring and arm the receive; call on the thread that
+// will service the socket (completion work runs on the submitter)
+int  dh6_uring_open(struct dh6_uring** out, int sock_fd);
+void dh6_uring_close(struct dh6_uring* u);
+int  dh6_uring_fd(const struct dh6_uring* u);
+
+int  dh6_uring_recv_batch(struct dh6_uring* u, dh6_batch_t* b);
+int  dh6_uring_send_batch(struct dh6_uring* u, dh6_batch_t* b);
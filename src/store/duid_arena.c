@@ -0,0 +1,271 @@
+// src/store/duid_arena.c
+#include "store/duid_arena.h"
+#include "util/hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INIT_RECS 64
+#define INIT_SLAB 1024
+
+// index entry and lookup key: the bytes are compared in the slab
+typedef struct {
+  uint64_t h;
+  uint32_t handle;
+  uint32_t pad;
+} idx_ent_t;
+
+typedef struct {
+  const duid_arena_t* a;
+  const uint8_t* p;
+  size_t len;
+  uint64_t h;
+} idx_key_t;
+
+static uint64_t idx_hash(const void* e){ return ((const idx_ent_t*)e)->h; }
+static int idx_eq(const void* e, const void* k){
+  const idx_ent_t* x = e;
+  const idx_key_t* q = k;
+  if(x->h != q->h) return 0;
+  const duid_rec_t* r = &q->a->a.recs[x->handle];
+  return r->len == q->len && memcmp(q->a->a.slab + r->off, q->p, q->len) == 0;
+}
+
+const htab_type_t duid_idx_type = { sizeof(idx_ent_t), idx_hash, idx_eq };
+
+static unsigned class_of(size_t len){ return (unsigned)((len - 1) / 8); }
+static uint32_t class_size(unsigned cls){ return (cls + 1) * 8; }
+
+// ---- records ----
+
+static int grow_recs(duid_arena_t* a){
+  duid_arena_arr_t* r = &a->a;
+  if(r->rec_cap >= UINT32_MAX / 2) return -1;
+  uint32_t ncap = r->rec_cap * 2;
+  duid_rec_t* n = realloc(r->recs, (size_t)ncap * sizeof(*n));
+  if(!n) return -1;
+  memset(n + r->rec_cap, 0, (size_t)(ncap - r->rec_cap) * sizeof(*n));
+  r->recs = n;
+  r->rec_cap = ncap;
+  return 0;
+}
+
+static int rec_alloc(duid_arena_t* a, uint32_t* out){
+  duid_arena_arr_t* r = &a->a;
+  if(r->c.free_rec){
+    *out = r->c.free_rec;
+    r->c.free_rec = r->recs[*out].off;
+    return 0;
+  }
+  if(r->c.nrec >= r->rec_cap && (a->fixed || grow_recs(a) < 0)) return -1;
+  *out = r->c.nrec++;
+  return 0;
+}
+
+static void rec_release(duid_arena_t* a, uint32_t handle){
+  duid_rec_t* x = &a->a.recs[handle];
+  memset(x, 0, sizeof(*x));
+  x->off = a->a.c.free_rec;
+  a->a.c.free_rec = handle;
+}
+
+// ---- slab ----
+
+static int grow_slab(duid_arena_t* a, uint64_t need){
+  duid_arena_arr_t* r = &a->a;
+  uint64_t ncap = r->slab_cap;
+  while(ncap < need) ncap *= 2;
+  if(ncap > UINT32_MAX) return -1;
+  uint8_t* n = realloc(r->slab, (size_t)ncap);
+  if(!n) return -1;
+  r->slab = n;
+  r->slab_cap = (uint32_t)ncap;
+  return 0;
+}
+
+// a free chunk holds the next one's offset + 1 in its first bytes
+static int chunk_alloc(duid_arena_t* a, unsigned cls, uint32_t* off){
+  duid_arena_arr_t* r = &a->a;
+  uint32_t* head = &r->c.free_chunk[cls];
+  if(*head){
+    *off = *head - 1;
+    memcpy(head, r->slab + *off, sizeof(*head));
+    return 0;
+  }
+  uint64_t end = (uint64_t)r->c.used + class_size(cls);
+  if(end > r->slab_cap && (a->fixed || grow_slab(a, end) < 0)) return -1;
+  *off = r->c.used;
+  r->c.used = (uint32_t)end;
+  return 0;
+}
+
+static void chunk_free(duid_arena_t* a, unsigned cls, uint32_t off){
+  uint32_t* head = &a->a.c.free_chunk[cls];
+  memcpy(a->a.slab + off, head, sizeof(*head));
+  *head = off + 1;
+}
+
+// ---- lifecycle ----
+
+void duid_arena_cnt_init(duid_arena_cnt_t* c){
+  memset(c, 0, sizeof(*c));
+  c->nrec = 1;
+}
+
+int duid_arena_init(duid_arena_t* a, uint64_t seed){
+  memset(a, 0, sizeof(*a));
+  a->seed = seed;
+  duid_arena_cnt_init(&a->a.c);
+  a->a.recs = calloc(INIT_RECS, sizeof(duid_rec_t));
+  a->a.slab = malloc(INIT_SLAB);
+  if(!a->a.recs || !a->a.slab || htab_init(&a->idx, &duid_idx_type, INIT_RECS) < 0){
+    free(a->a.recs);
+    free(a->a.slab);
+    memset(a, 0, sizeof(*a));
+    return -1;
+  }
+  a->a.rec_cap = INIT_RECS;
+  a->a.slab_cap = INIT_SLAB;
+  return 0;
+}
+
+void duid_arena_attach(duid_arena_t* a, const duid_arena_arr_t* arr, const htab_arr_t* idx, uint64_t seed){
+  memset(a, 0, sizeof(*a));
+  a->a = *arr;
+  a->seed = seed;
+  a->fixed = 1;
+  htab_attach(&a->idx, &duid_idx_type, idx);
+}
+
+void duid_arena_free(duid_arena_t* a){
+  if(!a->fixed){
+    free(a->a.recs);
+    free(a->a.slab);
+  }
+  htab_free(&a->idx);
+  memset(a, 0, sizeof(*a));
+}
+
+void duid_arena_clear(duid_arena_t* a){
+  htab_clear(&a->idx);
+  duid_arena_cnt_init(&a->a.c);
+}
+
+// ---- interning ----
+
+uint64_t duid_arena_hash(const duid_arena_t* a, const uint8_t* duid, size_t len){
+  return hash64_bytes(duid, len, a->seed);
+}
+
+uint32_t duid_arena_find(duid_arena_t* a, const uint8_t* duid, size_t len, uint64_t h){
+  if(len == 0 || len > DUID_MAX) return 0;
+  idx_key_t k = { a, duid, len, h };
+  const idx_ent_t* e = htab_find(&a->idx, h, &k);
+  return e ? e->handle : 0;
+}
+
+// a new handle for bytes known to be absent, refcount 0
+static uint32_t add(duid_arena_t* a, const uint8_t* duid, size_t len, uint64_t h){
+  unsigned cls = class_of(len);
+  uint32_t handle, off;
+  if(rec_alloc(a, &handle) < 0) return 0;
+  if(chunk_alloc(a, cls, &off) < 0){
+    rec_release(a, handle);
+    return 0;
+  }
+  idx_ent_t* e = htab_insert_unique(&a->idx, h);
+  if(!e){
+    chunk_free(a, cls, off);
+    rec_release(a, handle);
+    return 0;
+  }
+  e->h = h;
+  e->handle = handle;
+  e->pad = 0;
+
+  duid_rec_t* r = &a->a.recs[handle];
+  memset(r, 0, sizeof(*r));
+  r->h = h;
+  r->off = off;
+  r->len = (uint8_t)len;
+  memcpy(a->a.slab + off, duid, len);
+  a->a.c.live++;
+  a->a.c.bytes += class_size(cls);
+  return handle;
+}
+
+uint32_t duid_arena_get(duid_arena_t* a, const uint8_t* duid, size_t len, uint64_t h){
+  uint32_t handle = duid_arena_find(a, duid, len, h);
+  if(!handle && len > 0 && len <= DUID_MAX) handle = add(a, duid, len, h);
+  if(handle) a->a.recs[handle].ref++;
+  return handle;
+}
+
+void duid_arena_ref(duid_arena_t* a, uint32_t handle){
+  if(handle && handle < a->a.c.nrec) a->a.recs[handle].ref++;
+}
+
+void duid_arena_put(duid_arena_t* a, uint32_t handle){
+  if(!handle || handle >= a->a.c.nrec) return;
+  duid_rec_t* r = &a->a.recs[handle];
+  if(r->ref == 0 || --r->ref) return;
+
+  idx_key_t k = { a, a->a.slab + r->off, r->len, r->h };
+  htab_erase(&a->idx, r->h, &k);
+  unsigned cls = class_of(r->len);
+  chunk_free(a, cls, r->off);
+  a->a.c.live--;
+  a->a.c.bytes -= class_size(cls);
+  rec_release(a, handle);
+}
+
+const uint8_t* duid_arena_bytes(const duid_arena_t* a, uint32_t handle, size_t* len){
+  if(!handle || handle >= a->a.c.nrec || handle >= a->a.rec_cap) return NULL;
+  const duid_rec_t* r = &a->a.recs[handle];
+  // checked in full: a torn file mapping is validated through here
+  if(!r->ref || !r->len || r->len > DUID_MAX || (uint64_t)r->off + r->len > a->a.slab_cap) return NULL;
+  *len = r->len;
+  return a->a.slab + r->off;
+}
+
+int duid_arena_room(const duid_arena_arr_t* r){
+  return (r->c.free_rec || r->c.nrec < r->rec_cap) &&
+         (uint64_t)r->c.used + DUID_MAX <= r->slab_cap;
+}
+
+int duid_arena_reindex(duid_arena_t* a, uint64_t seed){
+  if(!a->fixed) return -1;
+  a->seed = seed;
+  htab_clear(&a->idx);
+  for(uint32_t i=1;i<a->a.c.nrec;i++){
+    duid_rec_t* r = &a->a.recs[i];
+    if(!r->ref) continue;
+    r->h = hash64_bytes(a->a.slab + r->off, r->len, seed);
+    idx_ent_t* e = htab_insert_unique(&a->idx, r->h);
+    if(!e) return -1;
+    e->h = r->h;
+    e->handle = i;
+    e->pad = 0;
+  }
+  return 0;
+}
+
+int duid_arena_copy(duid_arena_t* dst, const duid_arena_t* src){
+  duid_arena_arr_t* d = &dst->a;
+  if(d->c.nrec != 1 || d->c.live) return -1;
+  while(src->a.c.nrec > d->rec_cap){
+    if(dst->fixed || grow_recs(dst) < 0) return -1;
+  }
+  // live handles first: with no free list yet, add() hands out exactly i
+  for(uint32_t i=1;i<src->a.c.nrec;i++){
+    const duid_rec_t* r = &src->a.recs[i];
+    if(!r->ref) continue;
+    d->c.nrec = i;
+    if(add(dst, src->a.slab + r->off, r->len, r->h) != i) return -1;
+    d->recs[i].ref = r->ref;
+  }
+  d->c.nrec = src->a.c.nrec;
+  for(uint32_t i=src->a.c.nrec - 1; i>=1; i--){
+    if(!src->a.recs[i].ref) rec_release(dst, i);
+  }
+  return 0;
+}
@@ -0,0 +1,95 @@
+// src/store/duid_arena.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "dhcp/duid.h"
+#include "store/htab.h"
+
+/*
+ * Interned client DUIDs. Every distinct DUID is stored once and named by
+ * a 32-bit handle (0 = none); lease keys carry the handle, so a key
+ * compare is an exact identity check. Handles are refcounted by the
+ * leases holding them (a client's NA and PD share one) and recycled at
+ * zero.
+ * - records: handle-indexed array of hash/offset/length/refcount
+ * - slab: the bytes, in chunks of 8-byte size classes; freed chunks go on
+ *   a per-class list (DUIDs of one site come in a few sizes)
+ * - index: htab from the bytes (hash, then memcmp) back to the handle
+ *
+ * Like htab, the arrays are heap-owned and grow on demand, or are
+ * caller-provided (duid_arena_attach, e.g. in a file mapping) and never
+ * resized: an intern that does not fit then fails, so the owner checks
+ * duid_arena_room() and swaps in bigger arrays first.
+ *
+ * Byte pointers handed out stay valid only until the next intern.
+ */
+
+#define DUID_ARENA_CLASSES (DUID_MAX / 8)
+
+typedef struct {
+  uint64_t h;     // hash of the bytes (index rehash)
+  uint32_t off;   // slab offset; next unused handle while unused
+  uint32_t ref;   // leases (and callers) holding the handle, 0 = unused
+  uint8_t len;
+  uint8_t pad[7];
+} duid_rec_t;
+
+typedef struct {
+  uint32_t nrec;      // handles handed out so far (high water, >= 1)
+  uint32_t free_rec;  // an unused handle below nrec, 0 = none
+  uint32_t used;      // slab bytes handed out so far
+  uint32_t live;      // interned DUIDs
+  uint32_t bytes;     // slab bytes in live chunks
+  uint32_t free_chunk[DUID_ARENA_CLASSES]; // per class: offset + 1, 0 = none
+} duid_arena_cnt_t;
+
+typedef struct {
+  duid_rec_t* recs;
+  uint8_t* slab;
+  uint32_t rec_cap;   // records, handle 0 included
+  uint32_t slab_cap;  // bytes
+  duid_arena_cnt_t c;
+} duid_arena_arr_t;
+
+typedef struct {
+  duid_arena_arr_t a;
+  htab_t idx;
+  uint64_t seed;      // idx hashes: hash64_bytes(duid, len, seed)
+  int fixed;
+} duid_arena_t;
+
+// index entry type (fixed-array owners size and attach the table with it)
+extern const htab_type_t duid_idx_type;
+
+int  duid_arena_init(duid_arena_t* a, uint64_t seed);
+void duid_arena_attach(duid_arena_t* a, const duid_arena_arr_t* arr, const htab_arr_t* idx, uint64_t seed);
+void duid_arena_free(duid_arena_t* a);   // heap arrays only
+void duid_arena_clear(duid_arena_t* a);  // forget everything, keeping the arrays
+
+// empty fixed-array counters (handle 0 is never handed out)
+void duid_arena_cnt_init(duid_arena_cnt_t* c);
+
+// h = hash64_bytes(duid, len, a->seed), for callers that have none yet
+uint64_t duid_arena_hash(const duid_arena_t* a, const uint8_t* duid, size_t len);
+
+// handle of an interned DUID, 0 = not interned
+uint32_t duid_arena_find(duid_arena_t* a, const uint8_t* duid, size_t len, uint64_t h);
+
+// intern (or find) and take a reference; 0 = bad length or no room
+uint32_t duid_arena_get(duid_arena_t* a, const uint8_t* duid, size_t len, uint64_t h);
+void     duid_arena_ref(duid_arena_t* a, uint32_t handle);
+void     duid_arena_put(duid_arena_t* a, uint32_t handle); // last one frees it
+
+// bytes of a live handle; NULL = not a live handle
+const uint8_t* duid_arena_bytes(const duid_arena_t* a, uint32_t handle, size_t* len);
+
+// fixed arrays: one more DUID of any length can be interned (the index
+// table is sized by the owner like its other tables)
+int duid_arena_room(const duid_arena_arr_t* a);
+
+// rebuild the index under a new seed or hash selection (fixed arrays)
+int duid_arena_reindex(duid_arena_t* a, uint64_t seed);
+
+// fill an empty arena with src's live DUIDs under the same handles and
+// refcounts, packing the bytes; -1 = does not fit
+int duid_arena_copy(duid_arena_t* dst, const duid_arena_t* src);
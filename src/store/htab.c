@@ -0,0 +1,349 @@
+#include "store/htab.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define CTRL_EMPTY   ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
+
+#define SLOT(a, i, es) ((a)->slots + (size_t)(i) * (es))
+
+static inline int8_t h2_of(uint64_t h){ return (int8_t)(h & 0x7f); }
+static inline size_t h1_of(uint64_t h){ return (size_t)(h >> 7); }
+
+// ---- group scans: bit i set => slot i of the group qualifies ----
+#if defined(__SSE2__)
+static inline uint32_t grp_match(const int8_t* g, int8_t h2){
+  __m128i c = _mm_load_si128((const __m128i*)g);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(h2)));
+}
+static inline uint32_t grp_empty(const int8_t* g){
+  return grp_match(g, CTRL_EMPTY);
+}
+static inline uint32_t grp_free(const int8_t* g){
+  // EMPTY and DELETED are the only tags with the top bit set
+  return (uint32_t)_mm_movemask_epi8(_mm_load_si128((const __m128i*)g));
+}
+#else
+static inline uint32_t grp_match(const int8_t* g, int8_t h2){
+  uint32_t m = 0;
+  for(int i=0;i<HTAB_GROUP;i++) if(g[i] == h2) m |= 1u << i;
+  return m;
+}
+static inline uint32_t grp_empty(const int8_t* g){
+  return grp_match(g, CTRL_EMPTY);
+}
+static inline uint32_t grp_free(const int8_t* g){
+  uint32_t m = 0;
+  for(int i=0;i<HTAB_GROUP;i++) if(g[i] < 0) m |= 1u << i;
+  return m;
+}
+#endif
+
+static size_t round_pow2(size_t n){
+  size_t c = HTAB_GROUP;
+  while(c < n) c <<= 1;
+  return c;
+}
+
+static int arr_alloc(htab_arr_t* a, size_t cap, size_t esize){
+  memset(a, 0, sizeof(*a));
+  a->ctrl = aligned_alloc(HTAB_GROUP, cap);
+  a->slots = malloc(cap * esize);
+  if(!a->ctrl || !a->slots){
+    free(a->ctrl); free(a->slots);
+    memset(a, 0, sizeof(*a));
+    return -1;
+  }
+  memset(a->ctrl, CTRL_EMPTY, cap);
+  a->cap = cap;
+  return 0;
+}
+
+static void arr_free(htab_arr_t* a){
+  free(a->ctrl);
+  free(a->slots);
+  memset(a, 0, sizeof(*a));
+}
+
+static ssize_t arr_find(const htab_t* ht, const htab_arr_t* a, uint64_t h, const void* key){
+  if(a->cap == 0) return -1;
+  size_t gmask = a->cap / HTAB_GROUP - 1;
+  size_t g = h1_of(h) & gmask;
+  int8_t h2 = h2_of(h);
+  for(size_t p=0; p<=a->max_probe; p++){
+    const int8_t* cg = a->ctrl + g * HTAB_GROUP;
+    for(uint32_t m = grp_match(cg, h2); m; m &= m - 1){
+      size_t idx = g * HTAB_GROUP + (size_t)__builtin_ctz(m);
+      if(ht->t->eq(SLOT(a, idx, ht->t->esize), key)) return (ssize_t)idx;
+    }
+    if(grp_empty(cg)) return -1;
+    g = (g + p + 1) & gmask;
+  }
+  return -1;
+}
+
+// first EMPTY/DELETED slot on h's probe sequence; *probe = extra groups walked.
+// the caller guarantees the array is not full.
+static size_t arr_slot_for(const htab_arr_t* a, uint64_t h, size_t* probe){
+  size_t gmask = a->cap / HTAB_GROUP - 1;
+  size_t g = h1_of(h) & gmask;
+  for(size_t p=0;; p++){
+    uint32_t m = grp_free(a->ctrl + g * HTAB_GROUP);
+    if(m){
+      *probe = p;
+      return g * HTAB_GROUP + (size_t)__builtin_ctz(m);
+    }
+    g = (g + p + 1) & gmask;
+  }
+}
+
+// extra groups between h's home group and the one holding slot idx
+static size_t arr_probe_of(const htab_arr_t* a, uint64_t h, size_t idx){
+  size_t gmask = a->cap / HTAB_GROUP - 1;
+  size_t g = h1_of(h) & gmask;
+  size_t p = 0;
+  while(g != idx / HTAB_GROUP){
+    p++;
+    g = (g + p) & gmask;
+  }
+  return p;
+}
+
+static void arr_claim(htab_arr_t* a, size_t idx, uint64_t h, size_t probe){
+  if(a->ctrl[idx] == CTRL_DELETED) a->tomb--;
+  a->ctrl[idx] = h2_of(h);
+  a->count++;
+  a->probe_sum += probe;
+  if(probe > a->max_probe) a->max_probe = probe;
+}
+
+// entry moved out of the old array: a tombstone keeps it probe-able until freed
+static void arr_vacate(htab_arr_t* a, size_t idx, uint64_t h){
+  a->ctrl[idx] = CTRL_DELETED;
+  a->count--;
+  a->probe_sum -= arr_probe_of(a, h, idx);
+}
+
+static void arr_del(htab_arr_t* a, size_t idx, uint64_t h){
+  a->probe_sum -= arr_probe_of(a, h, idx);
+  // a group that still has an EMPTY slot ends every probe that reaches it,
+  // so no chain can run through this slot: it can go straight back to EMPTY
+  if(grp_empty(a->ctrl + (idx & ~(size_t)(HTAB_GROUP - 1)))){
+    a->ctrl[idx] = CTRL_EMPTY;
+  }else{
+    a->ctrl[idx] = CTRL_DELETED;
+    a->tomb++;
+  }
+  a->count--;
+}
+
+static void migrate(htab_t* ht, size_t n){
+  if(ht->old.cap == 0) return;
+  size_t es = ht->t->esize;
+  while(n-- > 0 && ht->mig_pos < ht->old.cap){
+    size_t i = ht->mig_pos++;
+    if(ht->old.ctrl[i] < 0) continue;
+    const uint8_t* e = SLOT(&ht->old, i, es);
+    uint64_t h = ht->t->hash(e);
+    size_t probe;
+    size_t d = arr_slot_for(&ht->cur, h, &probe);
+    arr_claim(&ht->cur, d, h, probe);
+    memcpy(SLOT(&ht->cur, d, es), e, es);
+    // the old array stays probe-able: migrated slots become tombstones
+    arr_vacate(&ht->old, i, h);
+  }
+  if(ht->mig_pos == ht->old.cap){
+    arr_free(&ht->old);
+    ht->mig_pos = 0;
+  }
+}
+
+static int start_resize(htab_t* ht, size_t ncap){
+  migrate(ht, SIZE_MAX); // at most one resize in flight
+  htab_arr_t na;
+  if(arr_alloc(&na, ncap, ht->t->esize) < 0) return -1;
+  ht->old = ht->cur;
+  ht->cur = na;
+  ht->mig_pos = 0;
+  return 0;
+}
+
+int htab_init(htab_t* ht, const htab_type_t* t, size_t min_cap){
+  memset(ht, 0, sizeof(*ht));
+  ht->t = t;
+  ht->min_cap = round_pow2(min_cap);
+  return arr_alloc(&ht->cur, ht->min_cap, t->esize);
+}
+
+void htab_free(htab_t* ht){
+  if(ht->fixed){
+    memset(ht, 0, sizeof(*ht));
+    return;
+  }
+  arr_free(&ht->cur);
+  arr_free(&ht->old);
+}
+
+void htab_attach(htab_t* ht, const htab_type_t* t, const htab_arr_t* arr){
+  memset(ht, 0, sizeof(*ht));
+  ht->t = t;
+  ht->cur = *arr;
+  ht->min_cap = arr->cap;
+  ht->fixed = 1;
+  // not kept with the arrays: one pass over the live entries
+  ht->cur.probe_sum = 0;
+  for(size_t i=0;i<ht->cur.cap;i++){
+    if(ht->cur.ctrl[i] >= 0) ht->cur.probe_sum += arr_probe_of(&ht->cur, t->hash(SLOT(&ht->cur, i, t->esize)), i);
+  }
+}
+
+void htab_clear(htab_t* ht){
+  if(!ht->fixed) return;
+  memset(ht->cur.ctrl, CTRL_EMPTY, ht->cur.cap);
+  ht->cur.count = 0;
+  ht->cur.tomb = 0;
+  ht->cur.max_probe = 0;
+  ht->cur.probe_sum = 0;
+}
+
+size_t htab_count(const htab_t* ht){
+  return ht->cur.count + ht->old.count;
+}
+
+void htab_stat(const htab_t* ht, htab_stat_t* out){
+  out->cap = ht->cur.cap;
+  out->count = htab_count(ht);
+  out->tomb = ht->cur.tomb;
+  out->max_probe = ht->cur.max_probe > ht->old.max_probe ? ht->cur.max_probe : ht->old.max_probe;
+  out->probe_sum = ht->cur.probe_sum + ht->old.probe_sum;
+  out->resizing = ht->old.cap != 0;
+}
+
+void* htab_find(htab_t* ht, uint64_t h, const void* key){
+  migrate(ht, HTAB_MIGRATE_STEP);
+  ssize_t i = arr_find(ht, &ht->cur, h, key);
+  if(i >= 0) return SLOT(&ht->cur, i, ht->t->esize);
+  i = arr_find(ht, &ht->old, h, key);
+  if(i >= 0) return SLOT(&ht->old, i, ht->t->esize);
+  return NULL;
+}
+
+void* htab_insert(htab_t* ht, uint64_t h, const void* key, int* existed){
+  size_t es = ht->t->esize;
+  migrate(ht, HTAB_MIGRATE_STEP);
+
+  ssize_t i = arr_find(ht, &ht->cur, h, key);
+  if(i >= 0){
+    *existed = 1;
+    return SLOT(&ht->cur, i, es);
+  }
+
+  // room for one more (old entries all end up in cur); tombstones count as load
+  size_t cap = ht->cur.cap;
+  if(htab_count(ht) + ht->cur.tomb + 1 > cap / 8 * 7){
+    if(ht->fixed) return NULL;
+    size_t ncap = (htab_count(ht) < cap / 2) ? cap : cap * 2; // same size = purge tombstones
+    if(start_resize(ht, ncap) < 0 && htab_count(ht) + ht->cur.tomb >= cap) return NULL;
+  }
+
+  size_t probe;
+  size_t d = arr_slot_for(&ht->cur, h, &probe);
+  if(probe > HTAB_MAX_PROBE && ht->old.cap == 0 && !ht->fixed){
+    // keep lookups within a couple of groups: grow rather than chain further
+    if(start_resize(ht, ht->cur.cap * 2) == 0) d = arr_slot_for(&ht->cur, h, &probe);
+  }
+
+  *existed = 0;
+  i = arr_find(ht, &ht->old, h, key);
+  arr_claim(&ht->cur, d, h, probe);
+  if(i >= 0){
+    // pull the entry forward so the caller updates it in cur
+    memcpy(SLOT(&ht->cur, d, es), SLOT(&ht->old, i, es), es);
+    arr_vacate(&ht->old, (size_t)i, h);
+    *existed = 1;
+  }
+  return SLOT(&ht->cur, d, es);
+}
+
+int htab_erase(htab_t* ht, uint64_t h, const void* key){
+  migrate(ht, HTAB_MIGRATE_STEP);
+
+  ssize_t i = arr_find(ht, &ht->cur, h, key);
+  if(i >= 0){
+    arr_del(&ht->cur, (size_t)i, h);
+    if(!ht->fixed && ht->old.cap == 0 && ht->cur.cap > ht->min_cap && htab_count(ht) < ht->cur.cap / 8){
+      (void)start_resize(ht, ht->cur.cap / 2); // best effort
+    }
+    return 1;
+  }
+  i = arr_find(ht, &ht->old, h, key);
+  if(i >= 0){
+    arr_vacate(&ht->old, (size_t)i, h);
+    return 1;
+  }
+  return 0;
+}
+
+int htab_reserve(htab_t* ht, size_t n){
+  migrate(ht, SIZE_MAX);
+  size_t ncap = round_pow2(n + n / 7 + HTAB_GROUP);
+  if(ncap <= ht->cur.cap) return 0;
+  if(ht->fixed) return -1;
+  if(start_resize(ht, ncap) < 0) return -1;
+  migrate(ht, SIZE_MAX);
+  return 0;
+}
+
+void* htab_insert_unique(htab_t* ht, uint64_t h){
+  size_t es = ht->t->esize;
+  migrate(ht, HTAB_MIGRATE_STEP);
+
+  size_t cap = ht->cur.cap;
+  if(htab_count(ht) + ht->cur.tomb + 1 > cap / 8 * 7){
+    if(ht->fixed) return NULL;
+    size_t ncap = (htab_count(ht) < cap / 2) ? cap : cap * 2;
+    if(start_resize(ht, ncap) < 0 && htab_count(ht) + ht->cur.tomb >= cap) return NULL;
+  }
+
+  size_t probe;
+  size_t d = arr_slot_for(&ht->cur, h, &probe);
+  if(probe > HTAB_MAX_PROBE && ht->old.cap == 0 && !ht->fixed){
+    if(start_resize(ht, ht->cur.cap * 2) == 0) d = arr_slot_for(&ht->cur, h, &probe);
+  }
+  arr_claim(&ht->cur, d, h, probe);
+  return SLOT(&ht->cur, d, es);
+}
+
+void* htab_next(const htab_t* ht, size_t* pos){
+  size_t es = ht->t->esize;
+  while(*pos < ht->cur.cap){
+    size_t i = (*pos)++;
+    if(ht->cur.ctrl[i] >= 0) return SLOT(&ht->cur, i, es);
+  }
+  while(*pos < ht->cur.cap + ht->old.cap){
+    size_t i = (*pos)++ - ht->cur.cap;
+    if(ht->old.ctrl[i] >= 0) return SLOT(&ht->old, i, es);
+  }
+  return NULL;
+}
+
+static void arr_probe_hist(const htab_t* ht, const htab_arr_t* a, size_t* hist, size_t nbins){
+  if(a->cap == 0) return;
+  for(size_t i=0;i<a->cap;i++){
+    if(a->ctrl[i] < 0) continue;
+    size_t p = arr_probe_of(a, ht->t->hash(SLOT(a, i, ht->t->esize)), i);
+    hist[p < nbins ? p : nbins - 1]++;
+  }
+}
+
+void htab_probe_hist(const htab_t* ht, size_t* hist, size_t nbins){
+  memset(hist, 0, nbins * sizeof(*hist));
+  if(nbins == 0) return;
+  arr_probe_hist(ht, &ht->cur, hist, nbins);
+  arr_probe_hist(ht, &ht->old, hist, nbins);
+}
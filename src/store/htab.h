@@ -0,0 +1,102 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Growable open-addressing hash table with fixed-size entries
+ * (SwissTable layout).
+ * - slots are split into 16-wide groups; a parallel control-byte array
+ *   holds a 7-bit hash tag per slot (or EMPTY/DELETED), so a probe scans
+ *   16 tags at once (SSE2) and only touches entries whose tag matches
+ * - power-of-two capacity, triangular probing over groups
+ * - deletes leave a tombstone only when the group has no EMPTY slot,
+ *   so probe chains are never cut
+ * - probe length is bounded: an insert that would need more than
+ *   HTAB_MAX_PROBE extra groups grows the table instead
+ * - grows at 7/8 load (counting tombstones), shrinks below 1/8
+ *   (never under min_cap); tombstone-heavy tables are rebuilt in place
+ * - resizes are incremental: the previous array is kept alongside the new
+ *   one and HTAB_MIGRATE_STEP slots are moved on every call, so no single
+ *   operation pays for a full rehash
+ *
+ * Entry pointers returned by htab_find()/htab_insert() stay valid only
+ * until the next call on the same table.
+ */
+
+#define HTAB_GROUP        16
+#define HTAB_MAX_PROBE    2
+#define HTAB_MIGRATE_STEP 8
+
+typedef struct {
+  size_t esize;
+  uint64_t (*hash)(const void* entry);            // rehash on migration
+  int (*eq)(const void* entry, const void* key);  // key shape is caller-defined
+} htab_type_t;
+
+typedef struct {
+  int8_t* ctrl;      // per-slot tag: >=0 full (h2), EMPTY or DELETED
+  uint8_t* slots;
+  size_t cap;        // 0 or power of two, multiple of HTAB_GROUP
+  size_t count;
+  size_t tomb;
+  size_t max_probe;  // extra groups any live entry needed; bounds lookups
+  size_t probe_sum;  // extra groups over all live entries (not persisted)
+} htab_arr_t;
+
+typedef struct {
+  const htab_type_t* t;
+  htab_arr_t cur;
+  htab_arr_t old;  // cap != 0 while a resize is in progress
+  size_t mig_pos;
+  size_t min_cap;
+  int fixed;       // caller-owned array (htab_attach): never resized or freed
+} htab_t;
+
+int  htab_init(htab_t* ht, const htab_type_t* t, size_t min_cap);
+void htab_free(htab_t* ht);
+
+// use a caller-provided array (e.g. in a file mapping) as-is, counters
+// included; the table then never resizes: an insert past 7/8 load returns
+// NULL and the owner has to provide a bigger array
+void htab_attach(htab_t* ht, const htab_type_t* t, const htab_arr_t* arr);
+void htab_clear(htab_t* ht); // drop every entry (fixed tables only)
+
+size_t htab_count(const htab_t* ht);
+
+// O(1) health counters, old and new array together while resizing.
+// max_probe only drops when the table is rebuilt; the average probe
+// length of a hit is probe_sum / count extra groups.
+typedef struct {
+  size_t cap;        // slots of the current array
+  size_t count;
+  size_t tomb;
+  size_t max_probe;
+  size_t probe_sum;
+  int resizing;
+} htab_stat_t;
+
+void htab_stat(const htab_t* ht, htab_stat_t* out);
+
+void* htab_find(htab_t* ht, uint64_t h, const void* key);
+
+// returns the entry slot for key (existing or freshly claimed, caller fills it);
+// *existed tells which. NULL only on allocation failure.
+void* htab_insert(htab_t* ht, uint64_t h, const void* key, int* existed);
+
+// returns 1 if an entry was removed
+int  htab_erase(htab_t* ht, uint64_t h, const void* key);
+
+// bulk loading: size the table for n entries up front (finishes any
+// resize), then claim slots for keys known to be absent without probing
+// for a match first
+int   htab_reserve(htab_t* ht, size_t n);
+void* htab_insert_unique(htab_t* ht, uint64_t h);
+
+// read-only walk over all entries: start with *pos = 0; returns NULL at end.
+// Safe on a fork()ed copy; any modifying call invalidates pos.
+void* htab_next(const htab_t* ht, size_t* pos);
+
+// probe length of every entry (extra groups past its home group, as a hit
+// walks them): hist[p] counts entries that needed p, the last bin
+// everything longer. Scans the whole table (benchmarks, diagnostics).
+void htab_probe_hist(const htab_t* ht, size_t* hist, size_t nbins);
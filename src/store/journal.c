@@ -1,20 +1,193 @@
 // src/store/journal.c
+#define _GNU_SOURCE
 #include "store/journal.h"
+#include "util/crc32c.h"
+#include "util/log.h"
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/stat.h>
+
+#define JOURNAL_BUF_MIN 65536
 
 int journal_open(journal_t* j, const char* path){
-  j->fd = open(path, O_CREAT|O_APPEND|O_WRONLY, 0644);
-  return (j->fd < 0) ? -1 : 0;
+  memset(j, 0, sizeof(*j));
+  j->fd = open(path, O_CREAT|O_APPEND|O_WRONLY|O_CLOEXEC, 0644);
+  if(j->fd < 0){
+    log_printf(LOG_ERR, "journal open %s failed: %s", path, strerror(errno));
+    return -1;
+  }
+  struct stat sb;
+  if(fstat(j->fd, &sb) == 0) j->size = (uint64_t)sb.st_size;
+  j->buf = malloc(JOURNAL_BUF_MIN);
+  if(!j->buf){
+    close(j->fd);
+    j->fd = -1;
+    return -1;
+  }
+  j->cap = JOURNAL_BUF_MIN;
+  return 0;
+}
+
+int journal_append(journal_t* j, uint8_t type, const void* payload, size_t len){
+  if(j->fd < 0 || len > JOURNAL_MAX_REC) return -1;
+  if(j->len + JOURNAL_HDR + len > j->cap){
+    size_t ncap = j->cap * 2;
+    uint8_t* nb = realloc(j->buf, ncap);
+    if(!nb) return -1;
+    j->buf = nb;
+    j->cap = ncap;
+  }
+  uint8_t* r = j->buf + j->len;
+  uint16_t l16 = (uint16_t)len;
+  memcpy(r + 4, &l16, 2);
+  r[6] = type;
+  memcpy(r + JOURNAL_HDR, payload, len);
+  uint32_t crc = crc32c(0, r + 4, 3 + len);
+  memcpy(r, &crc, 4);
+  j->len += JOURNAL_HDR + len;
+  j->seq++;
+  return 0;
 }
-int journal_append(journal_t* j, const void* rec, size_t len){
+
+int journal_commit(journal_t* j){
   if(j->fd < 0) return -1;
-  ssize_t n = write(j->fd, rec, len);
-  return (n == (ssize_t)len) ? 0 : -1;
+  if(!journal_pending(j)) return 0;
+
+  size_t off = 0;
+  while(off < j->len){
+    ssize_t n = write(j->fd, j->buf + off, j->len - off);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      log_printf(LOG_ERR, "journal write failed: %s", strerror(errno));
+      goto fail;
+    }
+    off += (size_t)n;
+  }
+  if(fdatasync(j->fd) < 0){
+    log_printf(LOG_ERR, "journal fdatasync failed: %s", strerror(errno));
+    goto fail;
+  }
+  j->size += j->len;
+  j->len = 0;
+  j->durable = j->seq;
+  j->commits++;
+  if(j->cap > JOURNAL_BUF_MIN * 16){
+    uint8_t* nb = realloc(j->buf, JOURNAL_BUF_MIN);
+    if(nb){ j->buf = nb; j->cap = JOURNAL_BUF_MIN; }
+  }
+  return 0;
+
+fail:
+  // the records never became durable: drop them so callers do not ack
+  // them, and cut any partial write so replay does not stop short of
+  // later records
+  if(ftruncate(j->fd, (off_t)j->size) < 0)
+    log_printf(LOG_ERR, "journal truncate failed: %s", strerror(errno));
+  j->len = 0;
+  j->seq = j->durable;
+  return -1;
+}
+
+int fsync_dir_of(const char* path){
+  char dir[256];
+  const char* slash = strrchr(path, '/');
+  if(!slash) snprintf(dir, sizeof(dir), ".");
+  else if(slash == path) snprintf(dir, sizeof(dir), "/");
+  else snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+  int fd = open(dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+  if(fd < 0) return -1;
+  int rc = fsync(fd);
+  close(fd);
+  return rc;
 }
+
+int journal_truncate(journal_t* j){
+  if(journal_commit(j) < 0) return -1;
+  if(ftruncate(j->fd, 0) < 0){
+    log_printf(LOG_ERR, "journal truncate failed: %s", strerror(errno));
+    return -1;
+  }
+  j->size = 0;
+  return 0;
+}
+
+int journal_rotate(journal_t* j, const char* path, const char* prev){
+  if(journal_commit(j) < 0) return -1;
+  if(rename(path, prev) < 0){
+    log_printf(LOG_ERR, "journal rotate %s failed: %s", path, strerror(errno));
+    return -1;
+  }
+  int fd = open(path, O_CREAT|O_APPEND|O_WRONLY|O_CLOEXEC, 0644);
+  if(fd < 0){
+    log_printf(LOG_ERR, "journal open %s failed: %s", path, strerror(errno));
+    // keep appending to the old file under its old name
+    if(rename(prev, path) < 0)
+      log_printf(LOG_ERR, "journal rename back %s failed: %s", prev, strerror(errno));
+    return -1;
+  }
+  close(j->fd);
+  j->fd = fd;
+  j->size = 0;
+  fsync_dir_of(path);
+  return 0;
+}
+
 void journal_close(journal_t* j){
-  if(j->fd >= 0) close(j->fd);
+  if(j->fd >= 0){
+    journal_commit(j);
+    close(j->fd);
+  }
+  free(j->buf);
+  memset(j, 0, sizeof(*j));
   j->fd = -1;
 }
+
+long journal_replay(const char* path, journal_replay_fn fn, void* arg){
+  int fd = open(path, O_RDWR|O_CLOEXEC);
+  if(fd < 0) return (errno == ENOENT) ? 0 : -1;
+
+  struct stat sb;
+  if(fstat(fd, &sb) < 0){
+    close(fd);
+    return -1;
+  }
+  size_t size = (size_t)sb.st_size;
+  uint8_t* data = malloc(size ? size : 1);
+  if(!data){
+    close(fd);
+    return -1;
+  }
+  size_t got = 0;
+  while(got < size){
+    ssize_t n = pread(fd, data + got, size - got, (off_t)got);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) break;
+    got += (size_t)n;
+  }
+
+  long count = 0;
+  size_t off = 0;
+  while(off + JOURNAL_HDR <= got){
+    uint32_t crc;
+    uint16_t len;
+    memcpy(&crc, data + off, 4);
+    memcpy(&len, data + off + 4, 2);
+    if(off + JOURNAL_HDR + len > got) break;
+    if(crc32c(0, data + off + 4, 3u + len) != crc) break;
+    fn(arg, data[off + 6], data + off + JOURNAL_HDR, len);
+    off += JOURNAL_HDR + len;
+    count++;
+  }
+  if(off < size){
+    log_printf(LOG_WARN, "journal %s: dropping %zu bytes of torn/corrupt tail",
+               path, size - off);
+    if(ftruncate(fd, (off_t)off) < 0) count = -1;
+  }
+  free(data);
+  close(fd);
+  return count;
+}
@@ -3,10 +3,48 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/*
+ * Append-only write-ahead log with group commit.
+ * Record: u32 crc32c | u16 len | u8 type | payload[len]
+ * (crc covers len..payload; host byte order, the file is node-local).
+ * journal_append() only buffers; journal_commit() writes everything
+ * buffered and fdatasyncs once, so a batch of records costs one sync.
+ * Records carry sequence numbers: seq counts appends, durable counts
+ * records known to be on stable storage.
+ */
+
+#define JOURNAL_HDR 7
+#define JOURNAL_MAX_REC 512
+
 typedef struct {
   int fd;
+  uint8_t* buf;
+  size_t len, cap;
+  uint64_t size;      // durable file length
+  uint64_t seq;       // records appended
+  uint64_t durable;   // records synced
+  uint64_t commits;   // fdatasync calls
 } journal_t;
 
 int journal_open(journal_t* j, const char* path);
-int journal_append(journal_t* j, const void* rec, size_t len);
-void journal_close(journal_t* j);
+int journal_append(journal_t* j, uint8_t type, const void* payload, size_t len);
+int journal_commit(journal_t* j); // 0 = everything appended is durable
+void journal_close(journal_t* j); // commits what is buffered
+
+// start a fresh file at path; what was written so far moves to prev.
+// Sequence counters carry on.
+int journal_rotate(journal_t* j, const char* path, const char* prev);
+
+// drop every durable record (their effects are persisted elsewhere)
+int journal_truncate(journal_t* j);
+
+// make a rename/create in path's directory durable
+int fsync_dir_of(const char* path);
+
+static inline int journal_pending(const journal_t* j){ return j->seq != j->durable; }
+
+// replay every intact record in order; a torn or corrupt tail (crash mid
+// write) is cut off so appends continue from the last good record.
+// Missing file = empty journal. Returns records replayed or -1.
+typedef void (*journal_replay_fn)(void* arg, uint8_t type, const uint8_t* payload, size_t len);
+long journal_replay(const char* path, journal_replay_fn fn, void* arg);
@@ -0,0 +1,207 @@
+#include "store/lease_journal.h"
+#include "util/log.h"
+#include "util/hash.h"
+#include <string.h>
+
+// fixed-layout record writer/reader (host order, see journal.h)
+typedef struct { uint8_t* p; size_t off; } wr_t;
+typedef struct { const uint8_t* p; size_t off, len; } rd_t;
+
+#define W(w, v) do{ memcpy((w)->p + (w)->off, &(v), sizeof(v)); (w)->off += sizeof(v); }while(0)
+#define R(r, v) do{ memcpy(&(v), (r)->p + (r)->off, sizeof(v)); (r)->off += sizeof(v); }while(0)
+
+// key: u8 DUID length, the DUID, iaid, ia_type (the handle is not stored)
+static void w_key(wr_t* w, const lease_key_t* k, const lease_duid_t* d){
+  uint8_t n = (uint8_t)d->len;
+  W(w, n);
+  memcpy(w->p + w->off, d->p, n);
+  w->off += n;
+  W(w, k->iaid); W(w, k->ia_type);
+}
+static int r_key(rd_t* r, lease_key_t* k, lease_duid_t* d){
+  uint8_t n;
+  memset(k, 0, sizeof(*k));
+  if(r->off + 1 > r->len) return -1;
+  R(r, n);
+  if(n == 0 || n > DUID_MAX || r->off + n + 4 + 2 > r->len) return -1;
+  d->p = r->p + r->off;
+  d->len = n;
+  r->off += n;
+  R(r, k->iaid); R(r, k->ia_type);
+  return 0;
+}
+
+size_t lj_enc_na(uint8_t* out, const lease_na_t* l, const lease_duid_t* d){
+  wr_t w = { out, 0 };
+  uint8_t st = (uint8_t)l->state;
+  w_key(&w, &l->key, d);
+  W(&w, l->addr);
+  W(&w, l->preferred_lft); W(&w, l->valid_lft);
+  W(&w, l->preferred_until); W(&w, l->valid_until);
+  W(&w, l->subnet_id); W(&w, l->pool_id);
+  W(&w, st); W(&w, l->hold_until);
+  return w.off;
+}
+
+size_t lj_enc_pd(uint8_t* out, const lease_pd_t* l, const lease_duid_t* d){
+  wr_t w = { out, 0 };
+  uint8_t st = (uint8_t)l->state;
+  w_key(&w, &l->key, d);
+  W(&w, l->prefix); W(&w, l->prefix_len);
+  W(&w, l->preferred_lft); W(&w, l->valid_lft);
+  W(&w, l->preferred_until); W(&w, l->valid_until);
+  W(&w, l->subnet_id); W(&w, l->pool_id);
+  W(&w, st); W(&w, l->hold_until);
+  return w.off;
+}
+
+size_t lj_enc_decl(uint8_t* out, const lease_decl_t* d){
+  wr_t w = { out, 0 };
+  W(&w, d->addr); W(&w, d->plen); W(&w, d->until);
+  return w.off;
+}
+
+// the fixed tail after the key
+#define NA_TAIL (LJ_NA_MAX - LJ_KEY_MAX)
+#define PD_TAIL (LJ_PD_MAX - LJ_KEY_MAX)
+
+size_t lj_dec_na(const uint8_t* p, size_t len, lease_na_t* l, lease_duid_t* d){
+  rd_t r = { p, 0, len };
+  uint8_t s8;
+  memset(l, 0, sizeof(*l));
+  if(r_key(&r, &l->key, d) < 0 || r.off + NA_TAIL > len) return 0;
+  R(&r, l->addr);
+  R(&r, l->preferred_lft); R(&r, l->valid_lft);
+  R(&r, l->preferred_until); R(&r, l->valid_until);
+  R(&r, l->subnet_id); R(&r, l->pool_id);
+  R(&r, s8); R(&r, l->hold_until);
+  l->state = (lease_state_t)s8;
+  return r.off;
+}
+
+size_t lj_dec_pd(const uint8_t* p, size_t len, lease_pd_t* l, lease_duid_t* d){
+  rd_t r = { p, 0, len };
+  uint8_t s8;
+  memset(l, 0, sizeof(*l));
+  if(r_key(&r, &l->key, d) < 0 || r.off + PD_TAIL > len) return 0;
+  R(&r, l->prefix); R(&r, l->prefix_len);
+  R(&r, l->preferred_lft); R(&r, l->valid_lft);
+  R(&r, l->preferred_until); R(&r, l->valid_until);
+  R(&r, l->subnet_id); R(&r, l->pool_id);
+  R(&r, s8); R(&r, l->hold_until);
+  l->state = (lease_state_t)s8;
+  return r.off;
+}
+
+void lj_dec_decl(const uint8_t* p, lease_decl_t* d){
+  rd_t r = { p, 0, LJ_DECL_SZ };
+  memset(d, 0, sizeof(*d));
+  R(&r, d->addr); R(&r, d->plen); R(&r, d->until);
+}
+
+int lj_put_na(journal_t* j, const lease_na_t* l, const lease_duid_t* d){
+  uint8_t buf[LJ_NA_MAX];
+  return journal_append(j, LJ_PUT_NA, buf, lj_enc_na(buf, l, d));
+}
+
+int lj_put_pd(journal_t* j, const lease_pd_t* l, const lease_duid_t* d){
+  uint8_t buf[LJ_PD_MAX];
+  return journal_append(j, LJ_PUT_PD, buf, lj_enc_pd(buf, l, d));
+}
+
+int lj_del(journal_t* j, uint8_t type, const lease_key_t* key, const lease_duid_t* d){
+  uint8_t buf[LJ_KEY_MAX];
+  wr_t w = { buf, 0 };
+  w_key(&w, key, d);
+  return journal_append(j, type, buf, w.off);
+}
+
+int lj_decline(journal_t* j, const struct in6_addr* a, uint8_t plen, uint64_t until){
+  uint8_t buf[LJ_DECL_SZ];
+  lease_decl_t d = { .addr = *a, .plen = plen, .until = until };
+  return journal_append(j, plen == 128 ? LJ_DECL_ADDR : LJ_DECL_PFX, buf, lj_enc_decl(buf, &d));
+}
+
+typedef struct {
+  lease_store_t* st;
+  uint64_t now;
+  long bad;
+} replay_t;
+
+int lj_expired(lease_state_t s, uint64_t hold_until, uint64_t valid_until, uint64_t now){
+  if(s == LS_ALLOCATED) return valid_until <= now;
+  if(s == LS_OFFERED) return hold_until <= now;
+  return 0;
+}
+
+// a put interns the DUID for the lease (which keeps its own reference);
+// a delete only needs it if the store knows the client
+static uint32_t client_of(lease_store_t* st, const lease_duid_t* d, int intern){
+  uint64_t h = hash64_bytes(d->p, d->len, st->duid_seed);
+  return intern ? st->v.duid_get(st, d->p, d->len, h) : st->v.duid_find(st, d->p, d->len, h);
+}
+
+static void replay_one(void* arg, uint8_t type, const uint8_t* p, size_t len){
+  replay_t* rp = (replay_t*)arg;
+  lease_store_t* st = rp->st;
+  rd_t r = { p, 0, len };
+  lease_duid_t id;
+
+  switch(type){
+    case LJ_PUT_NA: {
+      lease_na_t l;
+      if(lj_dec_na(p, len, &l, &id) != len) break;
+      // an expired binding may have been handed to someone else later on
+      int live = !lj_expired(l.state, l.hold_until, l.valid_until, rp->now);
+      if(!(l.key.duid = client_of(st, &id, live))) return;
+      if(live){
+        st->v.put_na(st, &l);
+        st->v.duid_put(st, l.key.duid);
+      }else st->v.del_na(st, &l.key);
+      return;
+    }
+    case LJ_PUT_PD: {
+      lease_pd_t l;
+      if(lj_dec_pd(p, len, &l, &id) != len) break;
+      int live = !lj_expired(l.state, l.hold_until, l.valid_until, rp->now);
+      if(!(l.key.duid = client_of(st, &id, live))) return;
+      if(live){
+        st->v.put_pd(st, &l);
+        st->v.duid_put(st, l.key.duid);
+      }else st->v.del_pd(st, &l.key);
+      return;
+    }
+    case LJ_DEL_NA:
+    case LJ_DEL_PD: {
+      lease_key_t k;
+      if(r_key(&r, &k, &id) < 0 || r.off != len) break;
+      if(!(k.duid = client_of(st, &id, 0))) return;
+      if(type == LJ_DEL_NA) st->v.del_na(st, &k);
+      else st->v.del_pd(st, &k);
+      return;
+    }
+    case LJ_DECL_ADDR:
+    case LJ_DECL_PFX: {
+      if(len != LJ_DECL_SZ) break;
+      lease_decl_t d;
+      lj_dec_decl(p, &d);
+      if(d.until <= rp->now) return;
+      if(type == LJ_DECL_ADDR) st->v.decline_addr(st, &d.addr, d.until);
+      else st->v.decline_prefix(st, &d.addr, d.plen, d.until);
+      return;
+    }
+    default:
+      break;
+  }
+  rp->bad++;
+}
+
+long lj_replay(const char* path, lease_store_t* st, uint64_t now){
+  replay_t rp = { st, now, 0 };
+  journal_t* saved = st->journal;
+  st->journal = NULL;
+  long n = journal_replay(path, replay_one, &rp);
+  st->journal = saved;
+  if(rp.bad) log_printf(LOG_WARN, "journal %s: skipped %ld unknown records", path, rp.bad);
+  return n;
+}
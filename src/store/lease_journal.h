@@ -0,0 +1,49 @@
+#pragma once
+#include "store/lease_store.h"
+#include "store/journal.h"
+
+/*
+ * Lease records in the journal: one per committed store mutation.
+ * Offers are not journaled (they live for offer_ttl only); an offer that
+ * replaces a binding is journaled as a delete. Expiry is not journaled
+ * either: replay drops records whose deadline has passed.
+ *
+ * Records name the client by its DUID bytes (u8 length, then the bytes),
+ * not by the store's handle, which means nothing outside the process.
+ */
+
+enum {
+  // 1-4: lease records keyed by a DUID hash (older files); skipped
+  LJ_DECL_ADDR = 5,
+  LJ_DECL_PFX = 6,
+  LJ_PUT_NA = 7,
+  LJ_PUT_PD = 8,
+  LJ_DEL_NA = 9,
+  LJ_DEL_PD = 10,
+};
+
+// record sizes: lease records up to the *_MAX (journal payloads are exact,
+// snapshot slots are padded to the maximum), declines fixed
+#define LJ_KEY_MAX (1 + DUID_MAX + 4 + 2)
+#define LJ_NA_MAX  (LJ_KEY_MAX + 16 + 4 + 4 + 8 + 8 + 4 + 4 + 1 + 8)
+#define LJ_PD_MAX  (LJ_NA_MAX + 1)
+#define LJ_DECL_SZ (16 + 1 + 8)
+
+// encoders return the bytes written; decoders the bytes read (0 = malformed)
+size_t lj_enc_na(uint8_t* out, const lease_na_t* l, const lease_duid_t* d);
+size_t lj_enc_pd(uint8_t* out, const lease_pd_t* l, const lease_duid_t* d);
+size_t lj_enc_decl(uint8_t* out, const lease_decl_t* d);
+size_t lj_dec_na(const uint8_t* p, size_t len, lease_na_t* l, lease_duid_t* d);
+size_t lj_dec_pd(const uint8_t* p, size_t len, lease_pd_t* l, lease_duid_t* d);
+void lj_dec_decl(const uint8_t* p, lease_decl_t* d);
+
+// deadline of an offered/bound lease has passed (declined: never)
+int lj_expired(lease_state_t s, uint64_t hold_until, uint64_t valid_until, uint64_t now);
+
+int lj_put_na(journal_t* j, const lease_na_t* l, const lease_duid_t* d);
+int lj_put_pd(journal_t* j, const lease_pd_t* l, const lease_duid_t* d);
+int lj_del(journal_t* j, uint8_t type, const lease_key_t* key, const lease_duid_t* d);
+int lj_decline(journal_t* j, const struct in6_addr* a, uint8_t plen, uint64_t until);
+
+// rebuild st from path (st->journal must not point at this journal yet)
+long lj_replay(const char* path, lease_store_t* st, uint64_t now);
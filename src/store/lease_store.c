@@ -1,9 +1,9 @@
 #include "store/lease_store.h"
 #include <string.h>
 
-lease_key_t lease_key_make(const duid_t* duid, uint32_t iaid, uint16_t ia_type){
+lease_key_t lease_key_make(uint32_t duid, uint32_t iaid, uint16_t ia_type){
   lease_key_t k;
-  k.duid_hash = duid->h;
+  k.duid = duid;
   k.iaid = iaid;
   k.ia_type = ia_type;
   return k;
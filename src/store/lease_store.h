@@ -2,16 +2,24 @@
 #include <stdint.h>
 #include <netinet/in.h>
 #include "dhcp/duid.h"
+#include "store/journal.h"
 
 typedef enum { IA_NA=3, IA_PD=25 } ia_type_t;
 typedef enum { LS_OFFERED=1, LS_ALLOCATED=2, LS_DECLINED=3 } lease_state_t;
 
+// duid: the client's interned DUID (store handle, see duid_find/duid_get)
 typedef struct {
-  uint64_t duid_hash;
+  uint32_t duid;
   uint32_t iaid;
   uint16_t ia_type;
 } lease_key_t;
 
+// a DUID outside the store (journal and snapshot records)
+typedef struct {
+  const uint8_t* p;
+  size_t len;
+} lease_duid_t;
+
 typedef struct {
   lease_key_t key;
   struct in6_addr addr;
@@ -33,9 +41,50 @@ typedef struct {
   uint64_t hold_until;
 } lease_pd_t;
 
+// a quarantined address (plen 128) or prefix
+typedef struct {
+  struct in6_addr addr;
+  uint8_t plen;
+  uint64_t until;
+} lease_decl_t;
+
+// foreach visitor: sections are walked in order (na, pd, declines);
+// a nonzero return stops the walk and is passed back
+typedef struct {
+  int (*na)(void* arg, const lease_na_t* l);
+  int (*pd)(void* arg, const lease_pd_t* l);
+  int (*decl)(void* arg, const lease_decl_t* d);
+} lease_visit_t;
+
+// new state and deadlines for touch_* (lifetimes and address are kept);
+// subnet_id is the client's current subnet, which the lease must be from
+typedef struct {
+  lease_state_t state;
+  uint64_t preferred_until, valid_until;
+  uint64_t hold_until;
+  uint32_t subnet_id;
+} lease_times_t;
+
+// allocation candidates for acquire_*: fill the i-th candidate (i counts
+// from 0); nonzero = no more. plen is ignored for addresses.
+typedef int (*lease_cand_fn)(void* arg, unsigned i, struct in6_addr* out, uint8_t* plen);
+
 typedef struct lease_store lease_store_t;
 
 typedef struct {
+  // client identity: each store interns the DUIDs its leases belong to and
+  // keeps a reference per NA/PD lease under a handle.
+  // h = hash64_bytes(duid, len, st->duid_seed).
+  // duid_find  - handle of a DUID the store holds, 0 = none (no leases)
+  // duid_get   - intern and take one reference for the caller, 0 = no
+  //              room; leases created under the handle take their own,
+  //              the caller drops its one with duid_put when done
+  // duid_bytes - the DUID behind a live handle (valid until the next get)
+  uint32_t (*duid_find)(lease_store_t*, const uint8_t* duid, size_t len, uint64_t h);
+  uint32_t (*duid_get)(lease_store_t*, const uint8_t* duid, size_t len, uint64_t h);
+  void (*duid_put)(lease_store_t*, uint32_t handle);
+  const uint8_t* (*duid_bytes)(lease_store_t*, uint32_t handle, size_t* len);
+
   int (*get_na)(lease_store_t*, const lease_key_t*, lease_na_t* out);
   int (*put_na)(lease_store_t*, const lease_na_t* in);
   int (*del_na)(lease_store_t*, const lease_key_t*);
@@ -44,6 +93,24 @@ typedef struct {
   int (*put_pd)(lease_store_t*, const lease_pd_t* in);
   int (*del_pd)(lease_store_t*, const lease_key_t*);
 
+  // fused paths, a single key probe each:
+  // touch  - update a live lease's state/deadlines in place.
+  //          0 = done, -1 = no live lease for key in t->subnet_id.
+  // acquire- a live lease for tmpl->key in tmpl->subnet_id is kept (an
+  //          offer leaves it as it is, a binding takes tmpl's
+  //          state/deadlines); otherwise the first candidate that is
+  //          neither bound to another key nor declined is bound with
+  //          tmpl's fields, releasing an address/prefix the key held in
+  //          another subnet (the client moved links).
+  //          1 = existing lease, 0 = newly bound, -1 = nothing free.
+  // out (may be NULL) receives the resulting lease.
+  int (*touch_na)(lease_store_t*, const lease_key_t*, const lease_times_t* t, uint64_t now, lease_na_t* out);
+  int (*acquire_na)(lease_store_t*, const lease_na_t* tmpl, lease_cand_fn cand, void* cand_arg,
+                    uint64_t now, lease_na_t* out);
+  int (*touch_pd)(lease_store_t*, const lease_key_t*, const lease_times_t* t, uint64_t now, lease_pd_t* out);
+  int (*acquire_pd)(lease_store_t*, const lease_pd_t* tmpl, lease_cand_fn cand, void* cand_arg,
+                    uint64_t now, lease_pd_t* out);
+
   int (*addr_in_use)(lease_store_t*, const struct in6_addr*);
   int (*prefix_in_use)(lease_store_t*, const struct in6_addr*, uint8_t plen);
 
@@ -53,13 +120,47 @@ typedef struct {
   int (*decline_addr)(lease_store_t*, const struct in6_addr*, uint64_t until);
   int (*decline_prefix)(lease_store_t*, const struct in6_addr*, uint8_t plen, uint64_t until);
 
+  // expire everything due by now; called from the event loop tick
   void (*gc)(lease_store_t*, uint64_t now);
+
+  // read-only walk over every entry (snapshots); safe in a fork()ed child
+  int (*foreach)(lease_store_t*, const lease_visit_t* v, void* arg);
 } lease_store_vtbl_t;
 
+// occupancy observer: an address (plen 128) or prefix became taken
+// (bound or declined) or completely free again. Called only on those
+// transitions, so taken/free calls for one address alternate.
+// Allocators keep their free-space maps in sync through this.
+typedef void (*lease_occ_fn)(void* arg, const struct in6_addr* a, uint8_t plen, int occupied);
+
+// state observer: the lease (or quarantine entry, as LS_DECLINED) on an
+// address/prefix went from one lease_state_t to another, 0 = none. A lease
+// moving to another address is a drop at the old one and a new one at the
+// new. Shares occ_arg; pool utilisation counters are kept with it.
+typedef void (*lease_use_fn)(void* arg, const struct in6_addr* a, uint8_t plen, int from, int to);
+
 struct lease_store {
   lease_store_vtbl_t v;
   void* impl;
+
+  lease_occ_fn on_occ;
+  lease_use_fn on_use;
+  void* occ_arg;
+
+  // write-ahead journal: committed mutations are appended here (NULL = off)
+  journal_t* journal;
+
+  uint64_t duid_seed; // DUID hash seed, fixed when the store is opened
 };
 
-lease_key_t lease_key_make(const duid_t* duid, uint32_t iaid, uint16_t ia_type);
+static inline void lease_store_occ(lease_store_t* st, const struct in6_addr* a, uint8_t plen, int occupied){
+  if(st->on_occ) st->on_occ(st->occ_arg, a, plen, occupied);
+}
+
+static inline void lease_store_use(lease_store_t* st, const struct in6_addr* a, uint8_t plen, int from, int to){
+  if(st->on_use && from != to) st->on_use(st->occ_arg, a, plen, from, to);
+}
+
+// duid: a handle from duid_find/duid_get of the store the key is used with
+lease_key_t lease_key_make(uint32_t duid, uint32_t iaid, uint16_t ia_type);
 int in6_equal(const struct in6_addr* a, const struct in6_addr* b);
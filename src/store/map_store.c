@@ -0,0 +1,558 @@
+// src/store/map_store.c
+#define _GNU_SOURCE
+#include "store/map_store.h"
+#include "store/mem_store.h"
+#include "store/journal.h"
+#include "util/hash.h"
+#include "util/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAP_MAGIC      "DH6MAP"
+#define MAP_VERSION    2
+#define MAP_HDR_SIZE   4096
+#define MAP_DUID_BYTES 32     // DUID slab bytes per slot
+#define MAP_SWEEP_STEP 65536  // inherited slots handed to the wheel per gc
+
+typedef struct {
+  uint64_t off_ctrl, off_slots;
+  uint64_t esize;
+  uint64_t count, tomb, max_probe;
+} map_tab_t;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t ntables;
+  uint64_t cap;        // slots per table
+  uint64_t size;       // file size
+  uint64_t gen;        // odd while a mutation is in progress
+  uint64_t commit;     // gen at the last completed sync
+  char boot_id[40];    // boot that last wrote the mapping
+  map_tab_t t[MEM_NTABLES];
+  uint64_t off_recs, off_slab;  // DUID arena (its index is table MEM_T_DUID)
+  uint32_t rec_cap, slab_cap;
+  duid_arena_cnt_t duid;
+  uint32_t duid_hash;  // hash_kind_t the DUID index was built with
+  uint64_t duid_seed;
+} map_hdr_t;
+
+_Static_assert(sizeof(map_hdr_t) <= MAP_HDR_SIZE, "map header fits its page");
+
+typedef struct {
+  lease_store_t in;    // mem_store over the mapped arrays
+  int fd;
+  uint8_t* base;
+  size_t size;
+  map_hdr_t* hdr;
+  size_t sweep_pos;
+  int swept;           // every inherited entry is on the wheel
+  char path[256];
+} map_impl_t;
+
+static uint64_t align_up(uint64_t v, uint64_t a){ return (v + a - 1) / a * a; }
+
+static size_t slots_for(size_t n){
+  size_t c = HTAB_GROUP;
+  while(c < n + n / 7 + HTAB_GROUP) c <<= 1;
+  return c;
+}
+
+static void read_boot_id(char* out, size_t cap){
+  memset(out, 0, cap);
+  FILE* f = fopen("/proc/sys/kernel/random/boot_id", "r");
+  if(!f) return;
+  if(!fgets(out, (int)cap, f)) out[0] = 0;
+  fclose(f);
+  out[strcspn(out, "\n")] = 0;
+}
+
+// geometry for cap slots per table; returns the file size
+static uint64_t layout(map_hdr_t* h, uint64_t cap){
+  uint64_t off = MAP_HDR_SIZE;
+  for(int i=0;i<MEM_NTABLES;i++){
+    h->t[i].esize = mem_store_esize(i);
+    h->t[i].off_ctrl = off;
+    h->t[i].off_slots = align_up(off + cap, 64);
+    off = align_up(h->t[i].off_slots + cap * h->t[i].esize, 64);
+  }
+  h->off_recs = off;
+  h->rec_cap = (uint32_t)cap;
+  h->off_slab = align_up(off + cap * sizeof(duid_rec_t), 64);
+  h->slab_cap = (uint32_t)(cap * MAP_DUID_BYTES);
+  off = h->off_slab + h->slab_cap;
+  h->cap = cap;
+  return align_up(off, MAP_HDR_SIZE);
+}
+
+static void arrays_of(const map_impl_t* m, htab_arr_t arr[MEM_NTABLES]){
+  const map_hdr_t* h = m->hdr;
+  for(int i=0;i<MEM_NTABLES;i++){
+    memset(&arr[i], 0, sizeof(arr[i]));
+    arr[i].ctrl = (int8_t*)(m->base + h->t[i].off_ctrl);
+    arr[i].slots = m->base + h->t[i].off_slots;
+    arr[i].cap = h->cap;
+    arr[i].count = h->t[i].count;
+    arr[i].tomb = h->t[i].tomb;
+    arr[i].max_probe = h->t[i].max_probe;
+  }
+}
+
+static void duids_of(const map_impl_t* m, duid_arena_arr_t* da){
+  const map_hdr_t* h = m->hdr;
+  da->recs = (duid_rec_t*)(m->base + h->off_recs);
+  da->slab = m->base + h->off_slab;
+  da->rec_cap = h->rec_cap;
+  da->slab_cap = h->slab_cap;
+  da->c = h->duid;
+}
+
+static int map_file(map_impl_t* m, const char* path, int fd, size_t size){
+  void* p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED){
+    log_printf(LOG_ERR, "lease map %s: mmap failed: %s", path, strerror(errno));
+    return -1;
+  }
+  m->fd = fd;
+  m->base = p;
+  m->size = size;
+  m->hdr = p;
+  return 0;
+}
+
+static void unmap_file(map_impl_t* m){
+  if(m->base) munmap(m->base, m->size);
+  if(m->fd >= 0) close(m->fd);
+  m->base = NULL;
+  m->hdr = NULL;
+  m->fd = -1;
+}
+
+// fresh file with empty tables
+static int map_create(map_impl_t* m, const char* path, size_t cap, uint64_t gen, uint64_t duid_seed){
+  map_hdr_t h;
+  memset(&h, 0, sizeof(h));
+  uint64_t size = layout(&h, cap);
+
+  int fd = open(path, O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+  if(fd < 0){
+    log_printf(LOG_ERR, "lease map %s: open failed: %s", path, strerror(errno));
+    return -1;
+  }
+  if(ftruncate(fd, (off_t)size) < 0){
+    log_printf(LOG_ERR, "lease map %s: resize failed: %s", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  if(map_file(m, path, fd, size) < 0){
+    close(fd);
+    return -1;
+  }
+  for(int i=0;i<MEM_NTABLES;i++) memset(m->base + h.t[i].off_ctrl, 0x80, cap); // EMPTY
+
+  memcpy(h.magic, MAP_MAGIC, sizeof(MAP_MAGIC));
+  h.version = MAP_VERSION;
+  h.ntables = MEM_NTABLES;
+  h.size = size;
+  h.gen = h.commit = gen;
+  duid_arena_cnt_init(&h.duid);
+  h.duid_hash = hash_selected();
+  h.duid_seed = duid_seed;
+  read_boot_id(h.boot_id, sizeof(h.boot_id));
+  memcpy(m->hdr, &h, sizeof(h));
+  return 0;
+}
+
+static int map_existing(map_impl_t* m, const char* path, int fd){
+  struct stat sb;
+  if(fstat(fd, &sb) < 0 || (size_t)sb.st_size < MAP_HDR_SIZE){
+    log_printf(LOG_ERR, "lease map %s: truncated", path);
+    return -1;
+  }
+  if(map_file(m, path, fd, (size_t)sb.st_size) < 0) return -1;
+
+  const map_hdr_t* h = m->hdr;
+  map_hdr_t want;
+  memset(&want, 0, sizeof(want));
+  int ok = memcmp(h->magic, MAP_MAGIC, sizeof(MAP_MAGIC)) == 0 &&
+           h->version == MAP_VERSION && h->ntables == MEM_NTABLES &&
+           h->cap >= HTAB_GROUP && (h->cap & (h->cap - 1)) == 0 &&
+           h->size == m->size && layout(&want, h->cap) == h->size;
+  for(int i=0;ok && i<MEM_NTABLES;i++){
+    ok = h->t[i].esize == want.t[i].esize &&
+         h->t[i].off_ctrl == want.t[i].off_ctrl &&
+         h->t[i].off_slots == want.t[i].off_slots &&
+         h->t[i].count + h->t[i].tomb <= h->cap;
+  }
+  ok = ok && h->off_recs == want.off_recs && h->off_slab == want.off_slab &&
+       h->rec_cap == want.rec_cap && h->slab_cap == want.slab_cap &&
+       h->duid.nrec >= 1 && h->duid.nrec <= h->rec_cap && h->duid.free_rec < h->duid.nrec &&
+       h->duid.used <= h->slab_cap && h->duid.bytes <= h->duid.used;
+  if(!ok){
+    log_printf(LOG_ERR, "lease map %s: unknown format or version", path);
+    munmap(m->base, m->size);
+    m->base = NULL;
+    m->hdr = NULL;
+    m->fd = -1; // the caller closes fd
+    return -1;
+  }
+  return 0;
+}
+
+// ---- mutation bracketing ----
+
+static void begin(map_impl_t* m){
+  m->hdr->gen++;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void end(map_impl_t* m){
+  htab_arr_t arr[MEM_NTABLES];
+  mem_store_arrays(&m->in, arr);
+  for(int i=0;i<MEM_NTABLES;i++){
+    m->hdr->t[i].count = arr[i].count;
+    m->hdr->t[i].tomb = arr[i].tomb;
+    m->hdr->t[i].max_probe = arr[i].max_probe;
+  }
+  duid_arena_arr_t da;
+  mem_store_duids(&m->in, &da);
+  m->hdr->duid = da.c;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  m->hdr->gen++;
+}
+
+// the inner store notifies and journals through its own lease_store_t
+static lease_store_t* inner(lease_store_t* st){
+  map_impl_t* m = (map_impl_t*)st->impl;
+  m->in.on_occ = st->on_occ;
+  m->in.on_use = st->on_use;
+  m->in.occ_arg = st->occ_arg;
+  m->in.journal = st->journal;
+  return &m->in;
+}
+
+// ---- growth ----
+
+typedef struct { lease_store_t* dst; } copy_t;
+
+// the DUIDs moved over with their counts: drop the reference put adds
+static int copy_na(void* arg, const lease_na_t* l){
+  lease_store_t* d = ((copy_t*)arg)->dst;
+  if(d->v.put_na(d, l) < 0) return -1;
+  d->v.duid_put(d, l->key.duid);
+  return 0;
+}
+static int copy_pd(void* arg, const lease_pd_t* l){
+  lease_store_t* d = ((copy_t*)arg)->dst;
+  if(d->v.put_pd(d, l) < 0) return -1;
+  d->v.duid_put(d, l->key.duid);
+  return 0;
+}
+static int copy_decl(void* arg, const lease_decl_t* x){
+  lease_store_t* d = ((copy_t*)arg)->dst;
+  int rc = x->plen == 128 ? d->v.decline_addr(d, &x->addr, x->until)
+                          : d->v.decline_prefix(d, &x->addr, x->plen, x->until);
+  return rc < 0 ? -1 : 0;
+}
+
+static void map_free(map_impl_t* m){
+  if(m->in.impl) mem_store_free(&m->in);
+  unmap_file(m);
+  free(m);
+}
+
+// rebuild into a file with ncap slots per table (same size = purge
+// tombstones, pack the DUID slab) and switch st over to it; DUID handles
+// are kept, callers may hold some across the switch
+static int map_grow(lease_store_t* st, size_t ncap){
+  map_impl_t* m = (map_impl_t*)st->impl;
+  map_impl_t* n = calloc(1, sizeof(*n));
+  if(!n) return -1;
+  n->fd = -1;
+  memcpy(n->path, m->path, sizeof(n->path));
+  char tmp[sizeof(m->path) + 8];
+  snprintf(tmp, sizeof(tmp), "%s.grow", m->path);
+
+  htab_arr_t arr[MEM_NTABLES];
+  duid_arena_arr_t da;
+  if(map_create(n, tmp, ncap, m->hdr->gen + 2, m->in.duid_seed) < 0) goto fail;
+  arrays_of(n, arr);
+  duids_of(n, &da);
+  if(mem_store_init_fixed(&n->in, arr, &da, m->in.duid_seed) < 0) goto fail;
+  if(mem_store_copy_duids(&n->in, &m->in) < 0) goto fail;
+
+  // copies are scheduled on the new wheel as they go in
+  static const lease_visit_t v = { copy_na, copy_pd, copy_decl };
+  copy_t c = { &n->in };
+  if(m->in.v.foreach(&m->in, &v, &c) != 0) goto fail;
+  n->swept = 1;
+  end(n);
+  n->hdr->gen = n->hdr->commit = m->hdr->gen + 2;
+  if(msync(n->base, n->size, MS_SYNC) < 0 || rename(tmp, m->path) < 0){
+    log_printf(LOG_ERR, "lease map %s: grow failed: %s", m->path, strerror(errno));
+    goto fail;
+  }
+  fsync_dir_of(m->path);
+  log_printf(LOG_INFO, "lease map %s: %zu -> %zu slots per table", m->path, (size_t)m->hdr->cap, ncap);
+
+  st->impl = n;
+  map_free(m);
+  return 0;
+
+fail:
+  map_free(n);
+  unlink(tmp);
+  return -1;
+}
+
+// every table keeps room for the entries one mutation can add
+static int room(lease_store_t* st){
+  map_impl_t* m = (map_impl_t*)st->impl;
+  htab_arr_t arr[MEM_NTABLES];
+  duid_arena_arr_t da;
+  mem_store_arrays(&m->in, arr);
+  mem_store_duids(&m->in, &da);
+  size_t cap = arr[0].cap, most = 0;
+  int full = !duid_arena_room(&da);
+  for(int i=0;i<MEM_NTABLES;i++){
+    if(arr[i].count + arr[i].tomb + 2 > cap / 8 * 7) full = 1;
+    if(arr[i].count > most) most = arr[i].count;
+  }
+  if(da.c.live + 2 > most) most = da.c.live + 2;
+  if(da.c.bytes / MAP_DUID_BYTES + DUID_MAX / MAP_DUID_BYTES > most)
+    most = da.c.bytes / MAP_DUID_BYTES + DUID_MAX / MAP_DUID_BYTES;
+  if(!full) return 0;
+  return map_grow(st, most + 2 < cap / 2 ? cap : cap * 2);
+}
+
+// ---- vtable ----
+
+#define MUTATE(st, call) do{ \
+    if(room(st) < 0) return -1; \
+    map_impl_t* m_ = (map_impl_t*)(st)->impl; \
+    lease_store_t* in = inner(st); \
+    begin(m_); \
+    int rc_ = (call); \
+    end(m_); \
+    return rc_; \
+  }while(0)
+
+static uint32_t ms_duid_find(lease_store_t* st, const uint8_t* duid, size_t len, uint64_t h){
+  lease_store_t* in = inner(st);
+  return in->v.duid_find(in, duid, len, h);
+}
+static uint32_t ms_duid_get(lease_store_t* st, const uint8_t* duid, size_t len, uint64_t h){
+  if(room(st) < 0) return 0;
+  map_impl_t* m = (map_impl_t*)st->impl;
+  lease_store_t* in = inner(st);
+  begin(m);
+  uint32_t id = in->v.duid_get(in, duid, len, h);
+  end(m);
+  return id;
+}
+static void ms_duid_put(lease_store_t* st, uint32_t id){
+  map_impl_t* m = (map_impl_t*)st->impl;
+  lease_store_t* in = inner(st);
+  begin(m);
+  in->v.duid_put(in, id);
+  end(m);
+}
+static const uint8_t* ms_duid_bytes(lease_store_t* st, uint32_t id, size_t* len){
+  lease_store_t* in = inner(st);
+  return in->v.duid_bytes(in, id, len);
+}
+
+static int ms_get_na(lease_store_t* st, const lease_key_t* k, lease_na_t* out){
+  lease_store_t* in = inner(st);
+  return in->v.get_na(in, k, out);
+}
+static int ms_put_na(lease_store_t* st, const lease_na_t* l){ MUTATE(st, in->v.put_na(in, l)); }
+static int ms_del_na(lease_store_t* st, const lease_key_t* k){ MUTATE(st, in->v.del_na(in, k)); }
+
+static int ms_get_pd(lease_store_t* st, const lease_key_t* k, lease_pd_t* out){
+  lease_store_t* in = inner(st);
+  return in->v.get_pd(in, k, out);
+}
+static int ms_put_pd(lease_store_t* st, const lease_pd_t* l){ MUTATE(st, in->v.put_pd(in, l)); }
+static int ms_del_pd(lease_store_t* st, const lease_key_t* k){ MUTATE(st, in->v.del_pd(in, k)); }
+
+static int ms_touch_na(lease_store_t* st, const lease_key_t* k, const lease_times_t* t,
+                       uint64_t now, lease_na_t* out){
+  MUTATE(st, in->v.touch_na(in, k, t, now, out));
+}
+static int ms_acquire_na(lease_store_t* st, const lease_na_t* tmpl, lease_cand_fn cand, void* arg,
+                         uint64_t now, lease_na_t* out){
+  MUTATE(st, in->v.acquire_na(in, tmpl, cand, arg, now, out));
+}
+static int ms_touch_pd(lease_store_t* st, const lease_key_t* k, const lease_times_t* t,
+                       uint64_t now, lease_pd_t* out){
+  MUTATE(st, in->v.touch_pd(in, k, t, now, out));
+}
+static int ms_acquire_pd(lease_store_t* st, const lease_pd_t* tmpl, lease_cand_fn cand, void* arg,
+                         uint64_t now, lease_pd_t* out){
+  MUTATE(st, in->v.acquire_pd(in, tmpl, cand, arg, now, out));
+}
+
+static int ms_addr_in_use(lease_store_t* st, const struct in6_addr* a){
+  lease_store_t* in = inner(st);
+  return in->v.addr_in_use(in, a);
+}
+static int ms_prefix_in_use(lease_store_t* st, const struct in6_addr* p, uint8_t plen){
+  lease_store_t* in = inner(st);
+  return in->v.prefix_in_use(in, p, plen);
+}
+static int ms_is_addr_declined(lease_store_t* st, const struct in6_addr* a, uint64_t now){
+  lease_store_t* in = inner(st);
+  return in->v.is_addr_declined(in, a, now);
+}
+static int ms_is_prefix_declined(lease_store_t* st, const struct in6_addr* p, uint8_t plen, uint64_t now){
+  lease_store_t* in = inner(st);
+  return in->v.is_prefix_declined(in, p, plen, now);
+}
+static int ms_decline_addr(lease_store_t* st, const struct in6_addr* a, uint64_t until){
+  MUTATE(st, in->v.decline_addr(in, a, until));
+}
+static int ms_decline_prefix(lease_store_t* st, const struct in6_addr* p, uint8_t plen, uint64_t until){
+  MUTATE(st, in->v.decline_prefix(in, p, plen, until));
+}
+
+static void ms_gc(lease_store_t* st, uint64_t now){
+  map_impl_t* m = (map_impl_t*)st->impl;
+  lease_store_t* in = inner(st);
+  begin(m);
+  // inherited entries join the wheel first, so overdue ones fire now
+  if(!m->swept) m->swept = mem_store_sweep(in, &m->sweep_pos, MAP_SWEEP_STEP) != 0;
+  in->v.gc(in, now);
+  end(m);
+}
+
+static int ms_foreach(lease_store_t* st, const lease_visit_t* v, void* arg){
+  lease_store_t* in = inner(st);
+  return in->v.foreach(in, v, arg);
+}
+
+// ---- lifecycle ----
+
+int map_store_open(lease_store_t* st, const char* path, size_t cap, uint64_t duid_seed){
+  map_impl_t* m = calloc(1, sizeof(*m));
+  if(!m) return -1;
+  m->fd = -1;
+  snprintf(m->path, sizeof(m->path), "%s", path);
+
+  int fd = open(path, O_RDWR|O_CLOEXEC);
+  int rc;
+  if(fd >= 0){
+    rc = map_existing(m, path, fd);
+    if(rc < 0) close(fd);
+  } else if(errno == ENOENT){
+    rc = map_create(m, path, slots_for(cap), 0, duid_seed);
+  } else {
+    log_printf(LOG_ERR, "lease map %s: open failed: %s", path, strerror(errno));
+    rc = -1;
+  }
+  htab_arr_t arr[MEM_NTABLES];
+  duid_arena_arr_t da;
+  if(rc == 0){
+    arrays_of(m, arr);
+    duids_of(m, &da);
+    rc = mem_store_init_fixed(&m->in, arr, &da, duid_seed);
+  }
+  if(rc < 0){
+    map_free(m);
+    return -1;
+  }
+
+  map_hdr_t* h = m->hdr;
+  char boot[sizeof(h->boot_id)];
+  read_boot_id(boot, sizeof(boot));
+  int torn = (h->gen & 1) || (h->commit != h->gen && strcmp(boot, h->boot_id) != 0);
+  if(torn){
+    if(h->gen & 1) h->gen++;
+    begin(m);
+    long n = mem_store_repair(&m->in);
+    end(m);
+    log_printf(LOG_WARN, "lease map %s: interrupted update, repaired (%ld entries dropped)", path, n);
+  } else if(h->duid_seed != duid_seed || h->duid_hash != (uint32_t)hash_selected()){
+    // the repair above rehashes as it goes; otherwise only the index is stale
+    begin(m);
+    int r = mem_store_reindex_duids(&m->in);
+    end(m);
+    if(r < 0){
+      log_printf(LOG_ERR, "lease map %s: cannot rehash client DUIDs", path);
+      map_free(m);
+      return -1;
+    }
+    log_printf(LOG_INFO, "lease map %s: client DUIDs rehashed (%s)", path, hash_kind_name(hash_selected()));
+  }
+  h->duid_seed = duid_seed;
+  h->duid_hash = hash_selected();
+  memcpy(h->boot_id, boot, sizeof(boot));
+
+  st->impl = m;
+  st->on_occ = NULL;
+  st->on_use = NULL;
+  st->occ_arg = NULL;
+  st->journal = NULL;
+  st->duid_seed = duid_seed;
+  st->v.duid_find = ms_duid_find;
+  st->v.duid_get = ms_duid_get;
+  st->v.duid_put = ms_duid_put;
+  st->v.duid_bytes = ms_duid_bytes;
+  st->v.get_na = ms_get_na;
+  st->v.put_na = ms_put_na;
+  st->v.del_na = ms_del_na;
+  st->v.get_pd = ms_get_pd;
+  st->v.put_pd = ms_put_pd;
+  st->v.del_pd = ms_del_pd;
+  st->v.touch_na = ms_touch_na;
+  st->v.acquire_na = ms_acquire_na;
+  st->v.touch_pd = ms_touch_pd;
+  st->v.acquire_pd = ms_acquire_pd;
+  st->v.addr_in_use = ms_addr_in_use;
+  st->v.prefix_in_use = ms_prefix_in_use;
+  st->v.is_addr_declined = ms_is_addr_declined;
+  st->v.is_prefix_declined = ms_is_prefix_declined;
+  st->v.decline_addr = ms_decline_addr;
+  st->v.decline_prefix = ms_decline_prefix;
+  st->v.gc = ms_gc;
+  st->v.foreach = ms_foreach;
+
+  log_printf(LOG_INFO, "lease map %s: %zu NA, %zu PD, %zu slots per table",
+             path, (size_t)h->t[MEM_T_NA].count, (size_t)h->t[MEM_T_PD].count, (size_t)h->cap);
+  return 0;
+}
+
+int map_store_sync(lease_store_t* st){
+  map_impl_t* m = (map_impl_t*)st->impl;
+  uint64_t gen = m->hdr->gen;
+  if(gen == m->hdr->commit) return 0;
+  if(msync(m->base, m->size, MS_SYNC) < 0){
+    log_printf(LOG_ERR, "lease map %s: msync failed: %s", m->path, strerror(errno));
+    return -1;
+  }
+  m->hdr->commit = gen;
+  return msync(m->base, MAP_HDR_SIZE, MS_SYNC) < 0 ? -1 : 0;
+}
+
+void map_store_replay_occ(lease_store_t* st){
+  mem_store_replay_occ(inner(st));
+}
+
+void map_store_stat(const lease_store_t* st, htab_stat_t out[MEM_NTABLES]){
+  mem_store_stat(&((const map_impl_t*)st->impl)->in, out);
+}
+
+void map_store_close(lease_store_t* st){
+  map_impl_t* m = (map_impl_t*)st->impl;
+  if(!m) return;
+  map_store_sync(st);
+  map_free(m);
+  st->impl = NULL;
+}
@@ -0,0 +1,38 @@
+// src/store/map_store.h
+#pragma once
+#include <stddef.h>
+#include "store/lease_store.h"
+#include "store/mem_store.h"
+
+/*
+ * Persistent lease store: the mem_store tables (fixed-array mode) live in
+ * a MAP_SHARED file mapping, so a restart just remaps the file.
+ *
+ * File: a 4 KiB versioned header, then per table a control-byte array and
+ * a slot array, then the DUID arena's records and slab. The header
+ * carries the geometry and counters, the DUID hash seed and kind the
+ * arena index was built with (rehashed on open if they changed), plus
+ * two words:
+ *   gen    - bumped before and after every mutation (odd = in progress)
+ *   commit - gen as of the last completed map_store_sync() (msync)
+ * Opening a file with an odd gen (the process died mid-update), or one
+ * whose commit lags gen and that was last written before a reboot (the
+ * page cache may not have reached the disk), runs mem_store_repair():
+ * entries a lookup no longer reaches are dropped and the indexes are
+ * rebuilt. The journal, replayed on top, restores exact lease contents.
+ *
+ * A table that reaches 7/8 load, or a DUID arena without room for one
+ * more client, is rebuilt into a bigger file (<path>.grow, then renamed
+ * over path).
+ */
+
+int  map_store_open(lease_store_t* st, const char* path, size_t cap, uint64_t duid_seed);
+int  map_store_sync(lease_store_t* st);  // msync everything, advance commit
+void map_store_close(lease_store_t* st); // sync + unmap
+
+// announce every lease in the file to the occupancy and state observers
+// (call once the pools are subscribed)
+void map_store_replay_occ(lease_store_t* st);
+
+// mem_store_stat() of the mapped tables
+void map_store_stat(const lease_store_t* st, htab_stat_t out[MEM_NTABLES]);
@@ -1,379 +1,1097 @@
 #include "store/mem_store.h"
+#include "store/htab.h"
+#include "store/twheel.h"
+#include "store/lease_journal.h"
 #include "util/time.h"
+#include "util/hash.h"
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 typedef struct {
-  int used;
+  struct in6_addr addr;
   lease_key_t key;
-  lease_na_t na;
-} na_slot_t;
+} addr_ent_t;
 
 typedef struct {
-  int used;
+  struct in6_addr prefix;
+  uint8_t plen;
   lease_key_t key;
-  lease_pd_t pd;
-} pd_slot_t;
+} pfx_ent_t;
 
 typedef struct {
-  int used;
   struct in6_addr addr;
-  lease_key_t key;
-} addr_slot_t;
+  uint64_t until;
+} decl_addr_ent_t;
 
 typedef struct {
-  int used;
   struct in6_addr prefix;
   uint8_t plen;
-  lease_key_t key;
-} pfx_slot_t;
+  uint64_t until;
+} decl_pfx_ent_t;
+
+// lookup key for prefix tables (matches the head of pfx_ent_t / decl_pfx_ent_t)
+typedef struct {
+  struct in6_addr prefix;
+  uint8_t plen;
+} pfx_key_t;
 
 typedef struct {
-  size_t cap;
+  htab_t na;        // lease_na_t by lease key
+  htab_t pd;        // lease_pd_t by lease key
+  htab_t addr_idx;  // addr -> lease key
+  htab_t pfx_idx;   // prefix/plen -> lease key
+
+  // decline quarantine sets
+  htab_t declined_addr;
+  htab_t declined_pfx;
 
-  na_slot_t* na;
-  pd_slot_t* pd;
-  addr_slot_t* addr_idx;
-  pfx_slot_t* pfx_idx;
+  // client DUIDs; lease keys hold a handle and a reference each
+  duid_arena_t duids;
 
-  // decline sets (simple arrays in same hash tables)
-  addr_slot_t* declined_addr;
-  pfx_slot_t* declined_pfx;
+  // expiry index: hold_until/valid_until and decline deadlines
+  twheel_t tw;
 
-  // store decline until in key.iaid field reuse? -> no, store separate arrays:
-  uint64_t* declined_addr_until;
-  uint64_t* declined_pfx_until;
+  lease_store_t* st; // for occupancy notifications
 } mem_impl_t;
 
-static uint64_t mix64(uint64_t x){
-  x ^= x >> 33;
-  x *= 0xff51afd7ed558ccdULL;
-  x ^= x >> 33;
-  x *= 0xc4ceb9fe1a85ec53ULL;
-  x ^= x >> 33;
-  return x;
-}
+// DUID handles and addresses are server-chosen: a plain finaliser is
+// enough for the tables
 static uint64_t hash_key(const lease_key_t* k){
-  uint64_t x = k->duid_hash ^ (((uint64_t)k->iaid)<<1) ^ ((uint64_t)k->ia_type<<48);
-  return mix64(x);
-}
-static uint64_t hash_in6(const struct in6_addr* a){
-  const uint64_t* p = (const uint64_t*)a->s6_addr;
-  return mix64(p[0] ^ p[1]);
+  uint64_t x = ((uint64_t)k->duid<<32 | k->iaid) ^ ((uint64_t)k->ia_type<<56);
+  return hash_mix64(x);
 }
 static uint64_t hash_prefix(const struct in6_addr* pfx, uint8_t plen){
-  return mix64(hash_in6(pfx) ^ ((uint64_t)plen<<32));
+  return hash_mix64(hash_in6(pfx) ^ ((uint64_t)plen<<32));
 }
 
 static int key_eq(const lease_key_t* a, const lease_key_t* b){
-  return a->duid_hash==b->duid_hash && a->iaid==b->iaid && a->ia_type==b->ia_type;
+  return a->duid==b->duid && a->iaid==b->iaid && a->ia_type==b->ia_type;
 }
 
-static ssize_t find_na(mem_impl_t* m, const lease_key_t* key){
-  uint64_t h = hash_key(key);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx = (h + i) % m->cap;
-    if(!m->na[idx].used) return -1;
-    if(key_eq(&m->na[idx].key, key)) return (ssize_t)idx;
-  }
-  return -1;
+// ---- table types ----
+static uint64_t na_hash(const void* e){ return hash_key(&((const lease_na_t*)e)->key); }
+static int na_eq(const void* e, const void* k){ return key_eq(&((const lease_na_t*)e)->key, k); }
+static uint64_t pd_hash(const void* e){ return hash_key(&((const lease_pd_t*)e)->key); }
+static int pd_eq(const void* e, const void* k){ return key_eq(&((const lease_pd_t*)e)->key, k); }
+
+static uint64_t addr_hash(const void* e){ return hash_in6(&((const addr_ent_t*)e)->addr); }
+static int addr_eq(const void* e, const void* k){ return in6_equal(&((const addr_ent_t*)e)->addr, k); }
+static uint64_t pfx_hash(const void* e){
+  const pfx_ent_t* p = e;
+  return hash_prefix(&p->prefix, p->plen);
 }
-static ssize_t find_pd(mem_impl_t* m, const lease_key_t* key){
-  uint64_t h = hash_key(key);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx = (h + i) % m->cap;
-    if(!m->pd[idx].used) return -1;
-    if(key_eq(&m->pd[idx].key, key)) return (ssize_t)idx;
-  }
-  return -1;
+static int pfx_eq(const void* e, const void* k){
+  const pfx_ent_t* p = e;
+  const pfx_key_t* q = k;
+  return p->plen==q->plen && in6_equal(&p->prefix, &q->prefix);
 }
-static ssize_t upsert_na(mem_impl_t* m, const lease_na_t* in){
-  uint64_t h = hash_key(&in->key);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx = (h + i) % m->cap;
-    if(!m->na[idx].used || key_eq(&m->na[idx].key, &in->key)){
-      m->na[idx].used = 1;
-      m->na[idx].key = in->key;
-      m->na[idx].na  = *in;
-      return (ssize_t)idx;
-    }
-  }
-  return -1;
+
+static uint64_t daddr_hash(const void* e){ return hash_in6(&((const decl_addr_ent_t*)e)->addr); }
+static int daddr_eq(const void* e, const void* k){ return in6_equal(&((const decl_addr_ent_t*)e)->addr, k); }
+static uint64_t dpfx_hash(const void* e){
+  const decl_pfx_ent_t* p = e;
+  return hash_prefix(&p->prefix, p->plen);
 }
-static ssize_t upsert_pd(mem_impl_t* m, const lease_pd_t* in){
-  uint64_t h = hash_key(&in->key);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx = (h + i) % m->cap;
-    if(!m->pd[idx].used || key_eq(&m->pd[idx].key, &in->key)){
-      m->pd[idx].used = 1;
-      m->pd[idx].key = in->key;
-      m->pd[idx].pd  = *in;
-      return (ssize_t)idx;
-    }
-  }
-  return -1;
+static int dpfx_eq(const void* e, const void* k){
+  const decl_pfx_ent_t* p = e;
+  const pfx_key_t* q = k;
+  return p->plen==q->plen && in6_equal(&p->prefix, &q->prefix);
+}
+
+static const htab_type_t na_type    = { sizeof(lease_na_t),      na_hash,    na_eq    };
+static const htab_type_t pd_type    = { sizeof(lease_pd_t),      pd_hash,    pd_eq    };
+static const htab_type_t addr_type  = { sizeof(addr_ent_t),      addr_hash,  addr_eq  };
+static const htab_type_t pfx_type   = { sizeof(pfx_ent_t),       pfx_hash,   pfx_eq   };
+static const htab_type_t daddr_type = { sizeof(decl_addr_ent_t), daddr_hash, daddr_eq };
+static const htab_type_t dpfx_type  = { sizeof(decl_pfx_ent_t),  dpfx_hash,  dpfx_eq  };
+
+// table order of the fixed-array interface (mem_store.h)
+static const htab_type_t* const table_type[MEM_NTABLES] = {
+  &na_type, &pd_type, &addr_type, &pfx_type, &daddr_type, &dpfx_type, &duid_idx_type,
+};
+
+static htab_t* table(mem_impl_t* m, int i){
+  htab_t* t[MEM_NTABLES] = {
+    &m->na, &m->pd, &m->addr_idx, &m->pfx_idx, &m->declined_addr, &m->declined_pfx,
+    &m->duids.idx,
+  };
+  return t[i];
+}
+
+static pfx_key_t pfx_key(const struct in6_addr* pfx, uint8_t plen){
+  pfx_key_t k;
+  memset(&k, 0, sizeof(k));
+  k.prefix = *pfx;
+  k.plen = plen;
+  return k;
 }
 
+// ---- address / prefix indexes ----
+// an address/prefix is "occupied" while it is bound or quarantined; the
+// observer is told only on the free <-> occupied transitions
 static int addr_index_put(mem_impl_t* m, const struct in6_addr* addr, const lease_key_t* key){
-  uint64_t h = hash_in6(addr);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx = (h + i) % m->cap;
-    if(!m->addr_idx[idx].used || in6_equal(&m->addr_idx[idx].addr, addr)){
-      m->addr_idx[idx].used = 1;
-      m->addr_idx[idx].addr = *addr;
-      m->addr_idx[idx].key  = *key;
-      return 0;
-    }
-  }
-  return -1;
+  int ex;
+  addr_ent_t* e = htab_insert(&m->addr_idx, hash_in6(addr), addr, &ex);
+  if(!e) return -1;
+  e->addr = *addr;
+  e->key = *key;
+  if(!ex && !htab_find(&m->declined_addr, hash_in6(addr), addr)) lease_store_occ(m->st, addr, 128, 1);
+  return 0;
 }
-static int addr_index_del(mem_impl_t* m, const struct in6_addr* addr){
+static void addr_index_del(mem_impl_t* m, const struct in6_addr* addr){
   uint64_t h = hash_in6(addr);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx = (h + i) % m->cap;
-    if(!m->addr_idx[idx].used) return 0;
-    if(in6_equal(&m->addr_idx[idx].addr, addr)){
-      m->addr_idx[idx].used = 0;
-      return 0;
-    }
-  }
-  return 0;
+  if(!htab_erase(&m->addr_idx, h, addr)) return;
+  if(!htab_find(&m->declined_addr, h, addr)) lease_store_occ(m->st, addr, 128, 0);
 }
 static int pfx_index_put(mem_impl_t* m, const struct in6_addr* pfx, uint8_t plen, const lease_key_t* key){
-  uint64_t h = hash_prefix(pfx, plen);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx = (h + i) % m->cap;
-    if(!m->pfx_idx[idx].used ||
-       (m->pfx_idx[idx].plen==plen && in6_equal(&m->pfx_idx[idx].prefix, pfx))){
-      m->pfx_idx[idx].used = 1;
-      m->pfx_idx[idx].prefix = *pfx;
-      m->pfx_idx[idx].plen = plen;
-      m->pfx_idx[idx].key  = *key;
-      return 0;
-    }
-  }
-  return -1;
+  pfx_key_t k = pfx_key(pfx, plen);
+  int ex;
+  pfx_ent_t* e = htab_insert(&m->pfx_idx, hash_prefix(pfx, plen), &k, &ex);
+  if(!e) return -1;
+  e->prefix = *pfx;
+  e->plen = plen;
+  e->key = *key;
+  if(!ex && !htab_find(&m->declined_pfx, hash_prefix(pfx, plen), &k)) lease_store_occ(m->st, pfx, plen, 1);
+  return 0;
 }
-static int pfx_index_del(mem_impl_t* m, const struct in6_addr* pfx, uint8_t plen){
+static void pfx_index_del(mem_impl_t* m, const struct in6_addr* pfx, uint8_t plen){
+  pfx_key_t k = pfx_key(pfx, plen);
   uint64_t h = hash_prefix(pfx, plen);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx = (h + i) % m->cap;
-    if(!m->pfx_idx[idx].used) return 0;
-    if(m->pfx_idx[idx].plen==plen && in6_equal(&m->pfx_idx[idx].prefix, pfx)){
-      m->pfx_idx[idx].used = 0;
-      return 0;
-    }
+  if(!htab_erase(&m->pfx_idx, h, &k)) return;
+  if(!htab_find(&m->declined_pfx, h, &k)) lease_store_occ(m->st, pfx, plen, 0);
+}
+
+// state observer: a lease went from state s0 at a0/p0 to s1 at a1/p1
+// (0 = no lease); a move is reported as a drop and a new lease
+static void use_move(mem_impl_t* m, const struct in6_addr* a0, uint8_t p0, int s0,
+                     const struct in6_addr* a1, uint8_t p1, int s1){
+  if(s0 && (p0 != p1 || !in6_equal(a0, a1))){
+    lease_store_use(m->st, a0, p0, s0, 0);
+    s0 = 0;
   }
+  lease_store_use(m->st, a1, p1, s0, s1);
+}
+
+static int na_expired(const lease_na_t* l, uint64_t now){
+  if(l->state == LS_OFFERED) return l->hold_until <= now;
+  if(l->state == LS_ALLOCATED) return l->valid_until <= now;
+  return 0;
+}
+static int pd_expired(const lease_pd_t* l, uint64_t now){
+  if(l->state == LS_OFFERED) return l->hold_until <= now;
+  if(l->state == LS_ALLOCATED) return l->valid_until <= now;
   return 0;
 }
 
+static int schedule_key(mem_impl_t* m, uint8_t kind, const lease_key_t* key,
+                        lease_state_t state, uint64_t hold_until, uint64_t valid_until){
+  tw_node_t n;
+  memset(&n, 0, sizeof(n));
+  if(state == LS_OFFERED) n.when = hold_until;
+  else if(state == LS_ALLOCATED) n.when = valid_until;
+  else return 0; // no deadline
+  n.kind = kind;
+  n.u.key = *key;
+  return tw_add(&m->tw, &n);
+}
+
+static lease_duid_t duid_of(mem_impl_t* m, uint32_t handle){
+  lease_duid_t d = { NULL, 0 };
+  d.p = duid_arena_bytes(&m->duids, handle, &d.len);
+  return d;
+}
+
+// journal: bindings are logged; offers are not, but an offer that replaces
+// a binding ends it, so it is logged as a delete
+static int journal_na(lease_store_t* st, const lease_na_t* l, int was_bound){
+  if(!st->journal) return 0;
+  lease_duid_t d = duid_of(st->impl, l->key.duid);
+  if(l->state != LS_OFFERED) return lj_put_na(st->journal, l, &d);
+  return was_bound ? lj_del(st->journal, LJ_DEL_NA, &l->key, &d) : 0;
+}
+static int journal_pd(lease_store_t* st, const lease_pd_t* l, int was_bound){
+  if(!st->journal) return 0;
+  lease_duid_t d = duid_of(st->impl, l->key.duid);
+  if(l->state != LS_OFFERED) return lj_put_pd(st->journal, l, &d);
+  return was_bound ? lj_del(st->journal, LJ_DEL_PD, &l->key, &d) : 0;
+}
+static int journal_del(lease_store_t* st, uint8_t type, const lease_key_t* key){
+  lease_duid_t d = duid_of(st->impl, key->duid);
+  return lj_del(st->journal, type, key, &d);
+}
+
+// ---- client DUIDs ----
+static uint32_t st_duid_find(lease_store_t* st, const uint8_t* duid, size_t len, uint64_t h){
+  return duid_arena_find(&((mem_impl_t*)st->impl)->duids, duid, len, h);
+}
+static uint32_t st_duid_get(lease_store_t* st, const uint8_t* duid, size_t len, uint64_t h){
+  return duid_arena_get(&((mem_impl_t*)st->impl)->duids, duid, len, h);
+}
+static void st_duid_put(lease_store_t* st, uint32_t handle){
+  duid_arena_put(&((mem_impl_t*)st->impl)->duids, handle);
+}
+static const uint8_t* st_duid_bytes(lease_store_t* st, uint32_t handle, size_t* len){
+  return duid_arena_bytes(&((mem_impl_t*)st->impl)->duids, handle, len);
+}
+
 static int st_get_na(lease_store_t* st, const lease_key_t* key, lease_na_t* out){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  ssize_t idx = find_na(m, key);
-  if(idx < 0) return -1;
-  *out = m->na[idx].na;
+  const lease_na_t* l = htab_find(&m->na, hash_key(key), key);
+  if(!l) return -1;
+  *out = *l;
   return 0;
 }
 static int st_put_na(lease_store_t* st, const lease_na_t* in){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  // update address index
+  if(schedule_key(m, TW_NA, &in->key, in->state, in->hold_until, in->valid_until) < 0) return -1;
+
+  int ex;
+  lease_na_t* l = htab_insert(&m->na, hash_key(&in->key), &in->key, &ex);
+  if(!l) return -1;
+  if(!ex) duid_arena_ref(&m->duids, in->key.duid);
   // delete old addr mapping if key exists and address changes
-  lease_na_t old;
-  if(st_get_na(st, &in->key, &old) == 0){
-    if(!in6_equal(&old.addr, &in->addr)) addr_index_del(m, &old.addr);
-  }
-  if(upsert_na(m, in) < 0) return -1;
-  return addr_index_put(m, &in->addr, &in->key);
+  int moved = ex && !in6_equal(&l->addr, &in->addr);
+  int was_bound = ex && l->state != LS_OFFERED;
+  int s0 = ex ? (int)l->state : 0;
+  struct in6_addr old = l->addr;
+  *l = *in;
+  if(moved) addr_index_del(m, &old);
+  if(addr_index_put(m, &in->addr, &in->key) < 0) return -1;
+  use_move(m, &old, 128, s0, &in->addr, 128, in->state);
+  return journal_na(st, in, was_bound);
 }
 static int st_del_na(lease_store_t* st, const lease_key_t* key){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  ssize_t idx = find_na(m, key);
-  if(idx < 0) return 0;
-  addr_index_del(m, &m->na[idx].na.addr);
-  m->na[idx].used = 0;
-  return 0;
+  uint64_t h = hash_key(key);
+  const lease_na_t* l = htab_find(&m->na, h, key);
+  if(!l) return 0;
+  struct in6_addr addr = l->addr;
+  int was_bound = l->state != LS_OFFERED;
+  int s0 = l->state;
+  htab_erase(&m->na, h, key);
+  addr_index_del(m, &addr);
+  lease_store_use(st, &addr, 128, s0, 0);
+  int rc = (was_bound && st->journal) ? journal_del(st, LJ_DEL_NA, key) : 0;
+  duid_arena_put(&m->duids, key->duid);
+  return rc;
 }
 
 static int st_get_pd(lease_store_t* st, const lease_key_t* key, lease_pd_t* out){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  ssize_t idx = find_pd(m, key);
-  if(idx < 0) return -1;
-  *out = m->pd[idx].pd;
+  const lease_pd_t* l = htab_find(&m->pd, hash_key(key), key);
+  if(!l) return -1;
+  *out = *l;
   return 0;
 }
 static int st_put_pd(lease_store_t* st, const lease_pd_t* in){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  lease_pd_t old;
-  if(st_get_pd(st, &in->key, &old) == 0){
-    if(old.prefix_len != in->prefix_len || !in6_equal(&old.prefix, &in->prefix)){
-      pfx_index_del(m, &old.prefix, old.prefix_len);
-    }
-  }
-  if(upsert_pd(m, in) < 0) return -1;
-  return pfx_index_put(m, &in->prefix, in->prefix_len, &in->key);
+  if(schedule_key(m, TW_PD, &in->key, in->state, in->hold_until, in->valid_until) < 0) return -1;
+
+  int ex;
+  lease_pd_t* l = htab_insert(&m->pd, hash_key(&in->key), &in->key, &ex);
+  if(!l) return -1;
+  if(!ex) duid_arena_ref(&m->duids, in->key.duid);
+  int moved = ex && (l->prefix_len != in->prefix_len || !in6_equal(&l->prefix, &in->prefix));
+  int was_bound = ex && l->state != LS_OFFERED;
+  int s0 = ex ? (int)l->state : 0;
+  struct in6_addr old = l->prefix;
+  uint8_t old_len = l->prefix_len;
+  *l = *in;
+  if(moved) pfx_index_del(m, &old, old_len);
+  if(pfx_index_put(m, &in->prefix, in->prefix_len, &in->key) < 0) return -1;
+  use_move(m, &old, old_len, s0, &in->prefix, in->prefix_len, in->state);
+  return journal_pd(st, in, was_bound);
 }
 static int st_del_pd(lease_store_t* st, const lease_key_t* key){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  ssize_t idx = find_pd(m, key);
-  if(idx < 0) return 0;
-  pfx_index_del(m, &m->pd[idx].pd.prefix, m->pd[idx].pd.prefix_len);
-  m->pd[idx].used = 0;
-  return 0;
+  uint64_t h = hash_key(key);
+  const lease_pd_t* l = htab_find(&m->pd, h, key);
+  if(!l) return 0;
+  struct in6_addr pfx = l->prefix;
+  uint8_t plen = l->prefix_len;
+  int was_bound = l->state != LS_OFFERED;
+  int s0 = l->state;
+  htab_erase(&m->pd, h, key);
+  pfx_index_del(m, &pfx, plen);
+  lease_store_use(st, &pfx, plen, s0, 0);
+  int rc = (was_bound && st->journal) ? journal_del(st, LJ_DEL_PD, key) : 0;
+  duid_arena_put(&m->duids, key->duid);
+  return rc;
 }
 
 static int st_addr_in_use(lease_store_t* st, const struct in6_addr* addr){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  uint64_t h = hash_in6(addr);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx = (h + i) % m->cap;
-    if(!m->addr_idx[idx].used) return 0;
-    if(in6_equal(&m->addr_idx[idx].addr, addr)) return 1;
-  }
-  return 0;
+  return htab_find(&m->addr_idx, hash_in6(addr), addr) != NULL;
 }
 static int st_prefix_in_use(lease_store_t* st, const struct in6_addr* pfx, uint8_t plen){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  uint64_t h = hash_prefix(pfx, plen);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx = (h + i) % m->cap;
-    if(!m->pfx_idx[idx].used) return 0;
-    if(m->pfx_idx[idx].plen==plen && in6_equal(&m->pfx_idx[idx].prefix, pfx)) return 1;
-  }
-  return 0;
+  pfx_key_t k = pfx_key(pfx, plen);
+  return htab_find(&m->pfx_idx, hash_prefix(pfx, plen), &k) != NULL;
 }
 
 // declined tables
 static int st_is_addr_declined(lease_store_t* st, const struct in6_addr* addr, uint64_t now){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  uint64_t h = hash_in6(addr);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx=(h+i)%m->cap;
-    if(!m->declined_addr[idx].used) return 0;
-    if(in6_equal(&m->declined_addr[idx].addr, addr)){
-      return m->declined_addr_until[idx] > now;
-    }
-  }
-  return 0;
+  const decl_addr_ent_t* d = htab_find(&m->declined_addr, hash_in6(addr), addr);
+  return d && d->until > now;
 }
 static int st_is_prefix_declined(lease_store_t* st, const struct in6_addr* pfx, uint8_t plen, uint64_t now){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  uint64_t h = hash_prefix(pfx, plen);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx=(h+i)%m->cap;
-    if(!m->declined_pfx[idx].used) return 0;
-    if(m->declined_pfx[idx].plen==plen && in6_equal(&m->declined_pfx[idx].prefix, pfx)){
-      return m->declined_pfx_until[idx] > now;
-    }
-  }
-  return 0;
+  pfx_key_t k = pfx_key(pfx, plen);
+  const decl_pfx_ent_t* d = htab_find(&m->declined_pfx, hash_prefix(pfx, plen), &k);
+  return d && d->until > now;
 }
 static int st_decline_addr(lease_store_t* st, const struct in6_addr* addr, uint64_t until){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  uint64_t h = hash_in6(addr);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx=(h+i)%m->cap;
-    if(!m->declined_addr[idx].used || in6_equal(&m->declined_addr[idx].addr, addr)){
-      m->declined_addr[idx].used=1;
-      m->declined_addr[idx].addr=*addr;
-      m->declined_addr_until[idx]=until;
-      return 0;
+  tw_node_t n;
+  memset(&n, 0, sizeof(n));
+  n.when = until;
+  n.kind = TW_DECL_ADDR;
+  n.u.addr = *addr;
+  if(tw_add(&m->tw, &n) < 0) return -1;
+
+  int ex;
+  decl_addr_ent_t* d = htab_insert(&m->declined_addr, hash_in6(addr), addr, &ex);
+  if(!d) return -1;
+  d->addr = *addr;
+  d->until = until;
+  if(!ex && !htab_find(&m->addr_idx, hash_in6(addr), addr)) lease_store_occ(st, addr, 128, 1);
+  if(!ex) lease_store_use(st, addr, 128, 0, LS_DECLINED);
+  return st->journal ? lj_decline(st->journal, addr, 128, until) : 0;
+}
+static int st_decline_prefix(lease_store_t* st, const struct in6_addr* pfx, uint8_t plen, uint64_t until){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  tw_node_t n;
+  memset(&n, 0, sizeof(n));
+  n.when = until;
+  n.kind = TW_DECL_PFX;
+  n.plen = plen;
+  n.u.addr = *pfx;
+  if(tw_add(&m->tw, &n) < 0) return -1;
+
+  pfx_key_t k = pfx_key(pfx, plen);
+  int ex;
+  decl_pfx_ent_t* d = htab_insert(&m->declined_pfx, hash_prefix(pfx, plen), &k, &ex);
+  if(!d) return -1;
+  d->prefix = *pfx;
+  d->plen = plen;
+  d->until = until;
+  if(!ex && !htab_find(&m->pfx_idx, hash_prefix(pfx, plen), &k)) lease_store_occ(st, pfx, plen, 1);
+  if(!ex) lease_store_use(st, pfx, plen, 0, LS_DECLINED);
+  return st->journal ? lj_decline(st->journal, pfx, plen, until) : 0;
+}
+
+// ---- fused paths ----
+static int na_live(const lease_na_t* l, uint64_t now){
+  return l->state != LS_DECLINED && !na_expired(l, now);
+}
+static int pd_live(const lease_pd_t* l, uint64_t now){
+  return l->state != LS_DECLINED && !pd_expired(l, now);
+}
+
+static int na_touch(lease_store_t* st, mem_impl_t* m, lease_na_t* l, const lease_times_t* t){
+  if(schedule_key(m, TW_NA, &l->key, t->state, t->hold_until, t->valid_until) < 0) return -1;
+  int was_bound = l->state != LS_OFFERED;
+  lease_store_use(st, &l->addr, 128, l->state, t->state);
+  l->state = t->state;
+  l->preferred_until = t->preferred_until;
+  l->valid_until = t->valid_until;
+  l->hold_until = t->hold_until;
+  return journal_na(st, l, was_bound);
+}
+static int pd_touch(lease_store_t* st, mem_impl_t* m, lease_pd_t* l, const lease_times_t* t){
+  if(schedule_key(m, TW_PD, &l->key, t->state, t->hold_until, t->valid_until) < 0) return -1;
+  int was_bound = l->state != LS_OFFERED;
+  lease_store_use(st, &l->prefix, l->prefix_len, l->state, t->state);
+  l->state = t->state;
+  l->preferred_until = t->preferred_until;
+  l->valid_until = t->valid_until;
+  l->hold_until = t->hold_until;
+  return journal_pd(st, l, was_bound);
+}
+
+static lease_times_t times_of_na(const lease_na_t* l){
+  lease_times_t t = { l->state, l->preferred_until, l->valid_until, l->hold_until, l->subnet_id };
+  return t;
+}
+static lease_times_t times_of_pd(const lease_pd_t* l){
+  lease_times_t t = { l->state, l->preferred_until, l->valid_until, l->hold_until, l->subnet_id };
+  return t;
+}
+
+static int st_touch_na(lease_store_t* st, const lease_key_t* key, const lease_times_t* t,
+                       uint64_t now, lease_na_t* out){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  lease_na_t* l = htab_find(&m->na, hash_key(key), key);
+  if(!l || !na_live(l, now) || l->subnet_id != t->subnet_id) return -1;
+  if(na_touch(st, m, l, t) < 0) return -1;
+  if(out) *out = *l;
+  return 0;
+}
+static int st_touch_pd(lease_store_t* st, const lease_key_t* key, const lease_times_t* t,
+                       uint64_t now, lease_pd_t* out){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  lease_pd_t* l = htab_find(&m->pd, hash_key(key), key);
+  if(!l || !pd_live(l, now) || l->subnet_id != t->subnet_id) return -1;
+  if(pd_touch(st, m, l, t) < 0) return -1;
+  if(out) *out = *l;
+  return 0;
+}
+
+// the slot for tmpl->key is claimed up front and filled in place; the
+// candidate checks only look at the address/decline tables, so it stays put
+static int st_acquire_na(lease_store_t* st, const lease_na_t* tmpl, lease_cand_fn cand, void* cand_arg,
+                         uint64_t now, lease_na_t* out){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  uint64_t h = hash_key(&tmpl->key);
+  int ex;
+  lease_na_t* l = htab_insert(&m->na, h, &tmpl->key, &ex);
+  if(!l) return -1;
+
+  // a lease from another subnet is off-link now: allocate anew, moving it
+  if(ex && na_live(l, now) && l->subnet_id == tmpl->subnet_id){
+    if(tmpl->state != LS_OFFERED){
+      lease_times_t t = times_of_na(tmpl);
+      if(na_touch(st, m, l, &t) < 0) return -1;
     }
+    if(out) *out = *l;
+    return 1;
   }
+  if(!ex) l->key = tmpl->key; // a failed attempt erases by key
+
+  struct in6_addr a;
+  uint8_t plen;
+  for(unsigned i=0; cand(cand_arg, i, &a, &plen) == 0; i++){
+    uint64_t ah = hash_in6(&a);
+    const addr_ent_t* owner = htab_find(&m->addr_idx, ah, &a);
+    if(owner && !key_eq(&owner->key, &tmpl->key)) continue;
+    const decl_addr_ent_t* d = htab_find(&m->declined_addr, ah, &a);
+    if(d && d->until > now) continue;
+
+    if(schedule_key(m, TW_NA, &tmpl->key, tmpl->state, tmpl->hold_until, tmpl->valid_until) < 0) break;
+    int moved = ex && !in6_equal(&l->addr, &a);
+    int was_bound = ex && l->state != LS_OFFERED;
+    int s0 = ex ? (int)l->state : 0;
+    struct in6_addr old = l->addr;
+    *l = *tmpl;
+    l->addr = a;
+    if(!ex) duid_arena_ref(&m->duids, tmpl->key.duid);
+    if(moved) addr_index_del(m, &old);
+    if(addr_index_put(m, &a, &tmpl->key) < 0) return -1;
+    use_move(m, &old, 128, s0, &a, 128, l->state);
+    if(out) *out = *l;
+    return journal_na(st, l, was_bound) < 0 ? -1 : 0;
+  }
+  if(!ex) htab_erase(&m->na, h, &tmpl->key);
   return -1;
 }
-static int st_decline_prefix(lease_store_t* st, const struct in6_addr* pfx, uint8_t plen, uint64_t until){
+static int st_acquire_pd(lease_store_t* st, const lease_pd_t* tmpl, lease_cand_fn cand, void* cand_arg,
+                         uint64_t now, lease_pd_t* out){
   mem_impl_t* m = (mem_impl_t*)st->impl;
-  uint64_t h = hash_prefix(pfx, plen);
-  for(size_t i=0;i<m->cap;i++){
-    size_t idx=(h+i)%m->cap;
-    if(!m->declined_pfx[idx].used ||
-       (m->declined_pfx[idx].plen==plen && in6_equal(&m->declined_pfx[idx].prefix, pfx))){
-      m->declined_pfx[idx].used=1;
-      m->declined_pfx[idx].prefix=*pfx;
-      m->declined_pfx[idx].plen=plen;
-      m->declined_pfx_until[idx]=until;
-      return 0;
+  uint64_t h = hash_key(&tmpl->key);
+  int ex;
+  lease_pd_t* l = htab_insert(&m->pd, h, &tmpl->key, &ex);
+  if(!l) return -1;
+
+  if(ex && pd_live(l, now) && l->subnet_id == tmpl->subnet_id){
+    if(tmpl->state != LS_OFFERED){
+      lease_times_t t = times_of_pd(tmpl);
+      if(pd_touch(st, m, l, &t) < 0) return -1;
     }
+    if(out) *out = *l;
+    return 1;
   }
+  if(!ex) l->key = tmpl->key;
+
+  struct in6_addr a;
+  uint8_t plen;
+  for(unsigned i=0; cand(cand_arg, i, &a, &plen) == 0; i++){
+    pfx_key_t k = pfx_key(&a, plen);
+    uint64_t ph = hash_prefix(&a, plen);
+    const pfx_ent_t* owner = htab_find(&m->pfx_idx, ph, &k);
+    if(owner && !key_eq(&owner->key, &tmpl->key)) continue;
+    const decl_pfx_ent_t* d = htab_find(&m->declined_pfx, ph, &k);
+    if(d && d->until > now) continue;
+
+    if(schedule_key(m, TW_PD, &tmpl->key, tmpl->state, tmpl->hold_until, tmpl->valid_until) < 0) break;
+    int moved = ex && (l->prefix_len != plen || !in6_equal(&l->prefix, &a));
+    int was_bound = ex && l->state != LS_OFFERED;
+    int s0 = ex ? (int)l->state : 0;
+    struct in6_addr old = l->prefix;
+    uint8_t old_len = l->prefix_len;
+    *l = *tmpl;
+    l->prefix = a;
+    l->prefix_len = plen;
+    if(!ex) duid_arena_ref(&m->duids, tmpl->key.duid);
+    if(moved) pfx_index_del(m, &old, old_len);
+    if(pfx_index_put(m, &a, plen, &tmpl->key) < 0) return -1;
+    use_move(m, &old, old_len, s0, &a, plen, l->state);
+    if(out) *out = *l;
+    return journal_pd(st, l, was_bound) < 0 ? -1 : 0;
+  }
+  if(!ex) htab_erase(&m->pd, h, &tmpl->key);
   return -1;
 }
 
+// wheel callback: entries are never cancelled, so re-check the current
+// deadline before dropping anything (renewed leases survive their old entry)
+static void expire_one(void* arg, const tw_node_t* n, uint64_t now){
+  mem_impl_t* m = (mem_impl_t*)arg;
+
+  switch(n->kind){
+    case TW_NA: {
+      uint64_t h = hash_key(&n->u.key);
+      const lease_na_t* l = htab_find(&m->na, h, &n->u.key);
+      if(!l || !na_expired(l, now)) return;
+      struct in6_addr addr = l->addr;
+      int s0 = l->state;
+      htab_erase(&m->na, h, &n->u.key);
+      addr_index_del(m, &addr);
+      lease_store_use(m->st, &addr, 128, s0, 0);
+      duid_arena_put(&m->duids, n->u.key.duid);
+      return;
+    }
+    case TW_PD: {
+      uint64_t h = hash_key(&n->u.key);
+      const lease_pd_t* l = htab_find(&m->pd, h, &n->u.key);
+      if(!l || !pd_expired(l, now)) return;
+      struct in6_addr pfx = l->prefix;
+      uint8_t plen = l->prefix_len;
+      int s0 = l->state;
+      htab_erase(&m->pd, h, &n->u.key);
+      pfx_index_del(m, &pfx, plen);
+      lease_store_use(m->st, &pfx, plen, s0, 0);
+      duid_arena_put(&m->duids, n->u.key.duid);
+      return;
+    }
+    case TW_DECL_ADDR: {
+      uint64_t h = hash_in6(&n->u.addr);
+      const decl_addr_ent_t* d = htab_find(&m->declined_addr, h, &n->u.addr);
+      if(!d || d->until > now) return;
+      htab_erase(&m->declined_addr, h, &n->u.addr);
+      if(!htab_find(&m->addr_idx, h, &n->u.addr)) lease_store_occ(m->st, &n->u.addr, 128, 0);
+      lease_store_use(m->st, &n->u.addr, 128, LS_DECLINED, 0);
+      return;
+    }
+    case TW_DECL_PFX: {
+      pfx_key_t k = pfx_key(&n->u.addr, n->plen);
+      uint64_t h = hash_prefix(&k.prefix, k.plen);
+      const decl_pfx_ent_t* d = htab_find(&m->declined_pfx, h, &k);
+      if(!d || d->until > now) return;
+      htab_erase(&m->declined_pfx, h, &k);
+      if(!htab_find(&m->pfx_idx, h, &k)) lease_store_occ(m->st, &k.prefix, k.plen, 0);
+      lease_store_use(m->st, &k.prefix, k.plen, LS_DECLINED, 0);
+      return;
+    }
+    default:
+      return;
+  }
+}
+
+// O(ticks + expired): only entries whose deadline has passed are visited
 static void st_gc(lease_store_t* st, uint64_t now){
   mem_impl_t* m = (mem_impl_t*)st->impl;
+  tw_advance(&m->tw, now, expire_one, m);
+}
 
-  // GC NA leases
-  for(size_t i=0;i<m->cap;i++){
-    if(!m->na[i].used) continue;
-    lease_na_t* l = &m->na[i].na;
-    if(l->state == LS_OFFERED && l->hold_until <= now){
-      addr_index_del(m, &l->addr);
-      m->na[i].used = 0;
-      continue;
+static int st_foreach(lease_store_t* st, const lease_visit_t* v, void* arg){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  size_t pos;
+  int rc;
+  const void* e;
+
+  pos = 0;
+  while((e = htab_next(&m->na, &pos)) != NULL){
+    if(v->na && (rc = v->na(arg, e)) != 0) return rc;
+  }
+  pos = 0;
+  while((e = htab_next(&m->pd, &pos)) != NULL){
+    if(v->pd && (rc = v->pd(arg, e)) != 0) return rc;
+  }
+  if(!v->decl) return 0;
+  pos = 0;
+  while((e = htab_next(&m->declined_addr, &pos)) != NULL){
+    const decl_addr_ent_t* d = e;
+    lease_decl_t out = { .addr = d->addr, .plen = 128, .until = d->until };
+    if((rc = v->decl(arg, &out)) != 0) return rc;
+  }
+  pos = 0;
+  while((e = htab_next(&m->declined_pfx, &pos)) != NULL){
+    const decl_pfx_ent_t* d = e;
+    lease_decl_t out = { .addr = d->prefix, .plen = d->plen, .until = d->until };
+    if((rc = v->decl(arg, &out)) != 0) return rc;
+  }
+  return 0;
+}
+
+// ---- bulk load ----
+// every table (and the wheel) is built by its own thread: each one only
+// touches its own htab_t, so no locking is needed
+typedef struct {
+  mem_impl_t* m;
+  const mem_bulk_t* b;
+  uint32_t* na_id;  // interned DUID per entry (0 = expired)
+  uint32_t* pd_id;
+  uint64_t now;
+  int next;   // task counter
+  int failed;
+  pthread_mutex_t mu;
+} bulk_t;
+
+enum { BK_NA, BK_ADDR, BK_PD, BK_PFX, BK_DADDR, BK_DPFX, BK_WHEEL, BK_TASKS };
+
+static int decl_live(const lease_decl_t* d, uint64_t now){ return d->until > now; }
+
+static lease_key_t with_duid(lease_key_t k, uint32_t duid){
+  k.duid = duid;
+  return k;
+}
+
+static int bulk_task(bulk_t* bk, int task){
+  mem_impl_t* m = bk->m;
+  const mem_bulk_t* b = bk->b;
+  uint64_t now = bk->now;
+
+  switch(task){
+    case BK_NA:
+      if(htab_reserve(&m->na, b->n_na) < 0) return -1;
+      for(size_t i=0;i<b->n_na;i++){
+        if(na_expired(&b->na[i], now)) continue;
+        lease_key_t k = with_duid(b->na[i].key, bk->na_id[i]);
+        lease_na_t* l = htab_insert_unique(&m->na, hash_key(&k));
+        if(!l) return -1;
+        *l = b->na[i];
+        l->key = k;
+      }
+      return 0;
+    case BK_ADDR:
+      // indexes go through htab_insert: a duplicate address keeps one owner
+      if(htab_reserve(&m->addr_idx, b->n_na) < 0) return -1;
+      for(size_t i=0;i<b->n_na;i++){
+        const lease_na_t* l = &b->na[i];
+        if(na_expired(l, now)) continue;
+        int ex;
+        addr_ent_t* e = htab_insert(&m->addr_idx, hash_in6(&l->addr), &l->addr, &ex);
+        if(!e) return -1;
+        e->addr = l->addr;
+        e->key = with_duid(l->key, bk->na_id[i]);
+      }
+      return 0;
+    case BK_PD:
+      if(htab_reserve(&m->pd, b->n_pd) < 0) return -1;
+      for(size_t i=0;i<b->n_pd;i++){
+        if(pd_expired(&b->pd[i], now)) continue;
+        lease_key_t k = with_duid(b->pd[i].key, bk->pd_id[i]);
+        lease_pd_t* l = htab_insert_unique(&m->pd, hash_key(&k));
+        if(!l) return -1;
+        *l = b->pd[i];
+        l->key = k;
+      }
+      return 0;
+    case BK_PFX:
+      if(htab_reserve(&m->pfx_idx, b->n_pd) < 0) return -1;
+      for(size_t i=0;i<b->n_pd;i++){
+        const lease_pd_t* l = &b->pd[i];
+        if(pd_expired(l, now)) continue;
+        pfx_key_t k = pfx_key(&l->prefix, l->prefix_len);
+        int ex;
+        pfx_ent_t* e = htab_insert(&m->pfx_idx, hash_prefix(&l->prefix, l->prefix_len), &k, &ex);
+        if(!e) return -1;
+        e->prefix = l->prefix;
+        e->plen = l->prefix_len;
+        e->key = with_duid(l->key, bk->pd_id[i]);
+      }
+      return 0;
+    case BK_DADDR:
+      for(size_t i=0;i<b->n_decl;i++){
+        const lease_decl_t* d = &b->decl[i];
+        if(d->plen != 128 || !decl_live(d, now)) continue;
+        int ex;
+        decl_addr_ent_t* e = htab_insert(&m->declined_addr, hash_in6(&d->addr), &d->addr, &ex);
+        if(!e) return -1;
+        e->addr = d->addr;
+        e->until = d->until;
+      }
+      return 0;
+    case BK_DPFX:
+      for(size_t i=0;i<b->n_decl;i++){
+        const lease_decl_t* d = &b->decl[i];
+        if(d->plen == 128 || !decl_live(d, now)) continue;
+        pfx_key_t k = pfx_key(&d->addr, d->plen);
+        int ex;
+        decl_pfx_ent_t* e = htab_insert(&m->declined_pfx, hash_prefix(&d->addr, d->plen), &k, &ex);
+        if(!e) return -1;
+        e->prefix = d->addr;
+        e->plen = d->plen;
+        e->until = d->until;
+      }
+      return 0;
+    case BK_WHEEL:
+      for(size_t i=0;i<b->n_na;i++){
+        const lease_na_t* l = &b->na[i];
+        if(na_expired(l, now)) continue;
+        lease_key_t k = with_duid(l->key, bk->na_id[i]);
+        if(schedule_key(m, TW_NA, &k, l->state, l->hold_until, l->valid_until) < 0) return -1;
+      }
+      for(size_t i=0;i<b->n_pd;i++){
+        const lease_pd_t* l = &b->pd[i];
+        if(pd_expired(l, now)) continue;
+        lease_key_t k = with_duid(l->key, bk->pd_id[i]);
+        if(schedule_key(m, TW_PD, &k, l->state, l->hold_until, l->valid_until) < 0) return -1;
+      }
+      for(size_t i=0;i<b->n_decl;i++){
+        const lease_decl_t* d = &b->decl[i];
+        if(!decl_live(d, now)) continue;
+        tw_node_t n;
+        memset(&n, 0, sizeof(n));
+        n.when = d->until;
+        n.kind = d->plen == 128 ? TW_DECL_ADDR : TW_DECL_PFX;
+        n.plen = d->plen;
+        n.u.addr = d->addr;
+        if(tw_add(&m->tw, &n) < 0) return -1;
+      }
+      return 0;
+    default:
+      return 0;
+  }
+}
+
+static void* bulk_main(void* arg){
+  bulk_t* bk = (bulk_t*)arg;
+  while(1){
+    pthread_mutex_lock(&bk->mu);
+    int task = bk->next++;
+    pthread_mutex_unlock(&bk->mu);
+    if(task >= BK_TASKS) break;
+    if(bulk_task(bk, task) < 0){
+      pthread_mutex_lock(&bk->mu);
+      bk->failed = 1;
+      pthread_mutex_unlock(&bk->mu);
     }
-    if(l->state == LS_ALLOCATED && l->valid_until <= now){
-      addr_index_del(m, &l->addr);
-      m->na[i].used = 0;
-      continue;
+  }
+  return NULL;
+}
+
+// clients go first, on the calling thread (every table refers to the
+// arena): each live entry takes its reference
+static int bulk_intern(mem_impl_t* m, const lease_duid_t* d, uint32_t* out){
+  *out = duid_arena_get(&m->duids, d->p, d->len, duid_arena_hash(&m->duids, d->p, d->len));
+  return *out ? 0 : -1;
+}
+
+int mem_store_load_bulk(lease_store_t* st, const mem_bulk_t* b, uint64_t now, int nthreads){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  if(htab_count(&m->na) || htab_count(&m->pd) || m->duids.a.c.live ||
+     htab_count(&m->declined_addr) || htab_count(&m->declined_pfx)) return -1;
+
+  bulk_t bk = { .m = m, .b = b, .now = now };
+  bk.na_id = calloc(b->n_na + 1, sizeof(*bk.na_id));
+  bk.pd_id = calloc(b->n_pd + 1, sizeof(*bk.pd_id));
+  int rc = bk.na_id && bk.pd_id ? 0 : -1;
+  for(size_t i=0; rc == 0 && i<b->n_na; i++){
+    if(!na_expired(&b->na[i], now)) rc = bulk_intern(m, &b->na_duid[i], &bk.na_id[i]);
+  }
+  for(size_t i=0; rc == 0 && i<b->n_pd; i++){
+    if(!pd_expired(&b->pd[i], now)) rc = bulk_intern(m, &b->pd_duid[i], &bk.pd_id[i]);
+  }
+  if(rc < 0){
+    free(bk.na_id);
+    free(bk.pd_id);
+    return -1;
+  }
+  pthread_mutex_init(&bk.mu, NULL);
+  if(nthreads > BK_TASKS) nthreads = BK_TASKS;
+  pthread_t thr[BK_TASKS];
+  int nthr = 0;
+  for(int i=1;i<nthreads;i++){
+    if(pthread_create(&thr[nthr], NULL, bulk_main, &bk) == 0) nthr++;
+  }
+  bulk_main(&bk);
+  for(int i=0;i<nthr;i++) pthread_join(thr[i], NULL);
+  pthread_mutex_destroy(&bk.mu);
+  free(bk.na_id);
+  free(bk.pd_id);
+  if(bk.failed) return -1;
+
+  // occupancy observers are not thread-safe: tell them afterwards
+  mem_store_replay_occ(st);
+  return 0;
+}
+
+void mem_store_replay_occ(lease_store_t* st){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  if(!st->on_occ && !st->on_use) return;
+  size_t pos = 0;
+  const addr_ent_t* a;
+  while((a = htab_next(&m->addr_idx, &pos)) != NULL) lease_store_occ(st, &a->addr, 128, 1);
+  pos = 0;
+  const pfx_ent_t* p;
+  while((p = htab_next(&m->pfx_idx, &pos)) != NULL) lease_store_occ(st, &p->prefix, p->plen, 1);
+  pos = 0;
+  const decl_addr_ent_t* d;
+  while((d = htab_next(&m->declined_addr, &pos)) != NULL){
+    if(!htab_find(&m->addr_idx, hash_in6(&d->addr), &d->addr)) lease_store_occ(st, &d->addr, 128, 1);
+    lease_store_use(st, &d->addr, 128, 0, LS_DECLINED);
+  }
+  pos = 0;
+  const decl_pfx_ent_t* dp;
+  while((dp = htab_next(&m->declined_pfx, &pos)) != NULL){
+    pfx_key_t k = pfx_key(&dp->prefix, dp->plen);
+    if(!htab_find(&m->pfx_idx, hash_prefix(&dp->prefix, dp->plen), &k)) lease_store_occ(st, &dp->prefix, dp->plen, 1);
+    lease_store_use(st, &dp->prefix, dp->plen, 0, LS_DECLINED);
+  }
+  pos = 0;
+  const lease_na_t* l;
+  while((l = htab_next(&m->na, &pos)) != NULL) lease_store_use(st, &l->addr, 128, 0, l->state);
+  pos = 0;
+  const lease_pd_t* lp;
+  while((lp = htab_next(&m->pd, &pos)) != NULL) lease_store_use(st, &lp->prefix, lp->prefix_len, 0, lp->state);
+}
+
+// ---- fixed arrays (map_store) ----
+
+size_t mem_store_esize(int t){
+  return table_type[t]->esize;
+}
+
+void mem_store_arrays(const lease_store_t* st, htab_arr_t out[MEM_NTABLES]){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  for(int i=0;i<MEM_NTABLES;i++) out[i] = table(m, i)->cur;
+}
+
+void mem_store_duids(const lease_store_t* st, duid_arena_arr_t* out){
+  *out = ((mem_impl_t*)st->impl)->duids.a;
+}
+
+void mem_store_stat(const lease_store_t* st, htab_stat_t out[MEM_NTABLES]){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  for(int i=0;i<MEM_NTABLES;i++) htab_stat(table(m, i), &out[i]);
+}
+
+void mem_store_probe_hist(const lease_store_t* st, int t, size_t* hist, size_t nbins){
+  htab_probe_hist(table((mem_impl_t*)st->impl, t), hist, nbins);
+}
+
+int mem_store_reindex_duids(lease_store_t* st){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  return duid_arena_reindex(&m->duids, m->duids.seed);
+}
+
+int mem_store_copy_duids(lease_store_t* dst, const lease_store_t* src){
+  return duid_arena_copy(&((mem_impl_t*)dst->impl)->duids, &((const mem_impl_t*)src->impl)->duids);
+}
+
+// entries the wheel has not seen yet (tables inherited from a file):
+// expire what is overdue, schedule the rest
+int mem_store_sweep(lease_store_t* st, size_t* pos, size_t budget){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  static const int order[4] = { MEM_T_NA, MEM_T_PD, MEM_T_DADDR, MEM_T_DPFX };
+  while(budget-- > 0){
+    size_t i = *pos;
+    int t = 0;
+    while(t < 4 && i >= table(m, order[t])->cur.cap) i -= table(m, order[t++])->cur.cap;
+    if(t == 4) return 1;
+    (*pos)++;
+
+    htab_arr_t* a = &table(m, order[t])->cur;
+    if(a->ctrl[i] < 0) continue;
+    const void* e = a->slots + i * table_type[order[t]]->esize;
+    tw_node_t n;
+    memset(&n, 0, sizeof(n));
+    if(order[t] == MEM_T_NA){
+      const lease_na_t* l = e;
+      n.kind = TW_NA; n.u.key = l->key;
+      n.when = l->state == LS_OFFERED ? l->hold_until : l->valid_until;
+      if(l->state == LS_DECLINED) continue;
+    } else if(order[t] == MEM_T_PD){
+      const lease_pd_t* l = e;
+      n.kind = TW_PD; n.u.key = l->key;
+      n.when = l->state == LS_OFFERED ? l->hold_until : l->valid_until;
+      if(l->state == LS_DECLINED) continue;
+    } else if(order[t] == MEM_T_DADDR){
+      const decl_addr_ent_t* d = e;
+      n.kind = TW_DECL_ADDR; n.u.addr = d->addr; n.when = d->until;
+    } else {
+      const decl_pfx_ent_t* d = e;
+      n.kind = TW_DECL_PFX; n.u.addr = d->prefix; n.plen = d->plen; n.when = d->until;
     }
+    // overdue entries fire on this gc's wheel advance
+    if(tw_add(&m->tw, &n) < 0) return -1;
   }
+  return 0;
+}
 
-  // GC PD leases
-  for(size_t i=0;i<m->cap;i++){
-    if(!m->pd[i].used) continue;
-    lease_pd_t* l = &m->pd[i].pd;
-    if(l->state == LS_OFFERED && l->hold_until <= now){
-      pfx_index_del(m, &l->prefix, l->prefix_len);
-      m->pd[i].used = 0;
-      continue;
+// an entry is kept only if a lookup by its own key lands on it
+static int na_sane(mem_impl_t* m, const lease_na_t* l){
+  return (l->state == LS_OFFERED || l->state == LS_ALLOCATED || l->state == LS_DECLINED) &&
+         htab_find(&m->na, hash_key(&l->key), &l->key) == l;
+}
+static int pd_sane(mem_impl_t* m, const lease_pd_t* l){
+  return (l->state == LS_OFFERED || l->state == LS_ALLOCATED || l->state == LS_DECLINED) &&
+         l->prefix_len <= 128 &&
+         htab_find(&m->pd, hash_key(&l->key), &l->key) == l;
+}
+
+// a kept lease's DUID, copied out while the arena is rebuilt
+typedef struct {
+  uint8_t len;
+  uint8_t b[DUID_MAX];
+} duid_copy_t;
+
+static int save_duid(mem_impl_t* m, uint32_t handle, duid_copy_t* out){
+  size_t len;
+  const uint8_t* p = duid_arena_bytes(&m->duids, handle, &len);
+  if(!p) return 0;
+  out->len = (uint8_t)len;
+  memcpy(out->b, p, len);
+  return 1;
+}
+
+static uint32_t restore_duid(mem_impl_t* m, const duid_copy_t* d){
+  return duid_arena_get(&m->duids, d->b, d->len, duid_arena_hash(&m->duids, d->b, d->len));
+}
+
+long mem_store_repair(lease_store_t* st){
+  mem_impl_t* m = (mem_impl_t*)st->impl;
+  size_t cnt[MEM_NTABLES];
+  void* keep[MEM_NTABLES] = { 0 };
+  duid_copy_t* ids[2] = { 0 };  // per kept NA / PD entry
+  long dropped = 0;
+
+  // copy out whatever is intact; the indexes are derived and rebuilt,
+  // the arena is rebuilt from the DUIDs of the kept leases
+  for(int t=0;t<MEM_NTABLES;t++){
+    cnt[t] = 0;
+    if(t == MEM_T_ADDR || t == MEM_T_PFX || t == MEM_T_DUID) continue;
+    htab_t* ht = table(m, t);
+    size_t es = table_type[t]->esize;
+    // size from the control bytes: the header's count may predate them
+    size_t n = 0, pos = 0;
+    const void* e;
+    while(htab_next(ht, &pos) != NULL) n++;
+    keep[t] = malloc((n + 1) * es);
+    if(!keep[t]) goto fail;
+    if(t == MEM_T_NA || t == MEM_T_PD){
+      ids[t] = malloc((n + 1) * sizeof(duid_copy_t));
+      if(!ids[t]) goto fail;
     }
-    if(l->state == LS_ALLOCATED && l->valid_until <= now){
-      pfx_index_del(m, &l->prefix, l->prefix_len);
-      m->pd[i].used = 0;
-      continue;
+    pos = 0;
+    while(cnt[t] < n && (e = htab_next(ht, &pos)) != NULL){
+      int ok;
+      if(t == MEM_T_NA){
+        const lease_na_t* l = e;
+        ok = na_sane(m, l) && save_duid(m, l->key.duid, &ids[t][cnt[t]]);
+      } else if(t == MEM_T_PD){
+        const lease_pd_t* l = e;
+        ok = pd_sane(m, l) && save_duid(m, l->key.duid, &ids[t][cnt[t]]);
+      } else if(t == MEM_T_DADDR){
+        const decl_addr_ent_t* d = e;
+        ok = htab_find(&m->declined_addr, hash_in6(&d->addr), &d->addr) == e;
+      } else {
+        const decl_pfx_ent_t* d = e;
+        pfx_key_t k = pfx_key(&d->prefix, d->plen);
+        ok = htab_find(&m->declined_pfx, hash_prefix(&d->prefix, d->plen), &k) == e;
+      }
+      if(!ok){ dropped++; continue; }
+      memcpy((uint8_t*)keep[t] + cnt[t] * es, e, es);
+      cnt[t]++;
     }
   }
+  for(int t=0;t<MEM_NTABLES;t++) htab_clear(table(m, t));
+  duid_arena_clear(&m->duids);
 
-  // decline expiry clear (best-effort)
-  for(size_t i=0;i<m->cap;i++){
-    if(m->declined_addr[i].used && m->declined_addr_until[i] <= now){
-      m->declined_addr[i].used = 0;
+  for(size_t i=0;i<cnt[MEM_T_NA];i++){
+    lease_na_t* l = (lease_na_t*)keep[MEM_T_NA] + i;
+    if(!(l->key.duid = restore_duid(m, &ids[MEM_T_NA][i]))){ dropped++; continue; }
+    // a table fills up only if the file is torn beyond what the checks
+    // above catch: drop the entry rather than write through NULL
+    lease_na_t* e = htab_insert_unique(&m->na, hash_key(&l->key));
+    if(e) *e = *l;
+    int ex;
+    addr_ent_t* a = e ? htab_insert(&m->addr_idx, hash_in6(&l->addr), &l->addr, &ex) : NULL;
+    if(!a){
+      if(e) htab_erase(&m->na, hash_key(&l->key), &l->key);
+      duid_arena_put(&m->duids, l->key.duid);
+      dropped++;
+      continue;
     }
-    if(m->declined_pfx[i].used && m->declined_pfx_until[i] <= now){
-      m->declined_pfx[i].used = 0;
+    a->addr = l->addr;
+    a->key = l->key;
+  }
+  for(size_t i=0;i<cnt[MEM_T_PD];i++){
+    lease_pd_t* l = (lease_pd_t*)keep[MEM_T_PD] + i;
+    if(!(l->key.duid = restore_duid(m, &ids[MEM_T_PD][i]))){ dropped++; continue; }
+    lease_pd_t* e = htab_insert_unique(&m->pd, hash_key(&l->key));
+    if(e) *e = *l;
+    pfx_key_t k = pfx_key(&l->prefix, l->prefix_len);
+    int ex;
+    pfx_ent_t* p = e ? htab_insert(&m->pfx_idx, hash_prefix(&l->prefix, l->prefix_len), &k, &ex) : NULL;
+    if(!p){
+      if(e) htab_erase(&m->pd, hash_key(&l->key), &l->key);
+      duid_arena_put(&m->duids, l->key.duid);
+      dropped++;
+      continue;
     }
+    p->prefix = l->prefix;
+    p->plen = l->prefix_len;
+    p->key = l->key;
+  }
+  for(size_t i=0;i<cnt[MEM_T_DADDR];i++){
+    const decl_addr_ent_t* d = (const decl_addr_ent_t*)keep[MEM_T_DADDR] + i;
+    decl_addr_ent_t* e = htab_insert_unique(&m->declined_addr, hash_in6(&d->addr));
+    if(e) *e = *d; else dropped++;
+  }
+  for(size_t i=0;i<cnt[MEM_T_DPFX];i++){
+    const decl_pfx_ent_t* d = (const decl_pfx_ent_t*)keep[MEM_T_DPFX] + i;
+    decl_pfx_ent_t* e = htab_insert_unique(&m->declined_pfx, hash_prefix(&d->prefix, d->plen));
+    if(e) *e = *d; else dropped++;
   }
+  for(int t=0;t<MEM_NTABLES;t++) free(keep[t]);
+  free(ids[0]);
+  free(ids[1]);
+  return dropped;
+
+fail:
+  for(int t=0;t<MEM_NTABLES;t++) free(keep[t]);
+  free(ids[0]);
+  free(ids[1]);
+  return -1;
 }
 
-int mem_store_init(lease_store_t* st, size_t cap){
-  mem_impl_t* m = calloc(1, sizeof(*m));
-  if(!m) return -1;
-  m->cap = cap;
-
-  m->na = calloc(cap, sizeof(na_slot_t));
-  m->pd = calloc(cap, sizeof(pd_slot_t));
-  m->addr_idx = calloc(cap, sizeof(addr_slot_t));
-  m->pfx_idx  = calloc(cap, sizeof(pfx_slot_t));
-
-  m->declined_addr = calloc(cap, sizeof(addr_slot_t));
-  m->declined_pfx  = calloc(cap, sizeof(pfx_slot_t));
-  m->declined_addr_until = calloc(cap, sizeof(uint64_t));
-  m->declined_pfx_until  = calloc(cap, sizeof(uint64_t));
-  if(!m->na || !m->pd || !m->addr_idx || !m->pfx_idx ||
-     !m->declined_addr || !m->declined_pfx || !m->declined_addr_until || !m->declined_pfx_until){
-    free(m->na); free(m->pd); free(m->addr_idx); free(m->pfx_idx);
-    free(m->declined_addr); free(m->declined_pfx);
-    free(m->declined_addr_until); free(m->declined_pfx_until);
-    free(m);
-    return -1;
-  }
+static void impl_free(mem_impl_t* m){
+  htab_free(&m->na); htab_free(&m->pd);
+  htab_free(&m->addr_idx); htab_free(&m->pfx_idx);
+  htab_free(&m->declined_addr); htab_free(&m->declined_pfx);
+  duid_arena_free(&m->duids);
+  tw_free(&m->tw);
+  free(m);
+}
+
+static void impl_bind(lease_store_t* st, mem_impl_t* m){
+  tw_init(&m->tw, now_epoch_sec());
+  m->st = st;
 
   st->impl = m;
+  st->on_occ = NULL;
+  st->on_use = NULL;
+  st->occ_arg = NULL;
+  st->journal = NULL;
+  st->duid_seed = m->duids.seed;
+  st->v.duid_find = st_duid_find;
+  st->v.duid_get = st_duid_get;
+  st->v.duid_put = st_duid_put;
+  st->v.duid_bytes = st_duid_bytes;
   st->v.get_na = st_get_na;
   st->v.put_na = st_put_na;
   st->v.del_na = st_del_na;
   st->v.get_pd = st_get_pd;
   st->v.put_pd = st_put_pd;
   st->v.del_pd = st_del_pd;
+  st->v.touch_na = st_touch_na;
+  st->v.acquire_na = st_acquire_na;
+  st->v.touch_pd = st_touch_pd;
+  st->v.acquire_pd = st_acquire_pd;
   st->v.addr_in_use = st_addr_in_use;
   st->v.prefix_in_use = st_prefix_in_use;
   st->v.is_addr_declined = st_is_addr_declined;
@@ -381,15 +1099,45 @@ int mem_store_init(lease_store_t* st, size_t cap){
   st->v.decline_addr = st_decline_addr;
   st->v.decline_prefix = st_decline_prefix;
   st->v.gc = st_gc;
+  st->v.foreach = st_foreach;
+}
+
+int mem_store_init(lease_store_t* st, size_t cap, uint64_t duid_seed){
+  mem_impl_t* m = calloc(1, sizeof(*m));
+  if(!m) return -1;
+
+  // cap is the initial (and minimum) size; tables grow and shrink with load
+  int rc = 0;
+  rc |= htab_init(&m->na, &na_type, cap);
+  rc |= htab_init(&m->pd, &pd_type, cap);
+  rc |= htab_init(&m->addr_idx, &addr_type, cap);
+  rc |= htab_init(&m->pfx_idx, &pfx_type, cap);
+  rc |= htab_init(&m->declined_addr, &daddr_type, cap);
+  rc |= htab_init(&m->declined_pfx, &dpfx_type, cap);
+  rc |= duid_arena_init(&m->duids, duid_seed);
+  if(rc < 0){
+    impl_free(m);
+    return -1;
+  }
+  impl_bind(st, m);
+  return 0;
+}
+
+int mem_store_init_fixed(lease_store_t* st, const htab_arr_t arr[MEM_NTABLES],
+                         const duid_arena_arr_t* duids, uint64_t duid_seed){
+  mem_impl_t* m = calloc(1, sizeof(*m));
+  if(!m) return -1;
+  for(int i=0;i<MEM_NTABLES;i++){
+    if(i != MEM_T_DUID) htab_attach(table(m, i), table_type[i], &arr[i]);
+  }
+  duid_arena_attach(&m->duids, duids, &arr[MEM_T_DUID], duid_seed);
+  impl_bind(st, m);
   return 0;
 }
 
 void mem_store_free(lease_store_t* st){
   mem_impl_t* m = (mem_impl_t*)st->impl;
   if(!m) return;
-  free(m->na); free(m->pd); free(m->addr_idx); free(m->pfx_idx);
-  free(m->declined_addr); free(m->declined_pfx);
-  free(m->declined_addr_until); free(m->declined_pfx_until);
-  free(m);
+  impl_free(m);
   st->impl = NULL;
 }
@@ -1,5 +1,66 @@
 #pragma once
 #include "store/lease_store.h"
+#include "store/htab.h"
+#include "store/duid_arena.h"
 
-int mem_store_init(lease_store_t* st, size_t cap);
+// cap: initial/minimum slots per table; tables grow and shrink online.
+// duid_seed: seed of the DUID hashes callers pass in (lease_store_t)
+int mem_store_init(lease_store_t* st, size_t cap, uint64_t duid_seed);
 void mem_store_free(lease_store_t* st);
+
+// restart path: fill an empty store from decoded snapshot arrays.
+// Entries whose deadline has passed by now are dropped. Client DUIDs
+// (na_duid[i] belongs to na[i]; the key handles are ignored) are interned
+// first, then the tables are built concurrently on up to nthreads
+// threads; occupancy observers are then told about every taken
+// address/prefix from the calling thread.
+typedef struct {
+  const lease_na_t* na;     const lease_duid_t* na_duid; size_t n_na;
+  const lease_pd_t* pd;     const lease_duid_t* pd_duid; size_t n_pd;
+  const lease_decl_t* decl; size_t n_decl;
+} mem_bulk_t;
+
+int mem_store_load_bulk(lease_store_t* st, const mem_bulk_t* b, uint64_t now, int nthreads);
+
+// tell the occupancy observer about every taken address/prefix and the
+// state observer about every lease and quarantine entry (after a bulk
+// load or when attaching to tables that already hold leases)
+void mem_store_replay_occ(lease_store_t* st);
+
+/*
+ * Fixed-array mode, for backends that keep the tables elsewhere (map_store
+ * places them in a file mapping). The arrays are used in place and never
+ * resized: a put/decline fails once a table is 7/8 full, so the owner
+ * checks mem_store_arrays() and swaps in bigger ones first. The DUID
+ * arena is provided the same way (records and slab, its index is table
+ * MEM_T_DUID). The expiry wheel stays on the heap; entries already in the
+ * arrays reach it through mem_store_sweep().
+ */
+enum { MEM_T_NA, MEM_T_PD, MEM_T_ADDR, MEM_T_PFX, MEM_T_DADDR, MEM_T_DPFX, MEM_T_DUID, MEM_NTABLES };
+
+size_t mem_store_esize(int table);  // entry size of a table
+int  mem_store_init_fixed(lease_store_t* st, const htab_arr_t arr[MEM_NTABLES],
+                          const duid_arena_arr_t* duids, uint64_t duid_seed);
+void mem_store_arrays(const lease_store_t* st, htab_arr_t out[MEM_NTABLES]); // current counters
+void mem_store_duids(const lease_store_t* st, duid_arena_arr_t* out);        // current counters
+
+// htab_stat() of every table (heap or fixed), in MEM_T_* order
+void mem_store_stat(const lease_store_t* st, htab_stat_t out[MEM_NTABLES]);
+
+// htab_probe_hist() of one table (heap or fixed)
+void mem_store_probe_hist(const lease_store_t* st, int table, size_t* hist, size_t nbins);
+
+// DUID arena maintenance for fixed arrays: rehash the index (the hash seed
+// or selection changed since the arrays were written), or take over src's
+// DUIDs under the same handles before src's leases are copied in (every
+// put then adds a reference the copy already counts: drop it again)
+int  mem_store_reindex_duids(lease_store_t* st);
+int  mem_store_copy_duids(lease_store_t* dst, const lease_store_t* src);
+
+// schedule up to budget inherited slots on the wheel; 1 = all done
+int  mem_store_sweep(lease_store_t* st, size_t* pos, size_t budget);
+
+// after a crash mid-update: keep entries a lookup by their own key still
+// reaches and whose DUID is intact, rebuild the address/prefix indexes
+// and the DUID arena (handles change). Returns entries dropped.
+long mem_store_repair(lease_store_t* st);
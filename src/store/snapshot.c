@@ -0,0 +1,369 @@
+// src/store/snapshot.c
+#define _GNU_SOURCE
+#include "store/snapshot.h"
+#include "store/lease_journal.h"
+#include "store/mem_store.h"
+#include "store/journal.h"
+#include "util/crc32c.h"
+#include "util/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t crc;
+  uint64_t created;
+  uint64_t n_na, n_pd, n_decl;
+  uint32_t block_recs;
+  uint16_t na_sz, pd_sz, decl_sz;
+  uint8_t pad[6];
+} snap_hdr_t;
+
+_Static_assert(sizeof(snap_hdr_t) == 64, "snapshot header layout");
+
+enum { SEC_NA, SEC_PD, SEC_DECL, SEC_N };
+
+// largest record of each section
+static const size_t sec_rec_max[SEC_N] = { LJ_NA_MAX, LJ_PD_MAX, LJ_DECL_SZ };
+
+static uint64_t sec_blocks(uint64_t n){ return (n + SNAP_BLOCK_RECS - 1) / SNAP_BLOCK_RECS; }
+
+static uint32_t hdr_crc(const snap_hdr_t* h){
+  snap_hdr_t c = *h;
+  c.crc = 0;
+  return crc32c(0, &c, sizeof(c));
+}
+
+// ---- writer ----
+
+typedef struct {
+  lease_store_t* st;
+  int fd;
+  int err;
+  int sec;         // section being filled
+  uint8_t* buf;    // one block: length, records, crc
+  size_t nrec;     // records in buf
+  size_t len;      // record bytes in buf
+  uint64_t n[SEC_N];
+} snap_wr_t;
+
+static int write_full(int fd, const void* p, size_t len){
+  const uint8_t* b = p;
+  while(len){
+    ssize_t n = write(fd, b, len);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      return errno;
+    }
+    b += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static int wr_flush(snap_wr_t* w){
+  if(!w->nrec) return 0;
+  uint32_t len = (uint32_t)w->len;
+  uint32_t crc = crc32c(0, w->buf + 4, len);
+  memcpy(w->buf, &len, 4);
+  memcpy(w->buf + 4 + len, &crc, 4);
+  w->nrec = 0;
+  w->len = 0;
+  return write_full(w->fd, w->buf, len + 8);
+}
+
+// room for the next record of section sec; sections only move forward.
+// The caller adds the encoded size to w->len.
+static uint8_t* wr_slot(snap_wr_t* w, int sec){
+  if(sec != w->sec || w->nrec == SNAP_BLOCK_RECS){
+    if((w->err = wr_flush(w)) != 0) return NULL;
+    w->sec = sec;
+  }
+  w->n[sec]++;
+  w->nrec++;
+  return w->buf + 4 + w->len;
+}
+
+static int wr_duid(snap_wr_t* w, uint32_t id, lease_duid_t* d){
+  d->p = w->st->v.duid_bytes(w->st, id, &d->len);
+  if(!d->p) w->err = EIO;
+  return d->p ? 0 : -1;
+}
+
+static int wr_na(void* arg, const lease_na_t* l){
+  snap_wr_t* w = arg;
+  lease_duid_t d;
+  if(wr_duid(w, l->key.duid, &d) < 0) return -1;
+  uint8_t* p = wr_slot(w, SEC_NA);
+  if(!p) return -1;
+  w->len += lj_enc_na(p, l, &d);
+  return 0;
+}
+static int wr_pd(void* arg, const lease_pd_t* l){
+  snap_wr_t* w = arg;
+  lease_duid_t d;
+  if(wr_duid(w, l->key.duid, &d) < 0) return -1;
+  uint8_t* p = wr_slot(w, SEC_PD);
+  if(!p) return -1;
+  w->len += lj_enc_pd(p, l, &d);
+  return 0;
+}
+static int wr_decl(void* arg, const lease_decl_t* d){
+  snap_wr_t* w = arg;
+  uint8_t* p = wr_slot(w, SEC_DECL);
+  if(!p) return -1;
+  w->len += lj_enc_decl(p, d);
+  return 0;
+}
+
+int snapshot_write(lease_store_t* st, const char* path, uint64_t now){
+  char tmp[512];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+  snap_wr_t w;
+  memset(&w, 0, sizeof(w));
+  w.st = st;
+  w.buf = malloc(SNAP_BLOCK_RECS * LJ_PD_MAX + 8);
+  if(!w.buf) return ENOMEM;
+  w.fd = open(tmp, O_CREAT|O_TRUNC|O_WRONLY|O_CLOEXEC, 0644);
+  if(w.fd < 0){
+    int e = errno;
+    free(w.buf);
+    return e;
+  }
+
+  // header last, once the counts are known
+  snap_hdr_t h;
+  memset(&h, 0, sizeof(h));
+  int rc = write_full(w.fd, &h, sizeof(h));
+  if(!rc){
+    static const lease_visit_t v = { wr_na, wr_pd, wr_decl };
+    if(st->v.foreach(st, &v, &w) != 0) rc = w.err ? w.err : EIO;
+  }
+  if(!rc) rc = wr_flush(&w);
+  if(!rc){
+    memcpy(h.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+    h.version = SNAP_VERSION;
+    h.created = now;
+    h.n_na = w.n[SEC_NA];
+    h.n_pd = w.n[SEC_PD];
+    h.n_decl = w.n[SEC_DECL];
+    h.block_recs = SNAP_BLOCK_RECS;
+    h.na_sz = LJ_NA_MAX;
+    h.pd_sz = LJ_PD_MAX;
+    h.decl_sz = LJ_DECL_SZ;
+    h.crc = hdr_crc(&h);
+    ssize_t n = pwrite(w.fd, &h, sizeof(h), 0);
+    if(n < 0) rc = errno;
+    else if(n != (ssize_t)sizeof(h)) rc = EIO;
+  }
+  if(!rc && fsync(w.fd) < 0) rc = errno;
+  close(w.fd);
+  free(w.buf);
+
+  if(!rc && rename(tmp, path) < 0) rc = errno;
+  if(rc){
+    unlink(tmp);
+    return rc;
+  }
+  fsync_dir_of(path);
+  return 0;
+}
+
+// ---- loader ----
+
+typedef struct {
+  const uint8_t* base;
+  const uint64_t* blk[SEC_N]; // block offsets, found by a walk over the lengths
+  uint64_t n[SEC_N];
+  uint64_t nblk[SEC_N];
+  lease_na_t* na;
+  lease_pd_t* pd;
+  lease_decl_t* decl;
+  lease_duid_t* na_duid;   // point into the mapping
+  lease_duid_t* pd_duid;
+
+  pthread_mutex_t mu;
+  uint64_t next;           // block counter across all sections
+  int bad;
+} snap_rd_t;
+
+static void mark_bad(snap_rd_t* r){
+  pthread_mutex_lock(&r->mu);
+  r->bad = 1;
+  pthread_mutex_unlock(&r->mu);
+}
+
+static void decode_block(snap_rd_t* r, int sec, uint64_t blk){
+  uint64_t first = blk * SNAP_BLOCK_RECS;
+  uint64_t cnt = r->n[sec] - first;
+  if(cnt > SNAP_BLOCK_RECS) cnt = SNAP_BLOCK_RECS;
+  const uint8_t* p = r->base + r->blk[sec][blk];
+
+  uint32_t len, crc;
+  memcpy(&len, p, 4);
+  p += 4;
+  memcpy(&crc, p + len, 4);
+  if(crc32c(0, p, len) != crc){
+    mark_bad(r);
+    return;
+  }
+  size_t off = 0;
+  for(uint64_t i=0;i<cnt;i++){
+    size_t n;
+    if(sec == SEC_NA) n = lj_dec_na(p + off, len - off, &r->na[first + i], &r->na_duid[first + i]);
+    else if(sec == SEC_PD) n = lj_dec_pd(p + off, len - off, &r->pd[first + i], &r->pd_duid[first + i]);
+    else if((n = len - off >= LJ_DECL_SZ ? LJ_DECL_SZ : 0) != 0) lj_dec_decl(p + off, &r->decl[first + i]);
+    if(!n) break;
+    off += n;
+  }
+  if(off != len) mark_bad(r);
+}
+
+static void* decode_main(void* arg){
+  snap_rd_t* r = (snap_rd_t*)arg;
+  uint64_t total = r->nblk[SEC_NA] + r->nblk[SEC_PD] + r->nblk[SEC_DECL];
+  while(1){
+    pthread_mutex_lock(&r->mu);
+    uint64_t b = r->next++;
+    int bad = r->bad;
+    pthread_mutex_unlock(&r->mu);
+    if(b >= total || bad) break;
+    int sec = SEC_NA;
+    while(b >= r->nblk[sec]){
+      b -= r->nblk[sec];
+      sec++;
+    }
+    decode_block(r, sec, b);
+  }
+  return NULL;
+}
+
+static int decode_all(snap_rd_t* r, int nthreads){
+  pthread_t thr[16];
+  int nthr = 0;
+  if(nthreads > 16) nthreads = 16;
+  for(int i=1;i<nthreads;i++){
+    if(pthread_create(&thr[nthr], NULL, decode_main, r) == 0) nthr++;
+  }
+  decode_main(r);
+  for(int i=0;i<nthr;i++) pthread_join(thr[i], NULL);
+  return r->bad ? -1 : 0;
+}
+
+long snapshot_load(const char* path, lease_store_t* st, uint64_t now, int nthreads){
+  int fd = open(path, O_RDONLY|O_CLOEXEC);
+  if(fd < 0){
+    if(errno == ENOENT) return 0;
+    log_printf(LOG_ERR, "snapshot open %s failed: %s", path, strerror(errno));
+    return -1;
+  }
+  struct stat sb;
+  if(fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(snap_hdr_t)){
+    log_printf(LOG_ERR, "snapshot %s: truncated", path);
+    close(fd);
+    return -1;
+  }
+  size_t size = (size_t)sb.st_size;
+  uint8_t* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE|MAP_POPULATE, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED){
+    log_printf(LOG_ERR, "snapshot mmap %s failed: %s", path, strerror(errno));
+    return -1;
+  }
+
+  long ret = -1;
+  uint64_t* blk = NULL;
+  snap_rd_t r;
+  memset(&r, 0, sizeof(r));
+  pthread_mutex_init(&r.mu, NULL);
+
+  snap_hdr_t h;
+  memcpy(&h, base, sizeof(h));
+  if(memcmp(h.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) != 0 || h.crc != hdr_crc(&h)){
+    log_printf(LOG_ERR, "snapshot %s: bad header", path);
+    goto out;
+  }
+  if(h.version != SNAP_VERSION || h.block_recs != SNAP_BLOCK_RECS ||
+     h.na_sz != LJ_NA_MAX || h.pd_sz != LJ_PD_MAX || h.decl_sz != LJ_DECL_SZ){
+    log_printf(LOG_ERR, "snapshot %s: unsupported version %u", path, h.version);
+    goto out;
+  }
+
+  r.base = base;
+  r.n[SEC_NA] = h.n_na;
+  r.n[SEC_PD] = h.n_pd;
+  r.n[SEC_DECL] = h.n_decl;
+  uint64_t nblk = 0;
+  for(int s=0;s<SEC_N;s++){
+    r.nblk[s] = sec_blocks(r.n[s]);
+    nblk += r.nblk[s];
+  }
+  if(nblk > size / 8){
+    log_printf(LOG_ERR, "snapshot %s: size mismatch", path);
+    goto out;
+  }
+  blk = malloc((nblk ? nblk : 1) * sizeof(*blk));
+  if(!blk) goto out;
+  uint64_t off = sizeof(h), k = 0;
+  for(int s=0;s<SEC_N;s++){
+    r.blk[s] = blk + k;
+    for(uint64_t i=0;i<r.nblk[s];i++, k++){
+      uint64_t cnt = r.n[s] - i * SNAP_BLOCK_RECS;
+      if(cnt > SNAP_BLOCK_RECS) cnt = SNAP_BLOCK_RECS;
+      uint32_t len;
+      if(off + 8 > size) break;
+      memcpy(&len, base + off, 4);
+      if(len > cnt * sec_rec_max[s]) break;
+      blk[k] = off;
+      off += (uint64_t)len + 8;
+    }
+  }
+  if(k != nblk || off != size){
+    log_printf(LOG_ERR, "snapshot %s: size mismatch", path);
+    goto out;
+  }
+
+  r.na = malloc((h.n_na ? h.n_na : 1) * sizeof(lease_na_t));
+  r.pd = malloc((h.n_pd ? h.n_pd : 1) * sizeof(lease_pd_t));
+  r.decl = malloc((h.n_decl ? h.n_decl : 1) * sizeof(lease_decl_t));
+  r.na_duid = malloc((h.n_na ? h.n_na : 1) * sizeof(lease_duid_t));
+  r.pd_duid = malloc((h.n_pd ? h.n_pd : 1) * sizeof(lease_duid_t));
+  if(!r.na || !r.pd || !r.decl || !r.na_duid || !r.pd_duid) goto out;
+
+  if(decode_all(&r, nthreads) < 0){
+    log_printf(LOG_ERR, "snapshot %s: checksum mismatch or bad record", path);
+    goto out;
+  }
+
+  mem_bulk_t b = {
+    .na = r.na, .na_duid = r.na_duid, .n_na = h.n_na,
+    .pd = r.pd, .pd_duid = r.pd_duid, .n_pd = h.n_pd,
+    .decl = r.decl, .n_decl = h.n_decl,
+  };
+  if(mem_store_load_bulk(st, &b, now, nthreads) < 0){
+    log_printf(LOG_ERR, "snapshot %s: bulk load failed", path);
+    goto out;
+  }
+  ret = (long)(h.n_na + h.n_pd + h.n_decl);
+
+out:
+  free(r.na);
+  free(r.pd);
+  free(r.decl);
+  free(r.na_duid);
+  free(r.pd_duid);
+  free(blk);
+  pthread_mutex_destroy(&r.mu);
+  munmap(base, size);
+  return ret;
+}
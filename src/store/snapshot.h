@@ -0,0 +1,34 @@
+// src/store/snapshot.h
+#pragma once
+#include <stdint.h>
+#include "store/lease_store.h"
+
+/*
+ * Point-in-time image of a lease store, so restart does not have to
+ * replay an unbounded journal.
+ *
+ *   header (64 bytes, crc32c over the header with the crc field zeroed)
+ *   NA section    : blocks of SNAP_BLOCK_RECS NA records
+ *   PD section    : blocks of SNAP_BLOCK_RECS PD records
+ *   decl section  : blocks of SNAP_BLOCK_RECS decline records
+ * Records use the journal encoding (lease_journal.h), so NA/PD records
+ * carry the client DUID and vary in length. Every block (the last of a
+ * section may be short) is its byte length, the records and their
+ * crc32c. The loader hops over the lengths once to find the blocks, then
+ * checks and decodes them in parallel.
+ *
+ * Host byte order, like the journal: the file is node-local.
+ */
+
+#define SNAP_MAGIC      "DH6SNAP"
+#define SNAP_VERSION    2
+#define SNAP_BLOCK_RECS 16384
+
+// write st to path (via path.tmp + rename). Meant for a fork()ed child:
+// no stdio or logging, so it cannot block on a lock held by another
+// thread of the parent. Returns 0 or an errno value.
+int snapshot_write(lease_store_t* st, const char* path, uint64_t now);
+
+// load path into an empty mem_store, using up to nthreads threads.
+// Missing file = nothing to load (0). Returns entries loaded or -1.
+long snapshot_load(const char* path, lease_store_t* st, uint64_t now, int nthreads);
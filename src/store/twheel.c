@@ -0,0 +1,120 @@
+#include "store/twheel.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TW_NIL UINT32_MAX
+
+static uint64_t level_span(int l){
+  return (uint64_t)1 << (TW_BITS * (l + 1));
+}
+
+int tw_init(twheel_t* tw, uint64_t now){
+  memset(tw, 0, sizeof(*tw));
+  tw->cur = now;
+  tw->free_head = TW_NIL;
+  for(int l=0;l<TW_LEVELS;l++)
+    for(uint32_t s=0;s<TW_SLOTS;s++) tw->head[l][s] = TW_NIL;
+  return 0;
+}
+
+void tw_free(twheel_t* tw){
+  free(tw->nodes);
+  tw->nodes = NULL;
+  tw->cap = 0;
+  tw->count = 0;
+  tw->free_head = TW_NIL;
+}
+
+static int node_get(twheel_t* tw, uint32_t* out){
+  if(tw->free_head == TW_NIL){
+    uint32_t ncap = tw->cap ? tw->cap * 2 : 1024;
+    if(ncap <= tw->cap) return -1;
+    tw_node_t* n = realloc(tw->nodes, (size_t)ncap * sizeof(*n));
+    if(!n) return -1;
+    // thread new nodes onto the free list (lowest index first)
+    for(uint32_t i=ncap; i>tw->cap; i--){
+      n[i-1].next = tw->free_head;
+      tw->free_head = i-1;
+    }
+    tw->nodes = n;
+    tw->cap = ncap;
+  }
+  *out = tw->free_head;
+  tw->free_head = tw->nodes[*out].next;
+  return 0;
+}
+
+static void node_put(twheel_t* tw, uint32_t i){
+  tw->nodes[i].next = tw->free_head;
+  tw->free_head = i;
+}
+
+// link node i into the lowest level whose span still covers its deadline
+static void place(twheel_t* tw, uint32_t i){
+  uint64_t when = tw->nodes[i].when;
+  if(when < tw->cur) when = tw->cur;
+  uint64_t delta = when - tw->cur;
+
+  int l = 0;
+  while(l < TW_LEVELS-1 && delta >= level_span(l)) l++;
+  if(delta >= level_span(l)){
+    // beyond the wheel horizon: park at the far edge, re-cascaded later
+    when = tw->cur + level_span(l) - 1;
+  }
+
+  uint32_t s = (uint32_t)(when >> (TW_BITS * l)) & (TW_SLOTS - 1);
+  tw->nodes[i].next = tw->head[l][s];
+  tw->head[l][s] = i;
+}
+
+int tw_add(twheel_t* tw, const tw_node_t* n){
+  uint32_t i;
+  if(node_get(tw, &i) < 0) return -1;
+  tw->nodes[i] = *n;
+  place(tw, i);
+  tw->count++;
+  return 0;
+}
+
+static void cascade(twheel_t* tw, int l, uint32_t s){
+  uint32_t i = tw->head[l][s];
+  tw->head[l][s] = TW_NIL;
+  while(i != TW_NIL){
+    uint32_t nx = tw->nodes[i].next;
+    place(tw, i);
+    i = nx;
+  }
+}
+
+void tw_advance(twheel_t* tw, uint64_t now, tw_fire_fn fire, void* arg){
+  while(tw->cur <= now){
+    if(tw->count == 0){
+      tw->cur = now + 1;
+      return;
+    }
+    uint64_t t = tw->cur;
+
+    // pull down higher levels whose slot starts at this tick
+    for(int l=1;l<TW_LEVELS;l++){
+      if(t & (((uint64_t)1 << (TW_BITS * l)) - 1)) break;
+      cascade(tw, l, (uint32_t)(t >> (TW_BITS * l)) & (TW_SLOTS - 1));
+    }
+
+    uint32_t* hp = &tw->head[0][t & (TW_SLOTS - 1)];
+    uint32_t i = *hp;
+    *hp = TW_NIL;
+    tw->cur = t + 1; // anything added from here on lands in a later tick
+    while(i != TW_NIL){
+      // copy out: fire() may add entries and move the node array
+      tw_node_t n = tw->nodes[i];
+      node_put(tw, i);
+      tw->count--;
+      i = n.next;
+      if(n.when > t){
+        tw_add(tw, &n);
+        continue;
+      }
+      fire(arg, &n, now);
+    }
+  }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include "store/lease_store.h"
+
+/*
+ * Hierarchical timer wheel (1 second resolution) used as the expiry index
+ * of the lease store.
+ * - 4 levels x 64 slots: level l slot covers 64^l seconds, ~194 days total.
+ * - entries further out are parked in the top level and re-cascaded.
+ * - entries are never cancelled: owners re-validate on fire (lazy delete),
+ *   so a renewed lease simply ignores its stale entry.
+ */
+
+enum { TW_NA=1, TW_PD=2, TW_DECL_ADDR=3, TW_DECL_PFX=4 };
+
+typedef struct {
+  uint64_t when;
+  uint32_t next;
+  uint8_t kind;
+  uint8_t plen;           // TW_DECL_PFX
+  union {
+    lease_key_t key;      // TW_NA, TW_PD
+    struct in6_addr addr; // TW_DECL_ADDR, TW_DECL_PFX
+  } u;
+} tw_node_t;
+
+#define TW_BITS   6
+#define TW_SLOTS  (1u << TW_BITS)
+#define TW_LEVELS 4
+
+typedef struct {
+  uint64_t cur;   // next tick to process
+  size_t count;   // pending entries
+
+  uint32_t head[TW_LEVELS][TW_SLOTS];
+
+  tw_node_t* nodes;
+  uint32_t cap;
+  uint32_t free_head;
+} twheel_t;
+
+typedef void (*tw_fire_fn)(void* arg, const tw_node_t* n, uint64_t now);
+
+int  tw_init(twheel_t* tw, uint64_t now);
+void tw_free(twheel_t* tw);
+
+// schedule an entry; n->next is ignored
+int  tw_add(twheel_t* tw, const tw_node_t* n);
+
+// process all ticks up to and including now; cost is O(ticks + fired)
+void tw_advance(twheel_t* tw, uint64_t now, tw_fire_fn fire, void* arg);
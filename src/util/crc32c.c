@@ -0,0 +1,33 @@
+#include "util/crc32c.h"
+
+#define CRC32C_POLY 0x82f63b78u  // reflected
+
+static uint32_t tbl[8][256];
+
+__attribute__((constructor))
+static void crc32c_init(void){
+  for(uint32_t i=0;i<256;i++){
+    uint32_t c = i;
+    for(int k=0;k<8;k++) c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+    tbl[0][i] = c;
+  }
+  for(uint32_t i=0;i<256;i++){
+    for(int s=1;s<8;s++) tbl[s][i] = (tbl[s-1][i] >> 8) ^ tbl[0][tbl[s-1][i] & 0xff];
+  }
+}
+
+// slicing-by-8
+uint32_t crc32c(uint32_t crc, const void* data, size_t len){
+  const uint8_t* p = (const uint8_t*)data;
+  crc = ~crc;
+  while(len >= 8){
+    uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+    crc = tbl[7][lo & 0xff] ^ tbl[6][(lo >> 8) & 0xff] ^
+          tbl[5][(lo >> 16) & 0xff] ^ tbl[4][lo >> 24] ^
+          tbl[3][p[4]] ^ tbl[2][p[5]] ^ tbl[1][p[6]] ^ tbl[0][p[7]];
+    p += 8;
+    len -= 8;
+  }
+  while(len--) crc = (crc >> 8) ^ tbl[0][(crc ^ *p++) & 0xff];
+  return ~crc;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-32C (Castagnoli), as used for journal/snapshot record checks.
+// crc32c(0, p, n) for a fresh checksum; pass a previous result to extend it.
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
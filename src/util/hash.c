@@ -1,5 +1,11 @@
 #include "util/hash.h"
 
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+__extension__ typedef unsigned __int128 u128;
+
 #define ROTL(x,b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
 #define U8TO64_LE(p) \
   (((uint64_t)((p)[0]))       | ((uint64_t)((p)[1])<<8)  | ((uint64_t)((p)[2])<<16) | ((uint64_t)((p)[3])<<24) | \
@@ -54,9 +60,150 @@ uint64_t siphash24(const uint8_t* data, size_t len, uint64_t k0, uint64_t k1){
   return v0 ^ v1 ^ v2 ^ v3;
 }
 
-uint64_t hash64_bytes(const uint8_t* data, size_t len, uint64_t seed){
-  // convenience wrapper: split seed into keys
+static uint64_t sip_seeded(const uint8_t* data, size_t len, uint64_t seed){
+  // split seed into keys
   uint64_t k0 = seed ^ 0x9e3779b97f4a7c15ULL;
   uint64_t k1 = (seed<<1) ^ 0xbf58476d1ce4e5b9ULL;
   return siphash24(data, len, k0, k1);
 }
+
+// ---- wyhash ----
+
+static const uint64_t wyp[4] = {
+  0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+static inline void wymum(uint64_t* a, uint64_t* b){
+  u128 r = (u128)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+}
+static inline uint64_t wymix(uint64_t a, uint64_t b){
+  wymum(&a, &b);
+  return a ^ b;
+}
+static inline uint64_t rd64(const uint8_t* p){ uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t rd32(const uint8_t* p){ uint32_t v; memcpy(&v, p, 4); return v; }
+
+uint64_t wyhash64(const uint8_t* p, size_t len, uint64_t seed){
+  seed ^= wymix(seed ^ wyp[0], wyp[1]);
+  uint64_t a, b;
+  if(len <= 16){
+    if(len >= 4){
+      size_t q = (len >> 3) << 2;
+      a = (rd32(p) << 32) | rd32(p + q);
+      b = (rd32(p + len - 4) << 32) | rd32(p + len - 4 - q);
+    }else if(len > 0){
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+      b = 0;
+    }else{
+      a = b = 0;
+    }
+  }else{
+    size_t i = len;
+    if(i > 48){
+      uint64_t s1 = seed, s2 = seed;
+      do{
+        seed = wymix(rd64(p) ^ wyp[1], rd64(p + 8) ^ seed);
+        s1 = wymix(rd64(p + 16) ^ wyp[2], rd64(p + 24) ^ s1);
+        s2 = wymix(rd64(p + 32) ^ wyp[3], rd64(p + 40) ^ s2);
+        p += 48;
+        i -= 48;
+      }while(i > 48);
+      seed ^= s1 ^ s2;
+    }
+    while(i > 16){
+      seed = wymix(rd64(p) ^ wyp[1], rd64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = rd64(p + i - 16);
+    b = rd64(p + i - 8);
+  }
+  a ^= wyp[1];
+  b ^= seed;
+  wymum(&a, &b);
+  return wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+}
+
+// ---- crc32c (SSE4.2) ----
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint64_t crc32c_hash64(const uint8_t* p, size_t len, uint64_t seed){
+  uint64_t lo = (uint32_t)seed, hi = (uint32_t)(seed >> 32) ^ len;
+  // the lanes see the word with its halves swapped: fed the same bytes,
+  // two CRCs differ by a constant and would only give 32 bits
+  size_t n = len;
+  for(; n >= 8; p += 8, n -= 8){
+    uint64_t v = rd64(p);
+    lo = _mm_crc32_u64(lo, v);
+    hi = _mm_crc32_u64(hi, v >> 32 | v << 32);
+  }
+  if(n){
+    // tail without a byte loop: the last 8 bytes shifted past the consumed
+    // ones, or (short input) two overlapping 4-byte / three 1-byte reads
+    uint64_t v;
+    if(len >= 8) v = rd64(p + n - 8) >> (64 - 8 * n);
+    else if(n >= 4) v = rd32(p) | rd32(p + n - 4) << 32;
+    else v = (uint64_t)p[0] << 16 | (uint64_t)p[n >> 1] << 8 | p[n - 1];
+    lo = _mm_crc32_u64(lo, v);
+    hi = _mm_crc32_u64(hi, v >> 32 | v << 32);
+  }
+  // crc is linear: the finaliser spreads it over all 64 bits
+  return hash_mix64(hi << 32 | lo);
+}
+static int have_crc32c(void){ return __builtin_cpu_supports("sse4.2"); }
+#else
+uint64_t crc32c_hash64(const uint8_t* p, size_t len, uint64_t seed){
+  (void)p; (void)len; (void)seed;
+  return 0;
+}
+static int have_crc32c(void){ return 0; }
+#endif
+
+// ---- selection ----
+
+typedef uint64_t (*hash_fn)(const uint8_t*, size_t, uint64_t);
+
+static const hash_fn fns[HASH_NKINDS] = { sip_seeded, wyhash64, crc32c_hash64 };
+static const char* const names[HASH_NKINDS] = { "siphash", "wyhash", "crc32c" };
+
+static hash_kind_t cur_kind = HASH_SIPHASH;
+static hash_fn cur_fn = sip_seeded;
+
+uint64_t hash64_bytes(const uint8_t* data, size_t len, uint64_t seed){
+  return cur_fn(data, len, seed);
+}
+
+uint64_t hash64_with(hash_kind_t k, const uint8_t* data, size_t len, uint64_t seed){
+  return fns[k](data, len, seed);
+}
+
+int hash_available(hash_kind_t k){
+  if(k >= HASH_NKINDS) return 0;
+  return k != HASH_CRC32C || have_crc32c();
+}
+
+int hash_select(hash_kind_t k){
+  if(!hash_available(k)) return -1;
+  cur_kind = k;
+  cur_fn = fns[k];
+  return 0;
+}
+
+hash_kind_t hash_selected(void){ return cur_kind; }
+
+const char* hash_kind_name(hash_kind_t k){
+  return k < HASH_NKINDS ? names[k] : "?";
+}
+
+int hash_kind_parse(const char* s, hash_kind_t* out){
+  for(int k=0;k<HASH_NKINDS;k++){
+    if(strcmp(s, names[k]) == 0){
+      *out = (hash_kind_t)k;
+      return 0;
+    }
+  }
+  return -1;
+}
@@ -1,6 +1,47 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+
+/*
+ * 64-bit hashing of client-supplied bytes (DUIDs): lease keys, address
+ * placement, reply cache. hash64_bytes() runs the process-wide selection:
+ *   siphash - SipHash-2-4, keyed: clients cannot aim for collisions (default)
+ *   wyhash  - wyhash (final4 layout), seeded multiply/fold; several times faster
+ *   crc32c  - two seeded CRC-32C lanes on the SSE4.2 crc32 instruction and a
+ *             final mix; fastest, trivially invertible
+ * The fast ones are for sites whose clients are trusted (behind relays the
+ * operator runs). Lease keys and address placement derive from the hash,
+ * so the selection is made once at startup, before any lease is keyed.
+ */
+typedef enum { HASH_SIPHASH, HASH_WYHASH, HASH_CRC32C, HASH_NKINDS } hash_kind_t;
 
 uint64_t siphash24(const uint8_t* data, size_t len, uint64_t k0, uint64_t k1);
+uint64_t wyhash64(const uint8_t* data, size_t len, uint64_t seed);
+uint64_t crc32c_hash64(const uint8_t* data, size_t len, uint64_t seed); // needs hash_available()
+
 uint64_t hash64_bytes(const uint8_t* data, size_t len, uint64_t seed);
+uint64_t hash64_with(hash_kind_t k, const uint8_t* data, size_t len, uint64_t seed);
+
+int  hash_available(hash_kind_t k);  // crc32c: CPU has SSE4.2
+int  hash_select(hash_kind_t k);     // -1 = not available, selection unchanged
+hash_kind_t hash_selected(void);
+const char* hash_kind_name(hash_kind_t k);
+int  hash_kind_parse(const char* s, hash_kind_t* out);
+
+// finaliser for server-chosen values (addresses, composed keys): no key needed
+static inline uint64_t hash_mix64(uint64_t x){
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+// 16 bytes of an in6_addr, no alignment assumed
+static inline uint64_t hash_in6(const void* addr){
+  uint64_t w[2];
+  memcpy(w, addr, sizeof(w));
+  return hash_mix64(w[0] ^ w[1]);
+}
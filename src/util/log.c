@@ -1,14 +1,71 @@
+#define _GNU_SOURCE
 #define _POSIX_C_SOURCE 200809L
 
 #include "util/log.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// one queued message; seq == pos: free for the producer claiming pos,
+// seq == pos + 1: filled, the writer's turn (bounded MPMC ring, single consumer)
+typedef struct {
+  uint64_t seq;
+  uint32_t sec;
+  uint8_t lvl;
+  uint8_t pad;
+  uint16_t len;
+  char msg[LOG_MSG_MAX];
+} __attribute__((aligned(64))) log_slot_t;
+
+typedef struct {
+  uint32_t sample;
+  uint32_t rate;
+  uint64_t seen;        // sampling counter
+  uint64_t win;         // (second << 32) | messages kept in it
+  uint64_t suppressed;  // sampled out or over the rate, not yet reported
+} log_limit_t;
+
+#define LOG_LEVELS 4
+#define LOG_OUT_BUF 65536
 
 static log_level_t g_lvl = LOG_INFO;
+static log_limit_t g_lim[LOG_LEVELS];
+
+static log_slot_t* g_ring;
+static uint64_t g_head __attribute__((aligned(64)));  // next slot to claim
+static uint64_t g_tail __attribute__((aligned(64)));  // next slot to write (writer only)
+static uint64_t g_lost;     // ring full
+static int g_async;         // producers queue (else write directly)
+static int g_idle;          // writer is (about to be) asleep on g_efd
+static int g_stop;
+static int g_efd = -1;
+static pthread_t g_thr;
 
 void log_set_level(log_level_t lvl){
-  g_lvl = lvl;
+  __atomic_store_n(&g_lvl, lvl, __ATOMIC_RELAXED);
+}
+
+void log_set_limit(log_level_t lvl, uint32_t sample, uint32_t rate){
+  if((unsigned)lvl >= LOG_LEVELS) return;
+  __atomic_store_n(&g_lim[lvl].sample, sample, __ATOMIC_RELAXED);
+  __atomic_store_n(&g_lim[lvl].rate, rate, __ATOMIC_RELAXED);
+}
+
+int log_level_parse(const char* s, log_level_t* out){
+  if(strcmp(s, "DEBUG") == 0) *out = LOG_DEBUG;
+  else if(strcmp(s, "INFO") == 0) *out = LOG_INFO;
+  else if(strcmp(s, "WARN") == 0) *out = LOG_WARN;
+  else if(strcmp(s, "ERROR") == 0) *out = LOG_ERR;
+  else return -1;
+  return 0;
 }
 
 static const char* lvl_s(log_level_t l){
@@ -21,22 +78,255 @@ static const char* lvl_s(log_level_t l){
   }
 }
 
-void log_printf(log_level_t lvl, const char* fmt, ...){
-  if(lvl > g_lvl) return;
+static uint32_t now_sec(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  return (uint32_t)ts.tv_sec;
+}
 
-  time_t t = time(NULL);
-  struct tm tm;
-  localtime_r(&t, &tm);
+// "YYYY-MM-DD HH:MM:SS", redone only when the second changes
+typedef struct {
+  uint32_t sec;
+  char s[32];
+} log_stamp_t;
 
-  char tbuf[32];
-  strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &tm);
+static const char* stamp(log_stamp_t* c, uint32_t sec){
+  if(c->sec != sec || !c->s[0]){
+    time_t t = (time_t)sec;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    strftime(c->s, sizeof(c->s), "%Y-%m-%d %H:%M:%S", &tm);
+    c->sec = sec;
+  }
+  return c->s;
+}
 
-  fprintf(stderr, "%s [%s] ", tbuf, lvl_s(lvl));
+// sampling, then a per-second budget; lock-free, any thread
+static int admit(log_limit_t* l, uint32_t sec){
+  uint32_t sample = __atomic_load_n(&l->sample, __ATOMIC_RELAXED);
+  uint32_t rate = __atomic_load_n(&l->rate, __ATOMIC_RELAXED);
+  if(sample > 1 && __atomic_fetch_add(&l->seen, 1, __ATOMIC_RELAXED) % sample != 0) goto drop;
+  if(rate){
+    uint64_t w = __atomic_load_n(&l->win, __ATOMIC_RELAXED), n;
+    do{
+      if((uint32_t)(w >> 32) != sec) n = ((uint64_t)sec << 32) | 1;
+      else if((uint32_t)w >= rate) goto drop;
+      else n = w + 1;
+    }while(!__atomic_compare_exchange_n(&l->win, &w, n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  }
+  return 1;
+drop:
+  __atomic_fetch_add(&l->suppressed, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+static void write_fd(const char* s, size_t len){
+  while(len > 0){
+    ssize_t n = write(STDERR_FILENO, s, len);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      return;
+    }
+    s += n;
+    len -= (size_t)n;
+  }
+}
+
+static void write_sync(log_level_t lvl, uint32_t sec, const char* fmt, va_list ap){
+  static __thread log_stamp_t ts;
+  // one line per call even with several worker threads logging
+  flockfile(stderr);
+  fprintf(stderr, "%s [%s] ", stamp(&ts, sec), lvl_s(lvl));
+  vfprintf(stderr, fmt, ap);
+  fputc('\n', stderr);
+  funlockfile(stderr);
+}
+
+static int enqueue(log_level_t lvl, uint32_t sec, const char* fmt, va_list ap){
+  uint64_t pos = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+  log_slot_t* s;
+  for(;;){
+    s = &g_ring[pos & (LOG_RING_SLOTS - 1)];
+    uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    int64_t d = (int64_t)(seq - pos);
+    if(d == 0){
+      if(__atomic_compare_exchange_n(&g_head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+    }else if(d < 0){
+      return -1; // full: the writer is a whole ring behind
+    }else{
+      pos = __atomic_load_n(&g_head, __ATOMIC_RELAXED);
+    }
+  }
+  int n = vsnprintf(s->msg, sizeof(s->msg), fmt, ap);
+  s->len = (uint16_t)(n < 0 ? 0 : n >= (int)sizeof(s->msg) ? (int)sizeof(s->msg) - 1 : n);
+  s->sec = sec;
+  s->lvl = (uint8_t)lvl;
+  __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+
+  // pairs with the writer's idle handshake: either it sees this slot or
+  // we see it asleep and wake it
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&g_idle, __ATOMIC_RELAXED) && __atomic_exchange_n(&g_idle, 0, __ATOMIC_RELAXED)){
+    uint64_t one = 1;
+    (void)!write(g_efd, &one, sizeof(one));
+  }
+  return 0;
+}
+
+void log_printf(log_level_t lvl, const char* fmt, ...){
+  if(lvl > __atomic_load_n(&g_lvl, __ATOMIC_RELAXED)) return;
+  uint32_t sec = now_sec();
+  if((unsigned)lvl < LOG_LEVELS && !admit(&g_lim[lvl], sec)) return;
 
   va_list ap;
   va_start(ap, fmt);
-  vfprintf(stderr, fmt, ap);
+  if(!__atomic_load_n(&g_async, __ATOMIC_ACQUIRE)) write_sync(lvl, sec, fmt, ap);
+  else if(enqueue(lvl, sec, fmt, ap) < 0) __atomic_fetch_add(&g_lost, 1, __ATOMIC_RELAXED);
   va_end(ap);
+}
 
-  fputc('\n', stderr);
+// ---- writer ----
+
+typedef struct {
+  char buf[LOG_OUT_BUF];
+  size_t len;
+  log_stamp_t ts;
+} log_out_t;
+
+static void out_flush(log_out_t* o){
+  write_fd(o->buf, o->len);
+  o->len = 0;
+}
+
+static void out_line(log_out_t* o, uint32_t sec, unsigned lvl, const char* msg, size_t len){
+  if(o->len + 64 + len > sizeof(o->buf)) out_flush(o);
+  int n = snprintf(o->buf + o->len, sizeof(o->buf) - o->len, "%s [%s] ", stamp(&o->ts, sec), lvl_s((log_level_t)lvl));
+  o->len += (size_t)n;
+  memcpy(o->buf + o->len, msg, len);
+  o->len += len;
+  o->buf[o->len++] = '\n';
+}
+
+static const char* const lvl_name[LOG_LEVELS] = { "ERROR", "WARN", "INFO", "DEBUG" };
+
+// counts of what never reached the ring
+static void out_drops(log_out_t* o, uint32_t sec){
+  char msg[128];
+  for(int i=0;i<LOG_LEVELS;i++){
+    uint64_t n = __atomic_exchange_n(&g_lim[i].suppressed, 0, __ATOMIC_RELAXED);
+    if(n){
+      int len = snprintf(msg, sizeof(msg), "log: %llu %s messages suppressed (sample/rate limit)",
+                         (unsigned long long)n, lvl_name[i]);
+      out_line(o, sec, LOG_WARN, msg, (size_t)len);
+    }
+  }
+  uint64_t n = __atomic_exchange_n(&g_lost, 0, __ATOMIC_RELAXED);
+  if(n){
+    int len = snprintf(msg, sizeof(msg), "log: %llu messages lost (ring full)", (unsigned long long)n);
+    out_line(o, sec, LOG_WARN, msg, (size_t)len);
+  }
+}
+
+// everything filled so far, in claim order; stops at the first slot a
+// producer has claimed but not filled yet
+static size_t drain(log_out_t* o){
+  size_t n = 0;
+  for(;;){
+    log_slot_t* s = &g_ring[g_tail & (LOG_RING_SLOTS - 1)];
+    if(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != g_tail + 1) break;
+    out_line(o, s->sec, s->lvl, s->msg, s->len);
+    __atomic_store_n(&s->seq, g_tail + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+    g_tail++;
+    n++;
+  }
+  return n;
+}
+
+static int ring_ready(void){
+  const log_slot_t* s = &g_ring[g_tail & (LOG_RING_SLOTS - 1)];
+  return __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) == g_tail + 1;
+}
+
+static void* writer_main(void* arg){
+  (void)arg;
+  static log_out_t o;
+  uint32_t last = now_sec();
+  for(;;){
+    int stop = __atomic_load_n(&g_stop, __ATOMIC_ACQUIRE);
+    size_t n = drain(&o);
+    uint32_t sec = now_sec();
+    if(sec != last){
+      out_drops(&o, sec);
+      last = sec;
+    }
+    if(o.len) out_flush(&o);
+    if(stop) break;
+    if(n) continue;
+
+    // nothing queued: announce the sleep, then look once more
+    __atomic_store_n(&g_idle, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(ring_ready() || __atomic_load_n(&g_stop, __ATOMIC_ACQUIRE)){
+      __atomic_store_n(&g_idle, 0, __ATOMIC_RELAXED);
+      continue;
+    }
+    struct pollfd p = { .fd = g_efd, .events = POLLIN };
+    if(poll(&p, 1, 1000) > 0){
+      uint64_t v;
+      (void)!read(g_efd, &v, sizeof(v));
+    }
+    __atomic_store_n(&g_idle, 0, __ATOMIC_RELAXED);
+  }
+  out_drops(&o, now_sec());
+  out_flush(&o);
+  return NULL;
+}
+
+// a fork()ed child has no writer: it logs directly
+static void at_fork_child(void){
+  __atomic_store_n(&g_async, 0, __ATOMIC_RELAXED);
+}
+
+int log_start(void){
+  static int once;
+  if(g_async) return 0;
+  if(!g_ring) g_ring = aligned_alloc(64, LOG_RING_SLOTS * sizeof(*g_ring));
+  if(!g_ring) return -1;
+  for(uint64_t i=0;i<LOG_RING_SLOTS;i++) g_ring[i].seq = i;
+  g_head = g_tail = 0;
+  g_stop = 0;
+  g_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if(g_efd < 0) return -1;
+  // signals are for the threads that wait for them (main's signalfd)
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int rc = pthread_create(&g_thr, NULL, writer_main, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if(rc != 0){
+    close(g_efd);
+    g_efd = -1;
+    return -1;
+  }
+  if(!once){
+    once = 1;
+    pthread_atfork(NULL, NULL, at_fork_child);
+    atexit(log_stop);
+  }
+  __atomic_store_n(&g_async, 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+// producers still inside enqueue() when the writer leaves lose their line
+void log_stop(void){
+  if(!__atomic_load_n(&g_async, __ATOMIC_ACQUIRE)) return;
+  __atomic_store_n(&g_async, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&g_stop, 1, __ATOMIC_RELEASE);
+  uint64_t one = 1;
+  (void)!write(g_efd, &one, sizeof(one));
+  pthread_join(g_thr, NULL);
+  close(g_efd);
+  g_efd = -1;
+  // the ring stays allocated (and is reused by log_start): a late
+  // producer may still be writing a slot
 }
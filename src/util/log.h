@@ -1,7 +1,31 @@
 #pragma once
 #include <stdarg.h>
+#include <stdint.h>
 
 typedef enum { LOG_ERR=0, LOG_WARN=1, LOG_INFO=2, LOG_DEBUG=3 } log_level_t;
 
+/*
+ * Logging off the packet path. Once log_start() has run, log_printf()
+ * formats the message body into a slot of a lock-free MPSC ring and
+ * returns; a background thread adds the timestamp (reformatted once per
+ * second) and level and writes the lines to stderr in batches. A full
+ * ring drops the message instead of waiting. Before log_start(), after
+ * log_stop() and in fork()ed children lines are written synchronously.
+ *
+ * Per level, sampling keeps one message in every `sample` and rate
+ * limiting keeps at most `rate` per second (0 = off, for both). Dropped
+ * and suppressed messages are counted and reported by the writer.
+ * Messages longer than LOG_MSG_MAX are cut.
+ */
+
+#define LOG_MSG_MAX   232   // body bytes kept per message (slot is 256)
+#define LOG_RING_SLOTS 4096
+
 void log_set_level(log_level_t lvl);
-void log_printf(log_level_t lvl, const char* fmt, ...);
+void log_set_limit(log_level_t lvl, uint32_t sample, uint32_t rate);
+int  log_level_parse(const char* s, log_level_t* out);  // "DEBUG".."ERROR"; -1 = unknown
+
+int  log_start(void);  // spawn the writer; -1 = stays synchronous
+void log_stop(void);   // write what is queued and join (also at exit)
+
+void log_printf(log_level_t lvl, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
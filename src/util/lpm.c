@@ -0,0 +1,188 @@
+// src/util/lpm.c
+#include "util/lpm.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LPM_DIR_NODE 0x80000000u
+#define FANOUT (1u << LPM_STRIDE)
+
+// build-time binary trie, index 0 = none (the root is 1)
+typedef struct {
+  uint32_t c[2];
+  uint32_t val;  // route value + 1, 0 = no route ends here
+} bnode_t;
+
+typedef struct {
+  lpm_t* t;
+  bnode_t* bn;
+  uint32_t nbn, bncap;
+  uint32_t nodecap, leafcap;
+} build_t;
+
+static uint64_t key64(const struct in6_addr* a){
+  uint64_t k = 0;
+  for(int i=0;i<8;i++) k = (k << 8) | a->s6_addr[i];
+  return k;
+}
+
+static uint32_t bn_new(build_t* b){
+  if(b->nbn == b->bncap){
+    uint32_t ncap = b->bncap * 2;
+    bnode_t* n = realloc(b->bn, (size_t)ncap * sizeof(*n));
+    if(!n) return 0;
+    b->bn = n;
+    b->bncap = ncap;
+  }
+  memset(&b->bn[b->nbn], 0, sizeof(bnode_t));
+  return b->nbn++;
+}
+
+static int bn_insert(build_t* b, const lpm_route_t* r){
+  uint64_t k = key64(&r->prefix);
+  unsigned plen = r->plen > 64 ? 64 : r->plen;
+  uint32_t cur = 1;
+  for(unsigned d=0; d<plen; d++){
+    unsigned bit = (unsigned)(k >> (63 - d)) & 1;
+    if(!b->bn[cur].c[bit]){
+      uint32_t n = bn_new(b);   // may move b->bn
+      if(!n) return -1;
+      b->bn[cur].c[bit] = n;
+    }
+    cur = b->bn[cur].c[bit];
+  }
+  b->bn[cur].val = r->val + 1;
+  return 0;
+}
+
+// follow bits bits of v from cur, picking up route values on the way;
+// returns the node reached (0 = fell off)
+static uint32_t bn_walk(const build_t* b, uint32_t cur, uint64_t v, unsigned bits, uint32_t* best){
+  for(unsigned i=0; i<bits && cur; i++){
+    cur = b->bn[cur].c[(v >> (bits - 1 - i)) & 1];
+    if(cur && b->bn[cur].val) *best = b->bn[cur].val;
+  }
+  return cur;
+}
+
+static int bn_inner(const build_t* b, uint32_t cur){
+  return cur && (b->bn[cur].c[0] || b->bn[cur].c[1]);
+}
+
+static int grow(void** p, uint32_t* cap, uint32_t need, size_t elt){
+  if(need <= *cap) return 0;
+  uint32_t ncap = *cap ? *cap : 64;
+  while(ncap < need) ncap *= 2;
+  void* n = realloc(*p, (size_t)ncap * elt);
+  if(!n) return -1;
+  *p = n;
+  *cap = ncap;
+  return 0;
+}
+
+// fill nodes[idx] for the stride starting below binary node cur (which
+// sits at depth bits; inherited = the value covering it)
+static int compile(build_t* b, uint32_t idx, uint32_t cur, uint32_t inherited){
+  lpm_t* t = b->t;
+  uint32_t sub[FANOUT], val[FANOUT];
+  uint64_t vector = 0, leafvec = 0;
+  uint32_t nchild = 0, nleaf = 0, prev = 0;
+  int first = 1;
+
+  for(unsigned v=0; v<FANOUT; v++){
+    uint32_t best = inherited;
+    uint32_t n = bn_walk(b, cur, v, LPM_STRIDE, &best);
+    val[v] = best;
+    if(bn_inner(b, n)){
+      vector |= 1ULL << v;
+      sub[nchild++] = n;
+      continue;
+    }
+    if(first || best != prev){
+      leafvec |= 1ULL << v;
+      nleaf++;
+    }
+    first = 0;
+    prev = best;
+  }
+
+  uint32_t base1 = t->nnodes, base0 = t->nleaves;
+  if(grow((void**)&t->nodes, &b->nodecap, base1 + nchild, sizeof(lpm_node_t)) < 0 ||
+     grow((void**)&t->leaves, &b->leafcap, base0 + nleaf, sizeof(uint32_t)) < 0) return -1;
+  t->nnodes += nchild;
+  for(unsigned v=0; v<FANOUT; v++){
+    if(leafvec >> v & 1) t->leaves[t->nleaves++] = val[v];
+  }
+
+  lpm_node_t* nd = &t->nodes[idx];
+  nd->vector = vector;
+  nd->leafvec = leafvec;
+  nd->base1 = base1;
+  nd->base0 = base0;
+
+  // children after the node is complete: the arrays move as they grow
+  for(uint32_t j=0, v=0; j<nchild; v++){
+    if(!(vector >> v & 1)) continue;
+    if(compile(b, base1 + j, sub[j], val[v]) < 0) return -1;
+    j++;
+  }
+  return 0;
+}
+
+int lpm_build(lpm_t* t, const lpm_route_t* r, size_t n){
+  memset(t, 0, sizeof(*t));
+  build_t b = { .t = t, .nbn = 2, .bncap = 256 };  // 0 = none, 1 = root
+  b.bn = calloc(b.bncap, sizeof(bnode_t));
+  if(!b.bn) goto fail;
+  for(size_t i=0;i<n;i++){
+    if(r[i].val >= LPM_DIR_NODE - 1 || bn_insert(&b, &r[i]) < 0) goto fail;
+  }
+
+  t->dir = malloc(sizeof(uint32_t) << LPM_DIR_BITS);
+  if(!t->dir) goto fail;
+  for(uint32_t d=0; d < (1u << LPM_DIR_BITS); d++){
+    uint32_t best = b.bn[1].val;
+    uint32_t cur = bn_walk(&b, 1, d, LPM_DIR_BITS, &best);
+    if(!bn_inner(&b, cur)){
+      t->dir[d] = best;
+      continue;
+    }
+    uint32_t idx = t->nnodes;
+    if(grow((void**)&t->nodes, &b.nodecap, idx + 1, sizeof(lpm_node_t)) < 0) goto fail;
+    t->nnodes++;
+    if(compile(&b, idx, cur, best) < 0) goto fail;
+    t->dir[d] = LPM_DIR_NODE | idx;
+  }
+  free(b.bn);
+  return 0;
+
+fail:
+  free(b.bn);
+  lpm_free(t);
+  return -1;
+}
+
+void lpm_free(lpm_t* t){
+  free(t->dir);
+  free(t->nodes);
+  free(t->leaves);
+  memset(t, 0, sizeof(*t));
+}
+
+uint32_t lpm_lookup(const lpm_t* t, const struct in6_addr* a){
+  if(!t->dir) return LPM_NONE;
+  uint64_t k = key64(a);
+  uint32_t d = t->dir[k >> (64 - LPM_DIR_BITS)];
+  if(d & LPM_DIR_NODE){
+    const lpm_node_t* n = &t->nodes[d & ~LPM_DIR_NODE];
+    for(unsigned off = LPM_DIR_BITS;; off += LPM_STRIDE){
+      unsigned v = (unsigned)(k >> (64 - LPM_STRIDE - off)) & (FANOUT - 1);
+      uint64_t below = (2ULL << v) - 1;  // slots 0..v (v = 63 wraps to all)
+      if(!(n->vector >> v & 1)){
+        d = t->leaves[n->base0 + (uint32_t)__builtin_popcountll(n->leafvec & below) - 1];
+        break;
+      }
+      n = &t->nodes[n->base1 + (uint32_t)__builtin_popcountll(n->vector & below) - 1];
+    }
+  }
+  return d ? d - 1 : LPM_NONE;
+}
@@ -0,0 +1,52 @@
+// src/util/lpm.h
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+/*
+ * Longest-prefix match on the upper 64 bits of IPv6 addresses (links,
+ * /64 address pools and delegation bases never go longer; a longer
+ * prefix is cut to its /64).
+ *
+ * Compiled Poptrie-style: a 2^16-entry direct table on the top bits, then
+ * 6-bit strides through nodes of two 64-bit bitmaps. A node keeps its
+ * children and its leaves in contiguous runs; vector marks the slots that
+ * descend and leafvec the slots where a run of equal leaves starts, so a
+ * child or leaf is found by a popcount. A lookup is the direct table plus
+ * at most 8 node loads, whatever the prefix count.
+ *
+ * Built once from a route list and read-only afterwards: workers share it.
+ */
+
+#define LPM_NONE UINT32_MAX
+#define LPM_DIR_BITS 16
+#define LPM_STRIDE 6
+
+typedef struct {
+  struct in6_addr prefix;
+  uint8_t plen;
+  uint32_t val;   // < 2^31 - 1
+} lpm_route_t;
+
+typedef struct {
+  uint64_t vector;   // slot descends to a child
+  uint64_t leafvec;  // slot starts a run of equal leaves
+  uint32_t base1;    // first child
+  uint32_t base0;    // first leaf
+} lpm_node_t;
+
+typedef struct {
+  uint32_t* dir;     // [1 << LPM_DIR_BITS]: LPM_DIR_NODE | node, else leaf
+  lpm_node_t* nodes;
+  uint32_t* leaves;  // value + 1, 0 = no route
+  uint32_t nnodes, nleaves;
+} lpm_t;
+
+// build from n routes (an equal prefix given twice: the later one wins);
+// an empty list is a valid trie that matches nothing
+int  lpm_build(lpm_t* t, const lpm_route_t* r, size_t n);
+void lpm_free(lpm_t* t);
+
+// value of the longest route covering a, LPM_NONE = none
+uint32_t lpm_lookup(const lpm_t* t, const struct in6_addr* a);
@@ -8,3 +8,43 @@ uint64_t now_epoch_sec(void){
   clock_gettime(CLOCK_REALTIME, &ts);
   return (uint64_t)ts.tv_sec;
 }
+
+__extension__ typedef unsigned __int128 u128;
+
+uint64_t cycles_mult = (uint64_t)1 << 32;
+int cycles_tsc;
+
+uint64_t cycles_mono_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+
+// CPUID 0x80000007 EDX bit 8: the TSC ticks at a fixed rate in every P/C-state
+static int invariant_tsc(void){
+  unsigned a, b, c, d;
+  if(!__get_cpuid(0x80000007, &a, &b, &c, &d)) return 0;
+  return (d >> 8) & 1;
+}
+#endif
+
+void cycles_init(void){
+#if defined(__x86_64__)
+  if(!invariant_tsc()) return; // monotonic ns, scale 1
+  cycles_tsc = 1;
+  // count TSC ticks over ~10ms of wall time
+  uint64_t t0 = cycles_mono_ns(), c0 = cycles_now(), t1, c1;
+  do{
+    t1 = cycles_mono_ns();
+    c1 = cycles_now();
+  }while(t1 - t0 < 10000000u);
+  cycles_mult = (uint64_t)(((u128)(t1 - t0) << 32) / (c1 - c0));
+#elif defined(__aarch64__)
+  uint64_t f;
+  __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(f));
+  if(f) cycles_mult = (uint64_t)(((u128)1000000000u << 32) / f);
+#endif
+}
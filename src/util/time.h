@@ -2,3 +2,38 @@
 #include <stdint.h>
 
 uint64_t now_epoch_sec(void);
+
+/*
+ * Cycle counter for per-packet timing: the TSC on x86-64 when it runs at
+ * a constant rate across power states (invariant TSC), the virtual
+ * counter on aarch64, else CLOCK_MONOTONIC in ns. cycles_init()
+ * calibrates the scale once (main thread, before workers start);
+ * cycles_to_ns() converts a difference of two readings.
+ */
+extern uint64_t cycles_mult; // ns per cycle, 32.32 fixed point
+extern int cycles_tsc;       // x86-64: reading the TSC
+
+void cycles_init(void);
+uint64_t cycles_mono_ns(void);
+
+static inline uint64_t cycles_now(void){
+#if defined(__x86_64__)
+  if(cycles_tsc){
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (uint64_t)hi << 32 | lo;
+  }
+  return cycles_mono_ns();
+#elif defined(__aarch64__)
+  uint64_t v;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+#else
+  return cycles_mono_ns();
+#endif
+}
+
+static inline uint64_t cycles_to_ns(uint64_t d){
+  __extension__ typedef unsigned __int128 u128;
+  return (uint64_t)(((u128)d * cycles_mult) >> 32);
+}
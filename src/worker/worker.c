@@ -0,0 +1,416 @@
+#define _GNU_SOURCE
+#include "worker/worker.h"
+#include "net/steer.h"
+#include "store/mem_store.h"
+#include "alloc/alloc.h"
+#include "util/log.h"
+#include "util/time.h"
+
+#include "config/config.h"
+#include "store/lease_journal.h"
+#include "store/snapshot.h"
+#include "store/map_store.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+static void on_sock(reactor_ev_t* ev, uint32_t events){
+  (void)events;
+  worker_on_readable((dh6_worker_t*)ev->arg);
+}
+
+static void on_tick(reactor_ev_t* ev, uint32_t events){
+  (void)events;
+  worker_tick((dh6_worker_t*)ev->arg, now_epoch_sec());
+}
+
+static void on_commit(reactor_ev_t* ev, uint32_t events){
+  (void)events;
+  worker_commit((dh6_worker_t*)ev->arg);
+}
+
+// the lease map is the persistent copy; the journal only covers what the
+// map may not have on disk yet, so it is emptied after every msync
+static void store_sync(dh6_worker_t* w){
+  worker_commit(w);
+  if(map_store_sync(&w->store) < 0) return;
+  if(w->jr.fd >= 0) journal_truncate(&w->jr);
+}
+
+static void on_store_sync(reactor_ev_t* ev, uint32_t events){
+  (void)events;
+  store_sync((dh6_worker_t*)ev->arg);
+}
+
+static int store_open(dh6_worker_t* w, const server_ctx_t* tmpl, int nshards){
+  if(!tmpl->store_path[0]) return mem_store_init(&w->store, 4096, tmpl->duid_seed);
+  char path[sizeof(tmpl->store_path) + 16];
+  if(nshards > 1) snprintf(path, sizeof(path), "%s.%d", tmpl->store_path, w->id);
+  else snprintf(path, sizeof(path), "%s", tmpl->store_path);
+  return map_store_open(&w->store, path, 4096, tmpl->duid_seed);
+}
+
+static void store_close(dh6_worker_t* w){
+  if(!w->store.impl) return;
+  if(w->ctx.store_path[0]) map_store_close(&w->store);
+  else mem_store_free(&w->store);
+}
+
+#define WORKER_HELD_MAX 256
+
+static uint64_t mono_ms(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+static void shard_file(char* out, size_t cap, const dh6_worker_t* w, const char* suffix){
+  snprintf(out, cap, "%s%s", w->jr_path, suffix);
+}
+
+// recovery: snapshot (bulk load), then the rotated journal it may not
+// cover yet, then the live journal; records are blind writes, so
+// replaying what the snapshot already holds is harmless
+static int journal_setup(dh6_worker_t* w, int nshards){
+  char snap[sizeof(w->jr_path) + 16], prev[sizeof(w->jr_path) + 16];
+  if(nshards > 1) snprintf(w->jr_path, sizeof(w->jr_path), "%s.%d", w->ctx.journal_path, w->id);
+  else snprintf(w->jr_path, sizeof(w->jr_path), "%s", w->ctx.journal_path);
+  shard_file(snap, sizeof(snap), w, ".snap.tmp");
+  unlink(snap);
+  shard_file(snap, sizeof(snap), w, ".snap");
+  shard_file(prev, sizeof(prev), w, ".prev");
+
+  uint64_t now = now_epoch_sec();
+  uint64_t t0 = mono_ms();
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  // a lease map already holds everything a snapshot would
+  long ns = w->ctx.store_path[0] ? 0 : snapshot_load(snap, &w->store, now, ncpu > 0 ? (int)ncpu : 1);
+  long np = ns < 0 ? -1 : lj_replay(prev, &w->store, now);
+  long n = np < 0 ? -1 : lj_replay(w->jr_path, &w->store, now);
+  if(n < 0){
+    log_printf(LOG_ERR, "worker %d: lease recovery from %s failed", w->id, w->jr_path);
+    return -1;
+  }
+  if(journal_open(&w->jr, w->jr_path) < 0) return -1;
+  w->held = malloc(WORKER_HELD_MAX * sizeof(*w->held));
+  if(!w->held) return -1;
+  w->store.journal = &w->jr;
+  w->snap_last = now;
+  log_printf(LOG_INFO, "worker %d: journal %s (%ld snapshot entries, %ld records replayed, %llu ms)",
+             w->id, w->jr_path, ns, np + n, (unsigned long long)(mono_ms() - t0));
+  return 0;
+}
+
+// O(1) per table: copy the counters out where the CLI can read them
+static void publish_tables(dh6_worker_t* w){
+  htab_stat_t t[MEM_NTABLES];
+  if(w->ctx.store_path[0]) map_store_stat(&w->store, t);
+  else mem_store_stat(&w->store, t);
+  pthread_mutex_lock(&w->tab_mu);
+  memcpy(w->tab, t, sizeof(t));
+  pthread_mutex_unlock(&w->tab_mu);
+}
+
+int worker_init(dh6_worker_t* w, const server_ctx_t* tmpl, int id, int nshards, uint16_t port){
+  memset(w, 0, sizeof(*w));
+  w->id = id;
+  w->cpu = -1;
+  w->sock_ev.fd = w->tick_ev.fd = w->commit_ev.fd = w->snap_ev.fd = w->store_ev.fd = -1;
+  w->jr.fd = -1;
+  dh6_batch_init(&w->batch);
+
+  int rc = (nshards > 1) ? dh6_sock_open_reuseport(&w->sock, port)
+                         : dh6_sock_open(&w->sock, port);
+  if(rc < 0) return -1;
+
+  if(store_open(w, tmpl, nshards) < 0){
+    dh6_sock_close(&w->sock);
+    return -1;
+  }
+
+  w->stats = dh6_stats_new();
+  if(!w->stats){
+    store_close(w);
+    dh6_sock_close(&w->sock);
+    return -1;
+  }
+  w->ctx = *tmpl;
+  w->ctx.store = &w->store;
+  w->ctx.stats = w->stats;
+  if(dh6_pools_init(&w->ctx, (unsigned)id, (unsigned)nshards) < 0){
+    log_printf(LOG_ERR, "worker %d: pool init failed", id);
+    dh6_stats_free(w->stats);
+    store_close(w);
+    dh6_sock_close(&w->sock);
+    return -1;
+  }
+
+  if(w->ctx.store_path[0]) map_store_replay_occ(&w->store);
+
+  // the program is per reuseport group; socket 0 carries it
+  if(nshards > 1 && id == 0) dh6_steer_attach(w->sock.fd, (uint32_t)nshards);
+
+  pthread_mutex_init(&w->cfg_mu, NULL);
+  pthread_mutex_init(&w->tab_mu, NULL);
+  if(reactor_init(&w->rx) < 0 ||
+     reactor_add_timer(&w->rx, &w->tick_ev, 1000, on_tick, w) < 0){
+    worker_destroy(w);
+    return -1;
+  }
+
+  if(w->ctx.journal_path[0]){
+    if(journal_setup(w, nshards) < 0 ||
+       (w->ctx.journal_sync_ms &&
+        reactor_add_timer(&w->rx, &w->commit_ev, w->ctx.journal_sync_ms, on_commit, w) < 0)){
+      worker_destroy(w);
+      return -1;
+    }
+  }
+  if(w->ctx.store_path[0] && w->ctx.store_msync_ms &&
+     reactor_add_timer(&w->rx, &w->store_ev, w->ctx.store_msync_ms, on_store_sync, w) < 0){
+    worker_destroy(w);
+    return -1;
+  }
+  publish_tables(w);
+  return 0;
+}
+
+static void cache_reply(dh6_worker_t* w, const rcache_key_t* k, const struct sockaddr_in6* src,
+                        const dh6_pkt_t* out, uint64_t now_ms){
+  rcache_put(&w->rc, k, src, out->buf, out->len, &out->peer, out->ifindex, now_ms, w->ctx.reply_cache_ms);
+}
+
+void worker_commit(dh6_worker_t* w){
+  if(w->jr.fd < 0) return;
+  if(journal_commit(&w->jr) < 0){
+    // not durable: the client retransmits and gets a fresh answer
+    if(w->nheld) log_printf(LOG_ERR, "worker %d: dropping %zu replies (journal)", w->id, w->nheld);
+    w->nheld = 0;
+    return;
+  }
+
+  dh6_batch_t* b = &w->batch;
+  uint64_t now_ms = mono_ms();
+  for(size_t i=0;i<w->nheld;){
+    b->ntx = 0;
+    while(i < w->nheld && b->ntx < DH6_BATCH_MAX){
+      const dh6_held_t* h = &w->held[i++];
+      if(h->cache) cache_reply(w, &h->key, &h->src, &h->pkt, now_ms);
+      b->tx[b->ntx++] = h->pkt;
+    }
+    dh6_sock_send_batch(&w->sock, b);
+  }
+  w->nheld = 0;
+}
+
+void worker_on_readable(dh6_worker_t* w){
+  dh6_batch_t* b = &w->batch;
+  if(dh6_sock_recv_batch(&w->sock, b) <= 0) return;
+
+  uint64_t now_ms = w->ctx.reply_cache_ms ? mono_ms() : 0;
+  for(size_t i=0;i<b->nrx;i++){
+    dh6_pkt_t* in = &b->rx[i];
+    dh6_pkt_t* out = &b->tx[b->ntx];
+
+    rcache_key_t key;
+    int cache = now_ms && rcache_key(in->buf, in->len, w->ctx.duid_seed, &key) == 0;
+    if(cache){
+      const rcache_ent_t* e = rcache_get(&w->rc, &key, &in->peer, now_ms);
+      if(e){
+        memcpy(out->buf, e->reply, e->len);
+        out->len = e->len;
+        out->peer = e->peer;
+        out->ifindex = e->ifindex;
+        b->ntx++;
+        dh6_stats_add(&w->stats->cached, 1);
+        continue;
+      }
+    }
+
+    uint64_t seq = w->jr.seq;
+    int h = dh6_handle_packet(&w->ctx, in->buf, in->len,
+                              &in->peer, in->ifindex,
+                              out->buf, sizeof(out->buf), &out->len,
+                              &out->peer, &out->ifindex);
+    if(h != 1) continue;
+    // a reply that commits a lease is released only once it is durable
+    if(w->jr.seq != seq){
+      dh6_held_t* hd = &w->held[w->nheld++];
+      hd->pkt = *out;
+      hd->cache = cache;
+      if(cache){
+        hd->key = key;
+        hd->src = in->peer;
+      }
+    }else{
+      if(cache) cache_reply(w, &key, &in->peer, out, now_ms);
+      b->ntx++;
+    }
+  }
+  dh6_sock_send_batch(&w->sock, b);
+
+  if(w->nheld && (!w->ctx.journal_sync_ms || w->nheld > WORKER_HELD_MAX - DH6_BATCH_MAX))
+    worker_commit(w);
+}
+
+// ---- background snapshots ----
+
+static void snapshot_reap(dh6_worker_t* w, int flags){
+  int status;
+  pid_t r = waitpid(w->snap_pid, &status, flags);
+  if(r == 0 || (r < 0 && errno == EINTR)) return;
+  w->snap_pid = 0;
+  reactor_del_owned(&w->rx, &w->snap_ev);
+
+  if(r < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+    // .prev stays until a later snapshot covers it
+    log_printf(LOG_ERR, "worker %d: snapshot failed (status %d)", w->id, r < 0 ? -1 : status);
+    return;
+  }
+  char prev[sizeof(w->jr_path) + 16];
+  shard_file(prev, sizeof(prev), w, ".prev");
+  unlink(prev);
+  log_printf(LOG_INFO, "worker %d: snapshot %s.snap written", w->id, w->jr_path);
+}
+
+static void on_snap_exit(reactor_ev_t* ev, uint32_t events){
+  (void)events;
+  snapshot_reap((dh6_worker_t*)ev->arg, 0);
+}
+
+static void snapshot_start(dh6_worker_t* w, uint64_t now){
+  char prev[sizeof(w->jr_path) + 16], snap[sizeof(w->jr_path) + 16];
+  shard_file(prev, sizeof(prev), w, ".prev");
+  shard_file(snap, sizeof(snap), w, ".snap");
+
+  // everything up to here goes into the snapshot: make it durable first,
+  // and start a new journal file unless an earlier failed snapshot
+  // still needs the rotated one (then the live file just keeps growing)
+  worker_commit(w);
+  if(journal_pending(&w->jr)) return;
+  if(access(prev, F_OK) != 0) journal_rotate(&w->jr, w->jr_path, prev);
+
+  pid_t pid = fork();
+  if(pid < 0){
+    log_printf(LOG_ERR, "worker %d: snapshot fork failed: %s", w->id, strerror(errno));
+    return;
+  }
+  if(pid == 0){
+    _exit(snapshot_write(&w->store, snap, now) == 0 ? 0 : 1);
+  }
+
+  w->snap_pid = pid;
+  w->snap_last = now;
+  w->snap_seq = w->jr.seq;
+#ifdef SYS_pidfd_open
+  int pfd = (int)syscall(SYS_pidfd_open, pid, 0);
+  if(pfd >= 0 && reactor_add(&w->rx, &w->snap_ev, pfd, EPOLLIN, on_snap_exit, w) < 0){
+    close(pfd);
+    w->snap_ev.fd = -1;
+  }
+#endif
+}
+
+void worker_tick(dh6_worker_t* w, uint64_t now){
+  pthread_mutex_lock(&w->cfg_mu);
+  if(w->cfg_pending){
+    config_apply_runtime(&w->ctx, &w->cfg_next);
+    w->cfg_pending = 0;
+  }
+  pthread_mutex_unlock(&w->cfg_mu);
+
+  if(now == w->last_tick) return;
+  w->store.v.gc(&w->store, now);
+  w->last_tick = now;
+  publish_tables(w);
+
+  if(w->snap_pid > 0 && w->snap_ev.fd < 0) snapshot_reap(w, WNOHANG);
+  if(w->ctx.snapshot_interval && !w->ctx.store_path[0] && w->jr.fd >= 0 && w->snap_pid == 0 &&
+     w->jr.seq != w->snap_seq && now - w->snap_last >= w->ctx.snapshot_interval)
+    snapshot_start(w, now);
+}
+
+void worker_post_config(dh6_worker_t* w, const server_ctx_t* cfg){
+  pthread_mutex_lock(&w->cfg_mu);
+  w->cfg_next = *cfg;
+  w->cfg_pending = 1;
+  pthread_mutex_unlock(&w->cfg_mu);
+}
+
+int worker_run(dh6_worker_t* w){
+  // io_uring completion work runs on the submitting thread: set it up here
+  dh6_sock_use_uring(&w->sock);
+  if(reactor_add(&w->rx, &w->sock_ev, dh6_sock_poll_fd(&w->sock), EPOLLIN, on_sock, w) < 0)
+    return -1;
+  return reactor_run(&w->rx);
+}
+
+static void* worker_main(void* arg){
+  dh6_worker_t* w = (dh6_worker_t*)arg;
+  log_printf(LOG_INFO, "worker %d running (cpu %d)", w->id, w->cpu);
+  worker_run(w);
+  return NULL;
+}
+
+int worker_spawn(dh6_worker_t* w){
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  if(w->cpu >= 0){
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+  }
+  int rc = pthread_create(&w->thr, &attr, worker_main, w);
+  pthread_attr_destroy(&attr);
+  if(rc != 0){
+    log_printf(LOG_ERR, "worker %d: pthread_create failed: %s", w->id, strerror(rc));
+    return -1;
+  }
+  w->threaded = 1;
+  return 0;
+}
+
+void worker_stop(dh6_worker_t* w){
+  reactor_stop(&w->rx);
+  if(w->threaded){
+    pthread_join(w->thr, NULL);
+    w->threaded = 0;
+  }
+}
+
+void worker_destroy(dh6_worker_t* w){
+  worker_commit(w);
+  if(w->snap_pid > 0) snapshot_reap(w, 0);
+  if(w->ctx.store_path[0] && w->store.impl) store_sync(w);
+  if(w->rx.epfd >= 0){
+    reactor_del(&w->rx, &w->sock_ev);
+    reactor_del_owned(&w->rx, &w->tick_ev);
+    reactor_del_owned(&w->rx, &w->commit_ev);
+    reactor_del_owned(&w->rx, &w->store_ev);
+    reactor_free(&w->rx);
+  }
+  w->store.journal = NULL;
+  if(w->jr.fd >= 0) journal_close(&w->jr);
+  free(w->held);
+  w->held = NULL;
+  if(w->rc.hits || w->rc.misses)
+    log_printf(LOG_INFO, "worker %d: reply cache %llu hits, %llu misses", w->id,
+               (unsigned long long)w->rc.hits, (unsigned long long)w->rc.misses);
+  rcache_free(&w->rc);
+  dh6_pools_free(&w->ctx);
+  dh6_stats_free(w->stats);
+  w->stats = w->ctx.stats = NULL;
+  store_close(w);
+  dh6_sock_close(&w->sock);
+  pthread_mutex_destroy(&w->cfg_mu);
+  pthread_mutex_destroy(&w->tab_mu);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "net/sock.h"
+#include "net/reactor.h"
+#include "dhcp/handlers.h"
+#include "store/lease_store.h"
+#include "store/journal.h"
+#include "store/mem_store.h"
+#include "dhcp/rcache.h"
+
+// a reply waiting for the group commit, and where it goes in the reply cache
+typedef struct {
+  dh6_pkt_t pkt;
+  rcache_key_t key;
+  struct sockaddr_in6 src;
+  int cache;
+} dh6_held_t;
+
+/*
+ * One DHCPv6 shard: socket, lease store and pool slices owned by a single
+ * thread. Shards share nothing, so the packet path takes no locks; the
+ * reuseport steering program keeps each client on the shard holding its
+ * leases.
+ */
+typedef struct {
+  int id;
+  int cpu;            // pin target, -1 = not pinned
+  dh6_sock_t sock;
+  lease_store_t store;
+  server_ctx_t ctx;   // clone of the loaded config with this shard's pools
+  dh6_batch_t batch;  // recvmmsg/sendmmsg buffers
+  uint64_t last_tick;
+
+  reactor_t rx;       // socket + 1s maintenance timer
+  reactor_ev_t sock_ev, tick_ev;
+
+  // lease journal; replies whose records are not yet durable wait in held
+  // until the group commit (end of batch or journal_sync_ms window)
+  journal_t jr;
+  dh6_held_t* held;
+  size_t nheld;
+  reactor_ev_t commit_ev;
+  char jr_path[160];  // this shard's journal file
+
+  // background snapshots: a fork()ed child writes "<jr_path>.snap" from its
+  // copy-on-write view of the store; the journal up to the fork is rotated
+  // to "<jr_path>.prev" and dropped once the snapshot is durable
+  pid_t snap_pid;     // 0 = none running
+  uint64_t snap_last; // last snapshot start
+  uint64_t snap_seq;  // jr.seq at that point
+  reactor_ev_t snap_ev; // pidfd of the child (-1 = polled on the tick)
+
+  reactor_ev_t store_ev; // lease map msync timer (store_msync_ms)
+
+  // retransmissions are answered from here before the handler runs; a
+  // reply enters the cache only once it is released (durable)
+  rcache_t rc;
+
+  // packet counters and handling times (ctx.stats points here); read
+  // by the CLI from its own thread
+  dh6_stats_t* stats;
+
+  // lease table counters (mem_store_stat) as of the last tick, for the CLI
+  pthread_mutex_t tab_mu;
+  htab_stat_t tab[MEM_NTABLES];
+
+  // config reload handoff: posted by the main thread, applied on the tick
+  pthread_mutex_t cfg_mu;
+  server_ctx_t cfg_next;
+  int cfg_pending;
+
+  pthread_t thr;
+  int threaded;
+} dh6_worker_t;
+
+// shard id of nshards; nshards < 2 = whole pools on a plain socket
+int  worker_init(dh6_worker_t* w, const server_ctx_t* tmpl, int id, int nshards, uint16_t port);
+void worker_on_readable(dh6_worker_t* w); // one recvmmsg batch in, one sendmmsg out
+void worker_tick(dh6_worker_t* w, uint64_t now); // 1s maintenance (lease expiry)
+void worker_commit(dh6_worker_t* w); // sync the journal, release held replies
+
+// run the shard on its own thread, pinned to w->cpu; or inline on w->rx
+int  worker_spawn(dh6_worker_t* w);
+int  worker_run(dh6_worker_t* w);
+
+void worker_post_config(dh6_worker_t* w, const server_ctx_t* cfg); // any thread
+void worker_stop(dh6_worker_t* w);    // stop the reactor; joins a spawned thread
+void worker_destroy(dh6_worker_t* w);
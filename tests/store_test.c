@@ -0,0 +1,416 @@
+// Lease store behaviour, once per backend: mem_store (heap tables) and
+// map_store (tables in a file mapping). Both run the same scenario and
+// must give the same answers:
+//   NA put / move / acquire / touch / delete, declines, PD, growth past
+//   the initial table size, gc expiry - checking every result, the
+//   occupancy observer's taken/free calls and the state observer's
+//   per-state counts after each step.
+// map_store additionally closes and reopens its file midway, once cleanly
+// and once with a torn header (stale counts, odd gen) that forces repair:
+// the leases, declines and the replayed observer calls must come back
+// unchanged, and the expiry of inherited entries must still happen.
+//
+//   make test
+#define _GNU_SOURCE
+#include "store/mem_store.h"
+#include "store/map_store.h"
+#include "util/hash.h"
+#include "util/log.h"
+#include "util/time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+
+#define DUID_LEN 14
+#define LFT 10          // lease and decline lifetime, s
+#define NGROW 300       // leases put to push the tables past their initial size
+#define OCC_MAX (NGROW + 64)
+
+static int g_fail;
+static const char* g_backend;
+
+#define CHECK(c) do{ \
+    if(!(c)){ fprintf(stderr, "FAIL [%s] %s:%d: %s\n", g_backend, __FILE__, __LINE__, #c); g_fail++; } \
+  }while(0)
+
+// ---- observers ----
+
+typedef struct {
+  struct in6_addr a;
+  uint8_t plen;
+} occ_ent_t;
+
+typedef struct {
+  occ_ent_t v[OCC_MAX];
+  int n;
+  int bad;          // taken twice / freed while free
+  long use[4];      // leases and quarantine entries per lease_state_t
+} obs_t;
+
+static int occ_find(const obs_t* o, const struct in6_addr* a, uint8_t plen){
+  for(int i=0;i<o->n;i++){
+    if(o->v[i].plen == plen && in6_equal(&o->v[i].a, a)) return i;
+  }
+  return -1;
+}
+
+static void on_occ(void* arg, const struct in6_addr* a, uint8_t plen, int occupied){
+  obs_t* o = arg;
+  int i = occ_find(o, a, plen);
+  if(occupied){
+    if(i >= 0 || o->n == OCC_MAX){ o->bad++; return; }
+    o->v[o->n].a = *a;
+    o->v[o->n].plen = plen;
+    o->n++;
+  }else{
+    if(i < 0){ o->bad++; return; }
+    o->v[i] = o->v[--o->n];
+  }
+}
+
+static void on_use(void* arg, const struct in6_addr* a, uint8_t plen, int from, int to){
+  obs_t* o = arg;
+  (void)a; (void)plen;
+  if(from < 0 || from > 3 || to < 0 || to > 3){ o->bad++; return; }
+  if(from) o->use[from]--;
+  if(to) o->use[to]++;
+}
+
+static void subscribe(lease_store_t* st, obs_t* o){
+  memset(o, 0, sizeof(*o));
+  st->on_occ = on_occ;
+  st->on_use = on_use;
+  st->occ_arg = o;
+}
+
+static int taken(const obs_t* o, const struct in6_addr* a, uint8_t plen){
+  return occ_find(o, a, plen) >= 0;
+}
+
+// ---- fixtures ----
+
+static uint64_t g_now;
+
+static void addr_of(struct in6_addr* a, uint16_t host){
+  inet_pton(AF_INET6, "2001:db8:1::", a);
+  a->s6_addr[14] = (uint8_t)(host >> 8);
+  a->s6_addr[15] = (uint8_t)host;
+}
+
+static void prefix_of(struct in6_addr* p, uint16_t n){
+  inet_pton(AF_INET6, "2001:db8:1000::", p);
+  p->s6_addr[5] = (uint8_t)n;
+  p->s6_addr[6] = (uint8_t)(n >> 8);
+}
+
+// a client's identity as lease keys take it: the store's DUID handle
+typedef uint32_t client_t;
+
+static client_t client(lease_store_t* st, uint32_t c){
+  uint8_t d[DUID_LEN];
+  memset(d, 0, sizeof(d));
+  d[1] = 3; d[3] = 1;
+  d[10] = (uint8_t)(c >> 24); d[11] = (uint8_t)(c >> 16); d[12] = (uint8_t)(c >> 8); d[13] = (uint8_t)c;
+  return st->v.duid_get(st, d, sizeof(d), hash64_bytes(d, sizeof(d), st->duid_seed));
+}
+
+static lease_na_t na_lease(client_t duid, uint32_t iaid, uint16_t host, lease_state_t s){
+  lease_na_t l;
+  memset(&l, 0, sizeof(l));
+  l.key = lease_key_make(duid, iaid, IA_NA);
+  addr_of(&l.addr, host);
+  l.preferred_lft = l.valid_lft = LFT;
+  l.preferred_until = l.valid_until = g_now + LFT;
+  l.hold_until = g_now + LFT;
+  l.state = s;
+  return l;
+}
+
+static lease_pd_t pd_lease(client_t duid, uint32_t iaid, uint16_t n, lease_state_t s){
+  lease_pd_t l;
+  memset(&l, 0, sizeof(l));
+  l.key = lease_key_make(duid, iaid, IA_PD);
+  prefix_of(&l.prefix, n);
+  l.prefix_len = 56;
+  l.preferred_lft = l.valid_lft = LFT;
+  l.preferred_until = l.valid_until = g_now + LFT;
+  l.hold_until = g_now + LFT;
+  l.state = s;
+  return l;
+}
+
+// candidates from a list of hosts
+typedef struct {
+  const uint16_t* host;
+  unsigned n;
+} cand_t;
+
+static int cand_next(void* arg, unsigned i, struct in6_addr* out, uint8_t* plen){
+  const cand_t* c = arg;
+  if(i >= c->n) return -1;
+  addr_of(out, c->host[i]);
+  *plen = 128;
+  return 0;
+}
+
+static int na_is(lease_store_t* st, client_t duid, uint32_t iaid, uint16_t host, lease_state_t s){
+  lease_key_t k = lease_key_make(duid, iaid, IA_NA);
+  lease_na_t l;
+  struct in6_addr a;
+  addr_of(&a, host);
+  return st->v.get_na(st, &k, &l) == 0 && in6_equal(&l.addr, &a) && l.state == s;
+}
+
+// ---- backends ----
+
+typedef struct {
+  const char* name;
+  int  (*open)(lease_store_t* st, const char* path);
+  void (*close)(lease_store_t* st);
+  void (*replay)(lease_store_t* st);  // NULL = cannot be reopened
+  int  (*tear)(const char* path);
+} backend_t;
+
+static int mem_open(lease_store_t* st, const char* path){
+  (void)path;
+  return mem_store_init(st, 16, 0xA5A5A5A5ULL);
+}
+static int map_open(lease_store_t* st, const char* path){
+  return map_store_open(st, path, 64, 0xA5A5A5A5ULL);
+}
+
+// what a power loss can leave: a header page older than the table pages.
+// Mirrors the head of map_store.c's map_hdr_t.
+typedef struct {
+  uint64_t off_ctrl, off_slots;
+  uint64_t esize;
+  uint64_t count, tomb, max_probe;
+} tear_tab_t;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t ntables;
+  uint64_t cap, size, gen, commit;
+  char boot_id[40];
+  tear_tab_t t[MEM_NTABLES];
+} tear_hdr_t;
+
+static int map_tear(const char* path){
+  tear_hdr_t h;
+  int fd = open(path, O_RDWR);
+  if(fd < 0) return -1;
+  int rc = -1;
+  if(pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && memcmp(h.magic, "DH6MAP", 6) == 0 &&
+     h.version == 2 && h.ntables == MEM_NTABLES){
+    h.gen |= 1;
+    for(int i=0;i<MEM_NTABLES;i++) if(h.t[i].count) h.t[i].count = 1;
+    rc = pwrite(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) ? 0 : -1;
+  }
+  close(fd);
+  return rc;
+}
+
+static const backend_t backends[] = {
+  { "mem_store", mem_open, mem_store_free, NULL, NULL },
+  { "map_store", map_open, map_store_close, map_store_replay_occ, map_tear },
+};
+
+// ---- scenario ----
+
+static void run(const backend_t* b, const char* path){
+  g_backend = b->name;
+  lease_store_t st;
+  memset(&st, 0, sizeof(st));
+  if(b->open(&st, path) < 0){
+    CHECK(!"open");
+    return;
+  }
+  obs_t o;
+  subscribe(&st, &o);
+  struct in6_addr a1, a2, a3, a4, a5, p1, p2;
+  addr_of(&a1, 1); addr_of(&a2, 2); addr_of(&a3, 3); addr_of(&a4, 4); addr_of(&a5, 5);
+  prefix_of(&p1, 1); prefix_of(&p2, 2);
+
+  client_t A = client(&st, 1), B = client(&st, 2), C = client(&st, 3);
+  CHECK(A && B && C && A != B && B != C);
+
+  // put, then move to another address
+  lease_na_t l = na_lease(A, 1, 1, LS_ALLOCATED);
+  CHECK(st.v.put_na(&st, &l) == 0);
+  CHECK(na_is(&st, A, 1, 1, LS_ALLOCATED));
+  CHECK(st.v.addr_in_use(&st, &a1));
+  CHECK(taken(&o, &a1, 128) && o.n == 1);
+  l = na_lease(A, 1, 2, LS_ALLOCATED);
+  CHECK(st.v.put_na(&st, &l) == 0);
+  CHECK(na_is(&st, A, 1, 2, LS_ALLOCATED));
+  CHECK(!st.v.addr_in_use(&st, &a1) && st.v.addr_in_use(&st, &a2));
+  CHECK(!taken(&o, &a1, 128) && taken(&o, &a2, 128) && o.n == 1);
+  CHECK(o.use[LS_ALLOCATED] == 1);
+
+  // acquire skips an address bound to another client, then keeps the lease
+  static const uint16_t c23[] = { 2, 3 };
+  cand_t c = { c23, 2 };
+  lease_na_t t = na_lease(B, 7, 0, LS_OFFERED), out;
+  CHECK(st.v.acquire_na(&st, &t, cand_next, &c, g_now, &out) == 0);
+  CHECK(in6_equal(&out.addr, &a3) && out.state == LS_OFFERED);
+  CHECK(st.v.acquire_na(&st, &t, cand_next, &c, g_now, &out) == 1);
+  CHECK(in6_equal(&out.addr, &a3));
+  CHECK(taken(&o, &a3, 128) && o.n == 2);
+  CHECK(o.use[LS_OFFERED] == 1 && o.use[LS_ALLOCATED] == 1);
+
+  // touch: offer -> binding, in place
+  lease_key_t kb = lease_key_make(B, 7, IA_NA);
+  lease_times_t tt = { LS_ALLOCATED, g_now + LFT, g_now + LFT, 0, 0 };
+  CHECK(st.v.touch_na(&st, &kb, &tt, g_now, &out) == 0);
+  CHECK(out.state == LS_ALLOCATED && in6_equal(&out.addr, &a3));
+  CHECK(na_is(&st, B, 7, 3, LS_ALLOCATED));
+  CHECK(o.use[LS_OFFERED] == 0 && o.use[LS_ALLOCATED] == 2);
+  lease_key_t kx = lease_key_make(C, 99, IA_NA);
+  CHECK(st.v.touch_na(&st, &kx, &tt, g_now, NULL) < 0);
+
+  // a live lease from another subnet is a miss: touch fails, acquire
+  // moves it onto a candidate and frees the old address
+  struct in6_addr a6, a7;
+  addr_of(&a6, 6); addr_of(&a7, 7);
+  l = na_lease(C, 50, 6, LS_ALLOCATED);
+  l.subnet_id = 1;
+  CHECK(st.v.put_na(&st, &l) == 0);
+  lease_key_t kc50 = lease_key_make(C, 50, IA_NA);
+  CHECK(st.v.touch_na(&st, &kc50, &tt, g_now, NULL) < 0);
+  CHECK(na_is(&st, C, 50, 6, LS_ALLOCATED));
+  static const uint16_t c67[] = { 6, 7 };
+  cand_t cm = { c67, 2 };
+  t = na_lease(C, 50, 0, LS_ALLOCATED);
+  CHECK(st.v.acquire_na(&st, &t, cand_next, &cm, g_now, &out) == 0);
+  CHECK(in6_equal(&out.addr, &a6) && out.subnet_id == 0);
+  CHECK(st.v.touch_na(&st, &kc50, &tt, g_now, NULL) == 0);
+  l = na_lease(C, 50, 7, LS_ALLOCATED);
+  l.subnet_id = 1;
+  CHECK(st.v.put_na(&st, &l) == 0);
+  CHECK(st.v.acquire_na(&st, &t, cand_next, &cm, g_now, &out) == 0);
+  CHECK(in6_equal(&out.addr, &a6) && !st.v.addr_in_use(&st, &a7));
+  CHECK(!taken(&o, &a7, 128) && taken(&o, &a6, 128) && o.n == 3);
+  CHECK(st.v.del_na(&st, &kc50) == 0);
+  CHECK(o.n == 2 && o.use[LS_ALLOCATED] == 2);
+
+  // a declined address is skipped by acquire until the quarantine ends
+  CHECK(st.v.decline_addr(&st, &a4, g_now + LFT) == 0);
+  CHECK(st.v.is_addr_declined(&st, &a4, g_now));
+  CHECK(!st.v.is_addr_declined(&st, &a4, g_now + LFT));
+  CHECK(taken(&o, &a4, 128) && o.n == 3 && o.use[LS_DECLINED] == 1);
+  static const uint16_t c45[] = { 4, 5 };
+  cand_t c2 = { c45, 2 };
+  t = na_lease(C, 1, 0, LS_ALLOCATED);
+  CHECK(st.v.acquire_na(&st, &t, cand_next, &c2, g_now, &out) == 0);
+  CHECK(in6_equal(&out.addr, &a5));
+  static const uint16_t c4[] = { 4 };
+  cand_t c3 = { c4, 1 };
+  t = na_lease(C, 2, 0, LS_ALLOCATED);
+  CHECK(st.v.acquire_na(&st, &t, cand_next, &c3, g_now, &out) < 0);
+  lease_key_t kc2 = lease_key_make(C, 2, IA_NA);
+  CHECK(st.v.get_na(&st, &kc2, &out) < 0);  // a failed acquire leaves nothing behind
+
+  // delete
+  lease_key_t ka = lease_key_make(A, 1, IA_NA);
+  CHECK(st.v.del_na(&st, &ka) == 0);
+  CHECK(st.v.get_na(&st, &ka, &out) < 0);
+  CHECK(!st.v.addr_in_use(&st, &a2) && !taken(&o, &a2, 128));
+  CHECK(st.v.del_na(&st, &ka) == 0);  // already gone: no-op
+  CHECK(o.n == 3 && o.use[LS_ALLOCATED] == 2);
+
+  // PD: put, move, decline
+  lease_pd_t pl = pd_lease(A, 1, 1, LS_ALLOCATED), pout;
+  CHECK(st.v.put_pd(&st, &pl) == 0);
+  lease_key_t kp = lease_key_make(A, 1, IA_PD);
+  CHECK(st.v.get_pd(&st, &kp, &pout) == 0 && in6_equal(&pout.prefix, &p1) && pout.prefix_len == 56);
+  CHECK(st.v.prefix_in_use(&st, &p1, 56) && !st.v.prefix_in_use(&st, &p1, 60));
+  CHECK(taken(&o, &p1, 56));
+  CHECK(st.v.decline_prefix(&st, &p2, 56, g_now + LFT) == 0);
+  CHECK(st.v.is_prefix_declined(&st, &p2, 56, g_now));
+  CHECK(taken(&o, &p2, 56) && o.n == 5);
+  CHECK(o.use[LS_ALLOCATED] == 3 && o.use[LS_DECLINED] == 2);
+
+  // grow past the initial table size
+  for(uint16_t i=0;i<NGROW;i++){
+    l = na_lease(C, 100 + i, 1000 + i, LS_ALLOCATED);
+    if(st.v.put_na(&st, &l) < 0){ CHECK(!"grow: put_na"); break; }
+  }
+  int all = 1;
+  for(uint16_t i=0;i<NGROW;i++) all &= na_is(&st, C, 100 + i, 1000 + i, LS_ALLOCATED);
+  CHECK(all);
+  CHECK(o.n == 5 + NGROW && o.use[LS_ALLOCATED] == 3 + NGROW);
+  CHECK(o.bad == 0);
+
+  // reopen, then reopen over a torn header: same leases, declines and
+  // observer calls both times
+  for(int torn=0;b->replay && torn<2;torn++){
+    obs_t before = o;
+    st.v.duid_put(&st, A); st.v.duid_put(&st, B); st.v.duid_put(&st, C);
+    b->close(&st);
+    memset(&st, 0, sizeof(st));
+    if(torn && b->tear(path) < 0){
+      CHECK(!"tear");
+      return;
+    }
+    if(b->open(&st, path) < 0){
+      CHECK(!"reopen");
+      return;
+    }
+    subscribe(&st, &o);
+    b->replay(&st);
+    CHECK(o.n == before.n && o.bad == 0);
+    int same = 1;
+    for(int i=0;i<before.n;i++) same &= taken(&o, &before.v[i].a, before.v[i].plen);
+    CHECK(same);
+    CHECK(memcmp(o.use, before.use, sizeof(o.use)) == 0);
+    A = client(&st, 1); B = client(&st, 2); C = client(&st, 3);
+    CHECK(na_is(&st, B, 7, 3, LS_ALLOCATED) && na_is(&st, C, 1, 5, LS_ALLOCATED));
+    kp = lease_key_make(A, 1, IA_PD);
+    CHECK(st.v.get_pd(&st, &kp, &pout) == 0 && in6_equal(&pout.prefix, &p1));
+    CHECK(st.v.is_addr_declined(&st, &a4, g_now) && st.v.is_prefix_declined(&st, &p2, 56, g_now));
+    all = 1;
+    for(uint16_t i=0;i<NGROW;i++) all &= na_is(&st, C, 100 + i, 1000 + i, LS_ALLOCATED);
+    CHECK(all);
+  }
+
+  // nothing is due yet; then everything is
+  st.v.gc(&st, g_now + 1);
+  CHECK(na_is(&st, B, 7, 3, LS_ALLOCATED) && o.n == 5 + NGROW);
+  st.v.gc(&st, g_now + LFT + 1);
+  CHECK(st.v.get_na(&st, &kb, &out) < 0);
+  CHECK(st.v.get_pd(&st, &kp, &pout) < 0);
+  CHECK(!st.v.addr_in_use(&st, &a3) && !st.v.is_addr_declined(&st, &a4, g_now));
+  CHECK(!st.v.prefix_in_use(&st, &p1, 56) && !st.v.is_prefix_declined(&st, &p2, 56, g_now));
+  CHECK(o.n == 0 && o.bad == 0);
+  CHECK(o.use[LS_OFFERED] == 0 && o.use[LS_ALLOCATED] == 0 && o.use[LS_DECLINED] == 0);
+
+  st.v.duid_put(&st, A); st.v.duid_put(&st, B); st.v.duid_put(&st, C);
+  b->close(&st);
+}
+
+int main(void){
+  log_set_level(LOG_ERR);  // the torn reopen warns by design
+  g_now = now_epoch_sec();
+
+  char dir[] = "/tmp/store_test.XXXXXX";
+  if(!mkdtemp(dir)){
+    perror("mkdtemp");
+    return 1;
+  }
+  char path[sizeof(dir) + 16];
+  snprintf(path, sizeof(path), "%s/leases.map", dir);
+
+  for(size_t i=0;i<sizeof(backends)/sizeof(backends[0]);i++){
+    int before = g_fail;
+    run(&backends[i], path);
+    printf("%-10s %s\n", backends[i].name, g_fail == before ? "ok" : "FAILED");
+  }
+  unlink(path);
+  rmdir(dir);
+  return g_fail ? 1 : 0;
+}